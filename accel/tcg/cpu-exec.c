@@ -28,6 +28,7 @@
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #include "sysemu/cpus.h"
@@ -41,6 +42,7 @@
 #include "tb-context.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "translate-pool.h"
 
 /* -icount align implementation. */
 
@@ -245,6 +247,106 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+static void tb_jmp_cache_window_reset(CPUJumpCache *jc, int64_t ns)
+{
+    jc->window_begin_ns = ns;
+    jc->window_evictions = jc->evictions;
+}
+
+/**
+ * tb_jmp_cache_resize() - resize the jump cache of @cpu if necessary
+ * @cpu: The vCPU, which is running
+ * @jc: Its jump cache
+ *
+ * Returns the jump cache to use from now on.
+ *
+ * The jump cache is direct mapped, and indirect branch heavy guest code,
+ * such as interpreters, can have more live targets than it has entries.
+ * Every such miss takes a tb_htable_lookup(), so, like the TLB (see
+ * tlb_mmu_resize_locked), the cache is sized from past observations.
+ * Hits are not counted, to keep the hit path free of stores, so the
+ * rules go by the rate of evictions, i.e. misses that replaced a live
+ * entry, per 100 ms window:
+ *
+ * 1. If live entries were evicted faster than a quarter of the cache
+ * per window, the working set does not fit and the cache is doubled,
+ * up to TB_JMP_CACHE_MAX_BITS.
+ *
+ * 2. If instead evictions were rare and less than 30% of the entries
+ * are in use, the cache is halved, down to TB_JMP_CACHE_BITS.
+ *
+ * This is only called on misses, so a cache which stopped missing keeps
+ * its size.  The live entries are moved to the new cache, which replaces
+ * the old one under RCU, as other threads may be invalidating entries.
+ */
+static CPUJumpCache *tb_jmp_cache_resize(CPUState *cpu, CPUJumpCache *jc)
+{
+    int64_t now = get_clock_realtime();
+    int64_t window_len_ns = 100 * SCALE_MS;
+    uint64_t evictions = jc->evictions - jc->window_evictions;
+    uint64_t elapsed_ns;
+    unsigned int bits = jc->bits;
+    CPUJumpCache *new_jc;
+    size_t i, used = 0;
+
+    if (!jc->window_begin_ns) {
+        /* Start the first window, rather than count since realize */
+        tb_jmp_cache_window_reset(jc, now);
+        return jc;
+    }
+    if (now < jc->window_begin_ns + window_len_ns) {
+        return jc;
+    }
+    elapsed_ns = now - jc->window_begin_ns;
+
+    /* This only runs on misses, so the window may be longer than 100 ms */
+    if (evictions * window_len_ns * 4 > tb_jmp_cache_size(jc) * elapsed_ns) {
+        bits = MIN(bits + 1, TB_JMP_CACHE_MAX_BITS);
+    } else if (evictions * window_len_ns * 64 <
+               tb_jmp_cache_size(jc) * elapsed_ns &&
+               bits > TB_JMP_CACHE_BITS) {
+        for (i = 0; i < tb_jmp_cache_size(jc); i++) {
+            used += qatomic_read(&jc->array[i].tb) != NULL;
+        }
+        if (used * 100 < tb_jmp_cache_size(jc) * 30) {
+            bits--;
+        }
+    }
+
+    if (bits == jc->bits) {
+        tb_jmp_cache_window_reset(jc, now);
+        return jc;
+    }
+
+    new_jc = tb_jmp_cache_new(bits);
+    new_jc->misses = jc->misses;
+    new_jc->evictions = jc->evictions;
+    new_jc->resizes = jc->resizes + 1;
+    tb_jmp_cache_window_reset(new_jc, now);
+    new_jc->ic_gen = qatomic_read(&jc->ic_gen);
+    memcpy(new_jc->ic, jc->ic, sizeof(jc->ic));
+
+    /*
+     * Entries invalidated meanwhile may be copied, as they would have
+     * been kept: tb_lookup() rejects them through CF_INVALID.
+     */
+    for (i = 0; i < tb_jmp_cache_size(jc); i++) {
+        TranslationBlock *tb = qatomic_read(&jc->array[i].tb);
+
+        if (tb) {
+            uint32_t h = tb_jmp_cache_hash_func(new_jc, jc->array[i].pc);
+
+            new_jc->array[h].pc = jc->array[i].pc;
+            new_jc->array[h].tb = tb;
+        }
+    }
+
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+    trace_tb_jmp_cache_resize(cpu->cpu_index, tb_jmp_cache_size(new_jc));
+    return new_jc;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                                           uint64_t cs_base, uint32_t flags,
@@ -253,12 +355,13 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
     TranslationBlock *tb;
     CPUJumpCache *jc;
     uint32_t hash;
+    bool evict;
 
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc, pc);
 
     tb = qatomic_read(&jc->array[hash].tb);
     if (likely(tb &&
@@ -269,11 +372,22 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
         goto hit;
     }
 
+    /* The same pc with other flags would collide at any cache size */
+    evict = tb && jc->array[hash].pc != pc;
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
     }
 
+    qatomic_set(&jc->misses, jc->misses + 1);
+    if (evict) {
+        qatomic_set(&jc->evictions, jc->evictions + 1);
+    }
+    if ((jc->misses & 63) == 0) {
+        jc = tb_jmp_cache_resize(cpu, jc);
+        hash = tb_jmp_cache_hash_func(jc, pc);
+    }
+
     jc->array[hash].pc = pc;
     qatomic_set(&jc->array[hash].tb, tb);
 
@@ -390,15 +504,8 @@ static inline bool check_for_breakpoints(CPUState *cpu, vaddr pc,
         check_for_breakpoints_slow(cpu, pc, cflags);
 }
 
-/**
- * helper_lookup_tb_ptr: quick check for next tb
- * @env: current cpu state
- *
- * Look for an existing TB matching the current cpu state.
- * If found, return the code pointer.  If not found, return
- * the tcg epilogue so that we return into cpu_tb_exec.
- */
-const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+static inline const void *lookup_tb_ptr(CPUArchState *env,
+                                        const TranslationBlock *site)
 {
     CPUState *cpu = env_cpu(env);
     TranslationBlock *tb;
@@ -428,11 +535,45 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
         log_cpu_exec(pc, cpu, tb);
+    } else if (site) {
+        CPUJumpCache *jc = cpu->tb_jmp_cache;
+        TBInlineCache *ic = &jc->ic[tb_ic_hash(site)];
+
+        ic->site = site;
+        ic->pc = pc;
+        ic->tb = tb;
+        ic->gen = jc->ic_gen;
     }
 
     return tb->tc.ptr;
 }
 
+/**
+ * helper_lookup_tb_ptr: quick check for next tb
+ * @env: current cpu state
+ *
+ * Look for an existing TB matching the current cpu state.
+ * If found, return the code pointer.  If not found, return
+ * the tcg epilogue so that we return into cpu_tb_exec.
+ */
+const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
+{
+    return lookup_tb_ptr(env, NULL);
+}
+
+/**
+ * helper_lookup_tb_ptr_ic: helper_lookup_tb_ptr for an inline cache miss
+ * @env: current cpu state
+ * @site: TB ending with the indirect branch
+ *
+ * As helper_lookup_tb_ptr, and also remember the TB found in the inline
+ * cache entry of @site (see translator_indirect_jump).
+ */
+const void *HELPER(lookup_tb_ptr_ic)(CPUArchState *env, const void *site)
+{
+    return lookup_tb_ptr(env, site);
+}
+
 /* Execute a TB, and fix up the CPU state afterwards if necessary */
 /*
  * Disable CFI checks.
@@ -946,6 +1087,64 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
 #endif
 }
 
+/*
+ * Hot trace tier.  With "-accel tcg,trace-threshold=N", a TB is not
+ * chained until it has exited N times through its goto_tb slots, so that
+ * each of these exits comes back here and is counted.  When the profile
+ * of a TB is complete and it mostly branches back to an earlier TB on its
+ * page, it closes a loop headed there; if the head has a dominant exit
+ * too, the head is translated again as a trace which follows the dominant
+ * exits of the blocks of the loop (see translator_trace_follow), so that
+ * the optimizer sees across their boundaries.
+ *
+ * Returns false if @last_tb, which exited through slot @n to @tb, must
+ * not be chained to it yet.  Sets *@trace if @tb is to be replaced with
+ * a trace.
+ */
+static bool tb_trace_profile(CPUState *cpu, TranslationBlock *last_tb,
+                             int n, TranslationBlock *tb, bool *trace)
+{
+    uint32_t count = qatomic_read(&last_tb->trace_count);
+    uint32_t cflags = tb_cflags(tb);
+    tb_page_addr_t head = tb_page_addr0(tb);
+    tb_page_addr_t tail = tb_page_addr0(last_tb);
+
+    if (count >= tb_trace_threshold) {
+        return true;
+    }
+
+    qatomic_set(&last_tb->trace_succ[n], tb);
+    qatomic_set(&last_tb->trace_exits[n], last_tb->trace_exits[n] + 1);
+    qatomic_set(&last_tb->trace_count, ++count);
+    if (count < tb_trace_threshold) {
+        return false;
+    }
+
+    /*
+     * Look for a loop with more than one block, and a head to replace.
+     * With icount, a trace would be charged in full on entry and leaving
+     * it through a side exit would count instructions which never ran.
+     */
+    if (tb == last_tb || tb_trace_dominant(last_tb) != n ||
+        head == -1 || head > tail || ((head ^ tail) & TARGET_PAGE_MASK) ||
+        (cflags & (CF_COUNT_MASK | CF_SINGLE_STEP | CF_NO_GOTO_TB |
+                   CF_USE_ICOUNT)) ||
+        tb_trace_dominant(tb) < 0) {
+        return true;
+    }
+#ifdef CONFIG_PLUGIN
+    if (cpu->plugin_state &&
+        test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return true;
+    }
+#endif
+
+    /* Only one vCPU may replace the head */
+    *trace = qatomic_xchg(&tb->trace_count, TB_TRACE_HEAD) != TB_TRACE_HEAD;
+    return true;
+}
+
 /* main execution loop */
 
 static int __attribute__((noinline))
@@ -997,12 +1196,33 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
+                h = tb_jmp_cache_hash_func(jc, pc);
                 jc->array[h].pc = pc;
                 qatomic_set(&jc->array[h].tb, tb);
             }
 
+            if (last_tb && unlikely(tb_trace_threshold)) {
+                bool trace = false;
+
+                if (!tb_trace_profile(cpu, last_tb, tb_exit, tb, &trace)) {
+                    last_tb = NULL;
+                } else if (trace &&
+                           !translate_pool_trace(cpu, tb, pc, cs_base,
+                                                 flags, cflags)) {
+                    /* Without a translation thread to do it meanwhile */
+                    CPUJumpCache *jc = cpu->tb_jmp_cache;
+                    uint32_t h = tb_jmp_cache_hash_func(jc, pc);
+
+                    mmap_lock();
+                    tb = tb_gen_trace(cpu, tb, pc, cs_base, flags, cflags);
+                    mmap_unlock();
+
+                    jc->array[h].pc = pc;
+                    qatomic_set(&jc->array[h].tb, tb);
+                }
+            }
+
 #ifndef CONFIG_USER_ONLY
             /*
              * We don't take care of direct jumps when address mapping
@@ -1082,7 +1302,7 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_BITS);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
@@ -1099,6 +1319,7 @@ void tcg_exec_unrealizefn(CPUState *cpu)
     tcg_iommu_free_notifier_list(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
+    translate_pool_cancel(cpu);
     tlb_destroy(cpu);
     g_free_rcu(cpu->tb_jmp_cache, rcu);
 }
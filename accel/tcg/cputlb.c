@@ -163,10 +163,11 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    i0 = tb_jmp_cache_hash_page(jc, page_addr);
+    for (i = 0; i < tb_jmp_page_size(jc); i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
+    tb_jmp_cache_ic_flush(jc);
 }
 
 /**
@@ -747,7 +748,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
      * If the length is larger than the jump cache size, then it will take
      * longer to clear each entry individually than it will to clear it all.
      */
-    if (d.len >= (TARGET_PAGE_SIZE * TB_JMP_CACHE_SIZE)) {
+    if (d.len >= (TARGET_PAGE_SIZE * tb_jmp_cache_size(cpu->tb_jmp_cache))) {
         tcg_flush_jmp_cache(cpu);
         return;
     }
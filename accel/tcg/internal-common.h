@@ -16,6 +16,33 @@ extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
+extern uint32_t tb_trace_threshold;
+
+/* TranslationBlock.trace_count of hot traces and of the TBs they replace */
+#define TB_TRACE_HEAD  UINT32_MAX
+
+/*
+ * Return the goto_tb slot through which @tb took at least 90% of the
+ * exits it was profiled for, or -1 if there is no such slot or the
+ * profile is not complete.
+ */
+static inline int tb_trace_dominant(const TranslationBlock *tb)
+{
+    uint32_t exits0 = qatomic_read(&tb->trace_exits[0]);
+    uint32_t exits1 = qatomic_read(&tb->trace_exits[1]);
+    uint64_t total = (uint64_t)exits0 + exits1;
+
+    if (!tb_trace_threshold || total < tb_trace_threshold) {
+        return -1;
+    }
+    if (exits0 * 10ull >= total * 9) {
+        return 0;
+    }
+    if (exits1 * 10ull >= total * 9) {
+        return 1;
+    }
+    return -1;
+}
 
 /*
  * Return true if CS is not running in parallel with other cpus, either
@@ -46,10 +73,19 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
                               uint64_t cs_base, uint32_t flags,
                               int cflags);
+TranslationBlock *tb_gen_trace(CPUState *cpu, TranslationBlock *head,
+                               vaddr pc, uint64_t cs_base, uint32_t flags,
+                               int cflags);
+TranslationBlock *tb_gen_code_async(CPUState *cpu,
+                                    TranslationBlock *trace_head,
+                                    vaddr pc, uint64_t cs_base,
+                                    uint32_t flags, int cflags,
+                                    tb_page_addr_t phys_pc);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
+void tb_retire(TranslationBlock *tb, vaddr pc);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
 
@@ -59,6 +59,7 @@ static inline void tb_unlock_pages(TranslationBlock *tb) { }
 void tb_lock_page0(tb_page_addr_t);
 void tb_lock_page1(tb_page_addr_t, tb_page_addr_t);
 void tb_unlock_page1(tb_page_addr_t, tb_page_addr_t);
+void tb_lock_pages(TranslationBlock *);
 void tb_unlock_pages(TranslationBlock *);
 #endif
 
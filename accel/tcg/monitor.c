@@ -19,6 +19,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -141,6 +142,28 @@ static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
     *pelide = elide;
 }
 
+static void dump_jmp_cache_info(GString *buf)
+{
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (!jc) {
+            continue;
+        }
+        g_string_append_printf(buf, "TB jump cache %-5d %zu entries "
+                               "(%zu resizes), %zu misses "
+                               "(%zu evictions)\n",
+                               cpu->cpu_index, tb_jmp_cache_size(jc),
+                               qatomic_read(&jc->resizes),
+                               qatomic_read(&jc->misses),
+                               qatomic_read(&jc->evictions));
+    }
+}
+
 static void tcg_dump_info(GString *buf)
 {
     g_string_append_printf(buf, "[TCG profiler not compiled]\n");
@@ -196,6 +219,7 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    dump_jmp_cache_info(buf);
     tcg_dump_info(buf);
 }
 
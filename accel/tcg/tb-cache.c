@@ -0,0 +1,815 @@
+/*
+ * Persistent translation block cache
+ *
+ * Short-lived guests, such as CI boots, spend a good part of their run
+ * translating the same firmware and kernel code as the previous run did.
+ * With "-accel tcg,tb-cache=FILE", the translation blocks in the code
+ * buffer at exit are written to FILE, and the next run adopts them
+ * instead of translating them again.
+ *
+ * Generated code refers to QEMU's helpers, to the prologue and to its own
+ * TranslationBlock by address, so it is not relocated.  The code buffer
+ * is requested at the address it had, each region gets back the code it
+ * held, and the cache is only used if the QEMU binary was loaded at the
+ * same address too.  That is never the case with address space
+ * randomization, so the cache is refused unless it is disabled for QEMU,
+ * e.g. by running it under "setarch -R".
+ *
+ * The file is also tied to the machine, CPU and accelerator configuration,
+ * as CPU properties such as the ISA features change the code generated
+ * for the same flags.  A block is adopted when the guest runs its PC with
+ * the same cs_base, flags and cflags it was translated for, and the guest
+ * code it was translated from is byte for byte the same.  A checksum of
+ * the file guards against running code from a damaged one.  Adopted
+ * blocks are linked into the page tables like freshly translated ones, so
+ * guest writes invalidate them through tb_invalidate_phys_range() as
+ * usual.  The cache is dropped on tb_flush(), as its code is then
+ * overwritten.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <zlib.h>
+#ifdef CONFIG_LINUX
+#include <sys/personality.h>
+#endif
+#include "qapi/error.h"
+#include "qemu/cacheflush.h"
+#include "qemu/cacheinfo.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/accel.h"
+#include "qemu/notify.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "hw/boards.h"
+#include "hw/core/cpu.h"
+#include "hw/core/tcg-cpu-ops.h"
+#include "semihosting/semihost.h"
+#include "sysemu/runstate.h"
+#include "sysemu/sysemu.h"
+#include "tcg/tcg.h"
+#include "host/cpuinfo.h"
+#ifdef CONFIG_PLUGIN
+#include "qemu/plugin.h"
+#endif
+#include "tb-hash.h"
+#include "tb-cache.h"
+#include "internal-common.h"
+#include "internal-target.h"
+#include "translate-pool.h"
+#include "trace.h"
+
+#define TB_CACHE_MAGIC  "QEMUTBC1"
+
+/*
+ * File layout: the header, then the sections it points to.  Everything
+ * is in host byte order, as the code is only valid for this host anyway.
+ * Region code is page aligned so that the file can be mapped.
+ */
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t header_size;
+    uint32_t nb_regions;
+    uint64_t nb_tbs;
+
+    /* The QEMU binary and where it was loaded */
+    uint64_t exe_dev;
+    uint64_t exe_ino;
+    uint64_t exe_size;
+    uint64_t exe_mtime;
+    uint64_t text_addr;
+
+    /* Host features the code was generated for */
+    uint64_t host_cpuinfo;
+    uint64_t host_page_size;
+    uint64_t icache_linesize;
+
+    /* The prologue, at the start of the code buffer */
+    uint64_t prologue_addr;
+    uint64_t prologue_size;
+    uint64_t prologue_offset;
+
+    /* Machine, accelerator and CPU configuration, see tb_cache_get_config */
+    uint64_t config_offset;
+    uint64_t config_size;
+
+    uint64_t regions_offset;
+    uint64_t tbs_offset;
+    uint64_t guest_offset;
+    uint64_t guest_size;
+
+    /* CRC-32 of the sections, in the order above, then of the regions */
+    uint64_t checksum;
+} TBCacheHeader;
+
+typedef struct TBCacheRegion {
+    uint64_t start;
+    uint64_t end;
+    /* Bytes of code at the start of the region */
+    uint64_t used;
+    uint64_t offset;
+} TBCacheRegion;
+
+typedef struct TBCacheEntry {
+    /* Address of the TranslationBlock, in its region */
+    uint64_t tb_addr;
+    /* Lookup key, as for tb_hash_func() */
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t page_addr[2];
+    uint32_t flags;
+    uint32_t cflags;
+    /* Guest code the block was translated from, in the guest section */
+    uint64_t guest_offset;
+    uint64_t size;
+} TBCacheEntry;
+
+static struct {
+    char *path;
+    GMappedFile *file;
+    const TBCacheHeader *header;
+    const TBCacheEntry *tbs;
+    const uint8_t *guest;
+    /* TBCacheEntry by lookup key; read-only once the cache is enabled */
+    GHashTable *index;
+    /* Set for the entries that have been adopted, by index in tbs[] */
+    bool *adopted;
+    bool enabled;
+    Notifier machine_done;
+    Notifier exit;
+} tb_cache;
+
+static void tb_cache_save(Notifier *notifier, void *data);
+
+static const void *tb_cache_section(uint64_t offset)
+{
+    return g_mapped_file_get_contents(tb_cache.file) + offset;
+}
+
+static bool tb_cache_section_valid(uint64_t offset, uint64_t size)
+{
+    uint64_t len = g_mapped_file_get_length(tb_cache.file);
+
+    return offset <= len && size <= len - offset;
+}
+
+static uint32_t tb_cache_crc(uint32_t crc, const void *buf, uint64_t size)
+{
+    const Bytef *p = buf;
+
+    while (size) {
+        uInt n = MIN(size, UINT_MAX);
+
+        crc = crc32(crc, p, n);
+        p += n;
+        size -= n;
+    }
+    return crc;
+}
+
+static void tb_cache_drop(void)
+{
+    qatomic_set(&tb_cache.enabled, false);
+    g_clear_pointer(&tb_cache.index, g_hash_table_destroy);
+    g_clear_pointer(&tb_cache.adopted, g_free);
+    g_clear_pointer(&tb_cache.file, g_mapped_file_unref);
+    tb_cache.header = NULL;
+    tb_cache.tbs = NULL;
+    tb_cache.guest = NULL;
+}
+
+/* Fill in what identifies this QEMU binary and host in @h */
+static bool tb_cache_get_host(TBCacheHeader *h, Error **errp)
+{
+#if defined(CONFIG_LINUX) && !defined(CONFIG_TCG_INTERPRETER)
+    struct stat st;
+
+    if (stat("/proc/self/exe", &st) < 0) {
+        error_setg_errno(errp, errno, "cannot identify the QEMU binary");
+        return false;
+    }
+
+    memcpy(h->magic, TB_CACHE_MAGIC, sizeof(h->magic));
+    h->header_size = sizeof(*h);
+    h->exe_dev = st.st_dev;
+    h->exe_ino = st.st_ino;
+    h->exe_size = st.st_size;
+    h->exe_mtime = st.st_mtime;
+    h->text_addr = (uintptr_t)tb_gen_code;
+#ifdef CPUINFO_ALWAYS
+    h->host_cpuinfo = cpuinfo;
+#endif
+    h->host_page_size = qemu_real_host_page_size();
+    h->icache_linesize = qemu_icache_linesize;
+    return true;
+#else
+    error_setg(errp, "not supported on this host");
+    return false;
+#endif
+}
+
+/*
+ * Whether the addresses QEMU is loaded at change from one run to the next.
+ * The cache is of no use then, see the top of this file.
+ */
+static bool tb_cache_aslr_enabled(void)
+{
+#ifdef CONFIG_LINUX
+    g_autofree char *contents = NULL;
+
+    if (personality(0xffffffff) & ADDR_NO_RANDOMIZE) {
+        return false;
+    }
+    return !g_file_get_contents("/proc/sys/kernel/randomize_va_space",
+                                &contents, NULL, NULL) ||
+           atoi(contents) != 0;
+#else
+    return true;
+#endif
+}
+
+static gint tb_cache_compare_names(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/* Append the value of each property of @obj but @skip to @config */
+static void tb_cache_add_props(GString *config, Object *obj, const char *skip)
+{
+    g_autoptr(GPtrArray) names = g_ptr_array_new();
+    ObjectPropertyIterator iter;
+    ObjectProperty *prop;
+    guint i;
+
+    object_property_iter_init(&iter, obj);
+    while ((prop = object_property_iter_next(&iter))) {
+        if (prop->get && !strstart(prop->type, "child<", NULL) &&
+            !strstart(prop->type, "link<", NULL) &&
+            g_strcmp0(prop->name, skip)) {
+            g_ptr_array_add(names, (gpointer)prop->name);
+        }
+    }
+    /* Property tables are hashed, so sort them for a stable order */
+    g_ptr_array_sort(names, tb_cache_compare_names);
+
+    for (i = 0; i < names->len; i++) {
+        const char *name = g_ptr_array_index(names, i);
+        g_autofree char *value = object_property_print(obj, name, false,
+                                                       NULL);
+
+        if (value) {
+            g_string_append_printf(config, ",%s=%s", name, value);
+        }
+    }
+}
+
+/*
+ * Describe what the generated code depends on besides the flags of each
+ * block: the machine, the accelerator options, semihosting, and each CPU
+ * with its properties and whatever else its target translates with.
+ */
+static char *tb_cache_get_config(void)
+{
+    GString *config = g_string_new(object_get_typename(OBJECT(
+                                                           current_machine)));
+    CPUState *cpu;
+
+    tb_cache_add_props(config, OBJECT(current_accel()), "tb-cache");
+    g_string_append_printf(config, ",semihosting=%d%d",
+                           semihosting_enabled(false),
+                           semihosting_enabled(true));
+
+    CPU_FOREACH(cpu) {
+        const TCGCPUOps *ops = cpu->cc->tcg_ops;
+
+        g_string_append_printf(config, ";%s",
+                               object_get_typename(OBJECT(cpu)));
+        tb_cache_add_props(config, OBJECT(cpu), NULL);
+        if (ops->tb_cache_config) {
+            ops->tb_cache_config(cpu, config);
+        }
+    }
+    return g_string_free(config, false);
+}
+
+static bool tb_cache_plugins_active(CPUState *cpu)
+{
+#ifdef CONFIG_PLUGIN
+    return cpu->plugin_state &&
+           test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                    cpu->plugin_state->event_mask);
+#else
+    return false;
+#endif
+}
+
+static bool tb_cache_check_header(const TBCacheHeader *host)
+{
+    const TBCacheHeader *h = tb_cache_section(0);
+    const TBCacheRegion *regions;
+    uint32_t i;
+
+    if (!tb_cache_section_valid(0, sizeof(*h)) ||
+        memcmp(h->magic, TB_CACHE_MAGIC, sizeof(h->magic)) ||
+        h->header_size != sizeof(*h) ||
+        h->exe_dev != host->exe_dev || h->exe_ino != host->exe_ino ||
+        h->exe_size != host->exe_size || h->exe_mtime != host->exe_mtime ||
+        h->host_cpuinfo != host->host_cpuinfo ||
+        h->host_page_size != host->host_page_size ||
+        h->icache_linesize != host->icache_linesize) {
+        warn_report("tb-cache: %s was written by another QEMU binary or "
+                    "on another host, ignoring it", tb_cache.path);
+        return false;
+    }
+    if (h->text_addr != host->text_addr) {
+        warn_report("tb-cache: QEMU is not loaded at the address it had "
+                    "when %s was written, ignoring it", tb_cache.path);
+        return false;
+    }
+    if (h->nb_tbs > SIZE_MAX / sizeof(TBCacheEntry) ||
+        !tb_cache_section_valid(h->prologue_offset, h->prologue_size) ||
+        !tb_cache_section_valid(h->config_offset, h->config_size) ||
+        !tb_cache_section_valid(h->regions_offset,
+                                h->nb_regions * sizeof(TBCacheRegion)) ||
+        !tb_cache_section_valid(h->tbs_offset,
+                                h->nb_tbs * sizeof(TBCacheEntry)) ||
+        !tb_cache_section_valid(h->guest_offset, h->guest_size)) {
+        warn_report("tb-cache: %s is truncated, ignoring it", tb_cache.path);
+        return false;
+    }
+    regions = tb_cache_section(h->regions_offset);
+    for (i = 0; i < h->nb_regions; i++) {
+        if (!tb_cache_section_valid(regions[i].offset, regions[i].used)) {
+            warn_report("tb-cache: %s is truncated, ignoring it",
+                        tb_cache.path);
+            return false;
+        }
+    }
+
+    tb_cache.header = h;
+    return true;
+}
+
+bool tb_cache_open(const char *path, Error **errp)
+{
+    g_autoptr(GError) gerr = NULL;
+    TBCacheHeader host = {};
+
+    if (!tb_cache_get_host(&host, errp)) {
+        return false;
+    }
+    if (tb_cache_aslr_enabled()) {
+        error_setg(errp, "tb-cache needs address space randomization "
+                   "to be disabled");
+        error_append_hint(errp, "The cached code is only valid at the "
+                          "addresses it was generated at.  Run QEMU with "
+                          "randomization disabled, e.g. under "
+                          "\"setarch -R\".\n");
+        return false;
+    }
+
+    tb_cache.path = g_strdup(path);
+    tb_cache.exit.notify = tb_cache_save;
+    qemu_add_exit_notifier(&tb_cache.exit);
+
+    tb_cache.file = g_mapped_file_new(path, false, &gerr);
+    if (!tb_cache.file) {
+        if (!g_error_matches(gerr, G_FILE_ERROR, G_FILE_ERROR_NOENT)) {
+            warn_report("tb-cache: %s", gerr->message);
+        }
+        return true;
+    }
+    if (!tb_cache_check_header(&host)) {
+        tb_cache_drop();
+        return true;
+    }
+
+    /* The code can only run in a code buffer at the same address */
+    tcg_region_set_address_hint((void *)(uintptr_t)
+                                tb_cache.header->prologue_addr);
+    return true;
+}
+
+static guint tb_cache_hash(gconstpointer p)
+{
+    const TBCacheEntry *e = p;
+
+    return tb_hash_func(e->page_addr[0], e->pc, e->flags, e->cs_base,
+                        e->cflags);
+}
+
+static gboolean tb_cache_equal(gconstpointer a, gconstpointer b)
+{
+    const TBCacheEntry *ea = a, *eb = b;
+
+    return ea->page_addr[0] == eb->page_addr[0] && ea->pc == eb->pc &&
+           ea->cs_base == eb->cs_base && ea->flags == eb->flags &&
+           ea->cflags == eb->cflags;
+}
+
+/* Check that @e describes a block in the restored code and guest code */
+static bool tb_cache_entry_valid(const TBCacheEntry *e,
+                                 const TBCacheRegion *regions)
+{
+    const TBCacheHeader *h = tb_cache.header;
+    const TranslationBlock *tb = (void *)(uintptr_t)e->tb_addr;
+    size_t len0;
+    uint32_t i;
+
+    if (e->page_addr[0] == -1 || e->size == 0 ||
+        e->guest_offset > h->guest_size ||
+        e->size > h->guest_size - e->guest_offset) {
+        return false;
+    }
+    len0 = TARGET_PAGE_SIZE - (e->page_addr[0] & ~TARGET_PAGE_MASK);
+    if ((e->size > len0) != (e->page_addr[1] != -1)) {
+        return false;
+    }
+
+    for (i = 0; i < h->nb_regions; i++) {
+        uint64_t start = regions[i].start;
+        uint64_t end = start + regions[i].used;
+
+        if (e->tb_addr >= start && e->tb_addr + sizeof(*tb) <= end) {
+            return (uintptr_t)tb->tc.ptr >= start &&
+                   (uintptr_t)tb->tc.ptr + tb->tc.size <= end &&
+                   tb->pc == (e->cflags & CF_PCREL ? tb->pc : e->pc) &&
+                   tb->cs_base == e->cs_base && tb->flags == e->flags &&
+                   tb->cflags == e->cflags && tb->size == e->size &&
+                   tb_page_addr0(tb) == e->page_addr[0] &&
+                   tb_page_addr1(tb) == e->page_addr[1];
+        }
+    }
+    return false;
+}
+
+static void tb_cache_machine_done(Notifier *notifier, void *data)
+{
+    const TBCacheHeader *h = tb_cache.header;
+    g_autofree char *config = NULL;
+
+    if (!h) {
+        return;
+    }
+
+    /* Generated code also depends on the CPU models */
+    config = tb_cache_get_config();
+    if (strlen(config) != h->config_size ||
+        memcmp(config, tb_cache_section(h->config_offset), h->config_size)) {
+        warn_report("tb-cache: %s was written for another machine "
+                    "configuration, ignoring it", tb_cache.path);
+        tb_cache_drop();
+        return;
+    }
+
+    qatomic_set(&tb_cache.enabled, true);
+}
+
+void tb_cache_restore(void)
+{
+    const TBCacheHeader *h = tb_cache.header;
+    const TBCacheRegion *regions;
+    void *start, *end;
+    uint32_t crc;
+    uint64_t i;
+
+    if (!h) {
+        return;
+    }
+
+    regions = tb_cache_section(h->regions_offset);
+    tcg_region_get_bounds(0, &start, &end);
+    if (tcg_splitwx_diff ||
+        (uintptr_t)tcg_qemu_tb_exec != h->prologue_addr ||
+        start - (void *)tcg_qemu_tb_exec != h->prologue_size ||
+        memcmp(start - h->prologue_size,
+               tb_cache_section(h->prologue_offset), h->prologue_size) ||
+        tcg_region_count() != h->nb_regions) {
+        warn_report("tb-cache: the code buffer does not have the layout "
+                    "it had when %s was written, ignoring it", tb_cache.path);
+        tb_cache_drop();
+        return;
+    }
+    for (i = 0; i < h->nb_regions; i++) {
+        tcg_region_get_bounds(i, &start, &end);
+        if ((uintptr_t)start != regions[i].start ||
+            (uintptr_t)end != regions[i].end ||
+            regions[i].used > end - start) {
+            warn_report("tb-cache: the code buffer does not have the layout "
+                        "it had when %s was written, ignoring it",
+                        tb_cache.path);
+            tb_cache_drop();
+            return;
+        }
+    }
+
+    crc = tb_cache_crc(0, tb_cache_section(h->prologue_offset),
+                       h->prologue_size);
+    crc = tb_cache_crc(crc, tb_cache_section(h->config_offset),
+                       h->config_size);
+    crc = tb_cache_crc(crc, regions, h->nb_regions * sizeof(TBCacheRegion));
+    crc = tb_cache_crc(crc, tb_cache_section(h->tbs_offset),
+                       h->nb_tbs * sizeof(TBCacheEntry));
+    crc = tb_cache_crc(crc, tb_cache_section(h->guest_offset),
+                       h->guest_size);
+    for (i = 0; i < h->nb_regions; i++) {
+        crc = tb_cache_crc(crc, tb_cache_section(regions[i].offset),
+                           regions[i].used);
+    }
+    if (crc != h->checksum) {
+        warn_report("tb-cache: %s is corrupted, ignoring it", tb_cache.path);
+        tb_cache_drop();
+        return;
+    }
+
+    qemu_thread_jit_write();
+    for (i = 0; i < h->nb_regions; i++) {
+        if (!regions[i].used) {
+            continue;
+        }
+        start = (void *)(uintptr_t)regions[i].start;
+        memcpy(start, tb_cache_section(regions[i].offset), regions[i].used);
+        flush_idcache_range((uintptr_t)start, (uintptr_t)start,
+                            regions[i].used);
+        tcg_region_prefill(i, regions[i].used);
+    }
+    qemu_thread_jit_execute();
+
+    tb_cache.tbs = tb_cache_section(h->tbs_offset);
+    tb_cache.guest = tb_cache_section(h->guest_offset);
+    tb_cache.adopted = g_new0(bool, h->nb_tbs);
+    tb_cache.index = g_hash_table_new(tb_cache_hash, tb_cache_equal);
+    for (i = 0; i < h->nb_tbs; i++) {
+        if (tb_cache_entry_valid(&tb_cache.tbs[i], regions)) {
+            g_hash_table_add(tb_cache.index, (gpointer)&tb_cache.tbs[i]);
+        }
+    }
+    trace_tb_cache_restore(h->nb_tbs, g_hash_table_size(tb_cache.index));
+
+    /* Wait for the CPUs to be created to check that they are the same */
+    tb_cache.machine_done.notify = tb_cache_machine_done;
+    qemu_add_machine_init_done_notifier(&tb_cache.machine_done);
+}
+
+static bool tb_cache_code_matches(const TBCacheEntry *e, const void *host_pc,
+                                  const void *host_p2)
+{
+    const uint8_t *code = tb_cache.guest + e->guest_offset;
+    size_t len0 = MIN(e->size, TARGET_PAGE_SIZE -
+                               (e->page_addr[0] & ~TARGET_PAGE_MASK));
+
+    if (memcmp(host_pc, code, len0)) {
+        return false;
+    }
+    return e->size == len0 || !memcmp(host_p2, code + len0, e->size - len0);
+}
+
+TranslationBlock *tb_cache_lookup(CPUState *cpu, vaddr pc, uint64_t cs_base,
+                                  uint32_t flags, uint32_t cflags,
+                                  tb_page_addr_t phys_pc, void *host_pc)
+{
+    TBCacheEntry key = {
+        .pc = cflags & CF_PCREL ? 0 : pc,
+        .cs_base = cs_base,
+        .page_addr[0] = phys_pc,
+        .flags = flags,
+        .cflags = cflags,
+    };
+    const TBCacheEntry *e;
+    TranslationBlock *tb, *existing_tb;
+    void *host_p2 = NULL;
+    size_t i;
+
+    if (!qatomic_read(&tb_cache.enabled) || phys_pc == -1 || !host_pc ||
+        tb_cache_plugins_active(cpu)) {
+        return NULL;
+    }
+
+    e = g_hash_table_lookup(tb_cache.index, &key);
+    if (!e) {
+        return NULL;
+    }
+
+    /* As in tb_lookup_cmp(), the second page must map where it did */
+    if (e->page_addr[1] != -1) {
+        vaddr pc2 = (pc & TARGET_PAGE_MASK) + TARGET_PAGE_SIZE;
+
+        if (get_page_addr_code_hostp(cpu_env(cpu), pc2, &host_p2) !=
+            e->page_addr[1]) {
+            return NULL;
+        }
+    }
+
+    /* Only one vCPU may adopt the block */
+    i = e - tb_cache.tbs;
+    if (qatomic_xchg(&tb_cache.adopted[i], true)) {
+        return NULL;
+    }
+
+    /* Forget the jumps the block had in the run that wrote the cache */
+    tb = (TranslationBlock *)(uintptr_t)e->tb_addr;
+    qemu_spin_init(&tb->jmp_lock);
+    tb->jmp_list_head = (uintptr_t)NULL;
+    tb->jmp_list_next[0] = (uintptr_t)NULL;
+    tb->jmp_list_next[1] = (uintptr_t)NULL;
+    tb->jmp_dest[0] = (uintptr_t)NULL;
+    tb->jmp_dest[1] = (uintptr_t)NULL;
+
+    /* Profile it afresh for the hot trace tier, unless it is a trace */
+    if (tb->trace_count != TB_TRACE_HEAD) {
+        tb->trace_count = 0;
+        tb->trace_exits[0] = 0;
+        tb->trace_exits[1] = 0;
+    }
+
+    /* Compare the guest code with the pages locked, as translation does */
+    tb_lock_pages(tb);
+    if (!tb_cache_code_matches(e, host_pc, host_p2)) {
+        tb_unlock_pages(tb);
+        qatomic_set(&tb_cache.adopted[i], false);
+        return NULL;
+    }
+
+    if (tb->jmp_reset_offset[0] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->jmp_reset_offset[1] != TB_JMP_OFFSET_INVALID) {
+        tb_reset_jump(tb, 1);
+    }
+
+    tcg_tb_insert(tb);
+    existing_tb = tb_link_page(tb);
+    assert_no_pages_locked();
+    if (unlikely(existing_tb != tb)) {
+        tcg_tb_remove(tb);
+        return existing_tb;
+    }
+
+    trace_tb_cache_adopt(tb, pc);
+    return tb;
+}
+
+void tb_cache_reset(void)
+{
+    if (tb_cache.header) {
+        tb_cache_drop();
+    }
+}
+
+typedef struct TBCacheWriter {
+    GArray *tbs;
+    GByteArray *guest;
+} TBCacheWriter;
+
+static gboolean tb_cache_save_tb(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    TBCacheWriter *w = data;
+    uint32_t cflags = tb_cflags(tb);
+    TBCacheEntry e = {
+        .tb_addr = (uintptr_t)tb,
+        .pc = cflags & CF_PCREL ? 0 : tb->pc,
+        .cs_base = tb->cs_base,
+        .page_addr[0] = tb_page_addr0(tb),
+        .page_addr[1] = tb_page_addr1(tb),
+        .flags = tb->flags,
+        .cflags = cflags,
+        .guest_offset = w->guest->len,
+        .size = tb->size,
+    };
+    size_t len0;
+
+    if (e.page_addr[0] == -1 || (cflags & CF_INVALID)) {
+        return false;
+    }
+
+    len0 = MIN(e.size, TARGET_PAGE_SIZE - (e.page_addr[0] & ~TARGET_PAGE_MASK));
+    if ((e.size > len0) != (e.page_addr[1] != -1)) {
+        return false;
+    }
+    g_byte_array_append(w->guest, qemu_map_ram_ptr(NULL, e.page_addr[0]),
+                        len0);
+    if (e.size > len0) {
+        g_byte_array_append(w->guest, qemu_map_ram_ptr(NULL, e.page_addr[1]),
+                            e.size - len0);
+    }
+    g_array_append_val(w->tbs, e);
+    return false;
+}
+
+static bool tb_cache_write(FILE *f, uint64_t offset, const void *buf,
+                           size_t size)
+{
+    return fseeko(f, offset, SEEK_SET) == 0 && fwrite(buf, 1, size, f) == size;
+}
+
+static void tb_cache_save(Notifier *notifier, void *data)
+{
+    g_autofree char *tmp = g_strdup_printf("%s.tmp", tb_cache.path);
+    g_autofree char *config = NULL;
+    g_autofree TBCacheRegion *regions = NULL;
+    g_autoptr(GArray) tbs = NULL;
+    g_autoptr(GByteArray) guest = NULL;
+    TBCacheWriter w;
+    TBCacheHeader h = {};
+    uint64_t offset, code_size = 0;
+    CPUState *cpu;
+    void *start, *end;
+    bool ok;
+    FILE *f;
+    size_t i;
+
+    /* Only write back once the vCPUs have stopped */
+    if (runstate_is_running() || !tb_cache_get_host(&h, NULL)) {
+        return;
+    }
+    /* Nor must the translation threads add blocks while they are saved */
+    translate_pool_shutdown();
+    CPU_FOREACH(cpu) {
+        if (tb_cache_plugins_active(cpu)) {
+            return;
+        }
+    }
+
+    tbs = g_array_new(false, false, sizeof(TBCacheEntry));
+    guest = g_byte_array_new();
+    w = (TBCacheWriter) { .tbs = tbs, .guest = guest };
+    tcg_tb_foreach(tb_cache_save_tb, &w);
+
+    config = tb_cache_get_config();
+    tcg_region_get_bounds(0, &start, &end);
+    h.nb_regions = tcg_region_count();
+    h.nb_tbs = tbs->len;
+    h.prologue_addr = (uintptr_t)tcg_qemu_tb_exec;
+    h.prologue_size = start - (void *)tcg_qemu_tb_exec;
+    h.config_size = strlen(config);
+
+    offset = ROUND_UP(sizeof(h), 8);
+    h.prologue_offset = offset;
+    offset = ROUND_UP(offset + h.prologue_size, 8);
+    h.config_offset = offset;
+    offset = ROUND_UP(offset + h.config_size, 8);
+    h.regions_offset = offset;
+    offset += h.nb_regions * sizeof(TBCacheRegion);
+    h.tbs_offset = offset;
+    offset += h.nb_tbs * sizeof(TBCacheEntry);
+    h.guest_offset = offset;
+    h.guest_size = guest->len;
+    offset += h.guest_size;
+
+    regions = g_new0(TBCacheRegion, h.nb_regions);
+    for (i = 0; i < h.nb_regions; i++) {
+        tcg_region_get_bounds(i, &start, &end);
+        regions[i].start = (uintptr_t)start;
+        regions[i].end = (uintptr_t)end;
+        regions[i].used = tcg_region_used(i);
+        offset = ROUND_UP(offset, h.host_page_size);
+        regions[i].offset = offset;
+        offset += regions[i].used;
+        code_size += regions[i].used;
+    }
+
+    h.checksum = tb_cache_crc(0, tcg_qemu_tb_exec, h.prologue_size);
+    h.checksum = tb_cache_crc(h.checksum, config, h.config_size);
+    h.checksum = tb_cache_crc(h.checksum, regions,
+                              h.nb_regions * sizeof(TBCacheRegion));
+    h.checksum = tb_cache_crc(h.checksum, tbs->data,
+                              h.nb_tbs * sizeof(TBCacheEntry));
+    h.checksum = tb_cache_crc(h.checksum, guest->data, h.guest_size);
+    for (i = 0; i < h.nb_regions; i++) {
+        h.checksum = tb_cache_crc(h.checksum,
+                                  (void *)(uintptr_t)regions[i].start,
+                                  regions[i].used);
+    }
+
+    f = fopen(tmp, "wb");
+    if (!f) {
+        warn_report("tb-cache: cannot write %s: %s", tmp, strerror(errno));
+        return;
+    }
+    ok = tb_cache_write(f, 0, &h, sizeof(h)) &&
+         tb_cache_write(f, h.prologue_offset, tcg_qemu_tb_exec,
+                        h.prologue_size) &&
+         tb_cache_write(f, h.config_offset, config, h.config_size) &&
+         tb_cache_write(f, h.regions_offset, regions,
+                        h.nb_regions * sizeof(TBCacheRegion)) &&
+         tb_cache_write(f, h.tbs_offset, tbs->data,
+                        h.nb_tbs * sizeof(TBCacheEntry)) &&
+         tb_cache_write(f, h.guest_offset, guest->data, h.guest_size);
+    for (i = 0; ok && i < h.nb_regions; i++) {
+        ok = tb_cache_write(f, regions[i].offset,
+                            (void *)(uintptr_t)regions[i].start,
+                            regions[i].used);
+    }
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || rename(tmp, tb_cache.path) < 0) {
+        warn_report("tb-cache: cannot write %s: %s", tb_cache.path,
+                    strerror(errno));
+        unlink(tmp);
+        return;
+    }
+    trace_tb_cache_save(h.nb_tbs, code_size);
+}
@@ -0,0 +1,65 @@
+/*
+ * Persistent translation block cache
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_CACHE_H
+#define ACCEL_TCG_TB_CACHE_H
+
+#include "exec/exec-all.h"
+
+#ifdef CONFIG_USER_ONLY
+static inline TranslationBlock *tb_cache_lookup(CPUState *cpu, vaddr pc,
+                                                uint64_t cs_base,
+                                                uint32_t flags,
+                                                uint32_t cflags,
+                                                tb_page_addr_t phys_pc,
+                                                void *host_pc)
+{
+    return NULL;
+}
+
+static inline void tb_cache_reset(void) { }
+#else
+/**
+ * tb_cache_open: Use @path as the persistent TB cache
+ *
+ * Reads the cache, if @path exists and was written by this QEMU binary
+ * on this host, and arranges for the translation blocks left at exit to
+ * be written back to it.  Must be called before tcg_init().
+ *
+ * Returns false and sets @errp if the cache cannot be used at all on this
+ * host or with address space randomization.
+ */
+bool tb_cache_open(const char *path, Error **errp);
+
+/**
+ * tb_cache_restore: Put the cached code back into the code buffer
+ *
+ * Must be called after tcg_prologue_init() and before any vCPU thread
+ * has registered with TCG.
+ */
+void tb_cache_restore(void);
+
+/**
+ * tb_cache_lookup: Adopt a cached translation block
+ *
+ * Returns the cached block for @pc, @cs_base, @flags and @cflags, linked
+ * in as if it had just been translated, or NULL if there is none or the
+ * guest code it was translated from has changed.  @phys_pc and @host_pc
+ * locate the guest code as for tb_gen_code().
+ */
+TranslationBlock *tb_cache_lookup(CPUState *cpu, vaddr pc, uint64_t cs_base,
+                                  uint32_t flags, uint32_t cflags,
+                                  tb_page_addr_t phys_pc, void *host_pc);
+
+/**
+ * tb_cache_reset: Drop the cache as the code buffer is flushed
+ *
+ * Call from a safe-work context.
+ */
+void tb_cache_reset(void);
+#endif
+
+#endif /* ACCEL_TCG_TB_CACHE_H */
@@ -27,35 +27,55 @@
 
 #ifdef CONFIG_SOFTMMU
 
-/* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
-   addresses on the same page.  The top bits are the same.  This allows
-   TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
-#define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
-#define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
-
-static inline unsigned int tb_jmp_cache_hash_page(vaddr pc)
+/*
+ * Only the bottom half of the jump cache hash bits vary for addresses on
+ * the same page.  The top bits are the same.  This allows TLB invalidation
+ * to quickly clear a subset of the hash table.
+ */
+static inline unsigned int tb_jmp_page_bits(const CPUJumpCache *jc)
+{
+    return jc->bits / 2;
+}
+
+static inline unsigned int tb_jmp_page_size(const CPUJumpCache *jc)
+{
+    return 1u << tb_jmp_page_bits(jc);
+}
+
+/* Keep the in-page hash bits below the page offset bits they mix in */
+#define TB_JMP_CACHE_MAX_BITS  MIN(16, 2 * (TARGET_PAGE_BITS_MIN - 1))
+
+static inline unsigned int tb_jmp_cache_hash_page(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
+    unsigned int shift = TARGET_PAGE_BITS - tb_jmp_page_bits(jc);
+    unsigned int page_mask = tb_jmp_cache_size(jc) - tb_jmp_page_size(jc);
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+
+    tmp = pc ^ (pc >> shift);
+    return (tmp >> shift) & page_mask;
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
+    unsigned int shift = TARGET_PAGE_BITS - tb_jmp_page_bits(jc);
+    unsigned int page_mask = tb_jmp_cache_size(jc) - tb_jmp_page_size(jc);
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+
+    tmp = pc ^ (pc >> shift);
+    return ((tmp >> shift) & page_mask) | (tmp & (tb_jmp_page_size(jc) - 1));
 }
 
 #else
 
+#define TB_JMP_CACHE_MAX_BITS  16
+
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(const CPUJumpCache *jc,
+                                                  vaddr pc)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> jc->bits)) & (tb_jmp_cache_size(jc) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
@@ -12,22 +12,93 @@
 #include "qemu/rcu.h"
 #include "exec/cpu-common.h"
 
+/*
+ * Initial and smallest size of the cache.  It grows with the miss rate
+ * of each vCPU, up to TB_JMP_CACHE_MAX_BITS (see tb_jmp_cache_resize).
+ */
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+/*
+ * Inline cache of indirect branches, see translator_indirect_jump.
+ * Each site, i.e. TB ending with an indirect branch, has an entry in each
+ * CPU, picked by tb_ic_hash(), which generated code checks against the
+ * new pc before going to @tb.  The entries are only valid for the current
+ * @ic_gen of the jump cache, which is bumped wherever the jump cache is
+ * cleared because the mapping of guest code may have changed.  TBs
+ * invalidated since they were cached are caught through CF_INVALID.
+ */
+#define TB_IC_BITS 8
+#define TB_IC_SIZE (1 << TB_IC_BITS)
+
+typedef struct TBInlineCache {
+    const TranslationBlock *site;
+    vaddr pc;
+    TranslationBlock *tb;
+    uint32_t gen;
+} TBInlineCache;
+
+static inline unsigned int tb_ic_hash(const TranslationBlock *site)
+{
+    uintptr_t p = (uintptr_t)site >> 6;
+
+    return (p ^ (p >> TB_IC_BITS)) & (TB_IC_SIZE - 1);
+}
+
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
  * A valid entry is read/written by a single CPU, therefore there is
  * no need for qatomic_rcu_read() and pc is always consistent with a
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
+ *
+ * The owning CPU replaces the whole cache when resizing it, so other
+ * threads must use qatomic_rcu_read() to get at it, under RCU.
  */
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
+    unsigned int bits;
+
+    /*
+     * Statistics, written by the owning CPU only and on misses only, so
+     * that hits do not store to this cache line.
+     */
+    size_t misses;          /* that tb_htable_lookup() found */
+    size_t evictions;       /* misses that replaced a live entry */
+    size_t resizes;
+
+    /* Counters at the start of the current resizing window */
+    int64_t window_begin_ns;
+    size_t window_evictions;
+
+    /* Read and written by the owning CPU only, apart from @ic_gen */
+    uint32_t ic_gen;
+    TBInlineCache ic[TB_IC_SIZE];
+
     struct {
         TranslationBlock *tb;
         vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    } array[];
 } CPUJumpCache;
 
+static inline size_t tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->bits;
+}
+
+static inline CPUJumpCache *tb_jmp_cache_new(unsigned int bits)
+{
+    CPUJumpCache *jc = g_malloc0(sizeof(*jc) +
+                                 (sizeof(jc->array[0]) << bits));
+
+    jc->bits = bits;
+    return jc;
+}
+
+/* Forget the inline cache entries of @jc */
+static inline void tb_jmp_cache_ic_flush(CPUJumpCache *jc)
+{
+    qatomic_inc(&jc->ic_gen);
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -30,8 +30,11 @@
 #include "tcg/tcg.h"
 #include "tb-hash.h"
 #include "tb-context.h"
+#include "tb-cache.h"
+#include "translate-pool.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "trace.h"
 
 
 /* List iterators for lists of tagged pointers in TranslationBlock. */
@@ -447,7 +450,7 @@ void tb_unlock_page1(tb_page_addr_t paddr0, tb_page_addr_t paddr1)
     }
 }
 
-static void tb_lock_pages(TranslationBlock *tb)
+void tb_lock_pages(TranslationBlock *tb)
 {
     tb_page_addr_t paddr0 = tb_page_addr0(tb);
     tb_page_addr_t paddr1 = tb_page_addr1(tb);
@@ -767,6 +770,9 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     }
     did_flush = true;
 
+    /* The translation threads use the code buffer as well */
+    translate_pool_pause();
+
     CPU_FOREACH(cpu) {
         tcg_flush_jmp_cache(cpu);
     }
@@ -774,9 +780,11 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     qht_reset_size(&tb_ctx.htable, CODE_GEN_HTABLE_SIZE);
     tb_remove_all();
 
+    tb_cache_reset();
     tcg_region_reset_all();
     /* XXX: flush processor icache at this point if cache flush is expensive */
     qatomic_inc(&tb_ctx.tb_flush_count);
+    translate_pool_resume();
 
 done:
     mmap_unlock();
@@ -875,6 +883,23 @@ static inline void tb_jmp_unlink(TranslationBlock *dest)
     qemu_spin_unlock(&dest->jmp_lock);
 }
 
+/* Forget @tb in the jump caches of the vCPUs which found it at @pc */
+static void tb_jmp_cache_inval_pc(TranslationBlock *tb, vaddr pc)
+{
+    CPUState *cpu;
+
+    RCU_READ_LOCK_GUARD();
+
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+        uint32_t h = tb_jmp_cache_hash_func(jc, pc);
+
+        if (qatomic_read(&jc->array[h].tb) == tb) {
+            qatomic_set(&jc->array[h].tb, NULL);
+        }
+    }
+}
+
 static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
 {
     CPUState *cpu;
@@ -885,15 +910,7 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb->pc);
-
-        CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
-
-            if (qatomic_read(&jc->array[h].tb) == tb) {
-                qatomic_set(&jc->array[h].tb, NULL);
-            }
-        }
+        tb_jmp_cache_inval_pc(tb, tb->pc);
     }
 }
 
@@ -901,8 +918,12 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
  * locks held.
+ *
+ * Returns false if @tb was not in the hash table any more.  Leaves the
+ * jump caches alone unless @inval_jmp_cache.
  */
-static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
+static bool do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list,
+                                  bool inval_jmp_cache)
 {
     uint32_t h;
     tb_page_addr_t phys_pc;
@@ -920,7 +941,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     h = tb_hash_func(phys_pc, (orig_cflags & CF_PCREL ? 0 : tb->pc),
                      tb->flags, tb->cs_base, orig_cflags);
     if (!qht_remove(&tb_ctx.htable, tb, h)) {
-        return;
+        return false;
     }
 
     /* remove the TB from the page list */
@@ -929,7 +950,9 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     }
 
     /* remove the TB from the hash list */
-    tb_jmp_cache_inval_tb(tb);
+    if (inval_jmp_cache) {
+        tb_jmp_cache_inval_tb(tb);
+    }
 
     /* suppress this TB from the two jump lists */
     tb_remove_from_jmp_list(tb, 0);
@@ -940,12 +963,13 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     qatomic_set(&tb_ctx.tb_phys_invalidate_count,
                 tb_ctx.tb_phys_invalidate_count + 1);
+    return true;
 }
 
 static void tb_phys_invalidate__locked(TranslationBlock *tb)
 {
     qemu_thread_jit_write();
-    do_tb_phys_invalidate(tb, true);
+    do_tb_phys_invalidate(tb, true, true);
     qemu_thread_jit_execute();
 }
 
@@ -957,10 +981,32 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     if (page_addr == -1 && tb_page_addr0(tb) != -1) {
         tb_lock_pages(tb);
-        do_tb_phys_invalidate(tb, true);
+        do_tb_phys_invalidate(tb, true, true);
         tb_unlock_pages(tb);
     } else {
-        do_tb_phys_invalidate(tb, false);
+        do_tb_phys_invalidate(tb, false, true);
+    }
+}
+
+/*
+ * Invalidate @tb, the head of a loop about to be replaced with a trace
+ * for @pc, without the flush of every jump cache tb_phys_invalidate()
+ * does for a CF_PCREL @tb.  A jump cache entry for @tb elsewhere can
+ * only miss from now on, as @tb has CF_INVALID set, and the lookup then
+ * finds the trace in the hash table.
+ * Called with mmap_lock held in user-mode.
+ */
+void tb_retire(TranslationBlock *tb, vaddr pc)
+{
+    bool removed;
+
+    tb_lock_pages(tb);
+    removed = do_tb_phys_invalidate(tb, true, false);
+    tb_unlock_pages(tb);
+
+    if (removed) {
+        tb_jmp_cache_inval_pc(tb, pc);
+        trace_tb_retire(tb, pc);
     }
 }
 
@@ -37,6 +37,8 @@
 #include "qemu/units.h"
 #if !defined(CONFIG_USER_ONLY)
 #include "hw/boards.h"
+#include "tb-cache.h"
+#include "translate-pool.h"
 #endif
 #include "internal-common.h"
 
@@ -47,11 +49,16 @@ struct TCGState {
     bool one_insn_per_tb;
     int splitwx_enabled;
     unsigned long tb_size;
+    uint32_t trace_threshold;
+    uint32_t translate_threads;
+    char *tb_cache;
 };
 typedef struct TCGState TCGState;
 
 #define TYPE_TCG_ACCEL ACCEL_CLASS_NAME("tcg")
 
+#define MAX_TRANSLATE_THREADS 64
+
 DECLARE_INSTANCE_CHECKER(TCGState, TCG_STATE,
                          TYPE_TCG_ACCEL)
 
@@ -99,6 +106,7 @@ static void tcg_accel_instance_init(Object *obj)
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+uint32_t tb_trace_threshold;
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -107,14 +115,29 @@ static int tcg_init_machine(MachineState *ms)
     unsigned max_cpus = 1;
 #else
     unsigned max_cpus = ms->smp.max_cpus;
+    Error *err = NULL;
 #endif
 
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
+    tb_trace_threshold = s->trace_threshold;
+
+    if (s->translate_threads && !mttcg_enabled) {
+        warn_report("translate-threads is ignored without thread=multi");
+        s->translate_threads = 0;
+    }
 
     page_init();
     tb_htable_init();
-    tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
+#if !defined(CONFIG_USER_ONLY)
+    if (s->tb_cache && !tb_cache_open(s->tb_cache, &err)) {
+        error_report_err(err);
+        return -EINVAL;
+    }
+#endif
+    /* The translation threads have TCG contexts too */
+    tcg_init(s->tb_size * MiB, s->splitwx_enabled,
+             max_cpus + s->translate_threads);
 
 #if defined(CONFIG_SOFTMMU)
     /*
@@ -122,6 +145,12 @@ static int tcg_init_machine(MachineState *ms)
      * initialize the prologue now.
      */
     tcg_prologue_init();
+    if (s->tb_cache) {
+        tb_cache_restore();
+    }
+    if (s->translate_threads) {
+        translate_pool_init(s->translate_threads);
+    }
 #endif
 
     return 0;
@@ -181,6 +210,34 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+static void tcg_get_trace_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->trace_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_trace_threshold(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value == TB_TRACE_HEAD) {
+        error_setg(errp, "trace-threshold must be below %u", TB_TRACE_HEAD);
+        return;
+    }
+
+    s->trace_threshold = value;
+}
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -193,6 +250,52 @@ static void tcg_set_splitwx(Object *obj, bool value, Error **errp)
     s->splitwx_enabled = value;
 }
 
+#if !defined(CONFIG_USER_ONLY)
+static void tcg_get_translate_threads(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value = s->translate_threads;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_translate_threads(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > MAX_TRANSLATE_THREADS) {
+        error_setg(errp, "translate-threads must be at most %u",
+                   MAX_TRANSLATE_THREADS);
+        return;
+    }
+
+    s->translate_threads = value;
+}
+
+static char *tcg_get_tb_cache(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    return g_strdup(s->tb_cache);
+}
+
+static void tcg_set_tb_cache(Object *obj, const char *value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+
+    g_free(s->tb_cache);
+    s->tb_cache = g_strdup(value);
+}
+#endif
+
 static bool tcg_get_one_insn_per_tb(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -242,11 +345,32 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+    object_class_property_add(oc, "trace-threshold", "int",
+        tcg_get_trace_threshold, tcg_set_trace_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "trace-threshold",
+        "Profile each translation block for this many exits before "
+        "chaining it, and translate hot loops as traces (0: off)");
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
         "Map jit pages into separate RW and RX regions");
 
+#if !defined(CONFIG_USER_ONLY)
+    object_class_property_add_str(oc, "tb-cache",
+                                  tcg_get_tb_cache, tcg_set_tb_cache);
+    object_class_property_set_description(oc, "tb-cache",
+        "File to keep translated code in across runs");
+
+    object_class_property_add(oc, "translate-threads", "int",
+        tcg_get_translate_threads, tcg_set_translate_threads,
+        NULL, NULL);
+    object_class_property_set_description(oc, "translate-threads",
+        "Number of threads translating code ahead of the vCPUs "
+        "(thread=multi only)");
+#endif
+
     object_class_property_add_bool(oc, "one-insn-per-tb",
                                    tcg_get_one_insn_per_tb,
                                    tcg_set_one_insn_per_tb);
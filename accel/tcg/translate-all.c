@@ -61,6 +61,7 @@
 #include "tb-jmp-cache.h"
 #include "tb-hash.h"
 #include "tb-context.h"
+#include "tb-cache.h"
 #include "internal-common.h"
 #include "internal-target.h"
 #include "tcg/perf.h"
@@ -283,27 +284,38 @@ static int setjmp_gen_code(CPUArchState *env, TranslationBlock *tb,
     return tcg_gen_code(tcg_ctx, tb, pc);
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
-TranslationBlock *tb_gen_code(CPUState *cpu,
-                              vaddr pc, uint64_t cs_base,
-                              uint32_t flags, int cflags)
+/*
+ * Translate the code at @pc, which is at @phys_pc and mapped at @host_pc.
+ * With @async, for the translation pool, return NULL rather than leave
+ * the work half done to the vCPU, e.g. by flushing the code buffer.
+ *
+ * Called with mmap_lock held for user mode emulation.
+ */
+static TranslationBlock *do_tb_gen_code(CPUState *cpu,
+                                        TranslationBlock *trace_head,
+                                        vaddr pc, uint64_t cs_base,
+                                        uint32_t flags, int cflags,
+                                        tb_page_addr_t phys_pc,
+                                        void *host_pc, bool async)
 {
     CPUArchState *env = cpu_env(cpu);
     TranslationBlock *tb, *existing_tb;
-    tb_page_addr_t phys_pc, phys_p2;
+    tb_page_addr_t phys_p2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
     int64_t ti;
-    void *host_pc;
 
     assert_memory_lock();
     qemu_thread_jit_write();
 
-    phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
-
     if (phys_pc == -1) {
         /* Generate a one-shot TB with 1 insn in it */
         cflags = (cflags & ~CF_COUNT_MASK) | 1;
+    } else if (!trace_head && !async) {
+        tb = tb_cache_lookup(cpu, pc, cs_base, flags, cflags, phys_pc, host_pc);
+        if (tb) {
+            return tb;
+        }
     }
 
     max_insns = cflags & CF_COUNT_MASK;
@@ -316,6 +328,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
+        if (async) {
+            /* Leave the flush to the vCPUs */
+            return NULL;
+        }
         /* flush must be done */
         tb_flush(cpu);
         mmap_unlock();
@@ -332,6 +348,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->trace_count = trace_head ? TB_TRACE_HEAD : 0;
+    tb->trace_exits[0] = 0;
+    tb->trace_exits[1] = 0;
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -339,6 +358,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 
     tcg_ctx->gen_tb = tb;
+    tcg_ctx->gen_trace_head = trace_head;
     tcg_ctx->addr_type = TARGET_LONG_BITS == 32 ? TCG_TYPE_I32 : TCG_TYPE_I64;
 #ifdef CONFIG_SOFTMMU
     tcg_ctx->page_bits = TARGET_PAGE_BITS;
@@ -415,6 +435,19 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                           "Restarting code generation with re-locked pages");
             goto restart_translate;
 
+        case -4:
+            /*
+             * A background translation needed the second page, which
+             * only the vCPU can look up.  Give up, and free the TB.
+             */
+            assert(async);
+            tb_unlock_pages(tb);
+            tcg_ctx->gen_tb = NULL;
+            qatomic_set(&tcg_ctx->code_gen_ptr, (void *)
+                        ((uintptr_t)gen_code_buf -
+                         ROUND_UP(sizeof(*tb), qemu_icache_linesize)));
+            return NULL;
+
         default:
             g_assert_not_reached();
         }
@@ -563,6 +596,71 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     return tb;
 }
 
+/* Called with mmap_lock held for user mode emulation.  */
+TranslationBlock *tb_gen_code(CPUState *cpu,
+                              vaddr pc, uint64_t cs_base,
+                              uint32_t flags, int cflags)
+{
+    tb_page_addr_t phys_pc;
+    void *host_pc;
+
+    phys_pc = get_page_addr_code_hostp(cpu_env(cpu), pc, &host_pc);
+    return do_tb_gen_code(cpu, NULL, pc, cs_base, flags, cflags,
+                          phys_pc, host_pc, false);
+}
+
+/*
+ * Translate the hot trace starting at @pc, which follows the dominant
+ * exits of @head, the TB for @pc, and of the TBs they lead to, and
+ * replace @head with it.
+ *
+ * Called with mmap_lock held for user mode emulation.
+ */
+TranslationBlock *tb_gen_trace(CPUState *cpu, TranslationBlock *head,
+                               vaddr pc, uint64_t cs_base,
+                               uint32_t flags, int cflags)
+{
+    TranslationBlock *tb;
+    tb_page_addr_t phys_pc;
+    void *host_pc;
+
+    phys_pc = get_page_addr_code_hostp(cpu_env(cpu), pc, &host_pc);
+
+    /* Remove @head from the hash table, lest tb_link_page() return it */
+    tb_retire(head, pc);
+    tb = do_tb_gen_code(cpu, head, pc, cs_base, flags, cflags,
+                        phys_pc, host_pc, false);
+    trace_tb_gen_trace(head, tb, tb->icount);
+    return tb;
+}
+
+#ifndef CONFIG_USER_ONLY
+/*
+ * Translate the code at @pc, or the trace replacing @trace_head, from the
+ * RAM at @phys_pc on a thread of the translation pool.  Returns NULL if
+ * the translation had to be abandoned.
+ */
+TranslationBlock *tb_gen_code_async(CPUState *cpu,
+                                    TranslationBlock *trace_head,
+                                    vaddr pc, uint64_t cs_base,
+                                    uint32_t flags, int cflags,
+                                    tb_page_addr_t phys_pc)
+{
+    TranslationBlock *tb;
+    void *host_pc = qemu_map_ram_ptr(NULL, phys_pc);
+
+    if (trace_head) {
+        tb_retire(trace_head, pc);
+    }
+    tb = do_tb_gen_code(cpu, trace_head, pc, cs_base, flags, cflags,
+                        phys_pc, host_pc, true);
+    if (tb && trace_head) {
+        trace_tb_gen_trace(trace_head, tb, tb->icount);
+    }
+    return tb;
+}
+#endif
+
 /* user-mode: call with mmap_lock held */
 void tb_check_watchpoint(CPUState *cpu, uintptr_t retaddr)
 {
@@ -652,14 +750,18 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc;
+
+    RCU_READ_LOCK_GUARD();
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
 
     /* During early initialization, the cache may not yet be allocated. */
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
+    tb_jmp_cache_ic_flush(jc);
 }
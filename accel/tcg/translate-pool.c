@@ -0,0 +1,380 @@
+/*
+ * Background translation threads
+ *
+ * With MTTCG and "-accel tcg,translate-threads=N", N threads translate
+ * code the vCPUs are expected to need, so that they find it in the hash
+ * table instead of stopping to translate it:
+ *
+ *  - the destinations of the direct branches of each newly translated
+ *    block, when they are on the same page and the target tells they
+ *    run with the same flags (see DisasContextBase.goto_tb_same_state);
+ *  - the hot traces found by the trace tier (see tb_trace_profile), which
+ *    the vCPU keeps running the old head block meanwhile.
+ *
+ * A vCPU still translates inline whatever it misses.  Translations are
+ * published with tb_link_page() like any other, which resolves the race
+ * with a vCPU translating the same block: the loser frees its copy.
+ *
+ * Each thread has a TCG context of its own.  The guest code is read from
+ * the RAM the first page was found in, without using the vCPU's TLB, so
+ * a block that runs into a second page is given up and left to the vCPU.
+ * The queue is bounded and dropped on tb_flush(), which waits for the
+ * translations in progress.  The threads are joined on exit, before the
+ * blocks are written to the tb-cache file.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/notify.h"
+#include "qemu/plugin.h"
+#include "qemu/queue.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "exec/exec-all.h"
+#include "exec/ram_addr.h"
+#include "hw/core/cpu.h"
+#include "sysemu/sysemu.h"
+#include "tcg/startup.h"
+#include "tcg/tcg.h"
+#include "tb-hash.h"
+#include "tb-context.h"
+#include "internal-common.h"
+#include "translate-pool.h"
+#include "trace.h"
+
+/* Beyond this, requests are dropped: the vCPUs went elsewhere since */
+#define TRANSLATE_POOL_MAX_JOBS 1024
+
+typedef struct TranslateJob {
+    CPUState *cpu;
+    TranslationBlock *trace_head;
+    vaddr pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+    tb_page_addr_t phys_pc;
+    QSIMPLEQ_ENTRY(TranslateJob) entry;
+} TranslateJob;
+
+static struct {
+    QemuMutex lock;
+    QemuCond cond;      /* a job was queued, the pool was resumed or stopped */
+    QemuCond idle;      /* a job was done */
+    QSIMPLEQ_HEAD(, TranslateJob) jobs;
+    unsigned nb_jobs;
+    unsigned nb_threads;
+    unsigned busy;
+    unsigned paused;
+    bool stopped;
+    Notifier exit;
+    QemuThread *threads;
+    CPUState *busy_cpu[];
+} *pool;
+
+static __thread bool translate_pool_worker;
+
+bool translate_pool_in_worker(void)
+{
+    return translate_pool_worker;
+}
+
+struct job_desc {
+    vaddr pc;
+    uint64_t cs_base;
+    tb_page_addr_t page_addr0;
+    uint32_t flags;
+    uint32_t cflags;
+};
+
+static bool job_cmp(const void *p, const void *d)
+{
+    const TranslationBlock *tb = p;
+    const struct job_desc *desc = d;
+
+    return (tb_cflags(tb) & CF_PCREL || tb->pc == desc->pc) &&
+           tb_page_addr0(tb) == desc->page_addr0 &&
+           tb->cs_base == desc->cs_base &&
+           tb->flags == desc->flags &&
+           tb_cflags(tb) == desc->cflags;
+}
+
+/* Whether a block for @job is in the hash table already */
+static bool job_done(const TranslateJob *job)
+{
+    struct job_desc desc = {
+        .pc = job->pc,
+        .cs_base = job->cs_base,
+        .page_addr0 = job->phys_pc,
+        .flags = job->flags,
+        .cflags = job->cflags,
+    };
+    uint32_t h = tb_hash_func(job->phys_pc,
+                              job->cflags & CF_PCREL ? 0 : job->pc,
+                              job->flags, job->cs_base, job->cflags);
+
+    return qht_lookup_custom(&tb_ctx.htable, &desc, h, job_cmp) != NULL;
+}
+
+static void translate_job(TranslateJob *job)
+{
+    TranslationBlock *tb;
+
+    RCU_READ_LOCK_GUARD();
+
+    if (job->trace_head) {
+        if (tb_cflags(job->trace_head) & CF_INVALID) {
+            return;
+        }
+    } else if (job_done(job)) {
+        return;
+    }
+
+    tb = tb_gen_code_async(job->cpu, job->trace_head, job->pc, job->cs_base,
+                           job->flags, job->cflags, job->phys_pc);
+    trace_translate_pool_job(job->cpu->cpu_index, job->pc,
+                             job->trace_head != NULL, tb);
+}
+
+static void *translate_pool_thread(void *arg)
+{
+    unsigned index = (uintptr_t)arg;
+
+    rcu_register_thread();
+    tcg_register_thread();
+    translate_pool_worker = true;
+
+    qemu_mutex_lock(&pool->lock);
+    while (true) {
+        TranslateJob *job;
+
+        while (!pool->stopped &&
+               (pool->paused || QSIMPLEQ_EMPTY(&pool->jobs))) {
+            qemu_cond_wait(&pool->cond, &pool->lock);
+        }
+        if (pool->stopped) {
+            break;
+        }
+        job = QSIMPLEQ_FIRST(&pool->jobs);
+        QSIMPLEQ_REMOVE_HEAD(&pool->jobs, entry);
+        pool->nb_jobs--;
+        pool->busy++;
+        pool->busy_cpu[index] = job->cpu;
+        qemu_mutex_unlock(&pool->lock);
+
+        translate_job(job);
+        g_free(job);
+
+        qemu_mutex_lock(&pool->lock);
+        pool->busy_cpu[index] = NULL;
+        pool->busy--;
+        qemu_cond_broadcast(&pool->idle);
+    }
+    qemu_mutex_unlock(&pool->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void translate_pool_exit(Notifier *notifier, void *data)
+{
+    translate_pool_shutdown();
+}
+
+void translate_pool_init(unsigned nb_threads)
+{
+    unsigned i;
+
+    pool = g_malloc0(sizeof(*pool) + nb_threads * sizeof(CPUState *));
+    qemu_mutex_init(&pool->lock);
+    qemu_cond_init(&pool->cond);
+    qemu_cond_init(&pool->idle);
+    QSIMPLEQ_INIT(&pool->jobs);
+    pool->nb_threads = nb_threads;
+    pool->threads = g_new(QemuThread, nb_threads);
+    pool->exit.notify = translate_pool_exit;
+    qemu_add_exit_notifier(&pool->exit);
+
+    for (i = 0; i < nb_threads; i++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "TCG translate %u", i);
+        qemu_thread_create(&pool->threads[i], name, translate_pool_thread,
+                           (void *)(uintptr_t)i, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static bool translate_pool_queue(TranslateJob *job)
+{
+    bool queued = false;
+
+    qemu_mutex_lock(&pool->lock);
+    if (!pool->paused && !pool->stopped &&
+        pool->nb_jobs < TRANSLATE_POOL_MAX_JOBS) {
+        QSIMPLEQ_INSERT_TAIL(&pool->jobs, job, entry);
+        pool->nb_jobs++;
+        qemu_cond_signal(&pool->cond);
+        queued = true;
+    }
+    qemu_mutex_unlock(&pool->lock);
+
+    if (!queued) {
+        g_free(job);
+    }
+    return queued;
+}
+
+static bool translate_pool_usable(CPUState *cpu, uint32_t cflags)
+{
+    if (!pool || translate_pool_worker ||
+        (cflags & (CF_COUNT_MASK | CF_SINGLE_STEP | CF_NOIRQ))) {
+        return false;
+    }
+#ifdef CONFIG_PLUGIN
+    /* Plugins must see each translation on the vCPU asking for it */
+    if (cpu->plugin_state &&
+        test_bit(QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+                 cpu->plugin_state->event_mask)) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+void translate_pool_speculate(CPUState *cpu, const TranslationBlock *tb,
+                              vaddr pc, const vaddr *dest, int nb_dest)
+{
+    tb_page_addr_t page0 = tb_page_addr0(tb);
+    int i;
+
+    if (page0 == -1 || !translate_pool_usable(cpu, tb_cflags(tb))) {
+        return;
+    }
+
+    for (i = 0; i < nb_dest; i++) {
+        TranslateJob *job;
+
+        if (dest[i] == pc) {
+            continue;
+        }
+        job = g_new(TranslateJob, 1);
+        job->cpu = cpu;
+        job->trace_head = NULL;
+        job->pc = dest[i];
+        job->cs_base = tb->cs_base;
+        job->flags = tb->flags;
+        job->cflags = tb_cflags(tb);
+        job->phys_pc = page0 + (dest[i] - pc);
+        translate_pool_queue(job);
+    }
+}
+
+bool translate_pool_trace(CPUState *cpu, TranslationBlock *head, vaddr pc,
+                          uint64_t cs_base, uint32_t flags, uint32_t cflags)
+{
+    TranslateJob *job;
+
+    if (tb_page_addr0(head) == -1 || !translate_pool_usable(cpu, cflags)) {
+        return false;
+    }
+
+    job = g_new(TranslateJob, 1);
+    job->cpu = cpu;
+    job->trace_head = head;
+    job->pc = pc;
+    job->cs_base = cs_base;
+    job->flags = flags;
+    job->cflags = cflags;
+    job->phys_pc = tb_page_addr0(head);
+    return translate_pool_queue(job);
+}
+
+/* Called with pool->lock held */
+static void translate_pool_drop(CPUState *cpu)
+{
+    TranslateJob *job, *next;
+
+    QSIMPLEQ_FOREACH_SAFE(job, &pool->jobs, entry, next) {
+        if (!cpu || job->cpu == cpu) {
+            QSIMPLEQ_REMOVE(&pool->jobs, job, TranslateJob, entry);
+            pool->nb_jobs--;
+            g_free(job);
+        }
+    }
+}
+
+static bool translate_pool_busy_with(CPUState *cpu)
+{
+    unsigned i;
+
+    for (i = 0; i < pool->nb_threads; i++) {
+        if (pool->busy_cpu[i] == cpu) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void translate_pool_pause(void)
+{
+    if (!pool) {
+        return;
+    }
+    qemu_mutex_lock(&pool->lock);
+    pool->paused++;
+    translate_pool_drop(NULL);
+    while (pool->busy) {
+        qemu_cond_wait(&pool->idle, &pool->lock);
+    }
+    qemu_mutex_unlock(&pool->lock);
+}
+
+void translate_pool_resume(void)
+{
+    if (!pool) {
+        return;
+    }
+    qemu_mutex_lock(&pool->lock);
+    assert(pool->paused);
+    if (--pool->paused == 0) {
+        qemu_cond_broadcast(&pool->cond);
+    }
+    qemu_mutex_unlock(&pool->lock);
+}
+
+void translate_pool_cancel(CPUState *cpu)
+{
+    if (!pool) {
+        return;
+    }
+    qemu_mutex_lock(&pool->lock);
+    translate_pool_drop(cpu);
+    while (translate_pool_busy_with(cpu)) {
+        qemu_cond_wait(&pool->idle, &pool->lock);
+    }
+    qemu_mutex_unlock(&pool->lock);
+}
+
+void translate_pool_shutdown(void)
+{
+    unsigned i;
+
+    if (!pool) {
+        return;
+    }
+    qemu_mutex_lock(&pool->lock);
+    if (pool->stopped) {
+        qemu_mutex_unlock(&pool->lock);
+        return;
+    }
+    pool->stopped = true;
+    translate_pool_drop(NULL);
+    qemu_cond_broadcast(&pool->cond);
+    qemu_mutex_unlock(&pool->lock);
+
+    /* The translations in progress are finished first */
+    for (i = 0; i < pool->nb_threads; i++) {
+        qemu_thread_join(&pool->threads[i]);
+    }
+    trace_translate_pool_shutdown(pool->nb_threads);
+}
@@ -0,0 +1,98 @@
+/*
+ * Background translation threads
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TRANSLATE_POOL_H
+#define ACCEL_TCG_TRANSLATE_POOL_H
+
+#include "exec/exec-all.h"
+
+#ifdef CONFIG_USER_ONLY
+static inline bool translate_pool_in_worker(void)
+{
+    return false;
+}
+
+static inline void translate_pool_speculate(CPUState *cpu,
+                                            const TranslationBlock *tb,
+                                            vaddr pc, const vaddr *dest,
+                                            int nb_dest)
+{
+}
+
+static inline bool translate_pool_trace(CPUState *cpu, TranslationBlock *head,
+                                        vaddr pc, uint64_t cs_base,
+                                        uint32_t flags, uint32_t cflags)
+{
+    return false;
+}
+
+static inline void translate_pool_pause(void) { }
+static inline void translate_pool_resume(void) { }
+static inline void translate_pool_cancel(CPUState *cpu) { }
+static inline void translate_pool_shutdown(void) { }
+#else
+/**
+ * translate_pool_init: Start @nb_threads background translation threads
+ *
+ * Each thread registers a TCG context, so tcg_init() must have been told
+ * about them on top of the vCPUs.
+ */
+void translate_pool_init(unsigned nb_threads);
+
+/**
+ * translate_pool_in_worker: Return true on a background translation thread
+ *
+ * Translation there must not look up the guest page tables, and so gives
+ * up instead of reading guest code from a second page.
+ */
+bool translate_pool_in_worker(void);
+
+/**
+ * translate_pool_speculate: Queue the translation of direct branch targets
+ *
+ * @tb, for @pc, has just been translated and can jump directly to the
+ * @nb_dest addresses in @dest, which are on the same page and run with
+ * the cs_base and flags of @tb.  Translate them in the background, so
+ * that the vCPU finds them when it gets there.
+ */
+void translate_pool_speculate(CPUState *cpu, const TranslationBlock *tb,
+                              vaddr pc, const vaddr *dest, int nb_dest);
+
+/**
+ * translate_pool_trace: Queue the translation of a hot trace
+ *
+ * Arranges for tb_gen_trace() to be done in the background.  Returns
+ * false if the caller must do it itself.
+ */
+bool translate_pool_trace(CPUState *cpu, TranslationBlock *head, vaddr pc,
+                          uint64_t cs_base, uint32_t flags, uint32_t cflags);
+
+/**
+ * translate_pool_pause: Stop background translation, and drop the queue
+ *
+ * Returns once no translation is in progress.  Used around tb_flush().
+ */
+void translate_pool_pause(void);
+void translate_pool_resume(void);
+
+/**
+ * translate_pool_cancel: Forget about the translations queued for @cpu
+ *
+ * Returns once none is in progress either.
+ */
+void translate_pool_cancel(CPUState *cpu);
+
+/**
+ * translate_pool_shutdown: Stop the background translation threads
+ *
+ * Drops the queue and joins the threads once they have finished the
+ * translations in progress.  Nothing is queued any more afterwards.
+ * Done on exit, and before anything walks all the translated blocks.
+ */
+void translate_pool_shutdown(void);
+#endif
+
+#endif /* ACCEL_TCG_TRANSLATE_POOL_H */
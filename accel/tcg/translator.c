@@ -16,7 +16,10 @@
 #include "exec/plugin-gen.h"
 #include "exec/cpu_ldst.h"
 #include "tcg/tcg-op-common.h"
+#include "internal-common.h"
 #include "internal-target.h"
+#include "translate-pool.h"
+#include "tb-jmp-cache.h"
 #include "disas/disas.h"
 
 static void set_can_do_io(DisasContextBase *db, bool val)
@@ -110,7 +113,95 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     }
 
     /* Check for the dest on the same page as the start of the TB.  */
-    return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
+    if ((db->pc_first ^ dest) & TARGET_PAGE_MASK) {
+        return false;
+    }
+
+    /* Remember it for translate_pool_speculate. */
+    if (db->nb_goto_tb_dest < ARRAY_SIZE(db->goto_tb_dest) &&
+        (db->nb_goto_tb_dest == 0 || db->goto_tb_dest[0] != dest)) {
+        db->goto_tb_dest[db->nb_goto_tb_dest++] = dest;
+    }
+    return true;
+}
+
+void translator_indirect_jump(DisasContextBase *db, TCGv_i64 dest)
+{
+    TranslationBlock *tb = db->tb;
+    intptr_t ic = offsetof(CPUJumpCache, ic) +
+                  tb_ic_hash(tb) * sizeof(TBInlineCache);
+    TCGLabel *miss;
+    TCGv_ptr jc, ptr;
+    TCGv_i64 pc;
+    TCGv_i32 gen, val;
+
+    if (tb_cflags(tb) & CF_NO_GOTO_PTR) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    plugin_gen_disable_mem_helpers();
+    miss = gen_new_label();
+    jc = tcg_temp_new_ptr();
+    ptr = tcg_temp_new_ptr();
+    pc = tcg_temp_new_i64();
+    gen = tcg_temp_new_i32();
+    val = tcg_temp_new_i32();
+
+    /* The entry for this TB must be current, and be for @dest */
+    tcg_gen_ld_ptr(jc, tcg_env,
+                   offsetof(ArchCPU, parent_obj.tb_jmp_cache) -
+                   offsetof(ArchCPU, env));
+    tcg_gen_ld_ptr(ptr, jc, ic + offsetof(TBInlineCache, site));
+    tcg_gen_brcondi_ptr(TCG_COND_NE, ptr, (intptr_t)tb, miss);
+    tcg_gen_ld_i64(pc, jc, ic + offsetof(TBInlineCache, pc));
+    tcg_gen_brcond_i64(TCG_COND_NE, pc, dest, miss);
+    tcg_gen_ld_i32(gen, jc, offsetof(CPUJumpCache, ic_gen));
+    tcg_gen_ld_i32(val, jc, ic + offsetof(TBInlineCache, gen));
+    tcg_gen_brcond_i32(TCG_COND_NE, val, gen, miss);
+
+    /* And its TB must not have been invalidated since */
+    tcg_gen_ld_ptr(ptr, jc, ic + offsetof(TBInlineCache, tb));
+    tcg_gen_ld_i32(val, ptr, offsetof(TranslationBlock, cflags));
+    tcg_gen_andi_i32(val, val, CF_INVALID);
+    tcg_gen_brcondi_i32(TCG_COND_NE, val, 0, miss);
+    tcg_gen_ld_ptr(ptr, ptr, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_goto_ptr(ptr);
+
+    gen_set_label(miss);
+    gen_helper_lookup_tb_ptr_ic(ptr, tcg_env, tcg_constant_ptr(tb));
+    tcg_gen_goto_ptr(ptr);
+}
+
+bool translator_trace_follow(DisasContextBase *db, int n, vaddr dest)
+{
+    TranslationBlock *tb = db->trace_tb;
+    TranslationBlock *succ;
+    tb_page_addr_t page0 = tb_page_addr0(db->tb);
+
+    /*
+     * Only follow forward branches within the first page, so that the
+     * trace stays within [pc_first, pc_next) for page tracking, and only
+     * while there is room for the instruction at @dest.
+     */
+    if (!tb || page0 == -1 || db->plugin_enabled || dest < db->pc_next ||
+        !translator_use_goto_tb(db, dest) ||
+        db->num_insns >= db->max_insns || tcg_op_buf_full() ||
+        tb_trace_dominant(tb) != n) {
+        return false;
+    }
+
+    /* The profile must have seen the block at @dest, in this context */
+    succ = qatomic_read(&tb->trace_succ[n]);
+    if (!succ || (tb_cflags(succ) & CF_INVALID) ||
+        tb_page_addr0(succ) != page0 + (dest - db->pc_first) ||
+        succ->cs_base != db->tb->cs_base || succ->flags != db->tb->flags) {
+        return false;
+    }
+
+    db->trace_tb = succ;
+    db->pc_next = dest;
+    return true;
 }
 
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
@@ -136,6 +227,9 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->host_addr[1] = NULL;
     db->record_start = 0;
     db->record_len = 0;
+    db->trace_tb = tcg_ctx->gen_trace_head;
+    db->nb_goto_tb_dest = 0;
+    db->goto_tb_same_state = false;
 
     ops->init_disas_context(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
@@ -149,6 +243,8 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
     db->plugin_enabled = plugin_enabled;
 
     while (true) {
+        TranslationBlock *trace_tb = db->trace_tb;
+
         *max_insns = ++db->num_insns;
         ops->insn_start(db, cpu);
         db->insn_start = tcg_last_op();
@@ -187,9 +283,14 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
             break;
         }
 
-        /* Stop translation if the output buffer is full,
-           or we have executed all of the allowed instructions.  */
-        if (tcg_op_buf_full() || db->num_insns >= db->max_insns) {
+        /*
+         * Stop translation if the output buffer is full,
+         * or we have executed all of the allowed instructions.
+         * Once a branch has been followed in a trace, as trace_tb
+         * tells, the insn at its destination must be translated.
+         */
+        if ((tcg_op_buf_full() && db->trace_tb == trace_tb) ||
+            db->num_insns >= db->max_insns) {
             db->is_jmp = DISAS_TOO_MANY;
             break;
         }
@@ -222,6 +323,12 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
         plugin_gen_tb_end(cpu, db->num_insns);
     }
 
+    if (db->nb_goto_tb_dest && db->goto_tb_same_state &&
+        !tcg_ctx->gen_trace_head) {
+        translate_pool_speculate(cpu, tb, db->pc_first,
+                                 db->goto_tb_dest, db->nb_goto_tb_dest);
+    }
+
     if (qemu_loglevel_mask(CPU_LOG_TB_IN_ASM)
         && qemu_log_in_addr_range(db->pc_first)) {
         FILE *logfile = qemu_log_trylock();
@@ -290,6 +397,14 @@ static bool translator_ld(CPUArchState *env, DisasContextBase *db,
     if (host == NULL) {
         tb_page_addr_t page0, old_page1, new_page1;
 
+        /*
+         * The page tables are the vCPU's to walk: a background
+         * translation gives up instead (see do_tb_gen_code).
+         */
+        if (translate_pool_in_worker()) {
+            siglongjmp(tcg_ctx->jmp_trans, -4);
+        }
+
         new_page1 = get_page_addr_code_hostp(env, base, &db->host_addr[1]);
 
         /*
@@ -0,0 +1,199 @@
+/*
+ * Rockchip RK3399 successive approximation ADC (SARADC) emulation
+ *
+ * The SARADC converts one of six external inputs to a 10-bit code each
+ * time it is powered up.  The input voltages are the "voltage[n]" QOM
+ * properties, in microvolts, and can be changed at run time with qom-set.
+ * A conversion completes as soon as POWER_CTRL is set, so STAS never reads
+ * busy; the interrupt stays pending until the guest powers the converter
+ * down or writes 0 to the status bit.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/registerfields.h"
+#include "hw/adc/rk3399-saradc.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+REG32(DATA, 0x00)
+REG32(STAS, 0x04)
+REG32(CTRL, 0x08)
+    FIELD(CTRL, CHN, 0, 3)
+    FIELD(CTRL, POWER_CTRL, 3, 1)
+    FIELD(CTRL, IRQ_ENABLE, 5, 1)
+    FIELD(CTRL, IRQ_STATUS, 6, 1)
+REG32(DLY_PU_SOC, 0x0c)
+
+#define SARADC_CTRL_MASK        0x2f
+#define SARADC_DLY_PU_SOC_MASK  0x3f
+#define SARADC_DATA_MAX         0x3ff
+
+static void rk3399_saradc_update_irq(RK3399SARADCState *s)
+{
+    qemu_set_irq(s->irq, FIELD_EX32(s->ctrl, CTRL, IRQ_ENABLE) &&
+                         FIELD_EX32(s->ctrl, CTRL, IRQ_STATUS));
+}
+
+static void rk3399_saradc_convert(RK3399SARADCState *s)
+{
+    int chn = FIELD_EX32(s->ctrl, CTRL, CHN);
+    uint64_t uv;
+
+    if (chn >= RK3399_SARADC_NUM_CHANNELS) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad channel %d\n", __func__, chn);
+        s->data = 0;
+    } else {
+        uv = MIN(s->voltage[chn], RK3399_SARADC_VREF_UV);
+        s->data = uv * SARADC_DATA_MAX / RK3399_SARADC_VREF_UV;
+    }
+
+    trace_rk3399_saradc_convert(chn, s->data);
+    s->ctrl = FIELD_DP32(s->ctrl, CTRL, IRQ_STATUS, 1);
+}
+
+static uint64_t rk3399_saradc_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399SARADCState *s = RK3399_SARADC(opaque);
+    uint32_t value;
+
+    switch (offset) {
+    case A_DATA:
+        value = s->data;
+        break;
+    case A_STAS:
+        value = 0;
+        break;
+    case A_CTRL:
+        value = s->ctrl;
+        break;
+    case A_DLY_PU_SOC:
+        value = s->dly_pu_soc;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: bad read offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        value = 0;
+        break;
+    }
+
+    trace_rk3399_saradc_read(offset, value);
+    return value;
+}
+
+static void rk3399_saradc_write(void *opaque, hwaddr offset, uint64_t value,
+                                unsigned size)
+{
+    RK3399SARADCState *s = RK3399_SARADC(opaque);
+    bool power_up;
+
+    trace_rk3399_saradc_write(offset, value);
+
+    switch (offset) {
+    case A_CTRL:
+        power_up = !FIELD_EX32(s->ctrl, CTRL, POWER_CTRL) &&
+                   FIELD_EX32(value, CTRL, POWER_CTRL);
+        /* The status bit can only be cleared, by writing 0 to it */
+        s->ctrl = (value & SARADC_CTRL_MASK) |
+                  (s->ctrl & value & R_CTRL_IRQ_STATUS_MASK);
+        if (!FIELD_EX32(s->ctrl, CTRL, POWER_CTRL)) {
+            s->ctrl = FIELD_DP32(s->ctrl, CTRL, IRQ_STATUS, 0);
+        } else if (power_up) {
+            rk3399_saradc_convert(s);
+        }
+        rk3399_saradc_update_irq(s);
+        break;
+    case A_DLY_PU_SOC:
+        s->dly_pu_soc = value & SARADC_DLY_PU_SOC_MASK;
+        break;
+    case A_DATA:
+    case A_STAS:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only register 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: bad write offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+}
+
+static const MemoryRegionOps rk3399_saradc_ops = {
+    .read = rk3399_saradc_read,
+    .write = rk3399_saradc_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_saradc_reset(DeviceState *dev)
+{
+    RK3399SARADCState *s = RK3399_SARADC(dev);
+
+    /* The input voltages are not state of the device and survive reset */
+    s->data = 0;
+    s->ctrl = 0;
+    s->dly_pu_soc = 0;
+    rk3399_saradc_update_irq(s);
+}
+
+static void rk3399_saradc_init(Object *obj)
+{
+    RK3399SARADCState *s = RK3399_SARADC(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int chn;
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_saradc_ops, s,
+                          TYPE_RK3399_SARADC, RK3399_SARADC_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+
+    for (chn = 0; chn < RK3399_SARADC_NUM_CHANNELS; chn++) {
+        object_property_add_uint32_ptr(obj, "voltage[*]", &s->voltage[chn],
+                                       OBJ_PROP_FLAG_READWRITE);
+    }
+}
+
+static const VMStateDescription rk3399_saradc_vmstate = {
+    .name = "rk3399-saradc",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32(data, RK3399SARADCState),
+        VMSTATE_UINT32(ctrl, RK3399SARADCState),
+        VMSTATE_UINT32(dly_pu_soc, RK3399SARADCState),
+        VMSTATE_UINT32_ARRAY(voltage, RK3399SARADCState,
+                             RK3399_SARADC_NUM_CHANNELS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_saradc_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->vmsd = &rk3399_saradc_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_saradc_reset);
+}
+
+static const TypeInfo rk3399_saradc_info = {
+    .name = TYPE_RK3399_SARADC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399SARADCState),
+    .instance_init = rk3399_saradc_init,
+    .class_init = rk3399_saradc_class_init,
+};
+
+static void rk3399_saradc_register_types(void)
+{
+    type_register_static(&rk3399_saradc_info);
+}
+
+type_init(rk3399_saradc_register_types);
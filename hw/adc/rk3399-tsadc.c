@@ -0,0 +1,304 @@
+/*
+ * Rockchip RK3399 temperature sensor ADC (TSADC) emulation
+ *
+ * The TSADC samples the two on-die temperature sensors, one in the CPU
+ * and one in the GPU.  Their temperatures are the "temperature[n]" QOM
+ * properties, in millidegrees Celsius, and can be changed at run time
+ * with qom-set.  In auto mode each sensor is compared against its high
+ * temperature threshold, which raises the interrupt the guest thermal
+ * framework sleeps on, and against its shutdown threshold, which either
+ * resets the SoC through the CRU or drives the TSHUT pin.
+ *
+ * Conversions are instant: DATA always reads the code of the current
+ * temperature, and the thresholds are checked whenever the temperature or
+ * the comparison setup changes rather than every AUTO_PERIOD.  The debounce
+ * counters only hold their values.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/qdev-core.h"
+#include "hw/registerfields.h"
+#include "hw/adc/rk3399-tsadc.h"
+#include "migration/vmstate.h"
+#include "sysemu/runstate.h"
+#include "trace.h"
+
+REG32(USER_CON, 0x00)
+REG32(AUTO_CON, 0x04)
+    FIELD(AUTO_CON, AUTO_EN, 0, 1)
+    FIELD(AUTO_CON, SRC_EN, 4, 2)
+REG32(INT_EN, 0x08)
+    FIELD(INT_EN, HT_INTEN, 0, 2)
+    FIELD(INT_EN, TSHUT_2GPIO, 4, 2)
+    FIELD(INT_EN, TSHUT_2CRU, 8, 2)
+REG32(INT_PD, 0x0c)
+    FIELD(INT_PD, HT, 0, 2)
+    FIELD(INT_PD, TSHUT, 4, 2)
+REG32(DATA0, 0x20)
+REG32(DATA1, 0x24)
+REG32(COMP0_INT, 0x30)
+REG32(COMP1_INT, 0x34)
+REG32(COMP0_SHUT, 0x40)
+REG32(COMP1_SHUT, 0x44)
+REG32(HIGHT_INT_DEBOUNCE, 0x60)
+REG32(HIGHT_TSHUT_DEBOUNCE, 0x64)
+REG32(AUTO_PERIOD, 0x68)
+REG32(AUTO_PERIOD_HT, 0x6c)
+
+#define TSADC_DATA_MASK         0x3ff
+
+/* Sensor codes from -40C to 125C in steps of 5C, as Linux tabulates them */
+#define TSADC_TABLE_MIN_TEMP    (-40000)
+#define TSADC_TABLE_MAX_TEMP    125000
+#define TSADC_TABLE_STEP        5000
+
+static const uint16_t rk3399_tsadc_codes[] = {
+    402, 410, 419, 427, 436, 444, 453, 461, 470, 478,
+    487, 496, 504, 513, 521, 530, 538, 547, 555, 564,
+    573, 581, 590, 599, 607, 616, 624, 633, 642, 650,
+    659, 668, 677, 685,
+};
+
+#define TSADC_DEFAULT_TEMP      40000
+
+/* Code of a temperature, interpolated between the 5C table entries */
+static uint32_t rk3399_tsadc_temp_to_code(int32_t temp)
+{
+    int i = (temp - TSADC_TABLE_MIN_TEMP) / TSADC_TABLE_STEP;
+    int32_t rem = (temp - TSADC_TABLE_MIN_TEMP) % TSADC_TABLE_STEP;
+
+    if (i >= ARRAY_SIZE(rk3399_tsadc_codes) - 1) {
+        return rk3399_tsadc_codes[ARRAY_SIZE(rk3399_tsadc_codes) - 1];
+    }
+    return rk3399_tsadc_codes[i] +
+           (rk3399_tsadc_codes[i + 1] - rk3399_tsadc_codes[i]) * rem /
+           TSADC_TABLE_STEP;
+}
+
+static void rk3399_tsadc_update_irq(RK3399TSADCState *s)
+{
+    qemu_set_irq(s->irq, !!(s->regs[R_INT_PD] & R_INT_PD_HT_MASK));
+}
+
+/* Compare the sensors that are sampled in auto mode with their thresholds */
+static void rk3399_tsadc_update(RK3399TSADCState *s)
+{
+    uint32_t int_en = s->regs[R_INT_EN];
+    bool tshut_gpio = false;
+    int chn;
+
+    if (!FIELD_EX32(s->regs[R_AUTO_CON], AUTO_CON, AUTO_EN)) {
+        qemu_set_irq(s->tshut, 0);
+        rk3399_tsadc_update_irq(s);
+        return;
+    }
+
+    for (chn = 0; chn < RK3399_TSADC_NUM_CHANNELS; chn++) {
+        uint32_t code = rk3399_tsadc_temp_to_code(s->temperature[chn]);
+
+        if (!(FIELD_EX32(s->regs[R_AUTO_CON], AUTO_CON, SRC_EN) & BIT(chn))) {
+            continue;
+        }
+
+        if ((FIELD_EX32(int_en, INT_EN, HT_INTEN) & BIT(chn)) &&
+            code >= (s->regs[R_COMP0_INT + chn] & TSADC_DATA_MASK)) {
+            trace_rk3399_tsadc_alarm(chn, code);
+            s->regs[R_INT_PD] |= BIT(R_INT_PD_HT_SHIFT + chn);
+        }
+
+        if (code < (s->regs[R_COMP0_SHUT + chn] & TSADC_DATA_MASK)) {
+            continue;
+        }
+        if (FIELD_EX32(int_en, INT_EN, TSHUT_2GPIO) & BIT(chn)) {
+            tshut_gpio = true;
+        }
+        if (s->regs[R_INT_PD] & BIT(R_INT_PD_TSHUT_SHIFT + chn)) {
+            continue;
+        }
+        trace_rk3399_tsadc_tshut(chn, code);
+        s->regs[R_INT_PD] |= BIT(R_INT_PD_TSHUT_SHIFT + chn);
+        if (FIELD_EX32(int_en, INT_EN, TSHUT_2CRU) & BIT(chn)) {
+            qemu_system_reset_request(SHUTDOWN_CAUSE_GUEST_RESET);
+        }
+    }
+
+    qemu_set_irq(s->tshut, tshut_gpio);
+    rk3399_tsadc_update_irq(s);
+}
+
+static uint64_t rk3399_tsadc_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399TSADCState *s = RK3399_TSADC(opaque);
+    uint32_t value;
+
+    switch (offset) {
+    case A_DATA0:
+    case A_DATA1:
+        value = rk3399_tsadc_temp_to_code(
+                    s->temperature[(offset - A_DATA0) >> 2]);
+        break;
+    default:
+        if (offset > A_AUTO_PERIOD_HT) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: bad read offset 0x%" HWADDR_PRIx "\n",
+                          __func__, offset);
+            value = 0;
+            break;
+        }
+        value = s->regs[offset >> 2];
+        break;
+    }
+
+    trace_rk3399_tsadc_read(offset, value);
+    return value;
+}
+
+static void rk3399_tsadc_write(void *opaque, hwaddr offset, uint64_t value,
+                               unsigned size)
+{
+    RK3399TSADCState *s = RK3399_TSADC(opaque);
+
+    trace_rk3399_tsadc_write(offset, value);
+
+    switch (offset) {
+    case A_INT_PD:
+        /* Pending bits are write-one-to-clear */
+        s->regs[R_INT_PD] &= ~value;
+        rk3399_tsadc_update_irq(s);
+        break;
+    case A_DATA0:
+    case A_DATA1:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only register 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    case A_AUTO_CON:
+    case A_INT_EN:
+    case A_COMP0_INT:
+    case A_COMP1_INT:
+    case A_COMP0_SHUT:
+    case A_COMP1_SHUT:
+        s->regs[offset >> 2] = value;
+        rk3399_tsadc_update(s);
+        break;
+    default:
+        if (offset > A_AUTO_PERIOD_HT) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: bad write offset 0x%" HWADDR_PRIx "\n",
+                          __func__, offset);
+            break;
+        }
+        s->regs[offset >> 2] = value;
+        break;
+    }
+}
+
+static const MemoryRegionOps rk3399_tsadc_ops = {
+    .read = rk3399_tsadc_read,
+    .write = rk3399_tsadc_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_tsadc_get_temperature(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    int64_t value = *(int32_t *)opaque;
+
+    visit_type_int(v, name, &value, errp);
+}
+
+static void rk3399_tsadc_set_temperature(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    RK3399TSADCState *s = RK3399_TSADC(obj);
+    int64_t temp;
+
+    if (!visit_type_int(v, name, &temp, errp)) {
+        return;
+    }
+    if (temp < TSADC_TABLE_MIN_TEMP || temp > TSADC_TABLE_MAX_TEMP) {
+        error_setg(errp, "temperature %" PRId64 " mC is out of the sensor "
+                   "range [%d, %d]", temp, TSADC_TABLE_MIN_TEMP,
+                   TSADC_TABLE_MAX_TEMP);
+        return;
+    }
+
+    *(int32_t *)opaque = temp;
+    rk3399_tsadc_update(s);
+}
+
+static void rk3399_tsadc_reset(DeviceState *dev)
+{
+    RK3399TSADCState *s = RK3399_TSADC(dev);
+
+    /* The temperatures are not state of the device and survive reset */
+    memset(s->regs, 0, sizeof(s->regs));
+    rk3399_tsadc_update(s);
+}
+
+static void rk3399_tsadc_init(Object *obj)
+{
+    RK3399TSADCState *s = RK3399_TSADC(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int chn;
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_tsadc_ops, s,
+                          TYPE_RK3399_TSADC, RK3399_TSADC_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->tshut, "tshut", 1);
+
+    for (chn = 0; chn < RK3399_TSADC_NUM_CHANNELS; chn++) {
+        s->temperature[chn] = TSADC_DEFAULT_TEMP;
+        object_property_add(obj, "temperature[*]", "int",
+                            rk3399_tsadc_get_temperature,
+                            rk3399_tsadc_set_temperature, NULL,
+                            &s->temperature[chn]);
+    }
+}
+
+static const VMStateDescription rk3399_tsadc_vmstate = {
+    .name = "rk3399-tsadc",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, RK3399TSADCState, RK3399_TSADC_NR_REGS),
+        VMSTATE_INT32_ARRAY(temperature, RK3399TSADCState,
+                            RK3399_TSADC_NUM_CHANNELS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_tsadc_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->vmsd = &rk3399_tsadc_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_tsadc_reset);
+}
+
+static const TypeInfo rk3399_tsadc_info = {
+    .name = TYPE_RK3399_TSADC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399TSADCState),
+    .instance_init = rk3399_tsadc_init,
+    .class_init = rk3399_tsadc_class_init,
+};
+
+static void rk3399_tsadc_register_types(void)
+{
+    type_register_static(&rk3399_tsadc_info);
+}
+
+type_init(rk3399_tsadc_register_types);
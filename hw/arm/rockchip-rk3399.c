@@ -1,26 +1,54 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
+#include "qemu/bitmap.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/timer.h"
 #include "qemu/typedefs.h"
 #include "qemu/units.h"
 #include "hw/qdev-core.h"
+#include "hw/qdev-clock.h"
+#include "hw/adc/rk3399-saradc.h"
+#include "hw/adc/rk3399-tsadc.h"
 #include "hw/arm/boot.h"
 #include "hw/boards.h"
 #include "hw/sysbus.h"
-#include "hw/char/serial-mm.h"
+#include "hw/char/dw-apb-uart.h"
+#include "hw/display/rk3399-vop.h"
 #include "hw/misc/unimp.h"
-#include "hw/usb/hcd-ehci.h"
+#include "hw/net/dw_gmac.h"
+#include "hw/or-irq.h"
+#include "hw/pci/pcie_host.h"
+#include "hw/pci-host/gpex.h"
+#include "hw/sd/dw_mmc.h"
+#include "hw/sd/sdhci.h"
+#include "hw/ssi/rk3399-spi.h"
+#include "hw/usb/hcd-dwc3.h"
+#include "hw/virtio/virtio-mmio.h"
 #include "hw/loader.h"
 #include "hw/intc/arm_gicv3_common.h"
 #include "hw/intc/arm_gicv3_its_common.h"
 #include "hw/arm/bsa.h"
+#include "hw/arm/fdt.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/device_tree.h"
+#include "sysemu/blockdev.h"
 #include "hw/arm/rockchip-rk3399.h"
+#include "hw/misc/rk3399-cru.h"
+#include "hw/misc/rk3399-crypto.h"
+#include "hw/misc/rk3399-emmc-phy.h"
+#include "hw/misc/rk3399-grf.h"
+#include "hw/misc/rk3399-pmu.h"
+#include "hw/timer/rk3399-timer.h"
 #include "target/arm/cpu-qom.h"
 #include "target/arm/cpu.h"
 #include "target/arm/gtimer.h"
+#include "target/arm/multiprocessing.h"
 #include "qapi/qmp/qlist.h"
+#include "qapi/qapi-builtin-visit.h"
+#include "qapi/visitor.h"
+#include "trace.h"
 
 #define NUM_IRQS 256
 
@@ -31,12 +59,32 @@ enum {
     RK3399_DEV_GIC_ITS,
     RK3399_DEV_PMU_CRU,
     RK3399_DEV_CRU,
-    RK3399_DEV_PMU_PMUGRF,
+    RK3399_DEV_PMUGRF,
     RK3399_DEV_UART0,
     RK3399_DEV_UART1,
     RK3399_DEV_UART2,
     RK3399_DEV_UART3,
-    RK3399_DEV_RKTIMER,
+    RK3399_DEV_RKTIMER0,
+    RK3399_DEV_RKTIMER1,
+    RK3399_DEV_SDMMC,
+    RK3399_DEV_EMMC,
+    RK3399_DEV_GMAC,
+    RK3399_DEV_DMAC0,
+    RK3399_DEV_DMAC1,
+    RK3399_DEV_USB3_0,
+    RK3399_DEV_USB3_1,
+    RK3399_DEV_VIRTIO,
+    RK3399_DEV_VOPB,
+    RK3399_DEV_VOPL,
+    RK3399_DEV_CRYPTO0,
+    RK3399_DEV_CRYPTO1,
+    RK3399_DEV_SPI1,
+    RK3399_DEV_PCIE,
+    RK3399_DEV_PCIE_ECAM,
+    RK3399_DEV_PCIE_MMIO,
+    RK3399_DEV_PCIE_PIO,
+    RK3399_DEV_PCIE_MMIO_HIGH,
+    RK3399_DEV_PCIE_APB,
     RK3399_DEV_GRF,
     RK3399_DEV_CPU_DEBUG0,
     RK3399_DEV_CPU_DEBUG1,
@@ -45,36 +93,1510 @@ enum {
     RK3399_DEV_CPU_DEBUG4,
     RK3399_DEV_CPU_DEBUG5,
     RK3399_DEV_PMU,
+    RK3399_DEV_TSADC,
+    RK3399_DEV_SARADC,
 };
 
 /* Memory map */
-const hwaddr rockchip_rk3399_memmap[] = {
-    [RK3399_SYSMEM] = 0,
-    [RK3399_DEV_GICD] = 0xfee00000,
-    [RK3399_DEV_GICR] = 0xfef00000,
-    [RK3399_DEV_GIC_ITS] = 0xfee20000,
-    [RK3399_DEV_PMU_CRU] = 0xff750000,
-    [RK3399_DEV_CRU] = 0xff760000,
-    [RK3399_DEV_PMU_PMUGRF] = 0xff770000,
-    [RK3399_DEV_UART0] = 0xff180000,
-    [RK3399_DEV_UART1] = 0xff190000,
-    [RK3399_DEV_UART2] = 0xff1a0000,
-    [RK3399_DEV_UART3] = 0xff1b0000,
-    [RK3399_DEV_RKTIMER] = 0xff850000,
-    [RK3399_DEV_GRF] = 0xff770000,
-    [RK3399_DEV_CPU_DEBUG0] = 0xfe430000,
-    [RK3399_DEV_CPU_DEBUG1] = 0xfe432000,
-    [RK3399_DEV_CPU_DEBUG2] = 0xfe434000,
-    [RK3399_DEV_CPU_DEBUG3] = 0xfe436000,
-    [RK3399_DEV_CPU_DEBUG4] = 0xfe610000,
-    [RK3399_DEV_CPU_DEBUG5] = 0xfe710000,
-    [RK3399_DEV_PMU] = 0xff310000,
+const MemMapEntry rockchip_rk3399_memmap[] = {
+    [RK3399_SYSMEM] = { 0, 0 },
+    [RK3399_DEV_GICD] = { 0xfee00000, 0x10000 },
+    [RK3399_DEV_GICR] = { 0xfef00000, 0xc0000 },
+    [RK3399_DEV_GIC_ITS] = { 0xfee20000, 0x20000 },
+    [RK3399_DEV_PMU_CRU] = { 0xff750000, 0x1000 },
+    [RK3399_DEV_CRU] = { 0xff760000, 0x1000 },
+    [RK3399_DEV_PMUGRF] = { 0xff320000, 0x1000 },
+    [RK3399_DEV_UART0] = { 0xff180000, 0x100 },
+    [RK3399_DEV_UART1] = { 0xff190000, 0x100 },
+    [RK3399_DEV_UART2] = { 0xff1a0000, 0x100 },
+    [RK3399_DEV_UART3] = { 0xff1b0000, 0x100 },
+    [RK3399_DEV_RKTIMER0] = { 0xff850000, 0x1000 },
+    [RK3399_DEV_RKTIMER1] = { 0xff858000, 0x1000 },
+    [RK3399_DEV_SDMMC] = { 0xfe320000, 0x4000 },
+    [RK3399_DEV_EMMC] = { 0xfe330000, 0x10000 },
+    [RK3399_DEV_GMAC] = { 0xfe300000, 0x10000 },
+    [RK3399_DEV_DMAC0] = { 0xff6d0000, 0x4000 },
+    [RK3399_DEV_DMAC1] = { 0xff6e0000, 0x4000 },
+    [RK3399_DEV_USB3_0] = { 0xfe800000, 0x100000 },
+    [RK3399_DEV_USB3_1] = { 0xfe900000, 0x100000 },
+    /* Unused on the SoC; size is per transport */
+    [RK3399_DEV_VIRTIO] = { 0xfc000000, 0x200 },
+    [RK3399_DEV_VOPB] = { 0xff900000, 0x2000 },
+    [RK3399_DEV_VOPL] = { 0xff8f0000, 0x2000 },
+    [RK3399_DEV_CRYPTO0] = { 0xff8b0000, 0x4000 },
+    [RK3399_DEV_CRYPTO1] = { 0xff8b8000, 0x4000 },
+    [RK3399_DEV_SPI1] = { 0xff1d0000, 0x1000 },
+    /* The AXI window is split into config, memory and I/O as on vendor DTs */
+    [RK3399_DEV_PCIE_ECAM] = { 0xf8000000, 0x2000000 },
+    [RK3399_DEV_PCIE_MMIO] = { 0xfa000000, 0x1e00000 },
+    [RK3399_DEV_PCIE_PIO] = { 0xfbe00000, 0x100000 },
+    [RK3399_DEV_PCIE_MMIO_HIGH] = { 0x4000000000ULL, 0x4000000000ULL },
+    [RK3399_DEV_PCIE_APB] = { 0xfd000000, 0x1000000 },
+    [RK3399_DEV_GRF] = { 0xff770000, 0x10000 },
+    [RK3399_DEV_CPU_DEBUG0] = { 0xfe430000, 0x1000 },
+    [RK3399_DEV_CPU_DEBUG1] = { 0xfe432000, 0x1000 },
+    [RK3399_DEV_CPU_DEBUG2] = { 0xfe434000, 0x1000 },
+    [RK3399_DEV_CPU_DEBUG3] = { 0xfe436000, 0x1000 },
+    [RK3399_DEV_CPU_DEBUG4] = { 0xfe610000, 0x1000 },
+    [RK3399_DEV_CPU_DEBUG5] = { 0xfe710000, 0x1000 },
+    [RK3399_DEV_PMU] = { 0xff310000, 0x1000 },
+    [RK3399_DEV_TSADC] = { 0xff260000, 0x100 },
+    [RK3399_DEV_SARADC] = { 0xff100000, 0x100 },
 };
 
-static void rockchip_rk3399_init(Object *obj)
+/* GIC SPI numbers */
+static const int rockchip_rk3399_irqmap[] = {
+    [RK3399_DEV_UART0] = 99,
+    [RK3399_DEV_UART1] = 98,
+    [RK3399_DEV_UART2] = 100,
+    [RK3399_DEV_UART3] = 101,
+    /* First of RK3399_TIMER_CHANNELS consecutive lines */
+    [RK3399_DEV_RKTIMER0] = 81,
+    [RK3399_DEV_RKTIMER1] = 87,
+    [RK3399_DEV_SDMMC] = 65,
+    [RK3399_DEV_EMMC] = 11,
+    [RK3399_DEV_GMAC] = 12,
+    /* Event interrupts, followed by the abort interrupt */
+    [RK3399_DEV_DMAC0] = 5,
+    [RK3399_DEV_DMAC1] = 7,
+    [RK3399_DEV_USB3_0] = 105,
+    [RK3399_DEV_USB3_1] = 110,
+    /* First of RK3399_NUM_VIRTIO_TRANSPORTS consecutive lines */
+    [RK3399_DEV_VIRTIO] = 224,
+    [RK3399_DEV_VOPB] = 118,
+    [RK3399_DEV_VOPL] = 119,
+    [RK3399_DEV_CRYPTO0] = 0,
+    [RK3399_DEV_CRYPTO1] = 135,
+    [RK3399_DEV_SPI1] = 53,
+    [RK3399_DEV_TSADC] = 97,
+    [RK3399_DEV_SARADC] = 62,
+    /* INTA to INTD */
+    [RK3399_DEV_PCIE] = 232,
+};
+
+#define RK3399_XIN24M_FREQ 24000000
+
+#define RK3399_NUM_VIRTIO_TRANSPORTS 8
+
+/*
+ * Arasan SDHCI 5.1 eMMC controller: v3 register set, 200MHz base clock,
+ * 8-bit bus, SDMA/ADMA2 with 64-bit addressing, SDR50/SDR104/DDR50 and
+ * the vendor HS400 capability bit.
+ */
+#define RK3399_EMMC_CAPABILITIES 0x80000007156cc8b2ULL
+
+/* Clock IDs of the cluster core clocks in the rk3399-cru binding */
+#define RK3399_CLK_ARMCLKL      8
+#define RK3399_CLK_ARMCLKB      9
+
+/* Operating points of each cluster, in MHz, slowest first */
+static const uint32_t rockchip_rk3399_opps_little[] = {
+    408, 600, 816, 1008, 1200, 1416,
+};
+static const uint32_t rockchip_rk3399_opps_big[] = {
+    408, 600, 816, 1008, 1200, 1416, 1608, 1800,
+};
+
+static const struct {
+    const char *cpu_type;
+    int num_cpus;
+    uint32_t capacity_dmips_mhz;
+    /* Core clock output of the CRU and its ID in the binding */
+    const char *clock;
+    uint32_t clock_id;
+    const uint32_t *opps;
+    int num_opps;
+} rockchip_rk3399_clusters[RK3399_NUM_CLUSTERS] = {
+    [RK3399_CLUSTER_LITTLE] = {
+        ARM_CPU_TYPE_NAME("cortex-a53"), 4, 485,
+        "armclkl", RK3399_CLK_ARMCLKL,
+        rockchip_rk3399_opps_little, ARRAY_SIZE(rockchip_rk3399_opps_little),
+    },
+    [RK3399_CLUSTER_BIG] = {
+        ARM_CPU_TYPE_NAME("cortex-a72"), 2, 1024,
+        "armclkb", RK3399_CLK_ARMCLKB,
+        rockchip_rk3399_opps_big, ARRAY_SIZE(rockchip_rk3399_opps_big),
+    },
+};
+
+/* Map a linear CPU index to its cluster and its core number within it */
+static int rockchip_rk3399_cpu_cluster(int n, int *core)
+{
+    int cluster;
+
+    for (cluster = 0; cluster < RK3399_NUM_CLUSTERS - 1; cluster++) {
+        if (n < rockchip_rk3399_clusters[cluster].num_cpus) {
+            break;
+        }
+        n -= rockchip_rk3399_clusters[cluster].num_cpus;
+    }
+    *core = n;
+    return cluster;
+}
+
+/*
+ * Machine init is broken down into stages for the
+ * rockchip_rk3399_init_stage trace event; each reports the host time
+ * since the previous one.  Together with loader_write_rom for the images
+ * arm_load_kernel() queues, -trace 'rockchip_rk3399_init_*' gives where
+ * startup time goes.
+ */
+static void rockchip_rk3399_init_stage(RK3399State *s, const char *stage)
+{
+    int64_t now = get_clock();
+
+    trace_rockchip_rk3399_init_stage(stage,
+                                     (now - s->init_stage_ns) / SCALE_US);
+    s->init_stage_ns = now;
+}
+
+static void create_fdt(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    void *fdt = create_device_tree(&s->fdt_size);
+
+    if (!fdt) {
+        error_report("create_device_tree() failed");
+        exit(1);
+    }
+
+    ms->fdt = fdt;
+
+    qemu_fdt_setprop_string(fdt, "/", "compatible", "rockchip,rk3399");
+    qemu_fdt_setprop_string(fdt, "/", "model", "Rockchip RK3399");
+    qemu_fdt_setprop_cell(fdt, "/", "#address-cells", 0x2);
+    qemu_fdt_setprop_cell(fdt, "/", "#size-cells", 0x2);
+
+    /* /chosen must exist for load_dtb to fill in necessary properties later */
+    qemu_fdt_add_subnode(fdt, "/chosen");
+    qemu_fdt_add_subnode(fdt, "/aliases");
+
+    /* The 24MHz crystal feeding the CRU, the UARTs and the timers */
+    s->clock_phandle = qemu_fdt_alloc_phandle(fdt);
+    qemu_fdt_add_subnode(fdt, "/xin24m");
+    qemu_fdt_setprop_string(fdt, "/xin24m", "compatible", "fixed-clock");
+    qemu_fdt_setprop_cell(fdt, "/xin24m", "#clock-cells", 0x0);
+    qemu_fdt_setprop_cell(fdt, "/xin24m", "clock-frequency",
+                          RK3399_XIN24M_FREQ);
+    qemu_fdt_setprop_string(fdt, "/xin24m", "clock-output-names", "xin24m");
+    qemu_fdt_setprop_cell(fdt, "/xin24m", "phandle", s->clock_phandle);
+
+    /* The CPU nodes refer to the CRU before it is created */
+    s->cru_phandle = qemu_fdt_alloc_phandle(fdt);
+}
+
+/*
+ * The operating points of a cluster, shared by its cores.  The OPPs carry
+ * no voltages; there is no PMIC for cpufreq-dt to program.
+ */
+static uint32_t fdt_add_opp_table(RK3399State *s, int cluster)
+{
+    MachineState *ms = MACHINE(s);
+    char *nodename = g_strdup_printf("/opp-table-%d", cluster);
+    uint32_t phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    int i;
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "operating-points-v2");
+    qemu_fdt_setprop(ms->fdt, nodename, "opp-shared", NULL, 0);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", phandle);
+
+    for (i = 0; i < rockchip_rk3399_clusters[cluster].num_opps; i++) {
+        uint32_t mhz = rockchip_rk3399_clusters[cluster].opps[i];
+        char *opp = g_strdup_printf("%s/opp-%u", nodename, mhz);
+
+        qemu_fdt_add_subnode(ms->fdt, opp);
+        qemu_fdt_setprop_u64(ms->fdt, opp, "opp-hz", mhz * 1000000ULL);
+        g_free(opp);
+    }
+    g_free(nodename);
+    return phandle;
+}
+
+static void fdt_add_cpu_nodes(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    int smp_cpus = ms->smp.cpus;
+    int cpu, cluster, core;
+    uint32_t opp_phandle[RK3399_NUM_CLUSTERS];
+
+    for (cluster = 0; cluster < RK3399_NUM_CLUSTERS; cluster++) {
+        opp_phandle[cluster] = fdt_add_opp_table(s, cluster);
+    }
+
+    qemu_fdt_add_subnode(ms->fdt, "/cpus");
+    qemu_fdt_setprop_cell(ms->fdt, "/cpus", "#address-cells", 1);
+    qemu_fdt_setprop_cell(ms->fdt, "/cpus", "#size-cells", 0x0);
+
+    for (cpu = smp_cpus - 1; cpu >= 0; cpu--) {
+        ARMCPU *armcpu = ARM_CPU(qemu_get_cpu(cpu));
+        uint64_t mpidr = arm_cpu_mp_affinity(armcpu);
+        char *nodename = g_strdup_printf("/cpus/cpu@%" PRIx64, mpidr);
+
+        cluster = rockchip_rk3399_cpu_cluster(cpu, &core);
+
+        qemu_fdt_add_subnode(ms->fdt, nodename);
+        qemu_fdt_setprop_string(ms->fdt, nodename, "device_type", "cpu");
+        qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                                armcpu->dtb_compatible);
+        if (smp_cpus > 1) {
+            qemu_fdt_setprop_string(ms->fdt, nodename,
+                                    "enable-method", "psci");
+        }
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "reg", mpidr);
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "capacity-dmips-mhz",
+            rockchip_rk3399_clusters[cluster].capacity_dmips_mhz);
+        qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks", s->cru_phandle,
+                               rockchip_rk3399_clusters[cluster].clock_id);
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "operating-points-v2",
+                              opp_phandle[cluster]);
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "#cooling-cells", 2);
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle",
+                              qemu_fdt_alloc_phandle(ms->fdt));
+        g_free(nodename);
+    }
+
+    /*
+     * Describe the two clusters through cpu-map so that the guest
+     * scheduler knows which cores share a cluster (and an L2 cache).
+     * See Linux Documentation/devicetree/bindings/cpu/cpu-topology.txt
+     */
+    qemu_fdt_add_subnode(ms->fdt, "/cpus/cpu-map");
+
+    for (cpu = smp_cpus - 1; cpu >= 0; cpu--) {
+        ARMCPU *armcpu = ARM_CPU(qemu_get_cpu(cpu));
+        char *cpu_path = g_strdup_printf("/cpus/cpu@%" PRIx64,
+                                         arm_cpu_mp_affinity(armcpu));
+        char *map_path;
+
+        cluster = rockchip_rk3399_cpu_cluster(cpu, &core);
+        map_path = g_strdup_printf("/cpus/cpu-map/cluster%d/core%d",
+                                   cluster, core);
+        qemu_fdt_add_path(ms->fdt, map_path);
+        qemu_fdt_setprop_phandle(ms->fdt, map_path, "cpu", cpu_path);
+
+        g_free(map_path);
+        g_free(cpu_path);
+    }
+}
+
+static void rockchip_rk3399_set_cpu_affinity(RK3399State *s, CPUState *cs,
+                                             int cluster)
+{
+    uint16List *l, *host_cpus = s->cluster_host_cpus[cluster];
+    unsigned long *bitmap;
+    int nbits = 0, ret;
+
+    if (!host_cpus) {
+        return;
+    }
+    if (!qemu_tcg_mttcg_enabled()) {
+        warn_report_once("rockchip-rk3399: cluster host CPU affinity "
+                         "requires multi-threaded TCG, ignoring");
+        return;
+    }
+
+    for (l = host_cpus; l; l = l->next) {
+        nbits = MAX(nbits, l->value + 1);
+    }
+    bitmap = bitmap_new(nbits);
+    for (l = host_cpus; l; l = l->next) {
+        set_bit(l->value, bitmap);
+    }
+
+    ret = qemu_thread_set_affinity(cs->thread, bitmap, nbits);
+    if (ret) {
+        warn_report("rockchip-rk3399: setting affinity of CPU %d failed: %s",
+                    cs->cpu_index, strerror(ret));
+    }
+    g_free(bitmap);
+}
+
+/*
+ * TCG runs a vCPU as fast as the host lets it, whatever the core clock the
+ * guest programs into the CRU.  With cpu-freq-scaling=on, the vCPUs of a
+ * cluster clocked below its top operating point sleep for a matching share
+ * of every time slice, as system/cpu-throttle.c slows all vCPUs down during
+ * migration.  icount would scale the instruction rate exactly, but its
+ * shift applies to every vCPU alike.  Single-threaded TCG runs both
+ * clusters on one thread, so the throttle needs MTTCG.
+ */
+#define RK3399_THROTTLE_TIMESLICE_NS    (10 * SCALE_MS)
+#define RK3399_THROTTLE_PCT_MAX         99
+
+static void rockchip_rk3399_throttle_vcpu(CPUState *cs, run_on_cpu_data data)
 {
-    // RK3399State *s = ROCKCHIP_RK3399(obj);
-    printf("rockchip_rk3399_init\n");
+    RK3399ClusterClock *cc = data.host_ptr;
+    int pct = qatomic_read(&cc->throttle_pct);
+    int64_t sleep_ns, end_ns;
+
+    sleep_ns = RK3399_THROTTLE_TIMESLICE_NS * pct / (100 - pct);
+    end_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleep_ns;
+    while (sleep_ns > 0 && !cs->stop) {
+        if (sleep_ns > SCALE_MS) {
+            qemu_cond_timedwait_bql(cs->halt_cond, sleep_ns / SCALE_MS);
+        } else {
+            bql_unlock();
+            g_usleep(sleep_ns / SCALE_US);
+            bql_lock();
+        }
+        sleep_ns = end_ns - qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+    qatomic_set(&cc->s->throttle_scheduled[cs->cpu_index], false);
+}
+
+static void rockchip_rk3399_throttle_tick(void *opaque)
+{
+    RK3399ClusterClock *cc = opaque;
+    int pct = qatomic_read(&cc->throttle_pct);
+    CPUState *cs;
+    int core;
+
+    if (!pct) {
+        return;
+    }
+
+    CPU_FOREACH(cs) {
+        if (rockchip_rk3399_cpu_cluster(cs->cpu_index, &core) == cc->cluster &&
+            !qatomic_xchg(&cc->s->throttle_scheduled[cs->cpu_index], true)) {
+            async_run_on_cpu(cs, rockchip_rk3399_throttle_vcpu,
+                             RUN_ON_CPU_HOST_PTR(cc));
+        }
+    }
+
+    timer_mod(cc->throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+              RK3399_THROTTLE_TIMESLICE_NS * 100 / (100 - pct));
+}
+
+static void rockchip_rk3399_cluster_clock_update(void *opaque,
+                                                 ClockEvent event)
+{
+    RK3399ClusterClock *cc = opaque;
+    int cluster = cc->cluster;
+    int top_opp = rockchip_rk3399_clusters[cluster].num_opps - 1;
+    uint64_t max_hz = rockchip_rk3399_clusters[cluster].opps[top_opp] *
+                      1000000ULL;
+    uint64_t hz = CLOCK_PERIOD_TO_HZ(clock_get(cc->clk));
+    int pct = 0;
+
+    if (hz < max_hz) {
+        pct = MIN((max_hz - hz) * 100 / max_hz, RK3399_THROTTLE_PCT_MAX);
+    }
+    trace_rockchip_rk3399_cluster_clock(cluster, hz, pct);
+
+    if (!cc->throttle_timer) {
+        return;
+    }
+    if (pct && !qatomic_read(&cc->throttle_pct)) {
+        timer_mod(cc->throttle_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                  RK3399_THROTTLE_TIMESLICE_NS);
+    }
+    qatomic_set(&cc->throttle_pct, pct);
+}
+
+static void rockchip_rk3399_init_cluster_clocks(RK3399State *s)
+{
+    bool throttle = s->cpu_freq_scaling;
+    int cluster;
+
+    if (throttle && !qemu_tcg_mttcg_enabled()) {
+        warn_report("rockchip-rk3399: cpu-freq-scaling requires "
+                    "multi-threaded TCG, ignoring");
+        throttle = false;
+    }
+
+    for (cluster = 0; cluster < RK3399_NUM_CLUSTERS; cluster++) {
+        RK3399ClusterClock *cc = &s->cluster_clock[cluster];
+        const char *name = rockchip_rk3399_clusters[cluster].clock;
+
+        cc->s = s;
+        cc->cluster = cluster;
+        cc->clk = clock_new(OBJECT(s), name);
+        clock_set_callback(cc->clk, rockchip_rk3399_cluster_clock_update, cc,
+                           ClockUpdate);
+        clock_set_source(cc->clk, qdev_get_clock_out(s->cru, name));
+        if (throttle) {
+            cc->throttle_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
+                                              rockchip_rk3399_throttle_tick,
+                                              cc);
+        }
+        rockchip_rk3399_cluster_clock_update(cc, ClockUpdate);
+    }
+}
+
+static void fdt_add_timer_nodes(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    const char compat[] = "arm,armv8-timer";
+    uint32_t irqflags = GIC_FDT_IRQ_FLAGS_LEVEL_HI;
+
+    qemu_fdt_add_subnode(ms->fdt, "/timer");
+    qemu_fdt_setprop(ms->fdt, "/timer", "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop(ms->fdt, "/timer", "always-on", NULL, 0);
+    qemu_fdt_setprop_cells(ms->fdt, "/timer", "interrupts",
+                           GIC_FDT_IRQ_TYPE_PPI,
+                           INTID_TO_PPI(ARCH_TIMER_S_EL1_IRQ), irqflags,
+                           GIC_FDT_IRQ_TYPE_PPI,
+                           INTID_TO_PPI(ARCH_TIMER_NS_EL1_IRQ), irqflags,
+                           GIC_FDT_IRQ_TYPE_PPI,
+                           INTID_TO_PPI(ARCH_TIMER_VIRT_IRQ), irqflags,
+                           GIC_FDT_IRQ_TYPE_PPI,
+                           INTID_TO_PPI(ARCH_TIMER_NS_EL2_IRQ), irqflags);
+}
+
+static void fdt_add_pmu_nodes(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    ARMCPU *armcpu = ARM_CPU(first_cpu);
+    const char compat[] = "arm,armv8-pmuv3";
+
+    if (!arm_feature(&armcpu->env, ARM_FEATURE_PMU)) {
+        return;
+    }
+
+    qemu_fdt_add_subnode(ms->fdt, "/pmu");
+    qemu_fdt_setprop(ms->fdt, "/pmu", "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_cells(ms->fdt, "/pmu", "interrupts",
+                           GIC_FDT_IRQ_TYPE_PPI,
+                           INTID_TO_PPI(VIRTUAL_PMU_IRQ),
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+}
+
+static void fdt_add_cru_node(RK3399State *s, int cru, const char *compat)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[cru].base;
+    char *nodename = g_strdup_printf("/clock-controller@%" PRIx64, base);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible", compat);
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[cru].size);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#clock-cells", 1);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#reset-cells", 1);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks", s->clock_phandle);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "clock-names", "xin24m");
+    if (cru == RK3399_DEV_CRU) {
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", s->cru_phandle);
+    }
+    g_free(nodename);
+}
+
+static void create_uart(RK3399State *s, int uart, Chardev *chr)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[uart].base;
+    int irq = rockchip_rk3399_irqmap[uart];
+    char *nodename = g_strdup_printf("/serial@%" PRIx64, base);
+    char *alias = g_strdup_printf("serial%d", uart - RK3399_DEV_UART0);
+    const char compat[] = "rockchip,rk3399-uart\0snps,dw-apb-uart";
+
+    dw_apb_uart_create(base, qdev_get_gpio_in(s->gic, irq),
+                       RK3399_XIN24M_FREQ / 16, chr);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop(ms->fdt, nodename, "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[uart].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "reg-shift", 2);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "reg-io-width", 4);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "clock-frequency",
+                          RK3399_XIN24M_FREQ);
+    qemu_fdt_setprop_string(ms->fdt, "/aliases", alias, nodename);
+
+    if (uart == RK3399_DEV_UART2) {
+        qemu_fdt_setprop_string(ms->fdt, "/chosen", "stdout-path", nodename);
+    }
+
+    g_free(alias);
+    g_free(nodename);
+}
+
+static void create_rktimer(RK3399State *s, int timer)
+{
+    MachineState *ms = MACHINE(s);
+    int n = timer - RK3399_DEV_RKTIMER0;
+    hwaddr base = rockchip_rk3399_memmap[timer].base;
+    int irq = rockchip_rk3399_irqmap[timer];
+    char *nodename = g_strdup_printf("/timer@%" PRIx64, base);
+    int i;
+
+    s->rktimer[n] = qdev_new(TYPE_RK3399_TIMER);
+    qdev_prop_set_uint32(s->rktimer[n], "clock-frequency", RK3399_XIN24M_FREQ);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->rktimer[n]), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->rktimer[n]), 0, base);
+    for (i = 0; i < RK3399_TIMER_CHANNELS; i++) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(s->rktimer[n]), i,
+                           qdev_get_gpio_in(s->gic, irq + i));
+    }
+
+    /* Linux only drives the first channel of a block as a clockevent */
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "rockchip,rk3399-timer");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[timer].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     "pclk\0timer", sizeof("pclk\0timer"));
+    g_free(nodename);
+}
+
+static void create_sdmmc(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_SDMMC].base;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_SDMMC];
+    char *nodename = g_strdup_printf("/mmc@%" PRIx64, base);
+    const char compat[] = "rockchip,rk3399-dw-mshc\0rockchip,rk3288-dw-mshc";
+    const char clock_names[] = "biu\0ciu";
+    DriveInfo *di = drive_get(IF_SD, 0, 0);
+    DeviceState *card;
+
+    s->sdmmc = qdev_new(TYPE_DW_MMC);
+    object_property_set_link(OBJECT(s->sdmmc), "dma-memory",
+                             OBJECT(get_system_memory()), &error_fatal);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->sdmmc), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->sdmmc), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->sdmmc), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+
+    /* SD card slot, -drive if=sd,index=0 */
+    card = qdev_new(TYPE_SD_CARD);
+    qdev_prop_set_drive_err(card, "drive", di ? blk_by_legacy_dinfo(di) : NULL,
+                            &error_fatal);
+    qdev_realize_and_unref(card, qdev_get_child_bus(s->sdmmc, "sd-bus"),
+                           &error_fatal);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop(ms->fdt, nodename, "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_SDMMC].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "fifo-depth", DW_MMC_FIFO_DEPTH);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "max-frequency", 150000000);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "bus-width", 4);
+    qemu_fdt_setprop(ms->fdt, nodename, "cap-sd-highspeed", NULL, 0);
+    qemu_fdt_setprop(ms->fdt, nodename, "disable-wp", NULL, 0);
+    g_free(nodename);
+}
+
+/*
+ * The GRF and PMUGRF keep their registers in RAM; only the banks with
+ * side effects or masked writes trap into the device.
+ */
+static void create_grf(RK3399State *s, int dev)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[dev].base;
+    char *nodename = g_strdup_printf("/syscon@%" PRIx64, base);
+    const char grf_compat[] = "rockchip,rk3399-grf\0syscon\0simple-mfd";
+    const char pmugrf_compat[] = "rockchip,rk3399-pmugrf\0syscon\0simple-mfd";
+    DeviceState *grf;
+
+    if (dev == RK3399_DEV_GRF) {
+        grf = s->grf = qdev_new(TYPE_RK3399_GRF);
+        object_property_add_child(OBJECT(s), "grf", OBJECT(grf));
+    } else {
+        grf = s->pmugrf = qdev_new(TYPE_RK3399_PMUGRF);
+        object_property_add_child(OBJECT(s), "pmugrf", OBJECT(grf));
+    }
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(grf), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(grf), 0, base);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    if (dev == RK3399_DEV_GRF) {
+        qemu_fdt_setprop(ms->fdt, nodename, "compatible",
+                         grf_compat, sizeof(grf_compat));
+    } else {
+        qemu_fdt_setprop(ms->fdt, nodename, "compatible",
+                         pmugrf_compat, sizeof(pmugrf_compat));
+    }
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[dev].size);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#address-cells", 1);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#size-cells", 1);
+    if (dev == RK3399_DEV_GRF) {
+        s->grf_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", s->grf_phandle);
+    }
+    g_free(nodename);
+}
+
+/*
+ * The PMU parks cores switched off through it as PSCI CPU_OFF does; the
+ * power domain controller under it is left out, so every domain stays on.
+ */
+static void create_pmu(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_PMU].base;
+    char *nodename = g_strdup_printf("/power-management@%" PRIx64, base);
+    const char compat[] = "rockchip,rk3399-pmu\0syscon\0simple-mfd";
+
+    s->pmu = qdev_new(TYPE_RK3399_PMU);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->pmu), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->pmu), 0, base);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop(ms->fdt, nodename, "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_PMU].size);
+    g_free(nodename);
+}
+
+static void create_emmc(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_EMMC].base;
+    hwaddr grf = rockchip_rk3399_memmap[RK3399_DEV_GRF].base;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_EMMC];
+    char *nodename = g_strdup_printf("/mmc@%" PRIx64, base);
+    char *grfname = g_strdup_printf("/syscon@%" PRIx64, grf);
+    char *phyname = g_strdup_printf("%s/phy@%x", grfname,
+                                    RK3399_EMMC_PHY_GRF_OFFSET);
+    const char compat[] = "rockchip,rk3399-sdhci-5.1\0arasan,sdhci-5.1";
+    const char clock_names[] = "clk_xin\0clk_ahb";
+    uint32_t emmc_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    uint32_t phy_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    DriveInfo *di = drive_get(IF_SD, 0, 1);
+    DeviceState *card;
+
+    /* The PHY is controlled through a few GRF registers, above the GRF */
+    s->emmc_phy = qdev_new(TYPE_RK3399_EMMC_PHY);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->emmc_phy), &error_fatal);
+    sysbus_mmio_map_overlap(SYS_BUS_DEVICE(s->emmc_phy), 0,
+                            grf + RK3399_EMMC_PHY_GRF_OFFSET, 1);
+
+    s->emmc = qdev_new(TYPE_SYSBUS_SDHCI);
+    qdev_prop_set_uint8(s->emmc, "sd-spec-version", 3);
+    qdev_prop_set_uint64(s->emmc, "capareg", RK3399_EMMC_CAPABILITIES);
+    qdev_prop_set_bit(s->emmc, "adma-coalesce", true);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->emmc), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->emmc), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->emmc), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+    /* Command queueing engine and vendor registers above the SDHCI ones */
+    create_unimplemented_device("emmc", base,
+                                rockchip_rk3399_memmap[RK3399_DEV_EMMC].size);
+
+    /* Soldered-down eMMC, -drive if=sd,index=1 */
+    card = qdev_new(TYPE_EMMC);
+    qdev_prop_set_drive_err(card, "drive", di ? blk_by_legacy_dinfo(di) : NULL,
+                            &error_fatal);
+    qdev_realize_and_unref(card, qdev_get_child_bus(s->emmc, "sd-bus"),
+                           &error_fatal);
+
+    qemu_fdt_add_subnode(ms->fdt, phyname);
+    qemu_fdt_setprop_string(ms->fdt, phyname, "compatible",
+                            "rockchip,rk3399-emmc-phy");
+    qemu_fdt_setprop_cells(ms->fdt, phyname, "reg",
+                           RK3399_EMMC_PHY_GRF_OFFSET, RK3399_EMMC_PHY_IOSIZE);
+    qemu_fdt_setprop_cell(ms->fdt, phyname, "clocks", emmc_phandle);
+    qemu_fdt_setprop_string(ms->fdt, phyname, "clock-names", "emmcclk");
+    qemu_fdt_setprop_cell(ms->fdt, phyname, "#phy-cells", 0);
+    qemu_fdt_setprop_cell(ms->fdt, phyname, "phandle", phy_phandle);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop(ms->fdt, nodename, "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_EMMC].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#clock-cells", 0);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "clock-output-names",
+                            "emmc_cardclock");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phys", phy_phandle);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "phy-names", "phy_arasan");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "bus-width", 8);
+    qemu_fdt_setprop(ms->fdt, nodename, "mmc-hs200-1_8v", NULL, 0);
+    qemu_fdt_setprop(ms->fdt, nodename, "mmc-hs400-1_8v", NULL, 0);
+    qemu_fdt_setprop(ms->fdt, nodename, "non-removable", NULL, 0);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", emmc_phandle);
+    g_free(phyname);
+    g_free(grfname);
+    g_free(nodename);
+}
+
+static void create_gmac(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_GMAC].base;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_GMAC];
+    char *nodename = g_strdup_printf("/ethernet@%" PRIx64, base);
+    char *mdioname = g_strdup_printf("%s/mdio", nodename);
+    char *phyname = g_strdup_printf("%s/ethernet-phy@0", mdioname);
+    const char clock_names[] = "stmmaceth\0mac_clk_rx\0mac_clk_tx\0"
+                               "clk_mac_ref\0clk_mac_refout\0aclk_mac\0pclk_mac";
+    uint32_t phy_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    const MACAddr *mac;
+
+    s->gmac = qdev_new(TYPE_DW_GMAC);
+    qemu_configure_nic_device(s->gmac, true, NULL);
+    object_property_set_link(OBJECT(s->gmac), "dma-memory",
+                             OBJECT(get_system_memory()), &error_fatal);
+    qdev_prop_set_uint32(s->gmac, "clock-frequency", RK3399_XIN24M_FREQ);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->gmac), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->gmac), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->gmac), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+    mac = &DW_GMAC(s->gmac)->conf.macaddr;
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "rockchip,rk3399-gmac");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GMAC].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "interrupt-names", "macirq");
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle,
+                           s->clock_phandle, s->clock_phandle,
+                           s->clock_phandle, s->clock_phandle,
+                           s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    /* The RGMII clocks come from the PHY, nothing to reprogram */
+    qemu_fdt_setprop_string(ms->fdt, nodename, "clock_in_out", "input");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "rockchip,grf", s->grf_phandle);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "phy-mode", "rgmii");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phy-handle", phy_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "local-mac-address",
+                     mac->a, sizeof(mac->a));
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "snps,txpbl", 4);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "snps,rxpbl", 4);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "tx-fifo-depth", 2048);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "rx-fifo-depth", 4096);
+
+    qemu_fdt_add_subnode(ms->fdt, mdioname);
+    qemu_fdt_setprop_string(ms->fdt, mdioname, "compatible",
+                            "snps,dwmac-mdio");
+    qemu_fdt_setprop_cell(ms->fdt, mdioname, "#address-cells", 1);
+    qemu_fdt_setprop_cell(ms->fdt, mdioname, "#size-cells", 0);
+
+    qemu_fdt_add_subnode(ms->fdt, phyname);
+    qemu_fdt_setprop_cell(ms->fdt, phyname, "reg", 0);
+    qemu_fdt_setprop_cell(ms->fdt, phyname, "phandle", phy_phandle);
+    g_free(phyname);
+    g_free(mdioname);
+    g_free(nodename);
+}
+
+/*
+ * The two PL330s differ in their channel, request line and event counts.
+ * DMAC0 (dmac_bus) takes the I2S0-2 requests on lines 0-5, SPDIF on 7 and
+ * SPI5 on 8-9; DMAC1 (dmac_peri) the UARTs and SPI0-4, SPIn on 10 + 2n.
+ * Of the peripherals modelled so far only SPI1 uses its request lines.
+ */
+static const struct {
+    uint32_t num_chnls;
+    uint32_t num_periph_req;
+    uint32_t num_events;
+} rockchip_rk3399_dmac_cfg[] = {
+    { 6, 12, 12 },
+    { 8, 20, 16 },
+};
+
+static void create_dmac(RK3399State *s, int n)
+{
+    MachineState *ms = MACHINE(s);
+    int dev = RK3399_DEV_DMAC0 + n;
+    hwaddr base = rockchip_rk3399_memmap[dev].base;
+    int irq = rockchip_rk3399_irqmap[dev];
+    uint32_t num_events = rockchip_rk3399_dmac_cfg[n].num_events;
+    char *nodename = g_strdup_printf("/dma-controller@%" PRIx64, base);
+    const char compat[] = "arm,pl330\0arm,primecell";
+    DeviceState *orgate;
+    SysBusDevice *busdev;
+    int i;
+
+    s->dmac[n] = qdev_new("pl330");
+    busdev = SYS_BUS_DEVICE(s->dmac[n]);
+    object_property_set_link(OBJECT(s->dmac[n]), "memory",
+                             OBJECT(get_system_memory()), &error_fatal);
+    qdev_prop_set_uint8(s->dmac[n], "num_chnls",
+                        rockchip_rk3399_dmac_cfg[n].num_chnls);
+    qdev_prop_set_uint8(s->dmac[n], "num_periph_req",
+                        rockchip_rk3399_dmac_cfg[n].num_periph_req);
+    qdev_prop_set_uint8(s->dmac[n], "num_events", num_events);
+    sysbus_realize_and_unref(busdev, &error_fatal);
+    sysbus_mmio_map(busdev, 0, base);
+    /* Registers are decoded in the first 4K and not aliased above */
+    create_unimplemented_device(n ? "dmac1" : "dmac0",
+                                base, rockchip_rk3399_memmap[dev].size);
+
+    /* All event lines share one SPI, the abort line has its own */
+    orgate = qdev_new(TYPE_OR_IRQ);
+    object_property_set_int(OBJECT(orgate), "num-lines", num_events,
+                            &error_fatal);
+    qdev_realize_and_unref(orgate, NULL, &error_fatal);
+    qdev_connect_gpio_out(orgate, 0, qdev_get_gpio_in(s->gic, irq));
+    for (i = 0; i < num_events; i++) {
+        sysbus_connect_irq(busdev, i + 1, qdev_get_gpio_in(orgate, i));
+    }
+    sysbus_connect_irq(busdev, 0, qdev_get_gpio_in(s->gic, irq + 1));
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop(ms->fdt, nodename, "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[dev].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI,
+                           GIC_FDT_IRQ_TYPE_SPI, irq + 1,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    /*
+     * The AMBA bus probes the ID registers at the end of "reg", which
+     * the 16K window does not alias; spell out the PL330 r1p1 ID.
+     */
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "arm,primecell-periphid",
+                          0x00241330);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#dma-cells", 1);
+    s->dmac_phandle[n] = qemu_fdt_alloc_phandle(ms->fdt);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", s->dmac_phandle[n]);
+    qemu_fdt_setprop(ms->fdt, nodename, "arm,pl330-periph-burst", NULL, 0);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "clocks", s->clock_phandle);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "clock-names", "apb_pclk");
+    g_free(nodename);
+}
+
+/*
+ * The two USB 3.0 OTG controllers, as xHCI hosts with one USB 2.0 and one
+ * USB 3.0 port each.  Interrupt moderation lets one interrupt cover all
+ * transfers that complete within the interval the driver programs.
+ */
+static void create_usb(RK3399State *s, int n)
+{
+    MachineState *ms = MACHINE(s);
+    int dev = RK3399_DEV_USB3_0 + n;
+    hwaddr base = rockchip_rk3399_memmap[dev].base;
+    int irq = rockchip_rk3399_irqmap[dev];
+    char *nodename = g_strdup_printf("/usb@%" PRIx64, base);
+    DeviceState *xhci;
+
+    s->usb[n] = qdev_new(TYPE_USB_DWC3);
+    object_property_add_child(OBJECT(s), "usb[*]", OBJECT(s->usb[n]));
+    xhci = DEVICE(&USB_DWC3(s->usb[n])->sysbus_xhci);
+    qdev_prop_set_uint32(xhci, "intrs", 1);
+    qdev_prop_set_uint32(xhci, "p2", 1);
+    qdev_prop_set_uint32(xhci, "p3", 1);
+    qdev_prop_set_bit(xhci, "imod", true);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->usb[n]), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->usb[n]), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(xhci), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+    /* Device mode and the rest of the window */
+    create_unimplemented_device(n ? "usb3-1" : "usb3-0",
+                                base, rockchip_rk3399_memmap[dev].size);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible", "snps,dwc3");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[dev].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "dr_mode", "host");
+    qemu_fdt_setprop_string(ms->fdt, nodename, "maximum-speed", "super-speed");
+    qemu_fdt_setprop(ms->fdt, nodename, "snps,dis_u2_susphy_quirk", NULL, 0);
+    g_free(nodename);
+}
+
+/*
+ * VOP big drives the first graphic console.  The output ports are not
+ * modelled, so the nodes carry no port graph.
+ */
+static void create_vop(RK3399State *s, int n)
+{
+    MachineState *ms = MACHINE(s);
+    int dev = RK3399_DEV_VOPB + n;
+    hwaddr base = rockchip_rk3399_memmap[dev].base;
+    int irq = rockchip_rk3399_irqmap[dev];
+    char *nodename = g_strdup_printf("/vop@%" PRIx64, base);
+    const char clock_names[] = "aclk_vop\0dclk_vop\0hclk_vop";
+
+    s->vop[n] = qdev_new(TYPE_RK3399_VOP);
+    object_property_set_link(OBJECT(s->vop[n]), "dma-memory",
+                             OBJECT(get_system_memory()), &error_fatal);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->vop[n]), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->vop[n]), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->vop[n]), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            n ? "rockchip,rk3399-vop-lit"
+                              : "rockchip,rk3399-vop-big");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[dev].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle,
+                           s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    g_free(nodename);
+}
+
+/*
+ * The two crypto engines, each its own instance of the block the
+ * rk3288-crypto driver knows.  The driver insists on a reset line; the CRU
+ * model does not act on soft resets, so they only need to name one of
+ * the crypto lines of SOFTRST_CON.
+ */
+static void create_crypto(RK3399State *s, int n)
+{
+    MachineState *ms = MACHINE(s);
+    int dev = RK3399_DEV_CRYPTO0 + n;
+    hwaddr base = rockchip_rk3399_memmap[dev].base;
+    int irq = rockchip_rk3399_irqmap[dev];
+    char *nodename = g_strdup_printf("/crypto@%" PRIx64, base);
+    const char clock_names[] = "aclk\0hclk\0sclk\0apb_pclk";
+    static const uint32_t srst[] = { 174, 178 };
+
+    s->crypto[n] = qdev_new(TYPE_RK3399_CRYPTO);
+    object_property_set_link(OBJECT(s->crypto[n]), "dma-memory",
+                             OBJECT(get_system_memory()), &error_fatal);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->crypto[n]), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->crypto[n]), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->crypto[n]), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "rockchip,rk3288-crypto");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[dev].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle,
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "resets",
+                           s->cru_phandle, srst[n]);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "reset-names", "crypto-rst");
+    g_free(nodename);
+}
+
+/*
+ * SPI1 with a 16MiB SPI NOR flash on chip select 0, -drive if=mtd,index=0.
+ * The flash model holds the whole image in memory, so reads through the
+ * FIFO never wait on the block layer.
+ */
+#define RK3399_SPI1_DMA_TX      12
+#define RK3399_SPI1_DMA_RX      13
+
+static void create_spi(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_SPI1].base;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_SPI1];
+    char *nodename = g_strdup_printf("/spi@%" PRIx64, base);
+    char *flashname = g_strdup_printf("%s/flash@0", nodename);
+    const char compat[] = "rockchip,rk3399-spi\0rockchip,rk3066-spi";
+    const char clock_names[] = "spiclk\0apb_pclk";
+    const char dma_names[] = "tx\0rx";
+    DriveInfo *di = drive_get(IF_MTD, 0, 0);
+    DeviceState *flash;
+    SSIBus *bus;
+
+    s->spi1 = qdev_new(TYPE_RK3399_SPI);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->spi1), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->spi1), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->spi1), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+    qdev_connect_gpio_out_named(s->spi1, "dma-busy", RK3399_SPI_DMA_TX,
+                                qdev_get_gpio_in(s->dmac[1],
+                                                 RK3399_SPI1_DMA_TX));
+    qdev_connect_gpio_out_named(s->spi1, "dma-busy", RK3399_SPI_DMA_RX,
+                                qdev_get_gpio_in(s->dmac[1],
+                                                 RK3399_SPI1_DMA_RX));
+
+    bus = (SSIBus *)qdev_get_child_bus(s->spi1, "spi");
+    flash = qdev_new("n25q128a13");
+    qdev_prop_set_drive_err(flash, "drive", di ? blk_by_legacy_dinfo(di) : NULL,
+                            &error_fatal);
+    qdev_realize_and_unref(flash, BUS(bus), &error_fatal);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->spi1), 1,
+                       qdev_get_gpio_in_named(flash, SSI_GPIO_CS, 0));
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop(ms->fdt, nodename, "compatible", compat, sizeof(compat));
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_SPI1].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "dmas",
+                           s->dmac_phandle[1], RK3399_SPI1_DMA_TX,
+                           s->dmac_phandle[1], RK3399_SPI1_DMA_RX);
+    qemu_fdt_setprop(ms->fdt, nodename, "dma-names",
+                     dma_names, sizeof(dma_names));
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#address-cells", 1);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#size-cells", 0);
+
+    qemu_fdt_add_subnode(ms->fdt, flashname);
+    qemu_fdt_setprop_string(ms->fdt, flashname, "compatible", "jedec,spi-nor");
+    qemu_fdt_setprop_cell(ms->fdt, flashname, "reg", 0);
+    qemu_fdt_setprop_cell(ms->fdt, flashname, "spi-max-frequency", 12000000);
+    g_free(flashname);
+    g_free(nodename);
+}
+
+/*
+ * The TSADC feeds the CPU and GPU thermal zones.  An over-temperature
+ * shutdown resets the SoC through the CRU, since the TSHUT pin is not
+ * wired to anything.  The driver insists on a reset line; the CRU model
+ * does not act on soft resets, so it only needs to name one.
+ */
+#define RK3399_TSHUT_TEMP       95000
+#define THERMAL_NO_LIMIT        0xffffffff
+
+static void create_tsadc(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_TSADC].base;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_TSADC];
+    char *nodename = g_strdup_printf("/tsadc@%" PRIx64, base);
+    const char clock_names[] = "tsadc\0apb_pclk";
+
+    s->tsadc = qdev_new(TYPE_RK3399_TSADC);
+    object_property_add_child(OBJECT(s), "tsadc", OBJECT(s->tsadc));
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->tsadc), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->tsadc), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->tsadc), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+
+    s->tsadc_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "rockchip,rk3399-tsadc");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_TSADC].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "resets", s->cru_phandle, 149);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "reset-names", "tsadc-apb");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "rockchip,grf", s->grf_phandle);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "rockchip,hw-tshut-temp",
+                          RK3399_TSHUT_TEMP);
+    /* 0: CRU, 1: GPIO */
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "rockchip,hw-tshut-mode", 0);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#thermal-sensor-cells", 1);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", s->tsadc_phandle);
+    g_free(nodename);
+}
+
+static uint32_t fdt_add_trip(RK3399State *s, const char *zone,
+                             const char *name, uint32_t temp,
+                             const char *type)
+{
+    MachineState *ms = MACHINE(s);
+    char *nodename = g_strdup_printf("%s/trips/%s", zone, name);
+    uint32_t phandle = qemu_fdt_alloc_phandle(ms->fdt);
+
+    qemu_fdt_add_path(ms->fdt, nodename);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "temperature", temp);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "hysteresis", 2000);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "type", type);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", phandle);
+    g_free(nodename);
+    return phandle;
+}
+
+/* Throttle the CPUs of the clusters in @clusters from trip @trip on */
+static void fdt_add_cooling_map(RK3399State *s, const char *zone,
+                                const char *name, uint32_t trip,
+                                unsigned clusters)
+{
+    MachineState *ms = MACHINE(s);
+    char *nodename = g_strdup_printf("%s/cooling-maps/%s", zone, name);
+    g_autofree uint32_t *cells = g_new(uint32_t, ms->smp.cpus * 3);
+    int cpu, core, n = 0;
+
+    for (cpu = 0; cpu < ms->smp.cpus; cpu++) {
+        ARMCPU *armcpu = ARM_CPU(qemu_get_cpu(cpu));
+        char *cpu_path = g_strdup_printf("/cpus/cpu@%" PRIx64,
+                                         arm_cpu_mp_affinity(armcpu));
+
+        if (clusters & BIT(rockchip_rk3399_cpu_cluster(cpu, &core))) {
+            cells[n++] = cpu_to_be32(qemu_fdt_get_phandle(ms->fdt, cpu_path));
+            cells[n++] = cpu_to_be32(THERMAL_NO_LIMIT);
+            cells[n++] = cpu_to_be32(THERMAL_NO_LIMIT);
+        }
+        g_free(cpu_path);
+    }
+
+    if (n) {
+        qemu_fdt_add_path(ms->fdt, nodename);
+        qemu_fdt_setprop_cell(ms->fdt, nodename, "trip", trip);
+        qemu_fdt_setprop(ms->fdt, nodename, "cooling-device",
+                         cells, n * sizeof(uint32_t));
+    }
+    g_free(nodename);
+}
+
+/*
+ * The thermal zones of the two sensors.  Past the first CPU trip point the
+ * guest lowers the clock of the big cluster, past the second that of both.
+ */
+static void fdt_add_thermal_zones(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    static const char * const zones[] = { "cpu", "gpu" };
+    uint32_t alert0, alert1;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(zones); i++) {
+        char *zone = g_strdup_printf("/thermal-zones/%s-thermal", zones[i]);
+        char *name;
+
+        qemu_fdt_add_path(ms->fdt, zone);
+        qemu_fdt_setprop_cell(ms->fdt, zone, "polling-delay-passive", 100);
+        qemu_fdt_setprop_cell(ms->fdt, zone, "polling-delay", 1000);
+        qemu_fdt_setprop_cells(ms->fdt, zone, "thermal-sensors",
+                               s->tsadc_phandle, i);
+
+        name = g_strdup_printf("%s-alert0", zones[i]);
+        alert0 = fdt_add_trip(s, zone, name, i ? 75000 : 70000, "passive");
+        g_free(name);
+        name = g_strdup_printf("%s-crit", zones[i]);
+        fdt_add_trip(s, zone, name, RK3399_TSHUT_TEMP, "critical");
+        g_free(name);
+
+        if (i == 0) {
+            alert1 = fdt_add_trip(s, zone, "cpu-alert1", 75000, "passive");
+            fdt_add_cooling_map(s, zone, "map0", alert0,
+                                BIT(RK3399_CLUSTER_BIG));
+            fdt_add_cooling_map(s, zone, "map1", alert1,
+                                BIT(RK3399_CLUSTER_LITTLE) |
+                                BIT(RK3399_CLUSTER_BIG));
+        }
+        g_free(zone);
+    }
+}
+
+/* The SARADC, referenced to the 1.8V supply it has on RK3399 boards */
+static void create_saradc(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_SARADC].base;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_SARADC];
+    char *nodename = g_strdup_printf("/saradc@%" PRIx64, base);
+    const char clock_names[] = "saradc\0apb_pclk";
+    uint32_t vref_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+
+    s->saradc = qdev_new(TYPE_RK3399_SARADC);
+    object_property_add_child(OBJECT(s), "saradc", OBJECT(s->saradc));
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->saradc), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->saradc), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(s->saradc), 0,
+                       qdev_get_gpio_in(s->gic, irq));
+
+    qemu_fdt_add_subnode(ms->fdt, "/vcca1v8-s3");
+    qemu_fdt_setprop_string(ms->fdt, "/vcca1v8-s3", "compatible",
+                            "regulator-fixed");
+    qemu_fdt_setprop_string(ms->fdt, "/vcca1v8-s3", "regulator-name",
+                            "vcca1v8_s3");
+    qemu_fdt_setprop_cell(ms->fdt, "/vcca1v8-s3", "regulator-min-microvolt",
+                          RK3399_SARADC_VREF_UV);
+    qemu_fdt_setprop_cell(ms->fdt, "/vcca1v8-s3", "regulator-max-microvolt",
+                          RK3399_SARADC_VREF_UV);
+    qemu_fdt_setprop(ms->fdt, "/vcca1v8-s3", "regulator-always-on", NULL, 0);
+    qemu_fdt_setprop_cell(ms->fdt, "/vcca1v8-s3", "phandle", vref_phandle);
+
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "rockchip,rk3399-saradc");
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_SARADC].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_SPI, irq,
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "clocks",
+                           s->clock_phandle, s->clock_phandle);
+    qemu_fdt_setprop(ms->fdt, nodename, "clock-names",
+                     clock_names, sizeof(clock_names));
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "vref-supply", vref_phandle);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#io-channel-cells", 1);
+    g_free(nodename);
+}
+
+static void create_pcie_irq_map(RK3399State *s, int first_irq,
+                                const char *nodename)
+{
+    MachineState *ms = MACHINE(s);
+    uint32_t full_irq_map[4 * PCI_NUM_PINS * 10] = { 0 };
+    uint32_t *irq_map = full_irq_map;
+    int devfn, pin, i;
+
+    /* Standard swizzle over four slots, repeated by the mask */
+    for (devfn = 0; devfn <= 0x18; devfn += 0x8) {
+        for (pin = 0; pin < PCI_NUM_PINS; pin++) {
+            int irq = first_irq + ((pin + PCI_SLOT(devfn)) % PCI_NUM_PINS);
+            uint32_t map[] = {
+                devfn << 8, 0, 0,                       /* devfn */
+                pin + 1,                                /* PCI pin */
+                s->gic_phandle, 0, 0, GIC_FDT_IRQ_TYPE_SPI, irq,
+                GIC_FDT_IRQ_FLAGS_LEVEL_HI };           /* GIC irq */
+
+            for (i = 0; i < ARRAY_SIZE(map); i++) {
+                irq_map[i] = cpu_to_be32(map[i]);
+            }
+            irq_map += ARRAY_SIZE(map);
+        }
+    }
+
+    qemu_fdt_setprop(ms->fdt, nodename, "interrupt-map",
+                     full_irq_map, sizeof(full_irq_map));
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupt-map-mask",
+                           cpu_to_be16(PCI_DEVFN(3, 0)), 0, 0, 0x7);
+}
+
+/*
+ * The PCIe 2.1 root complex.  Rather than the Rockchip controller with its
+ * outbound address translation, a generic ECAM host is placed in the same
+ * AXI window (config space, then memory, then I/O) and described to the
+ * guest as such; the controller's own registers are left unimplemented.
+ * MSI and MSI-X go through the GIC ITS, with the requester ID as device ID.
+ */
+static void create_pcie(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr base_ecam = rockchip_rk3399_memmap[RK3399_DEV_PCIE_ECAM].base;
+    hwaddr size_ecam = rockchip_rk3399_memmap[RK3399_DEV_PCIE_ECAM].size;
+    hwaddr base_mmio = rockchip_rk3399_memmap[RK3399_DEV_PCIE_MMIO].base;
+    hwaddr size_mmio = rockchip_rk3399_memmap[RK3399_DEV_PCIE_MMIO].size;
+    hwaddr base_mmio_high =
+        rockchip_rk3399_memmap[RK3399_DEV_PCIE_MMIO_HIGH].base;
+    hwaddr size_mmio_high =
+        rockchip_rk3399_memmap[RK3399_DEV_PCIE_MMIO_HIGH].size;
+    hwaddr base_pio = rockchip_rk3399_memmap[RK3399_DEV_PCIE_PIO].base;
+    hwaddr size_pio = rockchip_rk3399_memmap[RK3399_DEV_PCIE_PIO].size;
+    int irq = rockchip_rk3399_irqmap[RK3399_DEV_PCIE];
+    int nr_pcie_buses = size_ecam / PCIE_MMCFG_SIZE_MIN;
+    MemoryRegion *ecam_alias, *mmio_alias, *mmio_high_alias;
+    MemoryRegion *mmio_reg;
+    char *nodename;
+    int i;
+
+    s->pcie = qdev_new(TYPE_GPEX_HOST);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(s->pcie), &error_fatal);
+
+    /* Only the first size_ecam bytes of ECAM space are reachable */
+    ecam_alias = g_new0(MemoryRegion, 1);
+    memory_region_init_alias(ecam_alias, OBJECT(s->pcie), "pcie-ecam",
+                             sysbus_mmio_get_region(SYS_BUS_DEVICE(s->pcie), 0),
+                             0, size_ecam);
+    memory_region_add_subregion(get_system_memory(), base_ecam, ecam_alias);
+
+    /* Both memory windows map PCI addresses 1:1 */
+    mmio_reg = sysbus_mmio_get_region(SYS_BUS_DEVICE(s->pcie), 1);
+    mmio_alias = g_new0(MemoryRegion, 1);
+    memory_region_init_alias(mmio_alias, OBJECT(s->pcie), "pcie-mmio",
+                             mmio_reg, base_mmio, size_mmio);
+    memory_region_add_subregion(get_system_memory(), base_mmio, mmio_alias);
+    mmio_high_alias = g_new0(MemoryRegion, 1);
+    memory_region_init_alias(mmio_high_alias, OBJECT(s->pcie),
+                             "pcie-mmio-high", mmio_reg,
+                             base_mmio_high, size_mmio_high);
+    memory_region_add_subregion(get_system_memory(), base_mmio_high,
+                                mmio_high_alias);
+
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->pcie), 2, base_pio);
+
+    for (i = 0; i < GPEX_NUM_IRQS; i++) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(s->pcie), i,
+                           qdev_get_gpio_in(s->gic, irq + i));
+        gpex_set_irq_num(GPEX_HOST(s->pcie), i, irq + i);
+    }
+
+    create_unimplemented_device("pcie-apb",
+                                rockchip_rk3399_memmap[RK3399_DEV_PCIE_APB].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_PCIE_APB].size);
+
+    nodename = g_strdup_printf("/pcie@%" PRIx64, base_ecam);
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "pci-host-ecam-generic");
+    qemu_fdt_setprop_string(ms->fdt, nodename, "device_type", "pci");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#address-cells", 3);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#size-cells", 2);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "linux,pci-domain", 0);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "bus-range", 0,
+                           nr_pcie_buses - 1);
+    qemu_fdt_setprop(ms->fdt, nodename, "dma-coherent", NULL, 0);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "msi-map",
+                           0, s->msi_phandle, 0, 0x10000);
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, base_ecam, 2, size_ecam);
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "ranges",
+                                 1, FDT_PCI_RANGE_IOPORT, 2, 0,
+                                 2, base_pio, 2, size_pio,
+                                 1, FDT_PCI_RANGE_MMIO, 2, base_mmio,
+                                 2, base_mmio, 2, size_mmio,
+                                 1, FDT_PCI_RANGE_MMIO_64BIT,
+                                 2, base_mmio_high,
+                                 2, base_mmio_high, 2, size_mmio_high);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#interrupt-cells", 1);
+    create_pcie_irq_map(s, irq, nodename);
+    g_free(nodename);
+}
+
+/*
+ * A bank of paravirtual transports next to the SoC peripherals.  As on
+ * the virt board, the transports are created lowest address first, so
+ * -device options fill them from the highest address down, and the DT
+ * nodes are added in reverse so that they appear lowest address first.
+ */
+static void create_virtio_devices(RK3399State *s)
+{
+    MachineState *ms = MACHINE(s);
+    hwaddr size = rockchip_rk3399_memmap[RK3399_DEV_VIRTIO].size;
+    int i;
+
+    for (i = 0; i < RK3399_NUM_VIRTIO_TRANSPORTS; i++) {
+        int irq = rockchip_rk3399_irqmap[RK3399_DEV_VIRTIO] + i;
+        hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_VIRTIO].base + i * size;
+        DeviceState *dev = qdev_new(TYPE_VIRTIO_MMIO);
+
+        /* Queue notifications are kicked off the vCPU thread */
+        qdev_prop_set_bit(dev, "ioeventfd", true);
+        qdev_prop_set_bit(dev, "force-legacy", false);
+        sysbus_realize_and_unref(SYS_BUS_DEVICE(dev), &error_fatal);
+        sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0,
+                           qdev_get_gpio_in(s->gic, irq));
+    }
+
+    for (i = RK3399_NUM_VIRTIO_TRANSPORTS - 1; i >= 0; i--) {
+        int irq = rockchip_rk3399_irqmap[RK3399_DEV_VIRTIO] + i;
+        hwaddr base = rockchip_rk3399_memmap[RK3399_DEV_VIRTIO].base + i * size;
+        char *nodename = g_strdup_printf("/virtio_mmio@%" PRIx64, base);
+
+        qemu_fdt_add_subnode(ms->fdt, nodename);
+        qemu_fdt_setprop_string(ms->fdt, nodename,
+                                "compatible", "virtio,mmio");
+        qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                     2, base, 2, size);
+        qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                               GIC_FDT_IRQ_TYPE_SPI, irq,
+                               GIC_FDT_IRQ_FLAGS_EDGE_LO_HI);
+        qemu_fdt_setprop(ms->fdt, nodename, "dma-coherent", NULL, 0);
+        g_free(nodename);
+    }
+}
+
+static void *rockchip_rk3399_dtb(const struct arm_boot_info *binfo,
+                                 int *fdt_size)
+{
+    const RK3399State *s = container_of(binfo, RK3399State, bootinfo);
+    MachineState *ms = MACHINE(s);
+
+    *fdt_size = s->fdt_size;
+    return ms->fdt;
+}
+
+static void fdt_add_gic_node(RK3399State *sms)
+{
+    MachineState *ms = MACHINE(sms);
+    char *nodename;
+
+    sms->gic_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    qemu_fdt_setprop_cell(ms->fdt, "/", "interrupt-parent", sms->gic_phandle);
+
+    nodename = g_strdup_printf("/interrupt-controller@%" PRIx64,
+                               rockchip_rk3399_memmap[RK3399_DEV_GICD].base);
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible", "arm,gic-v3");
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#interrupt-cells", 3);
+    qemu_fdt_setprop(ms->fdt, nodename, "interrupt-controller", NULL, 0);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#address-cells", 0x2);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#size-cells", 0x2);
+    qemu_fdt_setprop(ms->fdt, nodename, "ranges", NULL, 0);
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GICD].base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GICD].size,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GICR].base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GICR].size);
+    qemu_fdt_setprop_cells(ms->fdt, nodename, "interrupts",
+                           GIC_FDT_IRQ_TYPE_PPI,
+                           INTID_TO_PPI(ARCH_GIC_MAINT_IRQ),
+                           GIC_FDT_IRQ_FLAGS_LEVEL_HI);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", sms->gic_phandle);
+    g_free(nodename);
+}
+
+static void fdt_add_its_gic_node(RK3399State *sms)
+{
+    MachineState *ms = MACHINE(sms);
+    char *nodename;
+
+    sms->msi_phandle = qemu_fdt_alloc_phandle(ms->fdt);
+    nodename = g_strdup_printf("/interrupt-controller@%" PRIx64 "/its@%" PRIx64,
+                               rockchip_rk3399_memmap[RK3399_DEV_GICD].base,
+                               rockchip_rk3399_memmap[RK3399_DEV_GIC_ITS].base);
+    qemu_fdt_add_subnode(ms->fdt, nodename);
+    qemu_fdt_setprop_string(ms->fdt, nodename, "compatible",
+                            "arm,gic-v3-its");
+    qemu_fdt_setprop(ms->fdt, nodename, "msi-controller", NULL, 0);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "#msi-cells", 1);
+    qemu_fdt_setprop_sized_cells(ms->fdt, nodename, "reg",
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GIC_ITS].base,
+                                 2, rockchip_rk3399_memmap[RK3399_DEV_GIC_ITS].size);
+    qemu_fdt_setprop_cell(ms->fdt, nodename, "phandle", sms->msi_phandle);
+    g_free(nodename);
 }
 
 static void create_its(RK3399State *sms)
@@ -87,7 +1609,9 @@ static void create_its(RK3399State *sms)
     object_property_set_link(OBJECT(dev), "parent-gicv3", OBJECT(sms->gic),
                              &error_abort);
     sysbus_realize_and_unref(SYS_BUS_DEVICE(dev), &error_fatal);
-    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, rockchip_rk3399_memmap[RK3399_DEV_GIC_ITS]);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, rockchip_rk3399_memmap[RK3399_DEV_GIC_ITS].base);
+
+    fdt_add_its_gic_node(sms);
 }
 
 static void create_gic(RK3399State *sms, MemoryRegion *mem)
@@ -123,8 +1647,9 @@ static void create_gic(RK3399State *sms, MemoryRegion *mem)
 
     gicbusdev = SYS_BUS_DEVICE(sms->gic);
     sysbus_realize_and_unref(gicbusdev, &error_fatal);
-    sysbus_mmio_map(gicbusdev, 0, rockchip_rk3399_memmap[RK3399_DEV_GICD]);
-    sysbus_mmio_map(gicbusdev, 1, rockchip_rk3399_memmap[RK3399_DEV_GICR]);
+    sysbus_mmio_map(gicbusdev, 0, rockchip_rk3399_memmap[RK3399_DEV_GICD].base);
+    sysbus_mmio_map(gicbusdev, 1, rockchip_rk3399_memmap[RK3399_DEV_GICR].base);
+    fdt_add_gic_node(sms);
 
     /*
      * Wire the outputs from each CPU's generic timer and the GICv3
@@ -175,18 +1700,25 @@ static void rockchip_rk3399_machine_init(MachineState *ms)
 {
     RK3399State *s = ROCKCHIP_RK3399(ms);
     MemoryRegion *sysmem = get_system_memory();
-    
-    printf("rockchip_rk3399_machine_init\n");
+    int64_t init_start_ns = get_clock();
 
-    printf("ram: %p\n", ms->ram);
+    s->init_stage_ns = init_start_ns;
+    create_fdt(s);
     memory_region_add_subregion(sysmem, RK3399_SYSMEM, ms->ram);
+    rockchip_rk3399_init_stage(s, "fdt");
 
-    printf("CPU type %s\n", ms->cpu_type);
     int n;
     int smp_cpus = ms->smp.cpus;
     for (n = 0; n < smp_cpus; n++) {
-        Object *cpuobj = object_new(ms->cpu_type);
-
+        int core, cluster = rockchip_rk3399_cpu_cluster(n, &core);
+        /* -cpu picks the LITTLE cores; the big cluster is always A72 */
+        const char *cpu_type = cluster == RK3399_CLUSTER_LITTLE ?
+            ms->cpu_type : rockchip_rk3399_clusters[cluster].cpu_type;
+        Object *cpuobj = object_new(cpu_type);
+
+        object_property_set_int(cpuobj, "mp-affinity",
+                                (cluster << ARM_AFF1_SHIFT) | core,
+                                &error_abort);
         object_property_set_bool(cpuobj, "has_el3", false, NULL);
 
         if (object_property_find(cpuobj, "has_el2")) {
@@ -194,234 +1726,187 @@ static void rockchip_rk3399_machine_init(MachineState *ms)
         }
 
         qdev_realize(DEVICE(cpuobj), NULL, &error_fatal);
+        rockchip_rk3399_set_cpu_affinity(s, CPU(cpuobj), cluster);
     }
+    rockchip_rk3399_init_stage(s, "cpus");
+    fdt_add_cpu_nodes(s);
+    fdt_add_timer_nodes(s);
+    fdt_add_pmu_nodes(s);
+    rockchip_rk3399_init_stage(s, "cpu-fdt");
 
     // Create GIC
     create_gic(s, sysmem);
+    rockchip_rk3399_init_stage(s, "gic");
 
-    // Create CRU as dummy
+    // Create CRU
     s->pmucru = qdev_new(TYPE_RK3399_PMUCRU);
     sysbus_realize_and_unref(SYS_BUS_DEVICE(s->pmucru), &error_fatal);
-    sysbus_mmio_map(SYS_BUS_DEVICE(s->pmucru), 0, rockchip_rk3399_memmap[RK3399_DEV_PMU_CRU]);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->pmucru), 0, rockchip_rk3399_memmap[RK3399_DEV_PMU_CRU].base);
+    fdt_add_cru_node(s, RK3399_DEV_PMU_CRU, "rockchip,rk3399-pmucru");
 
     s->cru = qdev_new(TYPE_RK3399_CRU);
     sysbus_realize_and_unref(SYS_BUS_DEVICE(s->cru), &error_fatal);
-    sysbus_mmio_map(SYS_BUS_DEVICE(s->cru), 0, rockchip_rk3399_memmap[RK3399_DEV_CRU]);
-
-    // serial_mm_init(get_system_memory(), rockchip_rk3399_memmap[RK3399_DEV_UART0], 2,
-    //                qdev_get_gpio_in(s->gic, 99),
-    //                115200, serial_hd(2), DEVICE_NATIVE_ENDIAN);
-    // serial_mm_init(get_system_memory(), rockchip_rk3399_memmap[RK3399_DEV_UART1], 2,
-    //                qdev_get_gpio_in(s->gic, 98),
-    //                115200, serial_hd(1), DEVICE_NATIVE_ENDIAN);
-    serial_mm_init(get_system_memory(), rockchip_rk3399_memmap[RK3399_DEV_UART2], 2,
-                   qdev_get_gpio_in(s->gic, 100),
-                   115200, serial_hd(0), DEVICE_NATIVE_ENDIAN);
-    // serial_mm_init(get_system_memory(), rockchip_rk3399_memmap[RK3399_DEV_UART3], 2,
-    //                qdev_get_gpio_in(s->gic, 101),
-    //                115200, serial_hd(3), DEVICE_NATIVE_ENDIAN);
-
-    create_unimplemented_device("rktimer", rockchip_rk3399_memmap[RK3399_DEV_RKTIMER], 0x20);
-    create_unimplemented_device("grf", rockchip_rk3399_memmap[RK3399_DEV_GRF], 0x10000);
-
-    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG0], 0x1000);
-    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG1], 0x1000);
-    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG2], 0x1000);
-    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG3], 0x1000);
-    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG4], 0x1000);
-    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG5], 0x1000);
-
-    create_unimplemented_device("pmu", rockchip_rk3399_memmap[RK3399_DEV_PMU], 0x1000);
+    sysbus_mmio_map(SYS_BUS_DEVICE(s->cru), 0, rockchip_rk3399_memmap[RK3399_DEV_CRU].base);
+    fdt_add_cru_node(s, RK3399_DEV_CRU, "rockchip,rk3399-cru");
+    rockchip_rk3399_init_cluster_clocks(s);
+    rockchip_rk3399_init_stage(s, "cru");
+
+    /* UART2 is the debug console */
+    create_uart(s, RK3399_DEV_UART0, serial_hd(2));
+    create_uart(s, RK3399_DEV_UART1, serial_hd(1));
+    create_uart(s, RK3399_DEV_UART2, serial_hd(0));
+    create_uart(s, RK3399_DEV_UART3, serial_hd(3));
+    rockchip_rk3399_init_stage(s, "uart");
+
+    create_rktimer(s, RK3399_DEV_RKTIMER0);
+    create_rktimer(s, RK3399_DEV_RKTIMER1);
+    rockchip_rk3399_init_stage(s, "rktimer");
+
+    create_grf(s, RK3399_DEV_GRF);
+    create_grf(s, RK3399_DEV_PMUGRF);
+    rockchip_rk3399_init_stage(s, "grf");
+    create_pmu(s);
+    rockchip_rk3399_init_stage(s, "pmu");
+
+    create_sdmmc(s);
+    rockchip_rk3399_init_stage(s, "sdmmc");
+    create_emmc(s);
+    rockchip_rk3399_init_stage(s, "emmc");
+    create_gmac(s);
+    rockchip_rk3399_init_stage(s, "gmac");
+    create_dmac(s, 0);
+    create_dmac(s, 1);
+    rockchip_rk3399_init_stage(s, "dmac");
+    create_usb(s, 0);
+    create_usb(s, 1);
+    rockchip_rk3399_init_stage(s, "usb");
+    create_vop(s, 0);
+    create_vop(s, 1);
+    rockchip_rk3399_init_stage(s, "vop");
+    create_crypto(s, 0);
+    create_crypto(s, 1);
+    rockchip_rk3399_init_stage(s, "crypto");
+    create_spi(s);
+    rockchip_rk3399_init_stage(s, "spi");
+    create_tsadc(s);
+    fdt_add_thermal_zones(s);
+    create_saradc(s);
+    rockchip_rk3399_init_stage(s, "adc");
+    create_pcie(s);
+    rockchip_rk3399_init_stage(s, "pcie");
+    create_virtio_devices(s);
+    rockchip_rk3399_init_stage(s, "virtio");
+
+    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG0].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG0].size);
+    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG1].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG1].size);
+    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG2].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG2].size);
+    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG3].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG3].size);
+    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG4].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG4].size);
+    create_unimplemented_device("debug", rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG5].base,
+                                rockchip_rk3399_memmap[RK3399_DEV_CPU_DEBUG5].size);
+    rockchip_rk3399_init_stage(s, "unimplemented");
 
     // Boot
     s->bootinfo.ram_size = ms->ram_size;
     s->bootinfo.board_id = -1;
     s->bootinfo.loader_start = RK3399_SYSMEM;
-    // s->bootinfo.get_dtb = machvirt_dtb;
-    // s->bootinfo.skip_dtb_autoload = true;
+    s->bootinfo.get_dtb = rockchip_rk3399_dtb;
     s->bootinfo.firmware_loaded = false;
     s->bootinfo.psci_conduit = QEMU_PSCI_CONDUIT_SMC;
     arm_load_kernel(ARM_CPU(first_cpu), ms, &s->bootinfo);
-}
+    rockchip_rk3399_init_stage(s, "load");
 
-static void rockchip_rk3399_class_init(ObjectClass *oc, void *data)
-{
-    MachineClass *mc = MACHINE_CLASS(oc);
-
-    mc->init = rockchip_rk3399_machine_init;
-    mc->desc = "Rockchip RK3399 Development Board";
-    mc->max_cpus = 4;
-    mc->default_ram_id = "rk3399.highmem";
-    
-    printf("rockchip_rk3399_class_init\n");
+    trace_rockchip_rk3399_init_done((get_clock() - init_start_ns) / SCALE_US);
 }
 
-static const TypeInfo rockchip_rk3399_type_info = {
-    .name = TYPE_ROCKCHIP_RK3399,
-    .parent = TYPE_MACHINE,
-    .instance_size = sizeof(RK3399State),
-    .instance_init = rockchip_rk3399_init,
-    .class_init = rockchip_rk3399_class_init,
-};
-
-static void rockchip_rk3399_register_types(void)
+static void rockchip_rk3399_get_host_cpus(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
 {
-    type_register_static(&rockchip_rk3399_type_info);
-}
+    RK3399State *s = ROCKCHIP_RK3399(obj);
+    int cluster = GPOINTER_TO_INT(opaque);
 
-type_init(rockchip_rk3399_register_types)
-
-// Below is implementation of RK3399_PMUCRU
-static uint64_t rk3399_pmucru_read(void *opaque, hwaddr offset, unsigned size)
-{
-    RK3399PMUCRUState *s = RK3399_PMUCRU(opaque);
-    switch (size) {
-    case 4:
-        printf("rk3399_pmucru_read: offset=0x%" HWADDR_PRIx " value=0x%" PRIx32 "\n", offset, *(uint32_t *)(s->buffer + offset));
-        return *(uint32_t *)(s->buffer + offset);
-    default:
-        printf("rk3399_pmucru_read: size=%d not supported\n", size);
-        return 0;
-    }
+    visit_type_uint16List(v, name, &s->cluster_host_cpus[cluster], errp);
 }
 
-static void rk3399_pmucru_write(void *opaque, hwaddr offset, uint64_t value, unsigned size)
+static void rockchip_rk3399_set_host_cpus(Object *obj, Visitor *v,
+                                          const char *name, void *opaque,
+                                          Error **errp)
 {
-    printf("rk3399_pmucru_write: offset=0x%" HWADDR_PRIx " value=0x%" PRIx64 "\n", offset, value);
-
-    if (offset == 8) {
-        value |= 1 << 31;
-    }
+    RK3399State *s = ROCKCHIP_RK3399(obj);
+    int cluster = GPOINTER_TO_INT(opaque);
+    uint16List *host_cpus = NULL;
 
-    RK3399PMUCRUState *s = RK3399_PMUCRU(opaque);
-    switch (size) {
-    case 4:
-        *(uint32_t *)(s->buffer + offset) = (uint32_t)value;
+    if (!visit_type_uint16List(v, name, &host_cpus, errp)) {
         return;
     }
-
-    // Not supported
-    printf("rk3399_pmucru_write: size=%d not supported\n", size);
+    qapi_free_uint16List(s->cluster_host_cpus[cluster]);
+    s->cluster_host_cpus[cluster] = host_cpus;
 }
 
-static const MemoryRegionOps rk3399_pmucru_ops = {
-    .read = rk3399_pmucru_read,
-    .write = rk3399_pmucru_write,
-    .impl.min_access_size = 4,
-    .impl.max_access_size = 4,
-    .valid.min_access_size = 4,
-    .valid.max_access_size = 4,
-    .endianness = DEVICE_NATIVE_ENDIAN,
-};
-
-static void rk3399_pmucru_realize(DeviceState *dev, Error **errp)
+static bool rockchip_rk3399_get_cpu_freq_scaling(Object *obj, Error **errp)
 {
-    RK3399PMUCRUState *s = RK3399_PMUCRU(dev);
-    s->buffer = malloc(0x1000);
-    memset(s->buffer, 0, 0x1000);
-
-    *(uint32_t *)(s->buffer + 0x8) = 0x0000031f;
-    *(uint32_t *)(s->buffer + 0x90) = 0x2dc;
-
-    memory_region_init_io(&s->iomem, OBJECT(dev), &rk3399_pmucru_ops, s, "rk3399.pmucru", 0x1000);
-    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->iomem);
+    return ROCKCHIP_RK3399(obj)->cpu_freq_scaling;
 }
 
-static void rk3399_pmucru_class_init(ObjectClass *oc, void *data)
+static void rockchip_rk3399_set_cpu_freq_scaling(Object *obj, bool value,
+                                                 Error **errp)
 {
-    DeviceClass *dc = DEVICE_CLASS(oc);
-
-    dc->realize = rk3399_pmucru_realize;
+    ROCKCHIP_RK3399(obj)->cpu_freq_scaling = value;
 }
 
-static const TypeInfo rk3399_pmucru_info = {
-    .name = TYPE_RK3399_PMUCRU,
-    .parent = TYPE_SYS_BUS_DEVICE,
-    .instance_size = sizeof(RK3399PMUCRUState),
-    .class_init = rk3399_pmucru_class_init,
-};
-
-static void rk3399_pmucru_register_types(void)
-{
-    type_register_static(&rk3399_pmucru_info);
-}
-
-type_init(rk3399_pmucru_register_types)
-
-// Below is implementation of RK3399_CRU
-static uint64_t rk3399_cru_read(void *opaque, hwaddr offset, unsigned size)
-{
-    RK3399CRUState *s = RK3399_CRU(opaque);
-    switch (size) {
-    case 4:
-        printf("rk3399_cru_read: offset=0x%" HWADDR_PRIx " value=0x%" PRIx32 "\n", offset, *(uint32_t *)(s->buffer + offset));
-        return *(uint32_t *)(s->buffer + offset);
-    default:
-        printf("rk3399_cru_read: size=%d not supported\n", size);
-        return 0;
-    }
-}
-
-static void rk3399_cru_write(void *opaque, hwaddr offset, uint64_t value, unsigned size)
-{
-    printf("rk3399_cru_write: offset=0x%" HWADDR_PRIx " value=0x%" PRIx64 "\n", offset, value);
-
-    // Always set bit 31 to report PLL as locked. Linux driver spins on this bit
-    if (offset < 0x100 && (offset % 0x20) == 0x8) {
-        value |= 1 << 31;
-    }
-
-    RK3399CRUState *s = RK3399_CRU(opaque);
-    switch (size) {
-    case 4:
-        *(uint32_t *)(s->buffer + offset) = (uint32_t)value;
-        return;
-    }
-
-    // Not supported
-    printf("rk3399_cru_write: size=%d not supported\n", size);
-}
-
-static const MemoryRegionOps rk3399_cru_ops = {
-    .read = rk3399_cru_read,
-    .write = rk3399_cru_write,
-    .impl.min_access_size = 4,
-    .impl.max_access_size = 4,
-    .valid.min_access_size = 4,
-    .valid.max_access_size = 4,
-    .endianness = DEVICE_NATIVE_ENDIAN,
-};
-
-static void rk3399_cru_realize(DeviceState *dev, Error **errp)
-{
-    RK3399CRUState *s = RK3399_CRU(dev);
-    s->buffer = malloc(0x1000);
-    memset(s->buffer, 0, 0x1000);
-
-    *(uint32_t *)(s->buffer + 0x8) = 0x0000031f;
-    *(uint32_t *)(s->buffer + 0x90) = 0x2dc;
-
-    memory_region_init_io(&s->iomem, OBJECT(dev), &rk3399_cru_ops, s, "rk3399.cru", 0x1000);
-    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->iomem);
-}
-
-static void rk3399_cru_class_init(ObjectClass *oc, void *data)
+static void rockchip_rk3399_class_init(ObjectClass *oc, void *data)
 {
-    DeviceClass *dc = DEVICE_CLASS(oc);
+    MachineClass *mc = MACHINE_CLASS(oc);
+    static const char * const valid_cpu_types[] = {
+        ARM_CPU_TYPE_NAME("cortex-a53"),
+        NULL
+    };
 
-    dc->realize = rk3399_cru_realize;
+    mc->init = rockchip_rk3399_machine_init;
+    mc->desc = "Rockchip RK3399 Development Board";
+    mc->max_cpus = RK3399_NUM_CPUS;
+    mc->default_cpus = RK3399_NUM_CPUS;
+    mc->default_cpu_type = ARM_CPU_TYPE_NAME("cortex-a53");
+    mc->valid_cpu_types = valid_cpu_types;
+    mc->default_ram_id = "rk3399.highmem";
+    mc->block_default_type = IF_SD;
+
+    object_class_property_add(oc, "little-cluster-host-cpus", "int",
+                              rockchip_rk3399_get_host_cpus,
+                              rockchip_rk3399_set_host_cpus, NULL,
+                              GINT_TO_POINTER(RK3399_CLUSTER_LITTLE));
+    object_class_property_set_description(oc, "little-cluster-host-cpus",
+        "Host CPUs to run the Cortex-A53 vCPU threads on (MTTCG only)");
+    object_class_property_add(oc, "big-cluster-host-cpus", "int",
+                              rockchip_rk3399_get_host_cpus,
+                              rockchip_rk3399_set_host_cpus, NULL,
+                              GINT_TO_POINTER(RK3399_CLUSTER_BIG));
+    object_class_property_set_description(oc, "big-cluster-host-cpus",
+        "Host CPUs to run the Cortex-A72 vCPU threads on (MTTCG only)");
+    object_class_property_add_bool(oc, "cpu-freq-scaling",
+                                   rockchip_rk3399_get_cpu_freq_scaling,
+                                   rockchip_rk3399_set_cpu_freq_scaling);
+    object_class_property_set_description(oc, "cpu-freq-scaling",
+        "Slow each cluster's vCPUs down to the core clock the guest "
+        "programs (MTTCG only)");
 }
 
-static const TypeInfo rk3399_cru_info = {
-    .name = TYPE_RK3399_CRU,
-    .parent = TYPE_SYS_BUS_DEVICE,
-    .instance_size = sizeof(RK3399CRUState),
-    .class_init = rk3399_cru_class_init,
+static const TypeInfo rockchip_rk3399_type_info = {
+    .name = TYPE_ROCKCHIP_RK3399,
+    .parent = TYPE_MACHINE,
+    .instance_size = sizeof(RK3399State),
+    .class_init = rockchip_rk3399_class_init,
 };
 
-static void rk3399_cru_register_types(void)
+static void rockchip_rk3399_register_types(void)
 {
-    type_register_static(&rk3399_cru_info);
+    type_register_static(&rockchip_rk3399_type_info);
 }
 
-type_init(rk3399_cru_register_types)
+type_init(rockchip_rk3399_register_types)
@@ -0,0 +1,263 @@
+/*
+ * Synopsys DesignWare APB UART emulation
+ *
+ * The DW-APB UART is a 16550 with 32-bit register spacing, deeper FIFOs
+ * and a handful of extra registers: the UART status register (USR), the
+ * transmit/receive FIFO levels (TFL/RFL), a software reset register and
+ * the component identification registers that drivers use to discover
+ * the FIFO depth.  The 16550 core is the common serial device, which is
+ * configured here to drain its transmit FIFO in batches.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qapi/error.h"
+#include "hw/char/dw-apb-uart.h"
+#include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
+#include "hw/registerfields.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+/* The 16550 registers, at 32-bit spacing */
+#define DW_UART_REGSHIFT    2
+#define DW_UART_16550_END   (8 << DW_UART_REGSHIFT)
+
+/* 16550 register offsets and bits used for the extra registers */
+#define UART_FCR            2
+#define UART_FCR_RFR        0x02
+#define UART_FCR_XFR        0x04
+#define UART_LSR_DR         0x01
+#define UART_LSR_TEMT       0x40
+
+REG32(USR, 0x7c)
+    FIELD(USR, BUSY, 0, 1)
+    FIELD(USR, TFNF, 1, 1)
+    FIELD(USR, TFE, 2, 1)
+    FIELD(USR, RFNE, 3, 1)
+    FIELD(USR, RFF, 4, 1)
+REG32(TFL, 0x80)
+REG32(RFL, 0x84)
+REG32(SRR, 0x88)
+    FIELD(SRR, UR, 0, 1)
+    FIELD(SRR, RFR, 1, 1)
+    FIELD(SRR, XFR, 2, 1)
+REG32(HTX, 0xa4)
+REG32(CPR, 0xf4)
+    FIELD(CPR, APB_DATA_WIDTH, 0, 2)
+    FIELD(CPR, AFCE_MODE, 4, 1)
+    FIELD(CPR, THRE_MODE, 5, 1)
+    FIELD(CPR, FIFO_ACCESS, 9, 1)
+    FIELD(CPR, FIFO_STAT, 10, 1)
+    FIELD(CPR, SHADOW, 11, 1)
+    FIELD(CPR, ADD_ENCODED_PARAMS, 12, 1)
+    FIELD(CPR, FIFO_MODE, 16, 8)
+REG32(UCV, 0xf8)
+REG32(CTR, 0xfc)
+
+#define DW_UART_UCV         0x3430312a /* "401*" */
+#define DW_UART_CTR         0x44570110 /* "DW" 0x0110 */
+
+static uint32_t dw_apb_uart_usr(DWAPBUARTState *s)
+{
+    SerialState *ser = &s->serial;
+    uint32_t usr = 0;
+
+    usr = FIELD_DP32(usr, USR, BUSY, !(ser->lsr & UART_LSR_TEMT));
+    usr = FIELD_DP32(usr, USR, TFNF, !fifo8_is_full(&ser->xmit_fifo));
+    usr = FIELD_DP32(usr, USR, TFE, fifo8_is_empty(&ser->xmit_fifo));
+    usr = FIELD_DP32(usr, USR, RFNE, !!(ser->lsr & UART_LSR_DR));
+    usr = FIELD_DP32(usr, USR, RFF, fifo8_is_full(&ser->recv_fifo));
+    return usr;
+}
+
+static uint32_t dw_apb_uart_cpr(DWAPBUARTState *s)
+{
+    uint32_t cpr = 0;
+
+    cpr = FIELD_DP32(cpr, CPR, APB_DATA_WIDTH, 2); /* 32 bits */
+    cpr = FIELD_DP32(cpr, CPR, AFCE_MODE, 1);
+    cpr = FIELD_DP32(cpr, CPR, FIFO_STAT, 1);
+    cpr = FIELD_DP32(cpr, CPR, ADD_ENCODED_PARAMS, 1);
+    cpr = FIELD_DP32(cpr, CPR, FIFO_MODE, s->serial.fifo_size / 16);
+    return cpr;
+}
+
+static uint64_t dw_apb_uart_read(void *opaque, hwaddr offset, unsigned size)
+{
+    DWAPBUARTState *s = DW_APB_UART(opaque);
+    uint64_t r = 0;
+
+    if (offset < DW_UART_16550_END) {
+        return serial_io_ops.read(&s->serial, offset >> DW_UART_REGSHIFT, 1);
+    }
+
+    switch (offset) {
+    case A_USR:
+        r = dw_apb_uart_usr(s);
+        break;
+    case A_TFL:
+        r = fifo8_num_used(&s->serial.xmit_fifo);
+        break;
+    case A_RFL:
+        r = fifo8_num_used(&s->serial.recv_fifo);
+        break;
+    case A_HTX:
+        break;
+    case A_CPR:
+        r = dw_apb_uart_cpr(s);
+        break;
+    case A_UCV:
+        r = DW_UART_UCV;
+        break;
+    case A_CTR:
+        r = DW_UART_CTR;
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented read at 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        break;
+    }
+
+    trace_dw_apb_uart_read(offset, r);
+    return r;
+}
+
+static void dw_apb_uart_write(void *opaque, hwaddr offset, uint64_t value,
+                              unsigned size)
+{
+    DWAPBUARTState *s = DW_APB_UART(opaque);
+    uint8_t fcr;
+
+    if (offset < DW_UART_16550_END) {
+        serial_io_ops.write(&s->serial, offset >> DW_UART_REGSHIFT,
+                            value & 0xff, 1);
+        return;
+    }
+
+    trace_dw_apb_uart_write(offset, value);
+
+    switch (offset) {
+    case A_SRR:
+        /*
+         * Flush the FIFOs through FCR, which is write-only and keeps its
+         * enable and trigger level bits.  A full UART reset is treated
+         * as flushing both FIFOs.
+         */
+        fcr = s->serial.fcr;
+        if (value & (R_SRR_UR_MASK | R_SRR_RFR_MASK)) {
+            fcr |= UART_FCR_RFR;
+        }
+        if (value & (R_SRR_UR_MASK | R_SRR_XFR_MASK)) {
+            fcr |= UART_FCR_XFR;
+        }
+        serial_io_ops.write(&s->serial, UART_FCR, fcr, 1);
+        break;
+    case A_HTX:
+        break;
+    case A_USR:
+    case A_TFL:
+    case A_RFL:
+    case A_CPR:
+    case A_UCV:
+    case A_CTR:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only offset 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented write at 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        break;
+    }
+}
+
+static const MemoryRegionOps dw_apb_uart_ops = {
+    .read = dw_apb_uart_read,
+    .write = dw_apb_uart_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 1,
+    .valid.max_access_size = 4,
+    .impl.min_access_size = 4,
+    .impl.max_access_size = 4,
+};
+
+static void dw_apb_uart_realize(DeviceState *dev, Error **errp)
+{
+    DWAPBUARTState *s = DW_APB_UART(dev);
+
+    if (s->serial.fifo_size % 16 || s->serial.fifo_size > 2048) {
+        error_setg(errp, "fifo-size must be a multiple of 16 up to 2048");
+        return;
+    }
+    if (!qdev_realize(DEVICE(&s->serial), NULL, errp)) {
+        return;
+    }
+
+    memory_region_init_io(&s->iomem, OBJECT(dev), &dw_apb_uart_ops, s,
+                          TYPE_DW_APB_UART, DW_APB_UART_IOSIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->iomem);
+    sysbus_init_irq(SYS_BUS_DEVICE(dev), &s->serial.irq);
+}
+
+static void dw_apb_uart_instance_init(Object *obj)
+{
+    DWAPBUARTState *s = DW_APB_UART(obj);
+
+    object_initialize_child(obj, "serial", &s->serial, TYPE_SERIAL);
+    qdev_prop_set_uint32(DEVICE(&s->serial), "fifo-size",
+                         DW_APB_UART_FIFO_SIZE);
+    qdev_prop_set_bit(DEVICE(&s->serial), "xmit-batch", true);
+
+    qdev_alias_all_properties(DEVICE(&s->serial), obj);
+}
+
+static const VMStateDescription dw_apb_uart_vmstate = {
+    .name = "dw-apb-uart",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_STRUCT(serial, DWAPBUARTState, 0, vmstate_serial,
+                       SerialState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void dw_apb_uart_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = dw_apb_uart_realize;
+    dc->vmsd = &dw_apb_uart_vmstate;
+}
+
+DWAPBUARTState *dw_apb_uart_create(hwaddr base, qemu_irq irq, int baudbase,
+                                   Chardev *chr)
+{
+    DeviceState *dev = qdev_new(TYPE_DW_APB_UART);
+
+    qdev_prop_set_uint32(dev, "baudbase", baudbase);
+    qdev_prop_set_chr(dev, "chardev", chr);
+    sysbus_realize_and_unref(SYS_BUS_DEVICE(dev), &error_fatal);
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0, base);
+    sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq);
+
+    return DW_APB_UART(dev);
+}
+
+static const TypeInfo dw_apb_uart_info = {
+    .name = TYPE_DW_APB_UART,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DWAPBUARTState),
+    .instance_init = dw_apb_uart_instance_init,
+    .class_init = dw_apb_uart_class_init,
+};
+
+static void dw_apb_uart_register_types(void)
+{
+    type_register_static(&dw_apb_uart_info);
+}
+
+type_init(dw_apb_uart_register_types);
@@ -31,6 +31,7 @@
 #include "chardev/char-serial.h"
 #include "qapi/error.h"
 #include "qemu/timer.h"
+#include "qemu/main-loop.h"
 #include "sysemu/reset.h"
 #include "sysemu/runstate.h"
 #include "qemu/error-report.h"
@@ -229,8 +230,87 @@ static gboolean serial_watch_cb(void *do_not_use, GIOCondition cond,
     return G_SOURCE_REMOVE;
 }
 
+/*
+ * Batched transmit: hand everything queued in the transmit FIFO to the
+ * chardev with as few qemu_chr_fe_write() calls as possible, instead of
+ * shifting it out one byte at a time.
+ */
+static void serial_xmit_batch(SerialState *s)
+{
+    while (!fifo8_is_empty(&s->xmit_fifo)) {
+        uint32_t len;
+        const uint8_t *buf = fifo8_peek_bufptr(&s->xmit_fifo,
+                                               fifo8_num_used(&s->xmit_fifo),
+                                               &len);
+        int rc = qemu_chr_fe_write(&s->chr, buf, len);
+
+        if (rc > 0) {
+            fifo8_drop(&s->xmit_fifo, rc);
+            s->tsr_retry = 0;
+            continue;
+        }
+        if ((rc == 0 || (rc == -1 && errno == EAGAIN)) &&
+            s->tsr_retry < MAX_XMIT_RETRY) {
+            assert(s->watch_tag == 0);
+            s->watch_tag =
+                qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                      serial_watch_cb, s);
+            if (s->watch_tag > 0) {
+                s->tsr_retry++;
+                return;
+            }
+        }
+        /* Like the byte-wise path, drop what the backend refuses */
+        fifo8_drop(&s->xmit_fifo, len);
+        s->tsr_retry = 0;
+    }
+
+    s->lsr |= UART_LSR_THRE | UART_LSR_TEMT;
+    if (!s->thr_ipending) {
+        s->thr_ipending = 1;
+        serial_update_irq(s);
+    }
+    s->last_xmit_ts = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+static bool serial_xmit_batched(SerialState *s)
+{
+    return s->xmit_batch && (s->fcr & UART_FCR_FE) &&
+           !(s->mcr & UART_MCR_LOOP);
+}
+
+/*
+ * The batched transmitter holds nothing but the FIFO contents: once they
+ * are cleared, forget about sending them.
+ */
+static void serial_xmit_batch_cancel(SerialState *s)
+{
+    qemu_bh_cancel(s->xmit_bh);
+    if (s->watch_tag > 0) {
+        g_source_remove(s->watch_tag);
+        s->watch_tag = 0;
+    }
+    s->tsr_retry = 0;
+    s->lsr |= UART_LSR_TEMT;
+}
+
+static void serial_xmit_bh(void *opaque)
+{
+    SerialState *s = opaque;
+
+    if (serial_xmit_batched(s) && s->tsr_retry == 0 &&
+        !(s->lsr & UART_LSR_TEMT)) {
+        serial_xmit(s);
+    }
+}
+
 static void serial_xmit(SerialState *s)
 {
+    if (serial_xmit_batched(s)) {
+        serial_xmit_batch(s);
+        return;
+    }
+
     do {
         assert(!(s->lsr & UART_LSR_TEMT));
         if (s->tsr_retry == 0) {
@@ -355,7 +435,13 @@ static void serial_ioport_write(void *opaque, hwaddr addr, uint64_t val,
             s->lsr &= ~UART_LSR_THRE;
             s->lsr &= ~UART_LSR_TEMT;
             serial_update_irq(s);
-            if (s->tsr_retry == 0) {
+            if (s->tsr_retry != 0) {
+                break;
+            }
+            if (serial_xmit_batched(s) && !fifo8_is_full(&s->xmit_fifo)) {
+                /* Let the guest fill the FIFO, then drain it in one go */
+                qemu_bh_schedule(s->xmit_bh);
+            } else {
                 serial_xmit(s);
             }
         }
@@ -420,6 +506,9 @@ static void serial_ioport_write(void *opaque, hwaddr addr, uint64_t val,
         }
 
         if (val & UART_FCR_XFR) {
+            if (serial_xmit_batched(s)) {
+                serial_xmit_batch_cancel(s);
+            }
             s->lsr |= UART_LSR_THRE;
             s->thr_ipending = 1;
             fifo8_reset(&s->xmit_fifo);
@@ -519,6 +608,11 @@ static uint64_t serial_ioport_read(void *opaque, hwaddr addr, unsigned size)
         ret = s->mcr;
         break;
     case 5:
+        if (serial_xmit_batched(s) && s->tsr_retry == 0 &&
+            !(s->lsr & UART_LSR_TEMT)) {
+            /* Don't make a guest polling for THRE wait for the bottom half */
+            serial_xmit(s);
+        }
         ret = s->lsr;
         /* Clear break and overrun interrupts */
         if (s->lsr & (UART_LSR_BI|UART_LSR_OE)) {
@@ -555,10 +649,10 @@ static uint64_t serial_ioport_read(void *opaque, hwaddr addr, unsigned size)
 static int serial_can_receive(SerialState *s)
 {
     if(s->fcr & UART_FCR_FE) {
-        if (s->recv_fifo.num < UART_FIFO_LENGTH) {
+        if (s->recv_fifo.num < s->fifo_size) {
             /*
              * Advertise (fifo.itl - fifo.count) bytes when count < ITL, and 1
-             * if above. If UART_FIFO_LENGTH - fifo.count is advertised the
+             * if above. If fifo_size - fifo.count is advertised the
              * effect will be to almost always fill the fifo completely before
              * the guest has a chance to respond, effectively overriding the ITL
              * that the guest has set.
@@ -671,8 +765,14 @@ static int serial_post_load(void *opaque, int version_id)
         s->watch_tag = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
                                              serial_watch_cb, s);
     } else {
-        /* tsr_retry == 0 implies LSR.TEMT = 1 (transmitter empty).  */
-        if (!(s->lsr & UART_LSR_TEMT)) {
+        /*
+         * tsr_retry == 0 implies LSR.TEMT = 1 (transmitter empty), unless
+         * a batched transmit was still waiting to drain the FIFO.
+         */
+        if (s->xmit_batch && !(s->lsr & UART_LSR_TEMT) &&
+            !fifo8_is_empty(&s->xmit_fifo)) {
+            qemu_bh_schedule(s->xmit_bh);
+        } else if (!(s->lsr & UART_LSR_TEMT)) {
             error_report("inconsistent state in serial device "
                          "(tsr not empty, tsr_retry=0");
             return -1;
@@ -877,6 +977,7 @@ static void serial_reset(void *opaque)
     s->timeout_ipending = 0;
     timer_del(s->fifo_timeout_timer);
     timer_del(s->modem_status_poll);
+    qemu_bh_cancel(s->xmit_bh);
 
     fifo8_reset(&s->recv_fifo);
     fifo8_reset(&s->xmit_fifo);
@@ -923,15 +1024,22 @@ static void serial_realize(DeviceState *dev, Error **errp)
 {
     SerialState *s = SERIAL(dev);
 
+    if (s->fifo_size < UART_FIFO_LENGTH) {
+        error_setg(errp, "fifo-size must be at least %d", UART_FIFO_LENGTH);
+        return;
+    }
+
     s->modem_status_poll = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) serial_update_msl, s);
 
     s->fifo_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) fifo_timeout_int, s);
+    s->xmit_bh = qemu_bh_new_guarded(serial_xmit_bh, s,
+                                     &dev->mem_reentrancy_guard);
     qemu_register_reset(serial_reset, s);
 
     qemu_chr_fe_set_handlers(&s->chr, serial_can_receive1, serial_receive1,
                              serial_event, serial_be_change, s, NULL, true);
-    fifo8_create(&s->recv_fifo, UART_FIFO_LENGTH);
-    fifo8_create(&s->xmit_fifo, UART_FIFO_LENGTH);
+    fifo8_create(&s->recv_fifo, s->fifo_size);
+    fifo8_create(&s->xmit_fifo, s->fifo_size);
     serial_reset(s);
 }
 
@@ -945,6 +1053,8 @@ static void serial_unrealize(DeviceState *dev)
 
     timer_free(s->fifo_timeout_timer);
 
+    qemu_bh_delete(s->xmit_bh);
+
     fifo8_destroy(&s->recv_fifo);
     fifo8_destroy(&s->xmit_fifo);
 
@@ -968,6 +1078,8 @@ static Property serial_properties[] = {
     DEFINE_PROP_CHR("chardev", SerialState, chr),
     DEFINE_PROP_UINT32("baudbase", SerialState, baudbase, 115200),
     DEFINE_PROP_BOOL("wakeup", SerialState, wakeup, false),
+    DEFINE_PROP_UINT32("fifo-size", SerialState, fifo_size, UART_FIFO_LENGTH),
+    DEFINE_PROP_BOOL("xmit-batch", SerialState, xmit_batch, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
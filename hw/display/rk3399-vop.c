@@ -0,0 +1,517 @@
+/*
+ * Rockchip RK3399 Video Output Processor (VOP) emulation
+ *
+ * The RK3399 has two instances, VOP big and VOP little, which share the
+ * register layout modelled here.  Only window 0 is scanned out, unscaled,
+ * as the whole screen; the other windows, the scalers and the output
+ * encoders are not modelled.  That covers the primary plane of a DRM/KMS
+ * or fbdev guest.  The window 0 registers are shadowed: what the guest
+ * writes takes effect when it sets REG_CFG_DONE.
+ *
+ * Scanout goes through the framebuffer helpers: only the lines the guest
+ * dirtied since the last refresh (per the DIRTY_MEMORY_VGA log) are
+ * looked at and passed on to the UI.  When the window format matches a
+ * pixman format (most of them on little-endian hosts) the console
+ * surface points straight at guest RAM and pixman does any conversion;
+ * otherwise the dirty lines are converted into a surface of our own.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/registerfields.h"
+#include "hw/display/rk3399-vop.h"
+#include "migration/vmstate.h"
+#include "ui/pixel_ops.h"
+#include "framebuffer.h"
+#include "trace.h"
+
+REG32(REG_CFG_DONE, 0x0000)
+REG32(VERSION_INFO, 0x0004)
+REG32(SYS_CTRL, 0x0008)
+    FIELD(SYS_CTRL, STANDBY, 22, 1)
+REG32(WIN0_CTRL0, 0x0030)
+    FIELD(WIN0_CTRL0, EN, 0, 1)
+    FIELD(WIN0_CTRL0, DATA_FMT, 1, 3)
+    FIELD(WIN0_CTRL0, RB_SWAP, 12, 1)
+REG32(WIN0_VIR, 0x003c)
+    FIELD(WIN0_VIR, YRGB_VIR, 0, 14)
+REG32(WIN0_YRGB_MST, 0x0040)
+REG32(WIN0_ACT_INFO, 0x0048)
+    FIELD(WIN0_ACT_INFO, WIDTH, 0, 13)
+    FIELD(WIN0_ACT_INFO, HEIGHT, 16, 13)
+/* Interrupt registers; the upper halfword is a write enable mask */
+REG32(INTR_EN0, 0x0280)
+REG32(INTR_CLEAR0, 0x0284)
+REG32(INTR_STATUS0, 0x0288)
+REG32(INTR_RAW_STATUS0, 0x028c)
+
+#define INTR_FS                 (1 << 0)
+#define INTR_LINE_FLAG0         (1 << 3)
+#define INTR_LINE_FLAG1         (1 << 4)
+#define INTR_DSP_HOLD_VALID     (1 << 13)
+#define INTR_MASK               0x3fff
+#define INTR_VSYNC              (INTR_FS | INTR_LINE_FLAG0 | INTR_LINE_FLAG1)
+
+/* WIN0_CTRL0.DATA_FMT */
+#define VOP_FMT_ARGB8888        0
+#define VOP_FMT_RGB888          1
+#define VOP_FMT_RGB565          2
+
+/* Largest frame of VOP big */
+#define VOP_MAX_WIDTH           4096
+#define VOP_MAX_HEIGHT          2160
+
+/* The output timing is not modelled; assume a 60Hz mode */
+#define VOP_FRAME_NS            (NANOSECONDS_PER_SECOND / 60)
+
+/* Registers latched into s->active[] by REG_CFG_DONE */
+static const unsigned rk3399_vop_shadowed[] = {
+    R_WIN0_CTRL0, R_WIN0_VIR, R_WIN0_YRGB_MST, R_WIN0_ACT_INFO,
+};
+
+static void rk3399_vop_latch(RK3399VOPState *s)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(rk3399_vop_shadowed); i++) {
+        s->active[rk3399_vop_shadowed[i]] = s->regs[rk3399_vop_shadowed[i]];
+    }
+}
+
+static void rk3399_vop_update_irq(RK3399VOPState *s)
+{
+    uint32_t status = s->int_raw & s->regs[R_INTR_EN0];
+
+    trace_rk3399_vop_irq(status);
+    qemu_set_irq(s->irq, status != 0);
+}
+
+static bool rk3399_vop_standby(RK3399VOPState *s)
+{
+    return FIELD_EX32(s->regs[R_SYS_CTRL], SYS_CTRL, STANDBY);
+}
+
+/* Only keep the frame timer running while the guest waits for vblanks */
+static void rk3399_vop_update_vsync(RK3399VOPState *s)
+{
+    if (!rk3399_vop_standby(s) && (s->regs[R_INTR_EN0] & INTR_VSYNC)) {
+        if (!timer_pending(s->vsync_timer)) {
+            timer_mod(s->vsync_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + VOP_FRAME_NS);
+        }
+    } else {
+        timer_del(s->vsync_timer);
+    }
+}
+
+static void rk3399_vop_vsync(void *opaque)
+{
+    RK3399VOPState *s = opaque;
+
+    s->int_raw |= INTR_VSYNC;
+    rk3399_vop_update_irq(s);
+    timer_mod(s->vsync_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + VOP_FRAME_NS);
+}
+
+static int rk3399_vop_bytes_per_pixel(uint32_t format)
+{
+    switch (format) {
+    case VOP_FMT_ARGB8888:
+        return 4;
+    case VOP_FMT_RGB888:
+        return 3;
+    case VOP_FMT_RGB565:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+/* The pixman format matching the window layout in guest RAM, if any */
+static pixman_format_code_t rk3399_vop_native_format(RK3399VOPMode *mode)
+{
+#if HOST_BIG_ENDIAN
+    return 0;
+#else
+    switch (mode->format) {
+    case VOP_FMT_ARGB8888:
+        /* Alpha only matters for blending with the windows above */
+        return mode->rb_swap ? PIXMAN_x8b8g8r8 : PIXMAN_x8r8g8b8;
+    case VOP_FMT_RGB888:
+        return mode->rb_swap ? PIXMAN_b8g8r8 : PIXMAN_r8g8b8;
+    case VOP_FMT_RGB565:
+        /* Swapped RGB565 goes through rk3399_vop_draw_line() */
+        return mode->rb_swap ? 0 : PIXMAN_r5g6b5;
+    default:
+        return 0;
+    }
+#endif
+}
+
+static void rk3399_vop_get_mode(RK3399VOPState *s, RK3399VOPMode *mode)
+{
+    uint32_t ctrl0 = s->active[R_WIN0_CTRL0];
+    uint32_t act = s->active[R_WIN0_ACT_INFO];
+    int bpp;
+
+    memset(mode, 0, sizeof(*mode));
+    if (rk3399_vop_standby(s) || !FIELD_EX32(ctrl0, WIN0_CTRL0, EN)) {
+        return;
+    }
+
+    mode->format = FIELD_EX32(ctrl0, WIN0_CTRL0, DATA_FMT);
+    mode->rb_swap = FIELD_EX32(ctrl0, WIN0_CTRL0, RB_SWAP);
+    mode->base = s->active[R_WIN0_YRGB_MST];
+    mode->width = FIELD_EX32(act, WIN0_ACT_INFO, WIDTH) + 1;
+    mode->height = FIELD_EX32(act, WIN0_ACT_INFO, HEIGHT) + 1;
+    mode->stride = FIELD_EX32(s->active[R_WIN0_VIR], WIN0_VIR, YRGB_VIR) * 4;
+
+    bpp = rk3399_vop_bytes_per_pixel(mode->format);
+    if (!bpp) {
+        qemu_log_mask(LOG_UNIMP, "%s: unsupported win0 format %u\n",
+                      __func__, mode->format);
+        return;
+    }
+    if (mode->width > VOP_MAX_WIDTH || mode->height > VOP_MAX_HEIGHT ||
+        mode->stride < mode->width * bpp) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad win0 geometry %ux%u, "
+                      "stride %u\n", __func__, mode->width, mode->height,
+                      mode->stride);
+        return;
+    }
+    mode->enabled = true;
+}
+
+static void rk3399_vop_draw_line(void *opaque, uint8_t *d, const uint8_t *src,
+                                 int width, int deststep)
+{
+    RK3399VOPState *s = opaque;
+    uint32_t *dest = (uint32_t *)d;
+    uint32_t pixel;
+    uint8_t r, g, b;
+
+    while (width--) {
+        switch (s->mode.format) {
+        case VOP_FMT_ARGB8888:
+            pixel = ldl_le_p(src);
+            r = pixel >> 16;
+            g = pixel >> 8;
+            b = pixel;
+            src += 4;
+            break;
+        case VOP_FMT_RGB888:
+            r = src[2];
+            g = src[1];
+            b = src[0];
+            src += 3;
+            break;
+        case VOP_FMT_RGB565:
+        default:
+            pixel = lduw_le_p(src);
+            r = ((pixel >> 11) & 0x1f) << 3;
+            g = ((pixel >> 5) & 0x3f) << 2;
+            b = (pixel & 0x1f) << 3;
+            src += 2;
+            break;
+        }
+        if (s->mode.rb_swap) {
+            uint8_t tmp = r;
+
+            r = b;
+            b = tmp;
+        }
+        *dest++ = rgb_to_pixel32(r, g, b);
+    }
+}
+
+/* The surface aliases guest RAM: nothing to copy, only report the line */
+static void rk3399_vop_draw_nothing(void *opaque, uint8_t *d,
+                                    const uint8_t *src, int width,
+                                    int deststep)
+{
+}
+
+/* Stop tracking the framebuffer, and show the blank placeholder surface */
+static void rk3399_vop_blank(RK3399VOPState *s)
+{
+    if (s->fbsection.mr) {
+        memory_region_set_log(s->fbsection.mr, false, DIRTY_MEMORY_VGA);
+        memory_region_unref(s->fbsection.mr);
+        s->fbsection.mr = NULL;
+    }
+    s->mode.enabled = false;
+    dpy_gfx_replace_surface(s->con, NULL);
+}
+
+static void rk3399_vop_set_mode(RK3399VOPState *s, RK3399VOPMode *mode)
+{
+    pixman_format_code_t format;
+    DisplaySurface *surface;
+
+    memcpy(&s->mode, mode, sizeof(s->mode));
+    trace_rk3399_vop_mode(mode->enabled, mode->width, mode->height,
+                          mode->format, mode->base, mode->stride);
+    if (!mode->enabled) {
+        rk3399_vop_blank(s);
+        return;
+    }
+
+    framebuffer_update_memory_section(&s->fbsection, s->dma_mr, mode->base,
+                                      mode->height, mode->stride);
+    if (!s->fbsection.mr) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: win0 framebuffer at 0x%x is not "
+                      "in RAM\n", __func__, mode->base);
+        rk3399_vop_blank(s);
+        return;
+    }
+
+    format = rk3399_vop_native_format(mode);
+    if (format) {
+        uint8_t *fb = memory_region_get_ram_ptr(s->fbsection.mr) +
+                      s->fbsection.offset_within_region;
+
+        surface = qemu_create_displaysurface_from(mode->width, mode->height,
+                                                  format, mode->stride, fb);
+    } else {
+        surface = qemu_create_displaysurface(mode->width, mode->height);
+    }
+    dpy_gfx_replace_surface(s->con, surface);
+}
+
+static void rk3399_vop_update_display(void *opaque)
+{
+    RK3399VOPState *s = opaque;
+    DisplaySurface *surface;
+    RK3399VOPMode mode;
+    int first = 0, last = 0;
+
+    rk3399_vop_get_mode(s, &mode);
+    if (memcmp(&mode, &s->mode, sizeof(mode)) != 0) {
+        rk3399_vop_set_mode(s, &mode);
+        s->invalidate = true;
+    }
+    if (!s->mode.enabled) {
+        return;
+    }
+
+    surface = qemu_console_surface(s->con);
+    framebuffer_update_display(surface, &s->fbsection,
+                               s->mode.width, s->mode.height, s->mode.stride,
+                               surface_stride(surface), 0, s->invalidate,
+                               rk3399_vop_native_format(&s->mode) ?
+                               rk3399_vop_draw_nothing : rk3399_vop_draw_line,
+                               s, &first, &last);
+    if (first >= 0) {
+        dpy_gfx_update(s->con, 0, first, s->mode.width, last - first + 1);
+    }
+    s->invalidate = false;
+}
+
+static void rk3399_vop_invalidate_display(void *opaque)
+{
+    RK3399VOPState *s = opaque;
+
+    s->invalidate = true;
+}
+
+static uint64_t rk3399_vop_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399VOPState *s = RK3399_VOP(opaque);
+    uint32_t r;
+
+    if (offset >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return 0;
+    }
+
+    switch (offset) {
+    case A_INTR_CLEAR0:
+        r = 0;
+        break;
+    case A_INTR_STATUS0:
+        r = s->int_raw & s->regs[R_INTR_EN0];
+        break;
+    case A_INTR_RAW_STATUS0:
+        r = s->int_raw;
+        break;
+    default:
+        r = s->regs[offset >> 2];
+        break;
+    }
+
+    trace_rk3399_vop_read(offset, r);
+    return r;
+}
+
+static void rk3399_vop_write(void *opaque, hwaddr offset, uint64_t value,
+                             unsigned size)
+{
+    RK3399VOPState *s = RK3399_VOP(opaque);
+    uint32_t mask = (value >> 16) & INTR_MASK;
+    bool standby = rk3399_vop_standby(s);
+
+    if (offset >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    }
+
+    trace_rk3399_vop_write(offset, value);
+
+    switch (offset) {
+    case A_VERSION_INFO:
+    case A_INTR_STATUS0:
+    case A_INTR_RAW_STATUS0:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    case A_INTR_EN0:
+        s->regs[R_INTR_EN0] = (s->regs[R_INTR_EN0] & ~mask) | (value & mask);
+        rk3399_vop_update_irq(s);
+        rk3399_vop_update_vsync(s);
+        break;
+    case A_INTR_CLEAR0:
+        s->int_raw &= ~(value & mask);
+        rk3399_vop_update_irq(s);
+        break;
+    case A_SYS_CTRL:
+        s->regs[R_SYS_CTRL] = value;
+        /* The output stops at the end of the frame and holds */
+        if (!standby && rk3399_vop_standby(s)) {
+            s->int_raw |= INTR_DSP_HOLD_VALID;
+            rk3399_vop_update_irq(s);
+        }
+        rk3399_vop_update_vsync(s);
+        break;
+    case A_REG_CFG_DONE:
+        /* Shadowed registers take effect; the next refresh picks them up */
+        rk3399_vop_latch(s);
+        s->invalidate = true;
+        break;
+    default:
+        s->regs[offset >> 2] = value;
+        break;
+    }
+}
+
+static const MemoryRegionOps rk3399_vop_ops = {
+    .read = rk3399_vop_read,
+    .write = rk3399_vop_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static const GraphicHwOps rk3399_vop_gfx_ops = {
+    .invalidate = rk3399_vop_invalidate_display,
+    .gfx_update = rk3399_vop_update_display,
+};
+
+static void rk3399_vop_reset(DeviceState *dev)
+{
+    RK3399VOPState *s = RK3399_VOP(dev);
+
+    memset(s->regs, 0, sizeof(s->regs));
+    memset(s->active, 0, sizeof(s->active));
+    /* Out of reset the output is in standby until the driver sets a mode */
+    s->regs[R_SYS_CTRL] = R_SYS_CTRL_STANDBY_MASK;
+    s->int_raw = 0;
+    timer_del(s->vsync_timer);
+    rk3399_vop_update_irq(s);
+    s->invalidate = true;
+}
+
+static void rk3399_vop_init(Object *obj)
+{
+    RK3399VOPState *s = RK3399_VOP(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_vop_ops, s,
+                          TYPE_RK3399_VOP, RK3399_VOP_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+}
+
+static void rk3399_vop_realize(DeviceState *dev, Error **errp)
+{
+    RK3399VOPState *s = RK3399_VOP(dev);
+
+    if (!s->dma_mr) {
+        error_setg(errp, TYPE_RK3399_VOP " 'dma-memory' link not set");
+        return;
+    }
+
+    s->vsync_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, rk3399_vop_vsync, s);
+    s->con = graphic_console_init(dev, 0, &rk3399_vop_gfx_ops, s);
+}
+
+static int rk3399_vop_post_load(void *opaque, int version_id)
+{
+    RK3399VOPState *s = opaque;
+
+    /* Version 1 did not shadow the window registers */
+    if (version_id < 2) {
+        rk3399_vop_latch(s);
+    }
+
+    /* Set the surface up again on the next refresh */
+    memset(&s->mode, 0, sizeof(s->mode));
+    s->invalidate = true;
+    return 0;
+}
+
+static Property rk3399_vop_properties[] = {
+    DEFINE_PROP_LINK("dma-memory", RK3399VOPState, dma_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static const VMStateDescription rk3399_vop_vmstate = {
+    .name = "rk3399-vop",
+    .version_id = 2,
+    .minimum_version_id = 1,
+    .post_load = rk3399_vop_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, RK3399VOPState, RK3399_VOP_NR_REGS),
+        VMSTATE_UINT32_ARRAY_V(active, RK3399VOPState, RK3399_VOP_NR_REGS, 2),
+        VMSTATE_UINT32(int_raw, RK3399VOPState),
+        VMSTATE_TIMER_PTR(vsync_timer, RK3399VOPState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_vop_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = rk3399_vop_realize;
+    dc->vmsd = &rk3399_vop_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_vop_reset);
+    device_class_set_props(dc, rk3399_vop_properties);
+    set_bit(DEVICE_CATEGORY_DISPLAY, dc->categories);
+}
+
+static const TypeInfo rk3399_vop_info = {
+    .name = TYPE_RK3399_VOP,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399VOPState),
+    .instance_init = rk3399_vop_init,
+    .class_init = rk3399_vop_class_init,
+};
+
+static void rk3399_vop_register_types(void)
+{
+    type_register_static(&rk3399_vop_info);
+}
+
+type_init(rk3399_vop_register_types);
@@ -16,6 +16,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
 #include "hw/sysbus.h"
@@ -61,6 +62,11 @@
 
 #define PL330_WATCHDOG_LIMIT        1024
 
+/* Program bytes scanned for a copy loop: a DMALPEND jumps back <= 255 bytes */
+#define PL330_BULK_WINDOW           (255 + 2)
+/* Bounce buffer size for bulk copies */
+#define PL330_BULK_CHUNK            (64 * KiB)
+
 /* IOMEM mapped registers */
 #define PL330_REG_DSR               0x000
 #define PL330_REG_DPC               0x004
@@ -367,15 +373,18 @@ static inline int pl330_fifo_num_free(PL330Fifo *s)
 
 static int pl330_fifo_push(PL330Fifo *s, uint8_t *buf, int len, uint8_t tag)
 {
-    int i;
+    int i, n;
 
     if (s->buf_size - s->num < len) {
         return PL330_FIFO_STALL;
     }
-    for (i = 0; i < len; i++) {
+    /* At most two contiguous runs, split where the buffer wraps */
+    for (i = 0; i < len; i += n) {
         int push_idx = (s->head + s->num + i) % s->buf_size;
-        s->buf[push_idx] = buf[i];
-        s->tag[push_idx] = tag;
+
+        n = MIN(len - i, s->buf_size - push_idx);
+        memcpy(&s->buf[push_idx], &buf[i], n);
+        memset(&s->tag[push_idx], tag, n);
     }
     s->num += len;
     return PL330_FIFO_OK;
@@ -1129,6 +1138,87 @@ static inline void pl330_update_pc(PL330Chan *ch,
     ch->pc += insn->size;
 }
 
+/*
+ * Fast path for memory-to-memory copy loops, as emitted by the Linux
+ * driver for memcpy offload:
+ *
+ *     DMALD; DMAST; [DMALD; DMAST; ...] DMALPEND
+ *
+ * with both addresses incrementing and aligned and the same number of
+ * bytes per burst on either side.  Rather than queueing every burst and
+ * moving it through the MFIFO, all remaining iterations are done as one
+ * bulk copy and the channel carries on after the loop.  Anything else
+ * (peripheral handshakes, conditional transfers, overlapping buffers or
+ * data of this channel still in flight) takes the cycle-by-cycle path.
+ *
+ * Returns true if the loop was executed.
+ */
+static bool pl330_chan_bulk_copy(PL330Chan *ch)
+{
+    PL330State *s = ch->parent;
+    uint8_t prog[PL330_BULK_WINDOW];
+    g_autofree uint8_t *buf = NULL;
+    uint32_t src_size, dst_size, burst, pairs = 0;
+    uint64_t total, done, len;
+    int off, lc;
+
+    if (ch->is_manager ||
+        pl330_fifo_has_tag(&s->fifo, ch->tag) ||
+        pl330_queue_find_insn(&s->read_queue, ch->tag, false) ||
+        pl330_queue_find_insn(&s->write_queue, ch->tag, false)) {
+        return false;
+    }
+    if (dma_memory_read(s->mem_as, ch->pc, prog, sizeof(prog),
+                        MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        return false;
+    }
+
+    /* Unconditional DMALD/DMAST pairs... */
+    for (off = 0; off + 2 < sizeof(prog); off += 2) {
+        if (prog[off] != 0x04 || prog[off + 1] != 0x08) {
+            break;
+        }
+        pairs++;
+    }
+    /* ...closed by an unconditional DMALPEND jumping back to the first one */
+    if (!pairs || (prog[off] & ~0x04) != 0x38 || prog[off + 1] != off) {
+        return false;
+    }
+    lc = extract32(prog[off], 2, 1);
+
+    src_size = 1 << extract32(ch->control, 1, 3);
+    dst_size = 1 << extract32(ch->control, 15, 3);
+    burst = src_size * (extract32(ch->control, 4, 4) + 1);
+    if (!extract32(ch->control, 0, 1) || !extract32(ch->control, 14, 1) ||
+        burst != dst_size * (extract32(ch->control, 18, 4) + 1) ||
+        (ch->src & (src_size - 1)) || (ch->dst & (dst_size - 1))) {
+        return false;
+    }
+
+    total = (uint64_t)(ch->lc[lc] + 1) * pairs * burst;
+    if (ch->src + total > UINT32_MAX + 1ULL ||
+        ch->dst + total > UINT32_MAX + 1ULL ||
+        (ch->src < ch->dst + total && ch->dst < ch->src + total)) {
+        return false;
+    }
+
+    trace_pl330_bulk_copy(ch->tag, ch->src, ch->dst, total);
+    buf = g_malloc(MIN(total, PL330_BULK_CHUNK));
+    for (done = 0; done < total; done += len) {
+        len = MIN(total - done, PL330_BULK_CHUNK);
+        dma_memory_read(s->mem_as, ch->src + done, buf, len,
+                        MEMTXATTRS_UNSPECIFIED);
+        dma_memory_write(s->mem_as, ch->dst + done, buf, len,
+                         MEMTXATTRS_UNSPECIFIED);
+    }
+
+    ch->src += total;
+    ch->dst += total;
+    ch->lc[lc] = 0;
+    ch->pc += off + 2;
+    return true;
+}
+
 /* Try to execute current instruction in channel CH. Number of executed
    instructions is returned (0 or 1). */
 static int pl330_chan_exec(PL330Chan *ch)
@@ -1148,6 +1238,10 @@ static int pl330_chan_exec(PL330Chan *ch)
         pl330_fault(ch, PL330_FAULT_UNDEF_INSTR);
         return 0;
     }
+    if (insn->exec == pl330_dmald && pl330_chan_bulk_copy(ch)) {
+        ch->watchdog_timer = 0;
+        return 1;
+    }
     pl330_exec_insn(ch, insn);
     if (!ch->stall) {
         pl330_update_pc(ch, insn);
@@ -0,0 +1,371 @@
+/*
+ * Rockchip RK3399 Clock and Reset Unit (CRU / PMUCRU) emulation
+ *
+ * Both clock units are described by a declarative register table.  The
+ * table gives the reset value and the write semantics of every register,
+ * most notably the Rockchip "hiword mask" convention in which bits [31:16]
+ * of a write select which of bits [15:0] are updated.
+ *
+ * The CRU also drives the core clocks of the two CPU clusters out of the
+ * PLL and CLKSEL settings, so that the board can follow the rate the
+ * guest's cpufreq driver programs.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/qdev-clock.h"
+#include "hw/sysbus.h"
+#include "migration/vmstate.h"
+#include "sysemu/runstate.h"
+#include "hw/misc/rk3399-cru.h"
+#include "trace.h"
+
+#define REG_INDEX(offset)    ((offset) / sizeof(uint32_t))
+
+#define XIN24M_FREQ             24000000
+#define XIN32K_FREQ             32768
+
+/* PLL_CON0 */
+#define PLL_CON0_FBDIV_MASK     0xfff
+
+/* PLL_CON1 */
+#define PLL_CON1_REFDIV_MASK    0x3f
+#define PLL_CON1_POSTDIV1_SHIFT 8
+#define PLL_CON1_POSTDIV2_SHIFT 12
+#define PLL_CON1_POSTDIV_MASK   0x7
+
+/* PLL_CON2 */
+#define PLL_CON2_LOCK           (1u << 31)
+#define PLL_CON2_FRAC_MASK      0x00ffffff
+
+/* PLL_CON3 */
+#define PLL_CON3_PWRDOWN        (1 << 0)
+#define PLL_CON3_DSMPD          (1 << 3)
+#define PLL_CON3_MODE_SHIFT     8
+#define PLL_CON3_MODE_MASK      0x3
+#define PLL_MODE_SLOW           0
+#define PLL_MODE_NORMAL         1
+#define PLL_MODE_DEEP_SLOW      2
+
+/* CLKSEL_CON0 / CLKSEL_CON2: core clock of the little / big cluster */
+#define CLKSEL_CORE_L           0x100
+#define CLKSEL_CORE_B           0x108
+#define CLKSEL_CORE_DIV_MASK    0x1f
+#define CLKSEL_CORE_SRC_SHIFT   6
+#define CLKSEL_CORE_SRC_MASK    0x3
+
+/* GLB_SRST_FST_VALUE / GLB_SRST_SND_VALUE magic values */
+#define GLB_SRST_FST_MAGIC      0xfdb9
+#define GLB_SRST_SND_MAGIC      0xeca8
+
+/* CON0 (fbdiv), CON1 (dividers), CON2 (frac/lock), CON3 (mode), CON4-5 */
+#define RK3399_PLL_REGS_RESET(pll, base, con0, con1, con2, con3, con4)      \
+    { pll "_CON0", (base) + 0x00, 1, (con0), RK3399_CRU_REG_HIWORD },       \
+    { pll "_CON1", (base) + 0x04, 1, (con1), RK3399_CRU_REG_HIWORD },       \
+    { pll "_CON2", (base) + 0x08, 1, (con2), RK3399_CRU_REG_PLL_CON2 },     \
+    { pll "_CON3", (base) + 0x0c, 1, (con3), RK3399_CRU_REG_HIWORD },       \
+    { pll "_CON4", (base) + 0x10, 1, (con4), RK3399_CRU_REG_HIWORD },       \
+    { pll "_CON5", (base) + 0x14, 1, 0x00000008, RK3399_CRU_REG_HIWORD }
+#define RK3399_PLL_REGS(pll, base)                                          \
+    RK3399_PLL_REGS_RESET(pll, base, 0x00000064, 0x00000064, 0x00000000,    \
+                          0x00000008, 0x00000008)
+
+/*
+ * The boot firmware, which is not modelled, leaves the cluster PLLs in
+ * normal mode at the top operating point of their cluster: 24MHz * 59
+ * (1416MHz) for LPLL and 24MHz * 75 (1800MHz) for BPLL, all dividers 1.
+ */
+#define PLL_CON1_DIV1           0x00001101
+#define PLL_CON3_NORMAL         0x00000108
+
+/*
+ * Values the original board model preset at offsets 0x08 and 0x90 of both
+ * units, which guests booted on it may rely on.
+ */
+#define CRU_RESET_0x08          0x0000031f
+#define CRU_RESET_0x90          0x000002dc
+
+static const RK3399CRURegInfo rk3399_cru_regs[] = {
+    RK3399_PLL_REGS_RESET("LPLL", 0x000, 59, PLL_CON1_DIV1, CRU_RESET_0x08,
+                          PLL_CON3_NORMAL, 0x00000008),
+    RK3399_PLL_REGS_RESET("BPLL", 0x020, 75, PLL_CON1_DIV1, 0x00000000,
+                          PLL_CON3_NORMAL, 0x00000008),
+    RK3399_PLL_REGS("DPLL", 0x040),
+    RK3399_PLL_REGS("CPLL", 0x060),
+    RK3399_PLL_REGS_RESET("GPLL", 0x080, 0x00000064, 0x00000064, 0x00000000,
+                          0x00000008, CRU_RESET_0x90),
+    RK3399_PLL_REGS("NPLL", 0x0a0),
+    RK3399_PLL_REGS("VPLL", 0x0c0),
+    { "CLKSEL_CON",         0x100, 108, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { "CLKGATE_CON",        0x300, 35,  0x00000000, RK3399_CRU_REG_HIWORD },
+    { "SOFTRST_CON",        0x400, 21,  0x00000000, RK3399_CRU_REG_HIWORD },
+    { "GLB_SRST_FST_VALUE", 0x500, 1,   0x00000000, RK3399_CRU_REG_GLB_SRST },
+    { "GLB_SRST_SND_VALUE", 0x504, 1,   0x00000000, RK3399_CRU_REG_GLB_SRST },
+    { "GLB_CNT_TH",         0x508, 1,   0x00000064, 0 },
+    { "MISC_CON",           0x50c, 1,   0x00000000, RK3399_CRU_REG_HIWORD },
+    { "GLB_RST_CON",        0x510, 1,   0x00000000, 0 },
+    { "GLB_RST_ST",         0x514, 1,   0x00000000, RK3399_CRU_REG_RO },
+    { "SDMMC_CON",          0x580, 2,   0x00000000, RK3399_CRU_REG_HIWORD },
+    { "SDIO0_CON",          0x588, 2,   0x00000000, RK3399_CRU_REG_HIWORD },
+    { "SDIO1_CON",          0x590, 2,   0x00000000, RK3399_CRU_REG_HIWORD },
+    { NULL }
+};
+
+static const RK3399CRURegInfo rk3399_pmucru_regs[] = {
+    RK3399_PLL_REGS_RESET("PPLL", 0x000, 0x00000064, 0x00000064,
+                          CRU_RESET_0x08, 0x00000008, 0x00000008),
+    { "PMUCRU_CLKSEL_CON",   0x080, 4, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { "PMUCRU_CLKSEL_CON",   0x090, 1, CRU_RESET_0x90, RK3399_CRU_REG_HIWORD },
+    { "PMUCRU_CLKSEL_CON",   0x094, 1, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { "PMUCRU_CLKGATE_CON",  0x100, 3, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { "PMUCRU_SOFTRST_CON",  0x110, 2, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { "PMUCRU_RSTNHOLD_CON", 0x120, 2, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { "PMUCRU_GATEDIS_CON",  0x130, 2, 0x00000000, RK3399_CRU_REG_HIWORD },
+    { NULL }
+};
+
+static bool rk3399_cru_pll_locked(RK3399CRUState *s, hwaddr offset)
+{
+    hwaddr con3 = QEMU_ALIGN_DOWN(offset, RK3399_CRU_PLL_STRIDE) + 0x0c;
+
+    /* The PLL locks instantly once it is powered up. */
+    return !(s->regs[REG_INDEX(con3)] & PLL_CON3_PWRDOWN);
+}
+
+/* Output rate of the PLL whose registers start at @base */
+static uint64_t rk3399_cru_pll_rate(RK3399CRUState *s, hwaddr base)
+{
+    uint32_t con0 = s->regs[REG_INDEX(base)];
+    uint32_t con1 = s->regs[REG_INDEX(base + 0x04)];
+    uint32_t con2 = s->regs[REG_INDEX(base + 0x08)];
+    uint32_t con3 = s->regs[REG_INDEX(base + 0x0c)];
+    uint32_t refdiv = con1 & PLL_CON1_REFDIV_MASK;
+    uint32_t postdiv1 = (con1 >> PLL_CON1_POSTDIV1_SHIFT) &
+                        PLL_CON1_POSTDIV_MASK;
+    uint32_t postdiv2 = (con1 >> PLL_CON1_POSTDIV2_SHIFT) &
+                        PLL_CON1_POSTDIV_MASK;
+    uint64_t rate;
+
+    switch ((con3 >> PLL_CON3_MODE_SHIFT) & PLL_CON3_MODE_MASK) {
+    case PLL_MODE_SLOW:
+        return XIN24M_FREQ;
+    case PLL_MODE_DEEP_SLOW:
+        return XIN32K_FREQ;
+    case PLL_MODE_NORMAL:
+        break;
+    default:
+        return 0;
+    }
+
+    if ((con3 & PLL_CON3_PWRDOWN) || !refdiv || !postdiv1 || !postdiv2) {
+        return 0;
+    }
+
+    rate = (uint64_t)XIN24M_FREQ * (con0 & PLL_CON0_FBDIV_MASK);
+    if (!(con3 & PLL_CON3_DSMPD)) {
+        /* Fractional mode adds frac / 2^24 to the feedback divider */
+        rate += ((uint64_t)XIN24M_FREQ * (con2 & PLL_CON2_FRAC_MASK)) >> 24;
+    }
+    return rate / refdiv / postdiv1 / postdiv2;
+}
+
+/* Core clock of a cluster: one of four PLLs through an integer divider */
+static uint64_t rk3399_cru_core_rate(RK3399CRUState *s, hwaddr clksel)
+{
+    static const hwaddr src_pll[] = { 0x000, 0x020, 0x040, 0x080 };
+    uint32_t val = s->regs[REG_INDEX(clksel)];
+    int src = (val >> CLKSEL_CORE_SRC_SHIFT) & CLKSEL_CORE_SRC_MASK;
+
+    return rk3399_cru_pll_rate(s, src_pll[src]) /
+           ((val & CLKSEL_CORE_DIV_MASK) + 1);
+}
+
+static void rk3399_cru_update_clocks(RK3399CRUState *s)
+{
+    if (!RK3399_CRU_GET_CLASS(s)->has_core_clocks) {
+        return;
+    }
+    clock_update(s->armclk[0],
+                 CLOCK_PERIOD_FROM_HZ(rk3399_cru_core_rate(s, CLKSEL_CORE_L)));
+    clock_update(s->armclk[1],
+                 CLOCK_PERIOD_FROM_HZ(rk3399_cru_core_rate(s, CLKSEL_CORE_B)));
+}
+
+static uint64_t rk3399_cru_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399CRUState *s = RK3399_CRU(opaque);
+    const uint32_t idx = REG_INDEX(offset);
+    const RK3399CRURegInfo *info = s->info[idx];
+    uint32_t val;
+
+    if (!info) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad read offset 0x%04x\n",
+                      __func__, (uint32_t)offset);
+        return 0;
+    }
+
+    val = s->regs[idx];
+    if ((info->flags & RK3399_CRU_REG_PLL_CON2) &&
+        rk3399_cru_pll_locked(s, offset)) {
+        val |= PLL_CON2_LOCK;
+    }
+
+    trace_rk3399_cru_read(object_get_typename(OBJECT(s)), info->name,
+                          offset, val);
+    return val;
+}
+
+static void rk3399_cru_write(void *opaque, hwaddr offset, uint64_t val,
+                             unsigned size)
+{
+    RK3399CRUState *s = RK3399_CRU(opaque);
+    const uint32_t idx = REG_INDEX(offset);
+    const RK3399CRURegInfo *info = s->info[idx];
+    uint32_t mask;
+
+    if (!info) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad write offset 0x%04x\n",
+                      __func__, (uint32_t)offset);
+        return;
+    }
+
+    trace_rk3399_cru_write(object_get_typename(OBJECT(s)), info->name,
+                           offset, val);
+
+    if (info->flags & RK3399_CRU_REG_RO) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only %s\n",
+                      __func__, info->name);
+        return;
+    }
+
+    if (info->flags & RK3399_CRU_REG_HIWORD) {
+        mask = val >> 16;
+        s->regs[idx] = (s->regs[idx] & ~mask) | (val & mask);
+    } else if (info->flags & RK3399_CRU_REG_PLL_CON2) {
+        /* The lock status bit is computed on read */
+        s->regs[idx] = val & PLL_CON2_FRAC_MASK;
+    } else {
+        s->regs[idx] = val;
+    }
+
+    rk3399_cru_update_clocks(s);
+
+    if (info->flags & RK3399_CRU_REG_GLB_SRST) {
+        uint32_t magic = offset == 0x500 ? GLB_SRST_FST_MAGIC
+                                         : GLB_SRST_SND_MAGIC;
+        if ((val & 0xffff) == magic) {
+            qemu_system_reset_request(SHUTDOWN_CAUSE_GUEST_RESET);
+        }
+    }
+}
+
+static const MemoryRegionOps rk3399_cru_ops = {
+    .read = rk3399_cru_read,
+    .write = rk3399_cru_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .impl.min_access_size = 4,
+};
+
+static void rk3399_cru_reset(DeviceState *dev)
+{
+    RK3399CRUState *s = RK3399_CRU(dev);
+    int i;
+
+    for (i = 0; i < RK3399_CRU_NR_REGS; i++) {
+        s->regs[i] = s->info[i] ? s->info[i]->reset : 0;
+    }
+    rk3399_cru_update_clocks(s);
+}
+
+static void rk3399_cru_init(Object *obj)
+{
+    RK3399CRUState *s = RK3399_CRU(obj);
+
+    if (RK3399_CRU_GET_CLASS(s)->has_core_clocks) {
+        s->armclk[0] = qdev_init_clock_out(DEVICE(s), "armclkl");
+        s->armclk[1] = qdev_init_clock_out(DEVICE(s), "armclkb");
+    }
+}
+
+static void rk3399_cru_realize(DeviceState *dev, Error **errp)
+{
+    RK3399CRUState *s = RK3399_CRU(dev);
+    RK3399CRUClass *rc = RK3399_CRU_GET_CLASS(s);
+    const RK3399CRURegInfo *info;
+    unsigned i;
+
+    /* Expand the register table into a per-slot lookup */
+    for (info = rc->regs; info->name; info++) {
+        for (i = 0; i < info->count; i++) {
+            uint32_t idx = REG_INDEX(info->offset) + i;
+
+            assert(idx < RK3399_CRU_NR_REGS && !s->info[idx]);
+            s->info[idx] = info;
+        }
+    }
+
+    memory_region_init_io(&s->iomem, OBJECT(s), &rk3399_cru_ops, s,
+                          object_get_typename(OBJECT(s)), RK3399_CRU_IOSIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+}
+
+static int rk3399_cru_post_load(void *opaque, int version_id)
+{
+    rk3399_cru_update_clocks(RK3399_CRU(opaque));
+    return 0;
+}
+
+static const VMStateDescription rk3399_cru_vmstate = {
+    .name = "rk3399-cru",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = rk3399_cru_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, RK3399CRUState, RK3399_CRU_NR_REGS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_cru_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    RK3399CRUClass *rc = RK3399_CRU_CLASS(klass);
+
+    dc->realize = rk3399_cru_realize;
+    device_class_set_legacy_reset(dc, rk3399_cru_reset);
+    dc->vmsd = &rk3399_cru_vmstate;
+    rc->regs = rk3399_cru_regs;
+    rc->has_core_clocks = true;
+}
+
+static void rk3399_pmucru_class_init(ObjectClass *klass, void *data)
+{
+    RK3399CRUClass *rc = RK3399_CRU_CLASS(klass);
+
+    rc->regs = rk3399_pmucru_regs;
+    rc->has_core_clocks = false;
+}
+
+static const TypeInfo rk3399_cru_types[] = {
+    {
+        .name          = TYPE_RK3399_CRU,
+        .parent        = TYPE_SYS_BUS_DEVICE,
+        .instance_size = sizeof(RK3399CRUState),
+        .instance_init = rk3399_cru_init,
+        .class_size    = sizeof(RK3399CRUClass),
+        .class_init    = rk3399_cru_class_init,
+    }, {
+        .name          = TYPE_RK3399_PMUCRU,
+        .parent        = TYPE_RK3399_CRU,
+        .class_init    = rk3399_pmucru_class_init,
+    },
+};
+
+DEFINE_TYPES(rk3399_cru_types)
@@ -0,0 +1,769 @@
+/*
+ * Rockchip RK3399 crypto engine emulation
+ *
+ * The block cipher unit (AES, DES and 3DES) and the hash unit (SHA-1,
+ * MD5 and SHA-256), each fed by its own DMA engine or, for the ciphers,
+ * through the data registers one block at a time.  All of the work is
+ * handed to the QEMU crypto layer and so to whatever acceleration the
+ * host has:
+ *
+ *  - a block DMA transfer is read in, processed and written back in a
+ *    single qcrypto_cipher_encrypt/decrypt call;
+ *  - the hash unit is given the whole message length up front and then
+ *    fed in chunks; the chunks are collected and the message is hashed
+ *    in a single qcrypto_hash_bytes call once its last byte is in.
+ *
+ * The PKA, the PRNG hash mode, HMAC and the TRNG are not modelled.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "crypto/hash.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/registerfields.h"
+#include "hw/misc/rk3399-crypto.h"
+#include "migration/vmstate.h"
+#include "sysemu/dma.h"
+#include "trace.h"
+
+REG32(INTSTS, 0x000)
+    FIELD(INTSTS, BCDMA_DONE, 0, 1)
+    FIELD(INTSTS, BCDMA_ERR, 1, 1)
+    FIELD(INTSTS, HRDMA_DONE, 2, 1)
+    FIELD(INTSTS, HRDMA_ERR, 3, 1)
+    FIELD(INTSTS, HASH_DONE, 4, 1)
+REG32(INTENA, 0x004)
+REG32(CTRL, 0x008)
+    FIELD(CTRL, AES_START, 0, 1)
+    FIELD(CTRL, TDES_START, 1, 1)
+    FIELD(CTRL, BLOCK_START, 2, 1)
+    FIELD(CTRL, HASH_START, 3, 1)
+    FIELD(CTRL, PKA_START, 4, 1)
+    FIELD(CTRL, BLOCK_FLUSH, 5, 1)
+    FIELD(CTRL, HASH_FLUSH, 6, 1)
+    FIELD(CTRL, TRNG_START, 8, 1)
+REG32(CONF, 0x00c)
+    FIELD(CONF, HASHINSEL, 0, 2)
+    FIELD(CONF, DESSEL, 2, 1)
+    FIELD(CONF, BYTESWAP_BRFIFO, 3, 1)
+    FIELD(CONF, BYTESWAP_BTFIFO, 4, 1)
+    FIELD(CONF, BYTESWAP_HRFIFO, 5, 1)
+REG32(BRDMAS, 0x010)
+REG32(BTDMAS, 0x014)
+REG32(BRDMAL, 0x018)
+REG32(HRDMAS, 0x01c)
+REG32(HRDMAL, 0x020)
+REG32(AES_CTRL, 0x080)
+    FIELD(AES_CTRL, DEC, 0, 1)
+    FIELD(AES_CTRL, KEY_SIZE, 2, 2)
+    FIELD(AES_CTRL, MODE, 4, 2)
+    FIELD(AES_CTRL, BYTESWAP_DI, 7, 1)
+    FIELD(AES_CTRL, BYTESWAP_DO, 8, 1)
+    FIELD(AES_CTRL, BYTESWAP_IV, 9, 1)
+    FIELD(AES_CTRL, BYTESWAP_KEY, 10, 1)
+    FIELD(AES_CTRL, BYTESWAP_CNT, 11, 1)
+REG32(AES_STS, 0x084)
+REG32(AES_DIN_0, 0x088)
+REG32(AES_DOUT_0, 0x098)
+REG32(AES_IV_0, 0x0a8)
+REG32(AES_KEY_0, 0x0b8)
+REG32(AES_CNT_0, 0x0d8)
+REG32(TDES_CTRL, 0x100)
+    FIELD(TDES_CTRL, DEC, 0, 1)
+    FIELD(TDES_CTRL, SELECT, 2, 1)
+    FIELD(TDES_CTRL, EEE, 3, 1)
+    FIELD(TDES_CTRL, CBC, 4, 1)
+    FIELD(TDES_CTRL, BYTESWAP_DI, 5, 1)
+    FIELD(TDES_CTRL, BYTESWAP_DO, 6, 1)
+    FIELD(TDES_CTRL, BYTESWAP_IV, 7, 1)
+    FIELD(TDES_CTRL, BYTESWAP_KEY, 8, 1)
+REG32(TDES_STS, 0x104)
+REG32(TDES_DIN_0, 0x108)
+REG32(TDES_DOUT_0, 0x110)
+REG32(TDES_IV_0, 0x118)
+REG32(TDES_KEY1_0, 0x120)
+REG32(HASH_CTRL, 0x180)
+    FIELD(HASH_CTRL, ALG, 0, 2)
+    FIELD(HASH_CTRL, SWAP_DO, 3, 1)
+REG32(HASH_STS, 0x184)
+REG32(HASH_MSG_LEN, 0x188)
+REG32(HASH_DOUT_0, 0x18c)
+REG32(HASH_SEED_0, 0x1ac)
+
+#define STS_DONE                1
+#define CTRL_START_MASK         (R_CTRL_AES_START_MASK | \
+                                 R_CTRL_TDES_START_MASK | \
+                                 R_CTRL_BLOCK_START_MASK | \
+                                 R_CTRL_HASH_START_MASK | \
+                                 R_CTRL_PKA_START_MASK | \
+                                 R_CTRL_TRNG_START_MASK)
+
+/* CONF.HASHINSEL */
+#define HASHINSEL_INDEPENDENT   0
+#define HASHINSEL_BLOCK_INPUT   1
+#define HASHINSEL_BLOCK_OUTPUT  2
+
+/* AES_CTRL.MODE */
+#define AES_MODE_ECB            0
+#define AES_MODE_CBC            1
+#define AES_MODE_CTR            2
+
+/* HASH_CTRL.ALG */
+#define HASH_ALG_SHA1           0
+#define HASH_ALG_MD5            1
+#define HASH_ALG_SHA256         2
+
+#define HASH_DOUT_WORDS         8
+/* Largest cipher transfer or hash message handled */
+#define MAX_DMA_LEN             (64 * MiB)
+
+#define REG_INDEX(offset)       ((offset) / sizeof(uint32_t))
+
+/* Everything needed to run one block cipher operation */
+typedef struct RK3399CryptoOp {
+    QCryptoCipherAlgo alg;
+    QCryptoCipherMode mode;
+    bool decrypt;
+    size_t block_len;
+    /* Registers holding the IV (or counter), and their byte order */
+    hwaddr iv_reg;
+    bool iv_swap;
+} RK3399CryptoOp;
+
+static void rk3399_crypto_update_irq(RK3399CryptoState *s)
+{
+    uint32_t pending = s->regs[R_INTSTS] & s->regs[R_INTENA];
+
+    trace_rk3399_crypto_irq(pending);
+    qemu_set_irq(s->irq, pending != 0);
+}
+
+/*
+ * Keys, IVs and data registers hold big-endian words unless the matching
+ * byte swap is enabled, in which case they hold the bytes in memory order.
+ */
+static void rk3399_crypto_get_bytes(RK3399CryptoState *s, hwaddr offset,
+                                    uint8_t *buf, size_t len, bool swap)
+{
+    size_t i;
+
+    for (i = 0; i < len; i += 4) {
+        uint32_t word = s->regs[REG_INDEX(offset + i)];
+
+        if (swap) {
+            stl_le_p(buf + i, word);
+        } else {
+            stl_be_p(buf + i, word);
+        }
+    }
+}
+
+static void rk3399_crypto_set_bytes(RK3399CryptoState *s, hwaddr offset,
+                                    const uint8_t *buf, size_t len, bool swap)
+{
+    size_t i;
+
+    for (i = 0; i < len; i += 4) {
+        s->regs[REG_INDEX(offset + i)] = swap ? ldl_le_p(buf + i)
+                                              : ldl_be_p(buf + i);
+    }
+}
+
+/* The DMA FIFOs swap each word unless told not to */
+static void rk3399_crypto_fifo_swap(uint8_t *buf, size_t len, bool byteswap)
+{
+    size_t i;
+
+    if (byteswap) {
+        return;
+    }
+    for (i = 0; i + 4 <= len; i += 4) {
+        stl_be_p(buf + i, ldl_le_p(buf + i));
+    }
+}
+
+/*
+ * Decode the cipher configuration and make sure s->cipher is set up for
+ * it, keyed and with the current IV.  The context is only rebuilt when
+ * the algorithm, mode or key changed since the last operation.
+ */
+static bool rk3399_crypto_cipher_setup(RK3399CryptoState *s, bool des,
+                                       RK3399CryptoOp *op)
+{
+    uint8_t key[sizeof(s->cipher_key)] = { 0 };
+    uint8_t iv[16];
+    size_t key_len;
+    Error *err = NULL;
+
+    if (des) {
+        uint32_t ctrl = s->regs[R_TDES_CTRL];
+        bool tdes = FIELD_EX32(ctrl, TDES_CTRL, SELECT);
+
+        if (tdes && FIELD_EX32(ctrl, TDES_CTRL, EEE)) {
+            qemu_log_mask(LOG_UNIMP, "%s: 3DES EEE mode\n", __func__);
+            return false;
+        }
+        op->alg = tdes ? QCRYPTO_CIPHER_ALGO_3DES : QCRYPTO_CIPHER_ALGO_DES;
+        op->mode = FIELD_EX32(ctrl, TDES_CTRL, CBC) ? QCRYPTO_CIPHER_MODE_CBC
+                                                    : QCRYPTO_CIPHER_MODE_ECB;
+        op->decrypt = FIELD_EX32(ctrl, TDES_CTRL, DEC);
+        op->iv_reg = A_TDES_IV_0;
+        op->iv_swap = FIELD_EX32(ctrl, TDES_CTRL, BYTESWAP_IV);
+        key_len = tdes ? 24 : 8;
+        rk3399_crypto_get_bytes(s, A_TDES_KEY1_0, key, key_len,
+                                FIELD_EX32(ctrl, TDES_CTRL, BYTESWAP_KEY));
+    } else {
+        uint32_t ctrl = s->regs[R_AES_CTRL];
+
+        switch (FIELD_EX32(ctrl, AES_CTRL, KEY_SIZE)) {
+        case 0:
+            op->alg = QCRYPTO_CIPHER_ALGO_AES_128;
+            break;
+        case 1:
+            op->alg = QCRYPTO_CIPHER_ALGO_AES_192;
+            break;
+        case 2:
+            op->alg = QCRYPTO_CIPHER_ALGO_AES_256;
+            break;
+        default:
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: bad AES key size\n",
+                          __func__);
+            return false;
+        }
+        switch (FIELD_EX32(ctrl, AES_CTRL, MODE)) {
+        case AES_MODE_ECB:
+            op->mode = QCRYPTO_CIPHER_MODE_ECB;
+            break;
+        case AES_MODE_CBC:
+            op->mode = QCRYPTO_CIPHER_MODE_CBC;
+            break;
+        case AES_MODE_CTR:
+            op->mode = QCRYPTO_CIPHER_MODE_CTR;
+            break;
+        default:
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: bad AES mode\n", __func__);
+            return false;
+        }
+        op->decrypt = FIELD_EX32(ctrl, AES_CTRL, DEC);
+        if (op->mode == QCRYPTO_CIPHER_MODE_CTR) {
+            op->iv_reg = A_AES_CNT_0;
+            op->iv_swap = FIELD_EX32(ctrl, AES_CTRL, BYTESWAP_CNT);
+        } else {
+            op->iv_reg = A_AES_IV_0;
+            op->iv_swap = FIELD_EX32(ctrl, AES_CTRL, BYTESWAP_IV);
+        }
+        key_len = qcrypto_cipher_get_key_len(op->alg);
+        rk3399_crypto_get_bytes(s, A_AES_KEY_0, key, key_len,
+                                FIELD_EX32(ctrl, AES_CTRL, BYTESWAP_KEY));
+    }
+    op->block_len = qcrypto_cipher_get_block_len(op->alg);
+
+    if (!s->cipher || s->cipher_alg != op->alg ||
+        s->cipher_mode != op->mode ||
+        memcmp(s->cipher_key, key, sizeof(key)) != 0) {
+        qcrypto_cipher_free(s->cipher);
+        s->cipher = qcrypto_cipher_new(op->alg, op->mode, key, key_len, &err);
+        if (!s->cipher) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: %s\n", __func__,
+                          error_get_pretty(err));
+            error_free(err);
+            return false;
+        }
+        s->cipher_alg = op->alg;
+        s->cipher_mode = op->mode;
+        memcpy(s->cipher_key, key, sizeof(key));
+    }
+
+    if (op->mode != QCRYPTO_CIPHER_MODE_ECB) {
+        rk3399_crypto_get_bytes(s, op->iv_reg, iv, op->block_len, op->iv_swap);
+        if (qcrypto_cipher_setiv(s->cipher, iv, op->block_len, &err) < 0) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: %s\n", __func__,
+                          error_get_pretty(err));
+            error_free(err);
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Run the cipher over @len bytes in place.  Afterwards the IV registers
+ * hold what the next operation chains from, as on the hardware.
+ */
+static bool rk3399_crypto_cipher_run(RK3399CryptoState *s, RK3399CryptoOp *op,
+                                     uint8_t *buf, size_t len)
+{
+    uint8_t next_iv[16];
+    Error *err = NULL;
+    int ret;
+
+    trace_rk3399_crypto_cipher(op->alg, op->mode, op->decrypt, len);
+
+    if (op->mode == QCRYPTO_CIPHER_MODE_CBC && op->decrypt) {
+        memcpy(next_iv, buf + len - op->block_len, op->block_len);
+    }
+    if (op->decrypt) {
+        ret = qcrypto_cipher_decrypt(s->cipher, buf, buf, len, &err);
+    } else {
+        ret = qcrypto_cipher_encrypt(s->cipher, buf, buf, len, &err);
+    }
+    if (ret < 0) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: %s\n", __func__,
+                      error_get_pretty(err));
+        error_free(err);
+        return false;
+    }
+
+    switch (op->mode) {
+    case QCRYPTO_CIPHER_MODE_CBC:
+        if (!op->decrypt) {
+            memcpy(next_iv, buf + len - op->block_len, op->block_len);
+        }
+        rk3399_crypto_set_bytes(s, op->iv_reg, next_iv, op->block_len,
+                                op->iv_swap);
+        break;
+    case QCRYPTO_CIPHER_MODE_CTR: {
+        /* 128-bit big-endian counter, advanced once per block */
+        uint64_t blocks = len / op->block_len;
+        uint64_t hi, lo;
+
+        rk3399_crypto_get_bytes(s, op->iv_reg, next_iv, 16, op->iv_swap);
+        hi = ldq_be_p(next_iv);
+        lo = ldq_be_p(next_iv + 8);
+        hi += (lo + blocks) < lo;
+        lo += blocks;
+        stq_be_p(next_iv, hi);
+        stq_be_p(next_iv + 8, lo);
+        rk3399_crypto_set_bytes(s, op->iv_reg, next_iv, 16, op->iv_swap);
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
+}
+
+static void rk3399_crypto_hash_reset(RK3399CryptoState *s)
+{
+    s->hash_len = 0;
+    s->regs[R_HASH_STS] = 0;
+}
+
+static void rk3399_crypto_hash_finish(RK3399CryptoState *s)
+{
+    QCryptoHashAlgo alg;
+    g_autofree uint8_t *digest = NULL;
+    uint8_t dout[HASH_DOUT_WORDS * 4] = { 0 };
+    size_t digest_len;
+    Error *err = NULL;
+
+    switch (FIELD_EX32(s->regs[R_HASH_CTRL], HASH_CTRL, ALG)) {
+    case HASH_ALG_SHA1:
+        alg = QCRYPTO_HASH_ALGO_SHA1;
+        break;
+    case HASH_ALG_MD5:
+        alg = QCRYPTO_HASH_ALGO_MD5;
+        break;
+    case HASH_ALG_SHA256:
+        alg = QCRYPTO_HASH_ALGO_SHA256;
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: PRNG mode\n", __func__);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+
+    trace_rk3399_crypto_hash(alg, s->hash_len);
+    if (qcrypto_hash_bytes(alg, (const char *)s->hash_buf, s->hash_len,
+                           &digest, &digest_len, &err) < 0) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: %s\n", __func__,
+                      error_get_pretty(err));
+        error_free(err);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+    memcpy(dout, digest, MIN(digest_len, sizeof(dout)));
+    rk3399_crypto_set_bytes(s, A_HASH_DOUT_0, dout, sizeof(dout),
+                            FIELD_EX32(s->regs[R_HASH_CTRL], HASH_CTRL,
+                                       SWAP_DO));
+
+    s->hash_len = 0;
+    s->regs[R_HASH_STS] = STS_DONE;
+    s->regs[R_INTSTS] |= R_INTSTS_HASH_DONE_MASK;
+}
+
+/* Append up to @len bytes to the message, hashing it once it is complete */
+static void rk3399_crypto_hash_feed(RK3399CryptoState *s, const uint8_t *buf,
+                                    uint32_t len)
+{
+    uint32_t msg_len = s->regs[R_HASH_MSG_LEN];
+
+    if (msg_len > MAX_DMA_LEN) {
+        qemu_log_mask(LOG_UNIMP, "%s: message of %u bytes is too long\n",
+                      __func__, msg_len);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+    if (s->hash_len == msg_len) {
+        return;
+    }
+
+    len = MIN(len, msg_len - s->hash_len);
+    if (s->hash_len + len > s->hash_size) {
+        s->hash_size = MAX(s->hash_len + len, s->hash_size * 2);
+        s->hash_buf = g_realloc(s->hash_buf, s->hash_size);
+    }
+    memcpy(s->hash_buf + s->hash_len, buf, len);
+    s->hash_len += len;
+
+    if (s->hash_len == msg_len) {
+        rk3399_crypto_hash_finish(s);
+    }
+}
+
+static void rk3399_crypto_hash_start(RK3399CryptoState *s)
+{
+    /* Whole words are read, the message may end part way through one */
+    uint64_t len = MIN((uint64_t)s->regs[R_HRDMAL] * 4,
+                       ROUND_UP((uint64_t)s->regs[R_HASH_MSG_LEN] -
+                                s->hash_len, 4));
+    g_autofree uint8_t *buf = NULL;
+
+    if (FIELD_EX32(s->regs[R_CONF], CONF, HASHINSEL) != HASHINSEL_INDEPENDENT) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: hash DMA started while fed by the block cipher\n",
+                      __func__);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+    if (s->hash_len == s->regs[R_HASH_MSG_LEN]) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: message already complete\n",
+                      __func__);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+
+    if (len > MAX_DMA_LEN) {
+        qemu_log_mask(LOG_UNIMP, "%s: message of %u bytes is too long\n",
+                      __func__, s->regs[R_HASH_MSG_LEN]);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+    buf = g_malloc(len);
+    if (dma_memory_read(&s->dma_as, s->regs[R_HRDMAS], buf, len,
+                        MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA read from 0x%x failed\n",
+                      __func__, s->regs[R_HRDMAS]);
+        s->regs[R_INTSTS] |= R_INTSTS_HRDMA_ERR_MASK;
+        return;
+    }
+    rk3399_crypto_fifo_swap(buf, len,
+                            FIELD_EX32(s->regs[R_CONF], CONF,
+                                       BYTESWAP_HRFIFO));
+    s->regs[R_INTSTS] |= R_INTSTS_HRDMA_DONE_MASK;
+    rk3399_crypto_hash_feed(s, buf, len);
+}
+
+/* One block cipher DMA transfer, BRDMAL words from BRDMAS to BTDMAS */
+static void rk3399_crypto_block_start(RK3399CryptoState *s)
+{
+    uint32_t conf = s->regs[R_CONF];
+    bool des = FIELD_EX32(conf, CONF, DESSEL);
+    uint32_t hashinsel = FIELD_EX32(conf, CONF, HASHINSEL);
+    uint64_t len = (uint64_t)s->regs[R_BRDMAL] * 4;
+    g_autofree uint8_t *buf = NULL;
+    RK3399CryptoOp op;
+
+    if (!rk3399_crypto_cipher_setup(s, des, &op)) {
+        goto err;
+    }
+    if (!len || len % op.block_len) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: length %" PRIu64 " is not a "
+                      "multiple of the block size\n", __func__, len);
+        goto err;
+    }
+    if (len > MAX_DMA_LEN) {
+        qemu_log_mask(LOG_UNIMP, "%s: transfer of %" PRIu64 " bytes is too "
+                      "long\n", __func__, len);
+        goto err;
+    }
+
+    buf = g_malloc(len);
+    if (dma_memory_read(&s->dma_as, s->regs[R_BRDMAS], buf, len,
+                        MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA read from 0x%x failed\n",
+                      __func__, s->regs[R_BRDMAS]);
+        goto err;
+    }
+    rk3399_crypto_fifo_swap(buf, len, FIELD_EX32(conf, CONF, BYTESWAP_BRFIFO));
+    if (hashinsel == HASHINSEL_BLOCK_INPUT) {
+        rk3399_crypto_hash_feed(s, buf, len);
+    }
+
+    if (!rk3399_crypto_cipher_run(s, &op, buf, len)) {
+        goto err;
+    }
+
+    if (hashinsel == HASHINSEL_BLOCK_OUTPUT) {
+        rk3399_crypto_hash_feed(s, buf, len);
+    }
+    rk3399_crypto_fifo_swap(buf, len, FIELD_EX32(conf, CONF, BYTESWAP_BTFIFO));
+    if (dma_memory_write(&s->dma_as, s->regs[R_BTDMAS], buf, len,
+                         MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA write to 0x%x failed\n",
+                      __func__, s->regs[R_BTDMAS]);
+        goto err;
+    }
+
+    s->regs[des ? R_TDES_STS : R_AES_STS] = STS_DONE;
+    s->regs[R_INTSTS] |= R_INTSTS_BCDMA_DONE_MASK;
+    return;
+
+err:
+    s->regs[R_INTSTS] |= R_INTSTS_BCDMA_ERR_MASK;
+}
+
+/* One block through the data registers */
+static void rk3399_crypto_slave_start(RK3399CryptoState *s, bool des)
+{
+    uint8_t buf[16];
+    hwaddr din = des ? A_TDES_DIN_0 : A_AES_DIN_0;
+    hwaddr dout = des ? A_TDES_DOUT_0 : A_AES_DOUT_0;
+    bool swap_di, swap_do;
+    RK3399CryptoOp op;
+
+    if (des) {
+        swap_di = FIELD_EX32(s->regs[R_TDES_CTRL], TDES_CTRL, BYTESWAP_DI);
+        swap_do = FIELD_EX32(s->regs[R_TDES_CTRL], TDES_CTRL, BYTESWAP_DO);
+    } else {
+        swap_di = FIELD_EX32(s->regs[R_AES_CTRL], AES_CTRL, BYTESWAP_DI);
+        swap_do = FIELD_EX32(s->regs[R_AES_CTRL], AES_CTRL, BYTESWAP_DO);
+    }
+
+    if (!rk3399_crypto_cipher_setup(s, des, &op)) {
+        return;
+    }
+    rk3399_crypto_get_bytes(s, din, buf, op.block_len, swap_di);
+    if (rk3399_crypto_cipher_run(s, &op, buf, op.block_len)) {
+        rk3399_crypto_set_bytes(s, dout, buf, op.block_len, swap_do);
+        s->regs[des ? R_TDES_STS : R_AES_STS] = STS_DONE;
+    }
+}
+
+static void rk3399_crypto_ctrl_write(RK3399CryptoState *s, uint32_t value)
+{
+    uint32_t mask = value >> 16;
+    uint32_t old = s->regs[R_CTRL];
+    uint32_t ctrl = (old & ~mask) | (value & mask);
+    uint32_t start = ctrl & CTRL_START_MASK;
+
+    /* The start bits clear themselves once the operation is done */
+    s->regs[R_CTRL] = ctrl & ~CTRL_START_MASK;
+
+    if (FIELD_EX32(ctrl & ~old, CTRL, HASH_FLUSH)) {
+        rk3399_crypto_hash_reset(s);
+    }
+    if (FIELD_EX32(ctrl & ~old, CTRL, BLOCK_FLUSH)) {
+        s->regs[R_AES_STS] = 0;
+        s->regs[R_TDES_STS] = 0;
+    }
+
+    if (FIELD_EX32(start, CTRL, AES_START)) {
+        rk3399_crypto_slave_start(s, false);
+    }
+    if (FIELD_EX32(start, CTRL, TDES_START)) {
+        rk3399_crypto_slave_start(s, true);
+    }
+    if (FIELD_EX32(start, CTRL, BLOCK_START)) {
+        rk3399_crypto_block_start(s);
+    }
+    if (FIELD_EX32(start, CTRL, HASH_START)) {
+        rk3399_crypto_hash_start(s);
+    }
+    if (start & (R_CTRL_PKA_START_MASK | R_CTRL_TRNG_START_MASK)) {
+        qemu_log_mask(LOG_UNIMP, "%s: PKA and TRNG are not implemented\n",
+                      __func__);
+    }
+    rk3399_crypto_update_irq(s);
+}
+
+static uint64_t rk3399_crypto_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399CryptoState *s = RK3399_CRYPTO(opaque);
+    uint32_t r;
+
+    if (offset >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return 0;
+    }
+
+    r = s->regs[REG_INDEX(offset)];
+    trace_rk3399_crypto_read(offset, r);
+    return r;
+}
+
+static void rk3399_crypto_write(void *opaque, hwaddr offset, uint64_t value,
+                                unsigned size)
+{
+    RK3399CryptoState *s = RK3399_CRYPTO(opaque);
+
+    if (offset >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    }
+
+    trace_rk3399_crypto_write(offset, value);
+
+    switch (offset) {
+    case A_INTSTS:
+        s->regs[R_INTSTS] &= ~value;
+        rk3399_crypto_update_irq(s);
+        break;
+    case A_INTENA:
+        s->regs[R_INTENA] = value;
+        rk3399_crypto_update_irq(s);
+        break;
+    case A_CTRL:
+        rk3399_crypto_ctrl_write(s, value);
+        break;
+    case A_HASH_MSG_LEN:
+        /* A new message */
+        s->regs[R_HASH_MSG_LEN] = value;
+        rk3399_crypto_hash_reset(s);
+        break;
+    case A_AES_STS:
+    case A_TDES_STS:
+    case A_HASH_STS:
+    case A_AES_DOUT_0 ... A_AES_DOUT_0 + 0xc:
+    case A_TDES_DOUT_0 ... A_TDES_DOUT_0 + 0x4:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    default:
+        s->regs[REG_INDEX(offset)] = value;
+        break;
+    }
+}
+
+static const MemoryRegionOps rk3399_crypto_ops = {
+    .read = rk3399_crypto_read,
+    .write = rk3399_crypto_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_crypto_reset(DeviceState *dev)
+{
+    RK3399CryptoState *s = RK3399_CRYPTO(dev);
+
+    memset(s->regs, 0, sizeof(s->regs));
+    rk3399_crypto_hash_reset(s);
+    rk3399_crypto_update_irq(s);
+}
+
+static void rk3399_crypto_init(Object *obj)
+{
+    RK3399CryptoState *s = RK3399_CRYPTO(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_crypto_ops, s,
+                          TYPE_RK3399_CRYPTO, RK3399_CRYPTO_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+}
+
+static void rk3399_crypto_finalize(Object *obj)
+{
+    RK3399CryptoState *s = RK3399_CRYPTO(obj);
+
+    qcrypto_cipher_free(s->cipher);
+    g_free(s->hash_buf);
+}
+
+static void rk3399_crypto_realize(DeviceState *dev, Error **errp)
+{
+    RK3399CryptoState *s = RK3399_CRYPTO(dev);
+
+    if (!s->dma_mr) {
+        error_setg(errp, TYPE_RK3399_CRYPTO " 'dma-memory' link not set");
+        return;
+    }
+
+    address_space_init(&s->dma_as, s->dma_mr, "rk3399-crypto-dma");
+}
+
+static int rk3399_crypto_pre_load(void *opaque)
+{
+    RK3399CryptoState *s = opaque;
+
+    /* The message buffer is allocated anew by the incoming stream */
+    g_free(s->hash_buf);
+    s->hash_buf = NULL;
+    return 0;
+}
+
+static int rk3399_crypto_post_load(void *opaque, int version_id)
+{
+    RK3399CryptoState *s = opaque;
+
+    s->hash_size = s->hash_len;
+    return 0;
+}
+
+static Property rk3399_crypto_properties[] = {
+    DEFINE_PROP_LINK("dma-memory", RK3399CryptoState, dma_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static const VMStateDescription rk3399_crypto_vmstate = {
+    .name = "rk3399-crypto",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_load = rk3399_crypto_pre_load,
+    .post_load = rk3399_crypto_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, RK3399CryptoState, RK3399_CRYPTO_NR_REGS),
+        VMSTATE_UINT32(hash_len, RK3399CryptoState),
+        VMSTATE_VBUFFER_ALLOC_UINT32(hash_buf, RK3399CryptoState, 0, NULL,
+                                     hash_len),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_crypto_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = rk3399_crypto_realize;
+    dc->vmsd = &rk3399_crypto_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_crypto_reset);
+    device_class_set_props(dc, rk3399_crypto_properties);
+}
+
+static const TypeInfo rk3399_crypto_info = {
+    .name = TYPE_RK3399_CRYPTO,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399CryptoState),
+    .instance_init = rk3399_crypto_init,
+    .instance_finalize = rk3399_crypto_finalize,
+    .class_init = rk3399_crypto_class_init,
+};
+
+static void rk3399_crypto_register_types(void)
+{
+    type_register_static(&rk3399_crypto_info);
+}
+
+type_init(rk3399_crypto_register_types);
@@ -0,0 +1,141 @@
+/*
+ * Rockchip RK3399 eMMC PHY emulation
+ *
+ * The PHY of the Arasan eMMC controller is controlled through a handful
+ * of GRF registers.  Only the power-up handshake is modelled: calibration
+ * completes as soon as the PHY is powered up, and the DLL reports lock as
+ * soon as it is enabled.  The remaining fields (drive strength, output
+ * tap delay, ...) only affect signal timing and are merely stored.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/registerfields.h"
+#include "hw/sysbus.h"
+#include "migration/vmstate.h"
+#include "hw/misc/rk3399-emmc-phy.h"
+#include "trace.h"
+
+REG32(CON0, 0x00)
+REG32(CON6, 0x18)
+    FIELD(CON6, PDB, 0, 1)
+    FIELD(CON6, ENDLL, 1, 1)
+REG32(STATUS, 0x20)
+    FIELD(STATUS, DLLRDY, 5, 1)
+    FIELD(STATUS, CALDONE, 6, 1)
+
+#define CON_INDEX(offset)   (((offset) - A_CON0) / sizeof(uint32_t))
+
+static uint32_t rk3399_emmc_phy_status(RK3399EMMCPhyState *s)
+{
+    uint32_t con6 = s->con[CON_INDEX(A_CON6)];
+    uint32_t status = 0;
+
+    if (FIELD_EX32(con6, CON6, PDB)) {
+        status = FIELD_DP32(status, STATUS, CALDONE, 1);
+        status = FIELD_DP32(status, STATUS, DLLRDY,
+                            FIELD_EX32(con6, CON6, ENDLL));
+    }
+    return status;
+}
+
+static uint64_t rk3399_emmc_phy_read(void *opaque, hwaddr offset,
+                                     unsigned size)
+{
+    RK3399EMMCPhyState *s = RK3399_EMMC_PHY(opaque);
+    uint64_t r;
+
+    if (offset == A_STATUS) {
+        r = rk3399_emmc_phy_status(s);
+    } else if (CON_INDEX(offset) < RK3399_EMMC_PHY_NR_CON) {
+        r = s->con[CON_INDEX(offset)];
+    } else {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    trace_rk3399_emmc_phy_read(offset, r);
+    return r;
+}
+
+static void rk3399_emmc_phy_write(void *opaque, hwaddr offset,
+                                  uint64_t value, unsigned size)
+{
+    RK3399EMMCPhyState *s = RK3399_EMMC_PHY(opaque);
+    uint32_t mask = value >> 16;
+    uint32_t *reg;
+
+    trace_rk3399_emmc_phy_write(offset, value);
+
+    if (offset == A_STATUS || CON_INDEX(offset) >= RK3399_EMMC_PHY_NR_CON) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to bad or read-only offset 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        return;
+    }
+
+    /* Bits [31:16] are the write enables of bits [15:0] */
+    reg = &s->con[CON_INDEX(offset)];
+    *reg = (*reg & ~mask) | (value & mask);
+}
+
+static const MemoryRegionOps rk3399_emmc_phy_ops = {
+    .read = rk3399_emmc_phy_read,
+    .write = rk3399_emmc_phy_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_emmc_phy_reset(DeviceState *dev)
+{
+    RK3399EMMCPhyState *s = RK3399_EMMC_PHY(dev);
+
+    memset(s->con, 0, sizeof(s->con));
+}
+
+static void rk3399_emmc_phy_init(Object *obj)
+{
+    RK3399EMMCPhyState *s = RK3399_EMMC_PHY(obj);
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_emmc_phy_ops, s,
+                          TYPE_RK3399_EMMC_PHY, RK3399_EMMC_PHY_IOSIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+}
+
+static const VMStateDescription rk3399_emmc_phy_vmstate = {
+    .name = "rk3399-emmc-phy",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(con, RK3399EMMCPhyState, RK3399_EMMC_PHY_NR_CON),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_emmc_phy_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->vmsd = &rk3399_emmc_phy_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_emmc_phy_reset);
+}
+
+static const TypeInfo rk3399_emmc_phy_info = {
+    .name = TYPE_RK3399_EMMC_PHY,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399EMMCPhyState),
+    .instance_init = rk3399_emmc_phy_init,
+    .class_init = rk3399_emmc_phy_class_init,
+};
+
+static void rk3399_emmc_phy_register_types(void)
+{
+    type_register_static(&rk3399_emmc_phy_info);
+}
+
+type_init(rk3399_emmc_phy_register_types);
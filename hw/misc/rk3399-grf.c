@@ -0,0 +1,170 @@
+/*
+ * Rockchip RK3399 General Register Files (GRF / PMUGRF) emulation
+ *
+ * The GRF and the PMUGRF hold hundreds of configuration registers
+ * (pin multiplexing, pulls, drive strengths, PHY and interface settings)
+ * that nothing in the machine acts on.  Their contents live in a RAM
+ * region mapped straight into the address space, so that plain registers
+ * are read and written without a device callback.  Only the banks
+ * described in a declarative table are overlaid with I/O regions: banks
+ * written with the Rockchip "hiword mask" convention, in which bits
+ * [31:16] of a write select which of bits [15:0] are updated, and status
+ * banks the guest must not be able to write.  The hooks update the same
+ * RAM, so it is all the state there is to migrate.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/sysbus.h"
+#include "hw/misc/rk3399-grf.h"
+#include "trace.h"
+
+static const RK3399GRFBank rk3399_grf_banks[] = {
+    { "VIO_SOC_CON",    0x6200, 0x080, RK3399_GRF_HIWORD },
+    { "GMAC_SOC_CON",   0xc200, 0x080, RK3399_GRF_HIWORD },
+    { "GPIO_IOMUX",     0xe000, 0x200, RK3399_GRF_HIWORD },
+    { "SOC_CON",        0xe200, 0x0a0, RK3399_GRF_HIWORD },
+    { "SOC_STATUS",     0xe2a0, 0x020, RK3399_GRF_RO },
+    { "USBPHY_CON",     0xe400, 0x200, RK3399_GRF_HIWORD },
+    { "IO_VSEL",        0xe600, 0x100, RK3399_GRF_HIWORD },
+    { "EMMCCORE_CON",   0xf000, 0x100, RK3399_GRF_HIWORD },
+    { NULL }
+};
+
+/* OS_REG0-3 at 0x300, which firmware uses to pass data on, stay plain */
+static const RK3399GRFBank rk3399_pmugrf_banks[] = {
+    { "PMU_GPIO_IOMUX", 0x000, 0x100, RK3399_GRF_HIWORD },
+    { "PMU_SOC_CON",    0x180, 0x080, RK3399_GRF_HIWORD },
+    { NULL }
+};
+
+static uint64_t rk3399_grf_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399GRFHook *hook = opaque;
+    hwaddr addr = hook->bank->offset + offset;
+    uint32_t val = ldl_le_p(memory_region_get_ram_ptr(&hook->grf->regs) +
+                            addr);
+
+    trace_rk3399_grf_read(object_get_typename(OBJECT(hook->grf)),
+                          hook->bank->name, addr, val);
+    return val;
+}
+
+static void rk3399_grf_write(void *opaque, hwaddr offset, uint64_t val,
+                             unsigned size)
+{
+    RK3399GRFHook *hook = opaque;
+    RK3399GRFState *s = hook->grf;
+    hwaddr addr = hook->bank->offset + offset;
+    uint8_t *ptr = memory_region_get_ram_ptr(&s->regs) + addr;
+    uint32_t mask;
+
+    trace_rk3399_grf_write(object_get_typename(OBJECT(s)), hook->bank->name,
+                           addr, val);
+
+    if (hook->bank->flags & RK3399_GRF_RO) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only %s\n",
+                      __func__, hook->bank->name);
+        return;
+    }
+
+    if (hook->bank->flags & RK3399_GRF_HIWORD) {
+        mask = val >> 16;
+        val = (ldl_le_p(ptr) & ~mask) | (val & mask);
+    }
+    stl_le_p(ptr, val);
+    memory_region_set_dirty(&s->regs, addr, sizeof(uint32_t));
+}
+
+static const MemoryRegionOps rk3399_grf_ops = {
+    .read = rk3399_grf_read,
+    .write = rk3399_grf_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+    .impl.min_access_size = 4,
+};
+
+static void rk3399_grf_reset(DeviceState *dev)
+{
+    RK3399GRFState *s = RK3399_GRF(dev);
+    RK3399GRFClass *gc = RK3399_GRF_GET_CLASS(s);
+
+    memset(memory_region_get_ram_ptr(&s->regs), 0, gc->size);
+    memory_region_set_dirty(&s->regs, 0, gc->size);
+}
+
+static void rk3399_grf_realize(DeviceState *dev, Error **errp)
+{
+    RK3399GRFState *s = RK3399_GRF(dev);
+    RK3399GRFClass *gc = RK3399_GRF_GET_CLASS(s);
+    const char *name = object_get_typename(OBJECT(s));
+    g_autofree char *regs_name = g_strdup_printf("%s.regs", name);
+    const RK3399GRFBank *bank;
+    int i;
+
+    memory_region_init(&s->iomem, OBJECT(s), name, gc->size);
+    if (!memory_region_init_ram(&s->regs, OBJECT(s), regs_name, gc->size,
+                                errp)) {
+        return;
+    }
+    memory_region_add_subregion(&s->iomem, 0, &s->regs);
+
+    for (bank = gc->banks, i = 0; bank->name; bank++, i++) {
+        RK3399GRFHook *hook;
+
+        assert(i < RK3399_GRF_MAX_HOOKS);
+        assert(bank->offset + bank->size <= gc->size);
+        hook = &s->hooks[i];
+        hook->grf = s;
+        hook->bank = bank;
+        memory_region_init_io(&hook->iomem, OBJECT(s), &rk3399_grf_ops, hook,
+                              bank->name, bank->size);
+        memory_region_add_subregion_overlap(&s->iomem, bank->offset,
+                                            &hook->iomem, 1);
+    }
+
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+}
+
+static void rk3399_grf_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    RK3399GRFClass *gc = RK3399_GRF_CLASS(klass);
+
+    dc->realize = rk3399_grf_realize;
+    device_class_set_legacy_reset(dc, rk3399_grf_reset);
+    gc->size = RK3399_GRF_IOSIZE;
+    gc->banks = rk3399_grf_banks;
+}
+
+static void rk3399_pmugrf_class_init(ObjectClass *klass, void *data)
+{
+    RK3399GRFClass *gc = RK3399_GRF_CLASS(klass);
+
+    gc->size = RK3399_PMUGRF_IOSIZE;
+    gc->banks = rk3399_pmugrf_banks;
+}
+
+static const TypeInfo rk3399_grf_types[] = {
+    {
+        .name          = TYPE_RK3399_GRF,
+        .parent        = TYPE_SYS_BUS_DEVICE,
+        .instance_size = sizeof(RK3399GRFState),
+        .class_size    = sizeof(RK3399GRFClass),
+        .class_init    = rk3399_grf_class_init,
+    }, {
+        .name          = TYPE_RK3399_PMUGRF,
+        .parent        = TYPE_RK3399_GRF,
+        .class_init    = rk3399_pmugrf_class_init,
+    },
+};
+
+DEFINE_TYPES(rk3399_grf_types)
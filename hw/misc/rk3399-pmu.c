@@ -0,0 +1,266 @@
+/*
+ * Rockchip RK3399 Power Management Unit emulation
+ *
+ * The PMU switches the power domains of the SoC, including one per CPU
+ * core.  A core whose PWRDN_CON bit is set is parked with
+ * arm_set_cpu_off(), which leaves its vCPU thread asleep and its generic
+ * timers stopped until the bit is cleared and the core comes back up
+ * through reset.  PWRDN_ST follows the cores' actual power state, so a
+ * core taken down through PSCI CPU_OFF reads back as off too, and a
+ * cluster reads as off once all of its cores are.
+ *
+ * Every other domain switches, and every bus idle request is
+ * acknowledged, as soon as it is written.  The automatic core power-down
+ * on WFI enabled through CPUxAPM_CON and the system sleep sequence of
+ * PWRMODE_CON are not modelled; the registers only hold their values.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "hw/core/cpu.h"
+#include "hw/registerfields.h"
+#include "hw/misc/rk3399-pmu.h"
+#include "migration/vmstate.h"
+#include "target/arm/arm-powerctl.h"
+#include "target/arm/cpu.h"
+#include "trace.h"
+
+REG32(PWRDN_CON, 0x14)
+    FIELD(PWRDN_CON, CORES, 0, 6)
+    FIELD(PWRDN_CON, SCU_L, 6, 1)
+    FIELD(PWRDN_CON, SCU_B, 7, 1)
+REG32(PWRDN_ST, 0x18)
+REG32(PWRMODE_CON, 0x20)
+REG32(BUS_IDLE_REQ, 0x60)
+REG32(BUS_IDLE_ST, 0x64)
+REG32(BUS_IDLE_ACK, 0x68)
+REG32(POWER_ST, 0x78)
+REG32(CORE_PWR_ST, 0x7c)
+REG32(CPU0APM_CON, 0xc0)
+REG32(SYS_REG3, 0xfc)
+
+/* PWRDN_CON/PWRDN_ST bits of the cores of each cluster */
+#define PWRDN_CORES_L           0x0f
+#define PWRDN_CORES_B           0x30
+
+/* Core n of the PMU is A53 n for n < 4, A72 n - 4 above */
+static uint64_t rk3399_pmu_core_mpidr(int core)
+{
+    return core < 4 ? core : (1 << ARM_AFF1_SHIFT) | (core - 4);
+}
+
+static bool rk3399_pmu_core_is_off(int core)
+{
+    CPUState *cs = arm_get_cpu_by_id(rk3399_pmu_core_mpidr(core));
+
+    /* A core the machine was started without has no power either */
+    return !cs || ARM_CPU(cs)->power_state == PSCI_OFF;
+}
+
+static uint32_t rk3399_pmu_pwrdn_st(RK3399PMUState *s)
+{
+    uint32_t value = s->regs[R_PWRDN_ST] & ~(R_PWRDN_CON_CORES_MASK |
+                                             R_PWRDN_CON_SCU_L_MASK |
+                                             R_PWRDN_CON_SCU_B_MASK);
+    int core;
+
+    for (core = 0; core < RK3399_PMU_NUM_CORES; core++) {
+        if (rk3399_pmu_core_is_off(core)) {
+            value |= BIT(core);
+        }
+    }
+    if ((value & PWRDN_CORES_L) == PWRDN_CORES_L) {
+        value |= R_PWRDN_CON_SCU_L_MASK;
+    }
+    if ((value & PWRDN_CORES_B) == PWRDN_CORES_B) {
+        value |= R_PWRDN_CON_SCU_B_MASK;
+    }
+    return value;
+}
+
+/*
+ * A parked core cannot take its generic timer interrupts, and comes back
+ * through reset, which reprograms them: stop them, so that an idle guest
+ * does not keep waking the host up for it.  This is queued behind the
+ * work of arm_set_cpu_off(), and so finds the core off unless the guest
+ * changed its mind in between.
+ */
+static void rk3399_pmu_stop_core_timers(CPUState *cs, run_on_cpu_data data)
+{
+    ARMCPU *cpu = ARM_CPU(cs);
+    int i;
+
+    if (cpu->power_state != PSCI_OFF) {
+        return;
+    }
+    for (i = 0; i < NUM_GTIMERS; i++) {
+        if (cpu->gt_timer[i]) {
+            timer_del(cpu->gt_timer[i]);
+        }
+    }
+}
+
+static void rk3399_pmu_set_core_power(int core, bool on)
+{
+    uint64_t mpidr = rk3399_pmu_core_mpidr(core);
+    CPUState *cs = arm_get_cpu_by_id(mpidr);
+    int ret;
+
+    if (!cs) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: core %d is not present\n",
+                      __func__, core);
+        return;
+    }
+
+    /* A core comes back on at its reset vector, as from a cold start */
+    if (on) {
+        ret = arm_set_cpu_on_and_reset(mpidr);
+    } else {
+        ret = arm_set_cpu_off(mpidr);
+        if (ret == QEMU_ARM_POWERCTL_RET_SUCCESS) {
+            async_run_on_cpu(cs, rk3399_pmu_stop_core_timers,
+                             RUN_ON_CPU_NULL);
+        }
+    }
+    trace_rk3399_pmu_core_power(core, on, ret);
+}
+
+static void rk3399_pmu_write_pwrdn_con(RK3399PMUState *s, uint32_t value)
+{
+    uint32_t changed = (s->regs[R_PWRDN_CON] ^ value) & R_PWRDN_CON_CORES_MASK;
+    int core;
+
+    s->regs[R_PWRDN_CON] = value;
+    /* Domains other than the cores switch at once */
+    s->regs[R_PWRDN_ST] = value;
+
+    for (core = 0; core < RK3399_PMU_NUM_CORES; core++) {
+        if (changed & BIT(core)) {
+            rk3399_pmu_set_core_power(core, !(value & BIT(core)));
+        }
+    }
+}
+
+static uint64_t rk3399_pmu_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399PMUState *s = RK3399_PMU(opaque);
+    uint32_t value;
+
+    switch (offset) {
+    case A_PWRDN_ST:
+        value = rk3399_pmu_pwrdn_st(s);
+        break;
+    case A_BUS_IDLE_ST:
+    case A_BUS_IDLE_ACK:
+        value = s->regs[R_BUS_IDLE_REQ];
+        break;
+    default:
+        if (offset > A_SYS_REG3) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: bad read offset 0x%" HWADDR_PRIx "\n",
+                          __func__, offset);
+            value = 0;
+            break;
+        }
+        value = s->regs[offset >> 2];
+        break;
+    }
+
+    trace_rk3399_pmu_read(offset, value);
+    return value;
+}
+
+static void rk3399_pmu_write(void *opaque, hwaddr offset, uint64_t value,
+                             unsigned size)
+{
+    RK3399PMUState *s = RK3399_PMU(opaque);
+
+    trace_rk3399_pmu_write(offset, value);
+
+    switch (offset) {
+    case A_PWRDN_CON:
+        rk3399_pmu_write_pwrdn_con(s, value);
+        break;
+    case A_PWRDN_ST:
+    case A_BUS_IDLE_ST:
+    case A_BUS_IDLE_ACK:
+    case A_POWER_ST:
+    case A_CORE_PWR_ST:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only register 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    default:
+        if (offset > A_SYS_REG3) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "%s: bad write offset 0x%" HWADDR_PRIx "\n",
+                          __func__, offset);
+            break;
+        }
+        s->regs[offset >> 2] = value;
+        break;
+    }
+}
+
+static const MemoryRegionOps rk3399_pmu_ops = {
+    .read = rk3399_pmu_read,
+    .write = rk3399_pmu_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_pmu_reset(DeviceState *dev)
+{
+    RK3399PMUState *s = RK3399_PMU(dev);
+
+    /* Everything is powered; the cores themselves are reset with the CPUs */
+    memset(s->regs, 0, sizeof(s->regs));
+}
+
+static void rk3399_pmu_init(Object *obj)
+{
+    RK3399PMUState *s = RK3399_PMU(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_pmu_ops, s,
+                          TYPE_RK3399_PMU, RK3399_PMU_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+}
+
+static const VMStateDescription rk3399_pmu_vmstate = {
+    .name = "rk3399-pmu",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, RK3399PMUState, RK3399_PMU_NR_REGS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_pmu_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->vmsd = &rk3399_pmu_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_pmu_reset);
+}
+
+static const TypeInfo rk3399_pmu_info = {
+    .name = TYPE_RK3399_PMU,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399PMUState),
+    .instance_init = rk3399_pmu_init,
+    .class_init = rk3399_pmu_class_init,
+};
+
+static void rk3399_pmu_register_types(void)
+{
+    type_register_static(&rk3399_pmu_info);
+}
+
+type_init(rk3399_pmu_register_types);
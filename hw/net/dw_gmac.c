@@ -0,0 +1,1077 @@
+/*
+ * Synopsys DesignWare Ethernet MAC (GMAC 3.x) emulation
+ *
+ * Models the GMAC 3.50a found on Rockchip SoCs with its descriptor DMA
+ * engine (enhanced descriptor format, ring and chain mode), checksum
+ * offload and a built-in gigabit PHY on the MDIO bus.
+ *
+ * A transmit poll demand drains every descriptor the guest owns in one
+ * go and raises a single interrupt for the whole batch.  Frames are sent
+ * asynchronously; if the peer cannot take more, the ring stays parked
+ * until the net layer reports the queued frame sent.  On the receive side
+ * the net layer holds frames while the ring is out of descriptors; the
+ * next receive poll demand delivers the backlog as one burst, again with
+ * a single interrupt update.  The receive interrupt watchdog (RIWT)
+ * provides the interrupt mitigation the stmmac driver relies on.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+#include "qemu/main-loop.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/registerfields.h"
+#include "hw/net/dw_gmac.h"
+#include "hw/net/mii.h"
+#include "migration/vmstate.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "sysemu/dma.h"
+#include "net_tx_pkt.h"
+#include "net_rx_pkt.h"
+#include "trace.h"
+
+/* MAC registers */
+REG32(MAC_CONFIG, 0x00)
+    FIELD(MAC_CONFIG, RE, 2, 1)
+    FIELD(MAC_CONFIG, TE, 3, 1)
+    FIELD(MAC_CONFIG, ACS, 7, 1)
+    FIELD(MAC_CONFIG, IPC, 10, 1)
+    FIELD(MAC_CONFIG, CST, 25, 1)
+REG32(FRAME_FILTER, 0x04)
+    FIELD(FRAME_FILTER, PR, 0, 1)
+    FIELD(FRAME_FILTER, HUC, 1, 1)
+    FIELD(FRAME_FILTER, HMC, 2, 1)
+    FIELD(FRAME_FILTER, PM, 4, 1)
+    FIELD(FRAME_FILTER, DBF, 5, 1)
+    FIELD(FRAME_FILTER, RA, 31, 1)
+REG32(HASH_HIGH, 0x08)
+REG32(HASH_LOW, 0x0c)
+REG32(MII_ADDR, 0x10)
+    FIELD(MII_ADDR, GB, 0, 1)
+    FIELD(MII_ADDR, GW, 1, 1)
+    FIELD(MII_ADDR, GR, 6, 5)
+    FIELD(MII_ADDR, PA, 11, 5)
+REG32(MII_DATA, 0x14)
+REG32(VERSION, 0x20)
+REG32(DEBUG, 0x24)
+REG32(INT_STATUS, 0x38)
+REG32(ADDR0_HIGH, 0x40)
+    FIELD(ADDR0_HIGH, AE, 31, 1)
+REG32(ADDR0_LOW, 0x44)
+
+#define DW_GMAC_NR_ADDRS    16
+#define A_MAC_END           (A_ADDR0_HIGH + DW_GMAC_NR_ADDRS * 8)
+
+/* DMA registers */
+REG32(BUS_MODE, 0x1000)
+    FIELD(BUS_MODE, SWR, 0, 1)
+    FIELD(BUS_MODE, DSL, 2, 5)
+    FIELD(BUS_MODE, ATDS, 7, 1)
+REG32(TX_POLL, 0x1004)
+REG32(RX_POLL, 0x1008)
+REG32(RX_BASE, 0x100c)
+REG32(TX_BASE, 0x1010)
+REG32(STATUS, 0x1014)
+    FIELD(STATUS, TI, 0, 1)
+    FIELD(STATUS, TPS, 1, 1)
+    FIELD(STATUS, TU, 2, 1)
+    FIELD(STATUS, RI, 6, 1)
+    FIELD(STATUS, RU, 7, 1)
+    FIELD(STATUS, RPS, 8, 1)
+    FIELD(STATUS, FBI, 13, 1)
+    FIELD(STATUS, ERI, 14, 1)
+    FIELD(STATUS, AIS, 15, 1)
+    FIELD(STATUS, NIS, 16, 1)
+    FIELD(STATUS, RS, 17, 3)
+    FIELD(STATUS, TS, 20, 3)
+REG32(OP_MODE, 0x1018)
+    FIELD(OP_MODE, SR, 1, 1)
+    FIELD(OP_MODE, ST, 13, 1)
+    FIELD(OP_MODE, FTF, 20, 1)
+REG32(INTR_ENA, 0x101c)
+REG32(MISSED_FRAME, 0x1020)
+REG32(RX_WATCHDOG, 0x1024)
+    FIELD(RX_WATCHDOG, RIWT, 0, 8)
+REG32(AXI_BUS_MODE, 0x1028)
+REG32(AXI_STATUS, 0x102c)
+REG32(CUR_TX_DESC, 0x1048)
+REG32(CUR_RX_DESC, 0x104c)
+REG32(CUR_TX_BUF, 0x1050)
+REG32(CUR_RX_BUF, 0x1054)
+REG32(HW_FEATURE, 0x1058)
+
+#define A_DMA_END           (A_HW_FEATURE + 4)
+#define DMA_REG(s, reg)     ((s)->dma[R_##reg - R_BUS_MODE])
+
+/* Write-1-to-clear interrupt bits; NIS and AIS summarise the others */
+#define STATUS_W1C_MASK     MAKE_64BIT_MASK(0, 17)
+#define STATUS_NIS_BITS     (R_STATUS_TI_MASK | R_STATUS_TU_MASK | \
+                             R_STATUS_RI_MASK | R_STATUS_ERI_MASK)
+#define STATUS_AIS_BITS     (R_STATUS_TPS_MASK | R_STATUS_RU_MASK | \
+                             R_STATUS_RPS_MASK | R_STATUS_FBI_MASK)
+
+/* TS and RS process states */
+#define TX_STATE_STOPPED    0
+#define TX_STATE_RUNNING    1
+#define TX_STATE_SUSPENDED  6
+#define RX_STATE_STOPPED    0
+#define RX_STATE_WAITING    3
+#define RX_STATE_SUSPENDED  4
+
+/* GMAC 3.50a, as found on the RK3399 */
+#define DW_GMAC_VERSION     0x1035
+
+/*
+ * 10/100/1000 MII/GMII, half duplex, 64-bin hash filter, MDIO, TX
+ * checksum offload, type 2 RX checksum offload, enhanced descriptors,
+ * RGMII PHY interface.
+ */
+#define DW_GMAC_HW_FEATURE  0x11050117
+
+/* Enhanced transmit descriptor */
+FIELD(TDES0, OWN, 31, 1)
+FIELD(TDES0, IC, 30, 1)
+FIELD(TDES0, LS, 29, 1)
+FIELD(TDES0, FS, 28, 1)
+FIELD(TDES0, CIC, 22, 2)
+FIELD(TDES0, TER, 21, 1)
+FIELD(TDES0, TCH, 20, 1)
+FIELD(TDES1, TBS2, 16, 13)
+FIELD(TDES1, TBS1, 0, 13)
+
+/* Smallest ethertype; lower values are IEEE 802.3 length fields */
+#define ETH_TYPE_MIN            0x600
+
+/* Enhanced receive descriptor */
+FIELD(RDES0, OWN, 31, 1)
+FIELD(RDES0, FL, 16, 14)
+FIELD(RDES0, DE, 14, 1)
+FIELD(RDES0, FS, 9, 1)
+FIELD(RDES0, LS, 8, 1)
+FIELD(RDES0, IPC_ERR, 7, 1)
+FIELD(RDES0, FT, 5, 1)
+FIELD(RDES0, PAYLOAD_ERR, 0, 1)
+FIELD(RDES1, DIC, 31, 1)
+FIELD(RDES1, RBS2, 16, 13)
+FIELD(RDES1, RER, 15, 1)
+FIELD(RDES1, RCH, 14, 1)
+FIELD(RDES1, RBS1, 0, 13)
+
+typedef struct DWGMACDesc {
+    uint32_t des0;
+    uint32_t des1;
+    uint32_t des2;
+    uint32_t des3;
+} DWGMACDesc;
+
+/* Descriptors handled per TX poll demand before yielding to a bottom half */
+#define DW_GMAC_TX_BUDGET       1024
+/* Guest buffers a single transmitted frame may be gathered from */
+#define DW_GMAC_TX_MAX_FRAGS    64
+/* Descriptors a single received frame may span */
+#define DW_GMAC_RX_MAX_DESCS    128
+
+/* Realtek RTL8211E, as fitted on RK3399 boards */
+#define DW_GMAC_PHY_ID1         0x001c
+#define DW_GMAC_PHY_ID2         0xc915
+
+static void dw_gmac_update_irq(DWGMACState *s)
+{
+    uint32_t status = DMA_REG(s, STATUS) &
+                      ~(R_STATUS_NIS_MASK | R_STATUS_AIS_MASK);
+    uint32_t ena = DMA_REG(s, INTR_ENA);
+    bool level;
+
+    if (status & STATUS_NIS_BITS) {
+        status |= R_STATUS_NIS_MASK;
+    }
+    if (status & STATUS_AIS_BITS) {
+        status |= R_STATUS_AIS_MASK;
+    }
+    DMA_REG(s, STATUS) = status;
+
+    level = ((status & ena & STATUS_NIS_BITS) && (ena & R_STATUS_NIS_MASK)) ||
+            ((status & ena & STATUS_AIS_BITS) && (ena & R_STATUS_AIS_MASK));
+    qemu_set_irq(s->irq, level);
+}
+
+static void dw_gmac_set_tx_state(DWGMACState *s, int state)
+{
+    DMA_REG(s, STATUS) = FIELD_DP32(DMA_REG(s, STATUS), STATUS, TS, state);
+}
+
+static void dw_gmac_set_rx_state(DWGMACState *s, int state)
+{
+    DMA_REG(s, STATUS) = FIELD_DP32(DMA_REG(s, STATUS), STATUS, RS, state);
+}
+
+static bool dw_gmac_read_desc(DWGMACState *s, dma_addr_t addr, DWGMACDesc *d)
+{
+    if (dma_memory_read(&s->dma_as, addr, d, sizeof(*d),
+                        MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad descriptor address 0x%"
+                      HWADDR_PRIx "\n", __func__, addr);
+        return false;
+    }
+    le32_to_cpus(&d->des0);
+    le32_to_cpus(&d->des1);
+    le32_to_cpus(&d->des2);
+    le32_to_cpus(&d->des3);
+    return true;
+}
+
+static void dw_gmac_write_des0(DWGMACState *s, dma_addr_t addr, uint32_t des0)
+{
+    stl_le_dma(&s->dma_as, addr, des0, MEMTXATTRS_UNSPECIFIED);
+}
+
+/* A fatal bus error stops both DMA engines until the guest resets them */
+static void dw_gmac_bus_error(DWGMACState *s)
+{
+    DMA_REG(s, STATUS) |= R_STATUS_FBI_MASK;
+    DMA_REG(s, OP_MODE) &= ~(R_OP_MODE_ST_MASK | R_OP_MODE_SR_MASK);
+    dw_gmac_set_tx_state(s, TX_STATE_STOPPED);
+    dw_gmac_set_rx_state(s, RX_STATE_STOPPED);
+}
+
+/* Address of the descriptor after @addr in ring or chain mode */
+static uint32_t dw_gmac_next_desc(DWGMACState *s, uint32_t addr,
+                                  uint32_t base, bool end, bool chain,
+                                  uint32_t next)
+{
+    uint32_t bus_mode = DMA_REG(s, BUS_MODE);
+
+    if (end) {
+        return base;
+    }
+    if (chain) {
+        return next;
+    }
+    return addr + (FIELD_EX32(bus_mode, BUS_MODE, ATDS) ? 32 : 16) +
+           FIELD_EX32(bus_mode, BUS_MODE, DSL) * 8;
+}
+
+static void dw_gmac_phy_reset(DWGMACState *s)
+{
+    memset(s->phy, 0, sizeof(s->phy));
+    s->phy[MII_BMCR] = MII_BMCR_AUTOEN | MII_BMCR_FD | MII_BMCR_SPEED1000;
+    s->phy[MII_BMSR] = MII_BMSR_100TX_FD | MII_BMSR_100TX_HD |
+                       MII_BMSR_10T_FD | MII_BMSR_10T_HD | MII_BMSR_EXTSTAT |
+                       MII_BMSR_MFPS | MII_BMSR_AUTONEG | MII_BMSR_EXTCAP;
+    s->phy[MII_PHYID1] = DW_GMAC_PHY_ID1;
+    s->phy[MII_PHYID2] = DW_GMAC_PHY_ID2;
+    s->phy[MII_ANAR] = MII_ANAR_TXFD | MII_ANAR_TX | MII_ANAR_10FD |
+                       MII_ANAR_10 | MII_ANAR_CSMACD;
+    s->phy[MII_ANLPAR] = MII_ANLPAR_ACK | MII_ANLPAR_TXFD | MII_ANLPAR_TX |
+                         MII_ANLPAR_10FD | MII_ANLPAR_10 | MII_ANLPAR_CSMACD;
+    s->phy[MII_ANER] = MII_ANER_NWAY;
+    s->phy[MII_CTRL1000] = MII_CTRL1000_FULL | MII_CTRL1000_HALF;
+    s->phy[MII_STAT1000] = MII_STAT1000_LOK | MII_STAT1000_ROK |
+                           MII_STAT1000_FULL | MII_STAT1000_HALF;
+    s->phy[MII_EXTSTAT] = MII_EXTSTAT_1000T_FD | MII_EXTSTAT_1000T_HD;
+
+    if (!qemu_get_queue(s->nic)->link_down) {
+        s->phy[MII_BMSR] |= MII_BMSR_LINK_ST | MII_BMSR_AN_COMP;
+    }
+}
+
+static uint16_t dw_gmac_phy_read(DWGMACState *s, int reg)
+{
+    return s->phy[reg];
+}
+
+static void dw_gmac_phy_write(DWGMACState *s, int reg, uint16_t value)
+{
+    switch (reg) {
+    case MII_BMCR:
+        if (value & MII_BMCR_RESET) {
+            dw_gmac_phy_reset(s);
+            return;
+        }
+        /* Autonegotiation completes instantly */
+        s->phy[reg] = value & ~MII_BMCR_ANRESTART;
+        break;
+    case MII_BMSR:
+    case MII_PHYID1:
+    case MII_PHYID2:
+    case MII_ANLPAR:
+    case MII_ANER:
+    case MII_STAT1000:
+    case MII_EXTSTAT:
+        break;
+    default:
+        s->phy[reg] = value;
+        break;
+    }
+}
+
+static void dw_gmac_mdio_access(DWGMACState *s, uint32_t value)
+{
+    int pa = FIELD_EX32(value, MII_ADDR, PA);
+    int gr = FIELD_EX32(value, MII_ADDR, GR);
+    bool write = FIELD_EX32(value, MII_ADDR, GW);
+
+    if (pa != s->phy_addr) {
+        /* Nothing answers; the bus floats high */
+        if (!write) {
+            s->mac[R_MII_DATA] = 0xffff;
+        }
+    } else if (write) {
+        dw_gmac_phy_write(s, gr, s->mac[R_MII_DATA]);
+    } else {
+        s->mac[R_MII_DATA] = dw_gmac_phy_read(s, gr);
+    }
+    trace_dw_gmac_mdio(pa, gr, write, s->mac[R_MII_DATA]);
+
+    /* The management frame completes immediately */
+    s->mac[R_MII_ADDR] = value & ~R_MII_ADDR_GB_MASK;
+}
+
+static void dw_gmac_tx_unmap_frag(void *opaque, void *base, size_t len)
+{
+    DWGMACState *s = opaque;
+
+    dma_memory_unmap(&s->dma_as, base, len, DMA_DIRECTION_TO_DEVICE, len);
+}
+
+/* Add one guest buffer to the frame being gathered, without copying it */
+static bool dw_gmac_tx_add_buffer(DWGMACState *s, dma_addr_t addr,
+                                  dma_addr_t len)
+{
+    while (len) {
+        dma_addr_t plen = len;
+        void *p = dma_memory_map(&s->dma_as, addr, &plen,
+                                 DMA_DIRECTION_TO_DEVICE,
+                                 MEMTXATTRS_UNSPECIFIED);
+
+        if (!p) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: bad buffer address 0x%"
+                          HWADDR_PRIx "\n", __func__, addr);
+            return false;
+        }
+        if (!net_tx_pkt_add_raw_fragment(s->tx_pkt, p, plen)) {
+            dma_memory_unmap(&s->dma_as, p, plen, DMA_DIRECTION_TO_DEVICE, 0);
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: frame has too many buffers\n",
+                          __func__);
+            return false;
+        }
+        addr += plen;
+        len -= plen;
+    }
+    return true;
+}
+
+static void dw_gmac_tx_sent(NetClientState *nc, ssize_t len);
+
+static void dw_gmac_tx_send(void *opaque, const struct iovec *iov, int iovcnt,
+                            const struct iovec *virt_iov, int virt_iovcnt)
+{
+    DWGMACState *s = opaque;
+
+    if (!qemu_sendv_packet_async(qemu_get_queue(s->nic), iov, iovcnt,
+                                 dw_gmac_tx_sent)) {
+        s->tx_blocked = true;
+    }
+}
+
+static void dw_gmac_tx_frame(DWGMACState *s, uint32_t des0)
+{
+    int cic = FIELD_EX32(des0, TDES0, CIC);
+
+    if (!FIELD_EX32(s->mac[R_MAC_CONFIG], MAC_CONFIG, TE)) {
+        return;
+    }
+    if (!net_tx_pkt_parse(s->tx_pkt)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: malformed frame dropped\n",
+                      __func__);
+        return;
+    }
+
+    if (cic && s->tx_ethertype == ETH_P_IP) {
+        net_tx_pkt_update_ip_hdr_checksum(s->tx_pkt);
+    }
+    if (cic >= 2 && !net_tx_pkt_build_vheader(s->tx_pkt, false, true, 0)) {
+        return;
+    }
+
+    trace_dw_gmac_tx_frame(net_tx_pkt_get_total_len(s->tx_pkt), cic);
+    net_tx_pkt_send_custom(s->tx_pkt, false, dw_gmac_tx_send, s);
+}
+
+/*
+ * Walk the transmit ring until it runs dry, sending every complete frame
+ * on the way.  The interrupt is only raised once for the whole batch.
+ */
+static void dw_gmac_tx_ring(DWGMACState *s)
+{
+    int budget = DW_GMAC_TX_BUDGET;
+    int frames = 0;
+    bool ti = false;
+
+    if (!FIELD_EX32(DMA_REG(s, OP_MODE), OP_MODE, ST) || s->tx_blocked) {
+        return;
+    }
+    dw_gmac_set_tx_state(s, TX_STATE_RUNNING);
+
+    while (!s->tx_blocked) {
+        uint32_t addr = DMA_REG(s, CUR_TX_DESC);
+        bool chain;
+        DWGMACDesc d;
+
+        if (!budget--) {
+            qemu_bh_schedule(s->tx_bh);
+            break;
+        }
+        if (!dw_gmac_read_desc(s, addr, &d)) {
+            dw_gmac_bus_error(s);
+            break;
+        }
+        if (!FIELD_EX32(d.des0, TDES0, OWN)) {
+            DMA_REG(s, STATUS) |= R_STATUS_TU_MASK;
+            dw_gmac_set_tx_state(s, TX_STATE_SUSPENDED);
+            break;
+        }
+        chain = FIELD_EX32(d.des0, TDES0, TCH);
+
+        if (FIELD_EX32(d.des0, TDES0, FS)) {
+            uint16_t proto = 0;
+
+            net_tx_pkt_reset(s->tx_pkt, dw_gmac_tx_unmap_frag, s);
+            dma_memory_read(&s->dma_as, d.des2 + 12, &proto, sizeof(proto),
+                            MEMTXATTRS_UNSPECIFIED);
+            s->tx_ethertype = be16_to_cpu(proto);
+        }
+
+        DMA_REG(s, CUR_TX_BUF) = d.des2;
+        if (!dw_gmac_tx_add_buffer(s, d.des2,
+                                   FIELD_EX32(d.des1, TDES1, TBS1)) ||
+            (!chain &&
+             !dw_gmac_tx_add_buffer(s, d.des3,
+                                    FIELD_EX32(d.des1, TDES1, TBS2)))) {
+            net_tx_pkt_reset(s->tx_pkt, dw_gmac_tx_unmap_frag, s);
+            dw_gmac_bus_error(s);
+            break;
+        }
+
+        if (FIELD_EX32(d.des0, TDES0, LS)) {
+            dw_gmac_tx_frame(s, d.des0);
+            net_tx_pkt_reset(s->tx_pkt, dw_gmac_tx_unmap_frag, s);
+            ti |= FIELD_EX32(d.des0, TDES0, IC);
+            frames++;
+        }
+
+        /* Hand the descriptor back with a clean status */
+        dw_gmac_write_des0(s, addr,
+                           d.des0 & ~(R_TDES0_OWN_MASK |
+                                      MAKE_64BIT_MASK(0, 17)));
+        DMA_REG(s, CUR_TX_DESC) =
+            dw_gmac_next_desc(s, addr, DMA_REG(s, TX_BASE),
+                              FIELD_EX32(d.des0, TDES0, TER), chain, d.des3);
+    }
+
+    if (ti) {
+        DMA_REG(s, STATUS) |= R_STATUS_TI_MASK;
+    }
+    trace_dw_gmac_tx_ring(frames, s->tx_blocked);
+    dw_gmac_update_irq(s);
+}
+
+static void dw_gmac_tx_bh(void *opaque)
+{
+    dw_gmac_tx_ring(opaque);
+}
+
+static void dw_gmac_tx_sent(NetClientState *nc, ssize_t len)
+{
+    DWGMACState *s = qemu_get_nic_opaque(nc);
+
+    s->tx_blocked = false;
+    dw_gmac_tx_ring(s);
+}
+
+static bool dw_gmac_hash_match(DWGMACState *s, const uint8_t *addr)
+{
+    int bit = revbit32(~net_crc32_le(addr, ETH_ALEN)) >> 26;
+    uint32_t hash = bit < 32 ? s->mac[R_HASH_LOW] : s->mac[R_HASH_HIGH];
+
+    return hash & BIT(bit % 32);
+}
+
+static bool dw_gmac_perfect_match(DWGMACState *s, const uint8_t *addr)
+{
+    int i;
+
+    for (i = 0; i < DW_GMAC_NR_ADDRS; i++) {
+        uint32_t high = s->mac[R_ADDR0_HIGH + i * 2];
+        uint32_t low = s->mac[R_ADDR0_LOW + i * 2];
+
+        /* Address 0 is always enabled */
+        if (i && !FIELD_EX32(high, ADDR0_HIGH, AE)) {
+            continue;
+        }
+        if (ldl_le_p(addr) == low && lduw_le_p(addr + 4) == (uint16_t)high) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool dw_gmac_rx_filter(DWGMACState *s, const uint8_t *buf)
+{
+    uint32_t ff = s->mac[R_FRAME_FILTER];
+
+    if (ff & (R_FRAME_FILTER_PR_MASK | R_FRAME_FILTER_RA_MASK)) {
+        return true;
+    }
+    if (is_broadcast_ether_addr(buf)) {
+        return !FIELD_EX32(ff, FRAME_FILTER, DBF);
+    }
+    if (is_multicast_ether_addr(buf)) {
+        if (FIELD_EX32(ff, FRAME_FILTER, PM)) {
+            return true;
+        }
+        if (FIELD_EX32(ff, FRAME_FILTER, HMC)) {
+            return dw_gmac_hash_match(s, buf);
+        }
+    } else if (FIELD_EX32(ff, FRAME_FILTER, HUC)) {
+        return dw_gmac_hash_match(s, buf);
+    }
+    return dw_gmac_perfect_match(s, buf);
+}
+
+/* RDES0 frame type and checksum status of a frame, see enh_desc_coe_rdes0 */
+static uint32_t dw_gmac_rx_csum_status(DWGMACState *s, const uint8_t *buf,
+                                       size_t size)
+{
+    const struct iovec iov = { .iov_base = (void *)buf, .iov_len = size };
+    uint32_t status = 0;
+    bool hasip4, hasip6, valid;
+    EthL4HdrProto l4;
+
+    if (lduw_be_p(buf + 12) < ETH_TYPE_MIN) {
+        return 0;
+    }
+    status = FIELD_DP32(status, RDES0, FT, 1);
+    if (!FIELD_EX32(s->mac[R_MAC_CONFIG], MAC_CONFIG, IPC)) {
+        return status;
+    }
+
+    net_rx_pkt_set_protocols(s->rx_pkt, &iov, 1, 0);
+    net_rx_pkt_attach_iovec(s->rx_pkt, &iov, 1, 0, false);
+    net_rx_pkt_get_protocols(s->rx_pkt, &hasip4, &hasip6, &l4);
+    if (!hasip4 && !hasip6) {
+        return status;
+    }
+    if (net_rx_pkt_validate_l3_csum(s->rx_pkt, &valid) && !valid) {
+        status = FIELD_DP32(status, RDES0, IPC_ERR, 1);
+    }
+    if (net_rx_pkt_validate_l4_csum(s->rx_pkt, &valid) && !valid) {
+        status = FIELD_DP32(status, RDES0, PAYLOAD_ERR, 1);
+    }
+    return status;
+}
+
+/* Copy @len bytes of the frame in @iov, starting at @off, to guest memory */
+static bool dw_gmac_rx_write(DWGMACState *s, dma_addr_t addr,
+                             const struct iovec *iov, int iovcnt,
+                             size_t off, size_t len)
+{
+    for (; len && iovcnt; iov++, iovcnt--) {
+        size_t chunk;
+
+        if (off >= iov->iov_len) {
+            off -= iov->iov_len;
+            continue;
+        }
+        chunk = MIN(len, iov->iov_len - off);
+        if (dma_memory_write(&s->dma_as, addr, iov->iov_base + off, chunk,
+                             MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+            return false;
+        }
+        addr += chunk;
+        len -= chunk;
+        off = 0;
+    }
+    return true;
+}
+
+static void dw_gmac_rx_watchdog(void *opaque)
+{
+    DWGMACState *s = opaque;
+
+    DMA_REG(s, STATUS) |= R_STATUS_RI_MASK;
+    dw_gmac_update_irq(s);
+}
+
+/* Receive interrupt for a completed frame, subject to RIWT mitigation */
+static void dw_gmac_rx_done(DWGMACState *s, bool dic)
+{
+    uint32_t riwt = FIELD_EX32(DMA_REG(s, RX_WATCHDOG), RX_WATCHDOG, RIWT);
+
+    if (!dic) {
+        timer_del(s->rx_watchdog);
+        DMA_REG(s, STATUS) |= R_STATUS_RI_MASK;
+    } else if (riwt && !timer_pending(s->rx_watchdog)) {
+        /* The watchdog counts in units of 256 CSR clock cycles */
+        timer_mod(s->rx_watchdog, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  muldiv64(riwt * 256, NANOSECONDS_PER_SECOND, s->freq));
+    }
+}
+
+static bool dw_gmac_can_receive(NetClientState *nc)
+{
+    DWGMACState *s = qemu_get_nic_opaque(nc);
+
+    return FIELD_EX32(s->mac[R_MAC_CONFIG], MAC_CONFIG, RE) &&
+           FIELD_EX32(DMA_REG(s, OP_MODE), OP_MODE, SR) && !s->rx_suspended;
+}
+
+static ssize_t dw_gmac_receive(NetClientState *nc, const uint8_t *buf,
+                               size_t size)
+{
+    DWGMACState *s = qemu_get_nic_opaque(nc);
+    struct {
+        uint32_t addr;
+        DWGMACDesc d;
+    } descs[DW_GMAC_RX_MAX_DESCS];
+    uint32_t config = s->mac[R_MAC_CONFIG];
+    uint32_t addr = DMA_REG(s, CUR_RX_DESC);
+    uint32_t status, fcs;
+    struct iovec iov[2];
+    size_t total, capacity = 0, off = 0;
+    int n = 0, i;
+
+    if (!dw_gmac_can_receive(nc)) {
+        return -1;
+    }
+    if (size < ETH_HLEN || !dw_gmac_rx_filter(s, buf)) {
+        return size;
+    }
+
+    /* Frames carry their FCS unless the MAC strips it */
+    status = dw_gmac_rx_csum_status(s, buf, size);
+    iov[0].iov_base = (void *)buf;
+    iov[0].iov_len = size;
+    iov[1].iov_base = &fcs;
+    iov[1].iov_len = 4;
+    if (FIELD_EX32(config, MAC_CONFIG, CST) ||
+        (FIELD_EX32(config, MAC_CONFIG, ACS) &&
+         !FIELD_EX32(status, RDES0, FT))) {
+        iov[1].iov_len = 0;
+    }
+    fcs = cpu_to_le32(~net_crc32_le(buf, size));
+    total = size + iov[1].iov_len;
+
+    /* Make sure the whole frame fits before touching any descriptor */
+    while (capacity < total) {
+        DWGMACDesc *d = &descs[n].d;
+        bool chain;
+
+        if (n == DW_GMAC_RX_MAX_DESCS) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: %zu byte frame needs too many "
+                          "descriptors, dropped\n", __func__, total);
+            DMA_REG(s, MISSED_FRAME)++;
+            return size;
+        }
+        if (!dw_gmac_read_desc(s, addr, d)) {
+            dw_gmac_bus_error(s);
+            dw_gmac_update_irq(s);
+            return -1;
+        }
+        if (!FIELD_EX32(d->des0, RDES0, OWN)) {
+            /* Keep the frame queued until the guest refills the ring */
+            trace_dw_gmac_rx_suspended(addr);
+            s->rx_suspended = true;
+            DMA_REG(s, STATUS) |= R_STATUS_RU_MASK;
+            dw_gmac_set_rx_state(s, RX_STATE_SUSPENDED);
+            dw_gmac_update_irq(s);
+            return 0;
+        }
+        chain = FIELD_EX32(d->des1, RDES1, RCH);
+        descs[n++].addr = addr;
+        capacity += FIELD_EX32(d->des1, RDES1, RBS1);
+        if (!chain) {
+            capacity += FIELD_EX32(d->des1, RDES1, RBS2);
+        }
+        addr = dw_gmac_next_desc(s, addr, DMA_REG(s, RX_BASE),
+                                 FIELD_EX32(d->des1, RDES1, RER), chain,
+                                 d->des3);
+    }
+
+    for (i = 0; i < n; i++) {
+        DWGMACDesc *d = &descs[i].d;
+        size_t len1 = MIN(FIELD_EX32(d->des1, RDES1, RBS1), total - off);
+        size_t len2 = 0;
+        uint32_t des0 = 0;
+
+        if (!FIELD_EX32(d->des1, RDES1, RCH)) {
+            len2 = MIN(FIELD_EX32(d->des1, RDES1, RBS2), total - off - len1);
+        }
+        if (!dw_gmac_rx_write(s, d->des2, iov, 2, off, len1) ||
+            !dw_gmac_rx_write(s, d->des3, iov, 2, off + len1, len2)) {
+            dw_gmac_bus_error(s);
+            dw_gmac_update_irq(s);
+            return -1;
+        }
+        off += len1 + len2;
+
+        if (i == 0) {
+            des0 = FIELD_DP32(des0, RDES0, FS, 1);
+        }
+        if (i == n - 1) {
+            des0 |= status;
+            des0 = FIELD_DP32(des0, RDES0, LS, 1);
+            des0 = FIELD_DP32(des0, RDES0, FL, total);
+        }
+        dw_gmac_write_des0(s, descs[i].addr, des0);
+        DMA_REG(s, CUR_RX_BUF) = d->des2;
+    }
+    DMA_REG(s, CUR_RX_DESC) = addr;
+
+    trace_dw_gmac_rx_frame(total, n, status);
+    dw_gmac_rx_done(s, FIELD_EX32(descs[n - 1].d.des1, RDES1, DIC));
+    if (!s->rx_burst) {
+        dw_gmac_update_irq(s);
+    }
+    return size;
+}
+
+/* Deliver everything the net layer held back while we could not receive */
+static void dw_gmac_rx_flush(DWGMACState *s)
+{
+    if (!dw_gmac_can_receive(qemu_get_queue(s->nic))) {
+        return;
+    }
+    s->rx_burst = true;
+    qemu_flush_queued_packets(qemu_get_queue(s->nic));
+    s->rx_burst = false;
+    dw_gmac_update_irq(s);
+}
+
+static void dw_gmac_set_link(NetClientState *nc)
+{
+    DWGMACState *s = qemu_get_nic_opaque(nc);
+
+    if (nc->link_down) {
+        s->phy[MII_BMSR] &= ~(MII_BMSR_LINK_ST | MII_BMSR_AN_COMP);
+    } else {
+        s->phy[MII_BMSR] |= MII_BMSR_LINK_ST | MII_BMSR_AN_COMP;
+    }
+}
+
+static NetClientInfo net_dw_gmac_info = {
+    .type = NET_CLIENT_DRIVER_NIC,
+    .size = sizeof(NICState),
+    .can_receive = dw_gmac_can_receive,
+    .receive = dw_gmac_receive,
+    .link_status_changed = dw_gmac_set_link,
+};
+
+static void dw_gmac_write_op_mode(DWGMACState *s, uint32_t value)
+{
+    uint32_t old = DMA_REG(s, OP_MODE);
+
+    /* The TX FIFO flushes instantly */
+    DMA_REG(s, OP_MODE) = value & ~R_OP_MODE_FTF_MASK;
+
+    if (!FIELD_EX32(value, OP_MODE, ST)) {
+        dw_gmac_set_tx_state(s, TX_STATE_STOPPED);
+    } else if (!FIELD_EX32(old, OP_MODE, ST)) {
+        dw_gmac_tx_ring(s);
+    }
+
+    if (!FIELD_EX32(value, OP_MODE, SR)) {
+        dw_gmac_set_rx_state(s, RX_STATE_STOPPED);
+    } else if (!FIELD_EX32(old, OP_MODE, SR)) {
+        s->rx_suspended = false;
+        dw_gmac_set_rx_state(s, RX_STATE_WAITING);
+        dw_gmac_rx_flush(s);
+    }
+}
+
+static void dw_gmac_soft_reset(DWGMACState *s)
+{
+    const uint8_t *a = s->conf.macaddr.a;
+    int i;
+
+    timer_del(s->rx_watchdog);
+    qemu_bh_cancel(s->tx_bh);
+    net_tx_pkt_reset(s->tx_pkt, dw_gmac_tx_unmap_frag, s);
+
+    memset(s->mac, 0, sizeof(s->mac));
+    memset(s->dma, 0, sizeof(s->dma));
+    for (i = 1; i < DW_GMAC_NR_ADDRS; i++) {
+        s->mac[R_ADDR0_HIGH + i * 2] = 0x0000ffff;
+        s->mac[R_ADDR0_LOW + i * 2] = 0xffffffff;
+    }
+    /* Firmware leaves the station address programmed */
+    s->mac[R_ADDR0_HIGH] = R_ADDR0_HIGH_AE_MASK | a[4] | (a[5] << 8);
+    s->mac[R_ADDR0_LOW] = ldl_le_p(a);
+    DMA_REG(s, BUS_MODE) = 0x00020100;
+
+    s->rx_suspended = false;
+    s->tx_ethertype = 0;
+    dw_gmac_update_irq(s);
+}
+
+static uint64_t dw_gmac_read(void *opaque, hwaddr offset, unsigned size)
+{
+    DWGMACState *s = DW_GMAC(opaque);
+    uint64_t r = 0;
+
+    switch (offset) {
+    case A_VERSION:
+        r = DW_GMAC_VERSION;
+        break;
+    case A_DEBUG:
+    case A_INT_STATUS:
+        break;
+    case A_HW_FEATURE:
+        r = DW_GMAC_HW_FEATURE;
+        break;
+    case A_MISSED_FRAME:
+        /* Clears on read */
+        r = DMA_REG(s, MISSED_FRAME);
+        DMA_REG(s, MISSED_FRAME) = 0;
+        break;
+    default:
+        if (offset < A_MAC_END) {
+            r = s->mac[offset / 4];
+        } else if (offset >= A_BUS_MODE && offset < A_DMA_END) {
+            r = s->dma[(offset - A_BUS_MODE) / 4];
+        } else {
+            qemu_log_mask(LOG_UNIMP, "%s: unimplemented register 0x%"
+                          HWADDR_PRIx "\n", __func__, offset);
+        }
+        break;
+    }
+
+    trace_dw_gmac_read(offset, r);
+    return r;
+}
+
+static void dw_gmac_write(void *opaque, hwaddr offset, uint64_t value,
+                          unsigned size)
+{
+    DWGMACState *s = DW_GMAC(opaque);
+    uint32_t old;
+
+    trace_dw_gmac_write(offset, value);
+
+    switch (offset) {
+    case A_MAC_CONFIG:
+        old = s->mac[R_MAC_CONFIG];
+        s->mac[R_MAC_CONFIG] = value;
+        if (FIELD_EX32(value & ~old, MAC_CONFIG, TE)) {
+            dw_gmac_tx_ring(s);
+        }
+        if (FIELD_EX32(value & ~old, MAC_CONFIG, RE)) {
+            dw_gmac_rx_flush(s);
+        }
+        break;
+    case A_MII_ADDR:
+        if (FIELD_EX32(value, MII_ADDR, GB)) {
+            dw_gmac_mdio_access(s, value);
+        } else {
+            s->mac[R_MII_ADDR] = value;
+        }
+        break;
+    case A_MII_DATA:
+        s->mac[R_MII_DATA] = value & 0xffff;
+        break;
+    case A_VERSION:
+    case A_DEBUG:
+    case A_INT_STATUS:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only register 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        break;
+    case A_BUS_MODE:
+        if (FIELD_EX32(value, BUS_MODE, SWR)) {
+            dw_gmac_soft_reset(s);
+        } else {
+            DMA_REG(s, BUS_MODE) = value;
+        }
+        break;
+    case A_TX_POLL:
+        dw_gmac_tx_ring(s);
+        break;
+    case A_RX_POLL:
+        if (s->rx_suspended) {
+            s->rx_suspended = false;
+            dw_gmac_set_rx_state(s, RX_STATE_WAITING);
+            dw_gmac_rx_flush(s);
+        }
+        break;
+    case A_RX_BASE:
+        DMA_REG(s, RX_BASE) = value;
+        DMA_REG(s, CUR_RX_DESC) = value;
+        break;
+    case A_TX_BASE:
+        DMA_REG(s, TX_BASE) = value;
+        DMA_REG(s, CUR_TX_DESC) = value;
+        break;
+    case A_STATUS:
+        DMA_REG(s, STATUS) &= ~(value & STATUS_W1C_MASK);
+        dw_gmac_update_irq(s);
+        break;
+    case A_OP_MODE:
+        dw_gmac_write_op_mode(s, value);
+        break;
+    case A_INTR_ENA:
+        DMA_REG(s, INTR_ENA) = value;
+        dw_gmac_update_irq(s);
+        break;
+    case A_RX_WATCHDOG:
+        DMA_REG(s, RX_WATCHDOG) = value & R_RX_WATCHDOG_RIWT_MASK;
+        break;
+    case A_AXI_BUS_MODE:
+        DMA_REG(s, AXI_BUS_MODE) = value;
+        break;
+    case A_MISSED_FRAME:
+    case A_AXI_STATUS:
+    case A_CUR_TX_DESC:
+    case A_CUR_RX_DESC:
+    case A_CUR_TX_BUF:
+    case A_CUR_RX_BUF:
+    case A_HW_FEATURE:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only register 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        break;
+    default:
+        if (offset < A_MAC_END) {
+            s->mac[offset / 4] = value;
+        } else {
+            qemu_log_mask(LOG_UNIMP, "%s: unimplemented register 0x%"
+                          HWADDR_PRIx "\n", __func__, offset);
+        }
+        break;
+    }
+}
+
+static const MemoryRegionOps dw_gmac_ops = {
+    .read = dw_gmac_read,
+    .write = dw_gmac_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void dw_gmac_reset(DeviceState *dev)
+{
+    DWGMACState *s = DW_GMAC(dev);
+
+    dw_gmac_soft_reset(s);
+    dw_gmac_phy_reset(s);
+    s->tx_blocked = false;
+}
+
+static void dw_gmac_init(Object *obj)
+{
+    DWGMACState *s = DW_GMAC(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->iomem, obj, &dw_gmac_ops, s,
+                          TYPE_DW_GMAC, DW_GMAC_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+}
+
+static void dw_gmac_realize(DeviceState *dev, Error **errp)
+{
+    DWGMACState *s = DW_GMAC(dev);
+
+    if (!s->dma_mr) {
+        error_setg(errp, TYPE_DW_GMAC " 'dma-memory' link not set");
+        return;
+    }
+    if (!s->freq) {
+        error_setg(errp, TYPE_DW_GMAC ": clock-frequency must be non-zero");
+        return;
+    }
+    if (s->phy_addr >= 32) {
+        error_setg(errp, TYPE_DW_GMAC ": phy-addr must be below 32");
+        return;
+    }
+
+    address_space_init(&s->dma_as, s->dma_mr, "dw-gmac-dma");
+    s->rx_watchdog = timer_new_ns(QEMU_CLOCK_VIRTUAL, dw_gmac_rx_watchdog, s);
+    s->tx_bh = qemu_bh_new_guarded(dw_gmac_tx_bh, s,
+                                   &dev->mem_reentrancy_guard);
+    net_tx_pkt_init(&s->tx_pkt, DW_GMAC_TX_MAX_FRAGS);
+    net_rx_pkt_init(&s->rx_pkt);
+
+    qemu_macaddr_default_if_unset(&s->conf.macaddr);
+    s->nic = qemu_new_nic(&net_dw_gmac_info, &s->conf,
+                          object_get_typename(OBJECT(dev)), dev->id,
+                          &dev->mem_reentrancy_guard, s);
+    qemu_format_nic_info_str(qemu_get_queue(s->nic), s->conf.macaddr.a);
+}
+
+static Property dw_gmac_properties[] = {
+    DEFINE_PROP_LINK("dma-memory", DWGMACState, dma_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_UINT32("clock-frequency", DWGMACState, freq, 24000000),
+    DEFINE_PROP_UINT8("phy-addr", DWGMACState, phy_addr, 0),
+    DEFINE_NIC_PROPERTIES(DWGMACState, conf),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static int dw_gmac_post_load(void *opaque, int version_id)
+{
+    DWGMACState *s = opaque;
+
+    /* The peer's queue was not migrated; restart from the ring */
+    s->tx_blocked = false;
+    if (FIELD_EX32(DMA_REG(s, STATUS), STATUS, TS) == TX_STATE_RUNNING) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+    return 0;
+}
+
+static const VMStateDescription dw_gmac_vmstate = {
+    .name = "dw-gmac",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = dw_gmac_post_load,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(mac, DWGMACState, DW_GMAC_NR_MAC_REGS),
+        VMSTATE_UINT32_ARRAY(dma, DWGMACState, DW_GMAC_NR_DMA_REGS),
+        VMSTATE_UINT16_ARRAY(phy, DWGMACState, DW_GMAC_NR_PHY_REGS),
+        VMSTATE_BOOL(rx_suspended, DWGMACState),
+        VMSTATE_TIMER_PTR(rx_watchdog, DWGMACState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void dw_gmac_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = dw_gmac_realize;
+    dc->vmsd = &dw_gmac_vmstate;
+    device_class_set_legacy_reset(dc, dw_gmac_reset);
+    device_class_set_props(dc, dw_gmac_properties);
+    set_bit(DEVICE_CATEGORY_NETWORK, dc->categories);
+}
+
+static const TypeInfo dw_gmac_info = {
+    .name = TYPE_DW_GMAC,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DWGMACState),
+    .instance_init = dw_gmac_init,
+    .class_init = dw_gmac_class_init,
+};
+
+static void dw_gmac_register_types(void)
+{
+    type_register_static(&dw_gmac_info);
+}
+
+type_init(dw_gmac_register_types);
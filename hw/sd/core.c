@@ -161,6 +161,34 @@ void sdbus_read_data(SDBus *sdbus, void *buf, size_t length)
     }
 }
 
+BlockBackend *sdbus_blk_transfer_begin(SDBus *sdbus, uint64_t *offset,
+                                       uint64_t *max_len)
+{
+    SDState *card = get_card(sdbus);
+
+    if (card) {
+        SDCardClass *sc = SDMMC_COMMON_GET_CLASS(card);
+
+        if (sc->blk_transfer_begin) {
+            return sc->blk_transfer_begin(card, offset, max_len);
+        }
+    }
+
+    return NULL;
+}
+
+void sdbus_blk_transfer_end(SDBus *sdbus, uint64_t len)
+{
+    SDState *card = get_card(sdbus);
+
+    trace_sdbus_blk_transfer_end(sdbus_name(sdbus), len);
+    if (card) {
+        SDCardClass *sc = SDMMC_COMMON_GET_CLASS(card);
+
+        sc->blk_transfer_end(card, len);
+    }
+}
+
 bool sdbus_receive_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
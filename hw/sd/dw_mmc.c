@@ -0,0 +1,731 @@
+/*
+ * Synopsys DesignWare Mobile Storage Host (dw_mmc) emulation
+ *
+ * Models the single-slot controller found on Rockchip SoCs, including the
+ * internal DMA controller (IDMAC).  An IDMAC transfer walks the guest
+ * descriptor chain into one scatter-gather list.  For READ/WRITE MULTIPLE
+ * BLOCK commands the list is handed to dma_blk_io() against the card's
+ * block backend, so the data never goes through the byte-wise SD bus path
+ * and the vCPU is not held up by the I/O.  Everything else (single block,
+ * register reads like CSD/EXT_CSD, PIO through the data FIFO) is moved
+ * synchronously through the SD bus.  Either way the descriptors keep
+ * their OWN bit until the data has moved, like on the real controller.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/registerfields.h"
+#include "hw/sd/dw_mmc.h"
+#include "migration/vmstate.h"
+#include "sysemu/block-backend.h"
+#include "trace.h"
+
+REG32(CTRL, 0x00)
+    FIELD(CTRL, CONTROLLER_RESET, 0, 1)
+    FIELD(CTRL, FIFO_RESET, 1, 1)
+    FIELD(CTRL, DMA_RESET, 2, 1)
+    FIELD(CTRL, INT_ENABLE, 4, 1)
+    FIELD(CTRL, USE_IDMAC, 25, 1)
+REG32(PWREN, 0x04)
+REG32(CLKDIV, 0x08)
+REG32(CLKSRC, 0x0c)
+REG32(CLKENA, 0x10)
+REG32(TMOUT, 0x14)
+REG32(CTYPE, 0x18)
+REG32(BLKSIZ, 0x1c)
+REG32(BYTCNT, 0x20)
+REG32(INTMASK, 0x24)
+REG32(CMDARG, 0x28)
+REG32(CMD, 0x2c)
+    FIELD(CMD, INDEX, 0, 6)
+    FIELD(CMD, RESP_EXP, 6, 1)
+    FIELD(CMD, RESP_LONG, 7, 1)
+    FIELD(CMD, DATA_EXP, 9, 1)
+    FIELD(CMD, WRITE, 10, 1)
+    FIELD(CMD, SEND_STOP, 12, 1)
+    FIELD(CMD, UPDATE_CLOCK, 21, 1)
+    FIELD(CMD, START, 31, 1)
+REG32(RESP0, 0x30)
+REG32(RESP1, 0x34)
+REG32(RESP2, 0x38)
+REG32(RESP3, 0x3c)
+REG32(MINTSTS, 0x40)
+REG32(RINTSTS, 0x44)
+REG32(STATUS, 0x48)
+    FIELD(STATUS, FIFO_EMPTY, 2, 1)
+    FIELD(STATUS, FIFO_FULL, 3, 1)
+    FIELD(STATUS, DATA_BUSY, 9, 1)
+    FIELD(STATUS, FIFO_COUNT, 17, 13)
+REG32(FIFOTH, 0x4c)
+REG32(CDETECT, 0x50)
+REG32(WRTPRT, 0x54)
+REG32(GPIO, 0x58)
+REG32(TCBCNT, 0x5c)
+REG32(TBBCNT, 0x60)
+REG32(DEBNCE, 0x64)
+REG32(USRID, 0x68)
+REG32(VERID, 0x6c)
+REG32(HCON, 0x70)
+REG32(UHS_REG, 0x74)
+REG32(RST_N, 0x78)
+REG32(BMOD, 0x80)
+    FIELD(BMOD, SWR, 0, 1)
+    FIELD(BMOD, DSL, 2, 5)
+    FIELD(BMOD, DE, 7, 1)
+REG32(PLDMND, 0x84)
+REG32(DBADDR, 0x88)
+REG32(IDSTS, 0x8c)
+    FIELD(IDSTS, TI, 0, 1)
+    FIELD(IDSTS, RI, 1, 1)
+    FIELD(IDSTS, FBE, 2, 1)
+    FIELD(IDSTS, DU, 4, 1)
+    FIELD(IDSTS, CES, 5, 1)
+    FIELD(IDSTS, NIS, 8, 1)
+    FIELD(IDSTS, AIS, 9, 1)
+REG32(IDINTEN, 0x90)
+REG32(DSCADDR, 0x94)
+REG32(BUFADDR, 0x98)
+REG32(CDTHRCTL, 0x100)
+REG32(UHS_REG_EXT, 0x108)
+REG32(DDR_REG, 0x10c)
+REG32(ENABLE_SHIFT, 0x110)
+
+#define A_DATA              0x200
+
+/* RINTSTS / INTMASK / MINTSTS */
+#define INT_CD              (1 << 0)
+#define INT_RESP_ERR        (1 << 1)
+#define INT_CMD_DONE        (1 << 2)
+#define INT_DATA_OVER       (1 << 3)
+#define INT_TXDR            (1 << 4)
+#define INT_RXDR            (1 << 5)
+#define INT_DCRC            (1 << 7)
+#define INT_RTO             (1 << 8)
+#define INT_ACD             (1 << 14)
+#define INT_MASK            0x0001ffff
+
+#define IDSTS_NORMAL        (R_IDSTS_TI_MASK | R_IDSTS_RI_MASK)
+#define IDSTS_ABNORMAL      (R_IDSTS_FBE_MASK | R_IDSTS_DU_MASK | \
+                             R_IDSTS_CES_MASK)
+
+/* IDMAC descriptor, 32-bit addressing */
+#define DES0_DIC            (1 << 1)
+#define DES0_LD             (1 << 2)
+#define DES0_FD             (1 << 3)
+#define DES0_CH             (1 << 4)
+#define DES0_ER             (1 << 5)
+#define DES0_CES            (1 << 30)
+#define DES0_OWN            (1u << 31)
+#define DES1_BS1(x)         extract32(x, 0, 13)
+#define DES1_BS2(x)         extract32(x, 13, 13)
+#define DESC_SIZE           16
+#define DESC_MAX_CHAIN      4096
+
+#define DW_MMC_VERID        0x5342270a
+/* One card slot, 32-bit host data bus, IDMAC interface, 32-bit addresses */
+#define DW_MMC_HCON         0x00000081
+
+#define DW_MMC_BLOCK_SIZE   512
+
+#define REG(s, name)        ((s)->regs[R_##name])
+
+static void dw_mmc_update_irq(DWMMCState *s)
+{
+    uint32_t mintsts = REG(s, RINTSTS) & REG(s, INTMASK);
+    uint32_t idsts = REG(s, IDSTS);
+    bool level;
+
+    idsts &= ~(R_IDSTS_NIS_MASK | R_IDSTS_AIS_MASK);
+    if (idsts & IDSTS_NORMAL) {
+        idsts |= R_IDSTS_NIS_MASK;
+    }
+    if (idsts & IDSTS_ABNORMAL) {
+        idsts |= R_IDSTS_AIS_MASK;
+    }
+    REG(s, IDSTS) = idsts;
+    REG(s, MINTSTS) = mintsts;
+
+    level = (FIELD_EX32(REG(s, CTRL), CTRL, INT_ENABLE) && mintsts) ||
+            (idsts & REG(s, IDINTEN) & (IDSTS_NORMAL | IDSTS_ABNORMAL));
+    trace_dw_mmc_update_irq(level);
+    qemu_set_irq(s->irq, level);
+}
+
+static void dw_mmc_send_command(DWMMCState *s, uint8_t cmd, uint32_t arg)
+{
+    uint32_t ctl = REG(s, CMD);
+    SDRequest request = { .cmd = cmd, .arg = arg };
+    uint8_t resp[16];
+    int rlen;
+
+    trace_dw_mmc_command(cmd, arg);
+    rlen = sdbus_do_command(&s->sdbus, &request, resp);
+
+    if (FIELD_EX32(ctl, CMD, RESP_EXP)) {
+        if (FIELD_EX32(ctl, CMD, RESP_LONG) && rlen == 16) {
+            REG(s, RESP0) = ldl_be_p(&resp[12]);
+            REG(s, RESP1) = ldl_be_p(&resp[8]);
+            REG(s, RESP2) = ldl_be_p(&resp[4]);
+            REG(s, RESP3) = ldl_be_p(&resp[0]);
+        } else if (!FIELD_EX32(ctl, CMD, RESP_LONG) && rlen == 4) {
+            REG(s, RESP0) = ldl_be_p(&resp[0]);
+        } else {
+            REG(s, RINTSTS) |= INT_RTO;
+        }
+    }
+}
+
+static void dw_mmc_data_done(DWMMCState *s)
+{
+    s->data_left = 0;
+    REG(s, RINTSTS) |= INT_DATA_OVER;
+
+    if (FIELD_EX32(REG(s, CMD), CMD, SEND_STOP)) {
+        uint32_t resp0 = REG(s, RESP0);
+
+        /* The auto-stop response goes to RESP1 */
+        dw_mmc_send_command(s, 12, 0);
+        REG(s, RESP1) = REG(s, RESP0);
+        REG(s, RESP0) = resp0;
+        REG(s, RINTSTS) |= INT_ACD;
+    }
+}
+
+/* A descriptor the IDMAC has taken from the guest */
+typedef struct DWMMCDesc {
+    uint32_t addr;
+    uint32_t des0;
+} DWMMCDesc;
+
+/*
+ * Collect the buffers of the descriptor chain for a transfer of @len
+ * bytes.  The descriptors taken stay owned by the IDMAC until
+ * dw_mmc_idmac_finish() hands them back.
+ */
+static bool dw_mmc_idmac_map(DWMMCState *s, uint32_t len)
+{
+    uint32_t skip = FIELD_EX32(REG(s, BMOD), BMOD, DSL) * sizeof(uint32_t);
+    uint32_t addr = s->dscaddr;
+    uint32_t desc[4];
+    int i, n;
+
+    qemu_sglist_init(&s->sg, DEVICE(s), 8, &s->dma_as);
+    s->descs = g_array_new(false, false, sizeof(DWMMCDesc));
+
+    for (n = 0; s->sg.size < len && n < DESC_MAX_CHAIN; n++) {
+        DWMMCDesc taken;
+        uint32_t bs1, bs2;
+
+        if (dma_memory_read(&s->dma_as, addr, desc, sizeof(desc),
+                            MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+            REG(s, IDSTS) |= R_IDSTS_FBE_MASK;
+            return false;
+        }
+        for (i = 0; i < ARRAY_SIZE(desc); i++) {
+            le32_to_cpus(&desc[i]);
+        }
+        trace_dw_mmc_desc(addr, desc[0], desc[1], desc[2], desc[3]);
+
+        if (!(desc[0] & DES0_OWN)) {
+            REG(s, IDSTS) |= R_IDSTS_DU_MASK;
+            return false;
+        }
+
+        bs1 = MIN(DES1_BS1(desc[1]), len - s->sg.size);
+        if (bs1) {
+            qemu_sglist_add(&s->sg, desc[2], bs1);
+        }
+        if (!(desc[0] & DES0_CH)) {
+            bs2 = MIN(DES1_BS2(desc[1]), len - s->sg.size);
+            if (bs2) {
+                qemu_sglist_add(&s->sg, desc[3], bs2);
+            }
+        }
+
+        taken = (DWMMCDesc) { .addr = addr, .des0 = desc[0] };
+        g_array_append_val(s->descs, taken);
+
+        if (desc[0] & DES0_ER) {
+            addr = REG(s, DBADDR);
+        } else if (desc[0] & DES0_CH) {
+            addr = desc[3];
+        } else {
+            addr += DESC_SIZE + skip;
+        }
+        s->dscaddr = addr;
+
+        if (desc[0] & DES0_LD) {
+            break;
+        }
+    }
+
+    return s->sg.size == len;
+}
+
+/*
+ * Called once the data has moved, or failed to: return the descriptors
+ * to the guest, flagging them with CES when the transfer went wrong.
+ */
+static void dw_mmc_idmac_finish(DWMMCState *s, bool ok)
+{
+    bool write = FIELD_EX32(REG(s, CMD), CMD, WRITE);
+    int i;
+
+    for (i = 0; i < s->descs->len; i++) {
+        DWMMCDesc *d = &g_array_index(s->descs, DWMMCDesc, i);
+        uint32_t des0 = d->des0 & ~DES0_OWN;
+
+        if (!ok) {
+            des0 |= DES0_CES;
+        }
+        stl_le_dma(&s->dma_as, d->addr, des0, MEMTXATTRS_UNSPECIFIED);
+    }
+    g_array_free(s->descs, true);
+    s->descs = NULL;
+    qemu_sglist_destroy(&s->sg);
+    REG(s, DSCADDR) = s->dscaddr;
+
+    if (ok) {
+        REG(s, IDSTS) |= write ? R_IDSTS_TI_MASK : R_IDSTS_RI_MASK;
+        dw_mmc_data_done(s);
+    } else {
+        REG(s, RINTSTS) |= INT_DCRC;
+        s->data_left = 0;
+    }
+    dw_mmc_update_irq(s);
+}
+
+static void dw_mmc_idmac_complete(void *opaque, int ret)
+{
+    DWMMCState *s = opaque;
+    uint64_t len = s->sg.size;
+
+    trace_dw_mmc_idmac_complete(len, ret);
+
+    s->aiocb = NULL;
+    if (ret < 0) {
+        block_acct_failed(blk_get_stats(s->blk), &s->acct);
+        REG(s, IDSTS) |= R_IDSTS_CES_MASK;
+    } else {
+        block_acct_done(blk_get_stats(s->blk), &s->acct);
+        sdbus_blk_transfer_end(&s->sdbus, len);
+    }
+    s->blk = NULL;
+
+    dw_mmc_idmac_finish(s, ret >= 0);
+}
+
+/* Move the data through the SD bus, one scatter-gather entry at a time */
+static bool dw_mmc_idmac_bounce(DWMMCState *s, bool write)
+{
+    uint8_t buf[DW_MMC_BLOCK_SIZE];
+    int i;
+
+    for (i = 0; i < s->sg.nsg; i++) {
+        dma_addr_t addr = s->sg.sg[i].base;
+        dma_addr_t left = s->sg.sg[i].len;
+
+        while (left) {
+            dma_addr_t chunk = MIN(left, DW_MMC_BLOCK_SIZE);
+            MemTxResult res;
+
+            if (write) {
+                res = dma_memory_read(&s->dma_as, addr, buf, chunk,
+                                      MEMTXATTRS_UNSPECIFIED);
+                sdbus_write_data(&s->sdbus, buf, chunk);
+            } else {
+                sdbus_read_data(&s->sdbus, buf, chunk);
+                res = dma_memory_write(&s->dma_as, addr, buf, chunk,
+                                       MEMTXATTRS_UNSPECIFIED);
+            }
+            if (res != MEMTX_OK) {
+                REG(s, IDSTS) |= R_IDSTS_FBE_MASK;
+                return false;
+            }
+            addr += chunk;
+            left -= chunk;
+        }
+    }
+
+    return true;
+}
+
+static void dw_mmc_idmac_start(DWMMCState *s)
+{
+    bool write = FIELD_EX32(REG(s, CMD), CMD, WRITE);
+    uint32_t len = s->data_left;
+    uint64_t offset, max_len;
+    BlockBackend *blk;
+
+    if (!dw_mmc_idmac_map(s, len)) {
+        dw_mmc_idmac_finish(s, false);
+        return;
+    }
+
+    blk = sdbus_blk_transfer_begin(&s->sdbus, &offset, &max_len);
+    if (blk && len % DW_MMC_BLOCK_SIZE == 0 && len <= max_len) {
+        trace_dw_mmc_idmac_start(write, offset, len);
+        s->blk = blk;
+        dma_acct_start(blk, &s->acct, &s->sg,
+                       write ? BLOCK_ACCT_WRITE : BLOCK_ACCT_READ);
+        if (write) {
+            s->aiocb = dma_blk_write(blk, &s->sg, offset, BDRV_SECTOR_SIZE,
+                                     dw_mmc_idmac_complete, s);
+        } else {
+            s->aiocb = dma_blk_read(blk, &s->sg, offset, BDRV_SECTOR_SIZE,
+                                    dw_mmc_idmac_complete, s);
+        }
+        return;
+    }
+
+    dw_mmc_idmac_finish(s, dw_mmc_idmac_bounce(s, write));
+}
+
+static void dw_mmc_start_command(DWMMCState *s)
+{
+    uint32_t ctl = REG(s, CMD);
+
+    REG(s, CMD) = FIELD_DP32(ctl, CMD, START, 0);
+
+    /* Clock updates never reach the card */
+    if (FIELD_EX32(ctl, CMD, UPDATE_CLOCK)) {
+        return;
+    }
+    if (s->aiocb) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: command issued while busy\n",
+                      __func__);
+        return;
+    }
+
+    dw_mmc_send_command(s, FIELD_EX32(ctl, CMD, INDEX), REG(s, CMDARG));
+    REG(s, RINTSTS) |= INT_CMD_DONE;
+
+    if (FIELD_EX32(ctl, CMD, DATA_EXP) && !(REG(s, RINTSTS) & INT_RTO)) {
+        s->data_left = REG(s, BYTCNT);
+        if (FIELD_EX32(REG(s, CTRL), CTRL, USE_IDMAC) &&
+            FIELD_EX32(REG(s, BMOD), BMOD, DE)) {
+            dw_mmc_idmac_start(s);
+            return;
+        }
+        /* PIO through the data FIFO */
+        REG(s, RINTSTS) |= FIELD_EX32(ctl, CMD, WRITE) ? INT_TXDR : INT_RXDR;
+    }
+    dw_mmc_update_irq(s);
+}
+
+static uint32_t dw_mmc_status(DWMMCState *s)
+{
+    uint32_t words = 0;
+    uint32_t status = 0;
+
+    if (s->data_left && !FIELD_EX32(REG(s, CMD), CMD, WRITE) && !s->aiocb) {
+        words = MIN(DIV_ROUND_UP(s->data_left, 4), DW_MMC_FIFO_DEPTH);
+    }
+    status = FIELD_DP32(status, STATUS, FIFO_COUNT, words);
+    status = FIELD_DP32(status, STATUS, FIFO_EMPTY, words == 0);
+    status = FIELD_DP32(status, STATUS, FIFO_FULL,
+                        words == DW_MMC_FIFO_DEPTH);
+    status = FIELD_DP32(status, STATUS, DATA_BUSY, s->aiocb != NULL);
+    return status;
+}
+
+static uint32_t dw_mmc_fifo_read(DWMMCState *s)
+{
+    uint32_t n = MIN(s->data_left, sizeof(uint32_t));
+    uint32_t val = 0;
+
+    if (!n || FIELD_EX32(REG(s, CMD), CMD, WRITE)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: no data to read\n", __func__);
+        return 0;
+    }
+    sdbus_read_data(&s->sdbus, &val, n);
+    s->data_left -= n;
+    if (!s->data_left) {
+        dw_mmc_data_done(s);
+        dw_mmc_update_irq(s);
+    }
+    return le32_to_cpu(val);
+}
+
+static void dw_mmc_fifo_write(DWMMCState *s, uint32_t value)
+{
+    uint32_t n = MIN(s->data_left, sizeof(uint32_t));
+    uint32_t val = cpu_to_le32(value);
+
+    if (!n || !FIELD_EX32(REG(s, CMD), CMD, WRITE)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: no data expected\n", __func__);
+        return;
+    }
+    sdbus_write_data(&s->sdbus, &val, n);
+    s->data_left -= n;
+    if (!s->data_left) {
+        dw_mmc_data_done(s);
+        dw_mmc_update_irq(s);
+    }
+}
+
+static void dw_mmc_reset_regs(DWMMCState *s)
+{
+    memset(s->regs, 0, sizeof(s->regs));
+    REG(s, TMOUT) = 0xffffff40;
+    REG(s, FIFOTH) = (DW_MMC_FIFO_DEPTH - 1) << 16;
+    REG(s, DEBNCE) = 0x00ffffff;
+    REG(s, USRID) = 0x07967797;
+    REG(s, VERID) = DW_MMC_VERID;
+    REG(s, HCON) = DW_MMC_HCON;
+    REG(s, RST_N) = 1;
+    s->data_left = 0;
+    s->dscaddr = 0;
+}
+
+static uint64_t dw_mmc_read(void *opaque, hwaddr offset, unsigned size)
+{
+    DWMMCState *s = DW_MMC(opaque);
+    uint64_t r;
+
+    if (offset >= A_DATA) {
+        return dw_mmc_fifo_read(s);
+    }
+    if (offset >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+
+    switch (offset) {
+    case A_STATUS:
+        r = dw_mmc_status(s);
+        break;
+    case A_CDETECT:
+        r = !sdbus_get_inserted(&s->sdbus);
+        break;
+    case A_WRTPRT:
+        r = sdbus_get_readonly(&s->sdbus);
+        break;
+    case A_TCBCNT:
+        r = REG(s, BYTCNT) - s->data_left;
+        break;
+    case A_TBBCNT:
+        r = s->data_left;
+        break;
+    case A_DSCADDR:
+        r = s->dscaddr;
+        break;
+    default:
+        r = s->regs[offset / sizeof(uint32_t)];
+        break;
+    }
+
+    trace_dw_mmc_read(offset, r);
+    return r;
+}
+
+static void dw_mmc_write(void *opaque, hwaddr offset, uint64_t value,
+                         unsigned size)
+{
+    DWMMCState *s = DW_MMC(opaque);
+
+    if (offset >= A_DATA) {
+        dw_mmc_fifo_write(s, value);
+        return;
+    }
+    if (offset >= sizeof(s->regs)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    trace_dw_mmc_write(offset, value);
+
+    switch (offset) {
+    case A_CTRL:
+        /* The reset bits self-clear immediately */
+        if (value & (R_CTRL_CONTROLLER_RESET_MASK | R_CTRL_FIFO_RESET_MASK)) {
+            s->data_left = 0;
+        }
+        REG(s, CTRL) = value & ~(R_CTRL_CONTROLLER_RESET_MASK |
+                                 R_CTRL_FIFO_RESET_MASK |
+                                 R_CTRL_DMA_RESET_MASK);
+        dw_mmc_update_irq(s);
+        break;
+    case A_CMD:
+        REG(s, CMD) = value;
+        if (FIELD_EX32(value, CMD, START)) {
+            dw_mmc_start_command(s);
+        }
+        break;
+    case A_RINTSTS:
+        REG(s, RINTSTS) &= ~(value & INT_MASK);
+        /* The FIFO keeps requesting service until the transfer is over */
+        if (s->data_left && !s->aiocb) {
+            REG(s, RINTSTS) |= FIELD_EX32(REG(s, CMD), CMD, WRITE) ?
+                               INT_TXDR : INT_RXDR;
+        }
+        dw_mmc_update_irq(s);
+        break;
+    case A_INTMASK:
+        REG(s, INTMASK) = value & INT_MASK;
+        dw_mmc_update_irq(s);
+        break;
+    case A_BMOD:
+        if (FIELD_EX32(value, BMOD, SWR)) {
+            s->dscaddr = REG(s, DBADDR);
+            REG(s, IDSTS) = 0;
+        }
+        REG(s, BMOD) = FIELD_DP32(value, BMOD, SWR, 0);
+        dw_mmc_update_irq(s);
+        break;
+    case A_DBADDR:
+        REG(s, DBADDR) = value;
+        s->dscaddr = value;
+        break;
+    case A_IDSTS:
+        REG(s, IDSTS) &= ~(value & (IDSTS_NORMAL | IDSTS_ABNORMAL));
+        dw_mmc_update_irq(s);
+        break;
+    case A_IDINTEN:
+        REG(s, IDINTEN) = value;
+        dw_mmc_update_irq(s);
+        break;
+    case A_PLDMND:
+        break;
+    case A_MINTSTS:
+    case A_STATUS:
+    case A_CDETECT:
+    case A_WRTPRT:
+    case A_TCBCNT:
+    case A_TBBCNT:
+    case A_VERID:
+    case A_HCON:
+    case A_DSCADDR:
+    case A_BUFADDR:
+    case A_RESP0 ... A_RESP3:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only offset 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        break;
+    default:
+        s->regs[offset / sizeof(uint32_t)] = value;
+        break;
+    }
+}
+
+static const MemoryRegionOps dw_mmc_ops = {
+    .read = dw_mmc_read,
+    .write = dw_mmc_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void dw_mmc_set_inserted(DeviceState *dev, bool inserted)
+{
+    DWMMCState *s = DW_MMC(dev);
+
+    REG(s, RINTSTS) |= INT_CD;
+    dw_mmc_update_irq(s);
+}
+
+static void dw_mmc_reset(DeviceState *dev)
+{
+    DWMMCState *s = DW_MMC(dev);
+
+    if (s->aiocb) {
+        blk_aio_cancel(s->aiocb);
+        s->aiocb = NULL;
+    }
+    dw_mmc_reset_regs(s);
+    dw_mmc_update_irq(s);
+}
+
+static void dw_mmc_init(Object *obj)
+{
+    DWMMCState *s = DW_MMC(obj);
+
+    qbus_init(&s->sdbus, sizeof(s->sdbus), TYPE_DW_MMC_BUS, DEVICE(s),
+              "sd-bus");
+
+    memory_region_init_io(&s->iomem, obj, &dw_mmc_ops, s, TYPE_DW_MMC,
+                          DW_MMC_IOSIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+    sysbus_init_irq(SYS_BUS_DEVICE(s), &s->irq);
+}
+
+static void dw_mmc_realize(DeviceState *dev, Error **errp)
+{
+    DWMMCState *s = DW_MMC(dev);
+
+    if (!s->dma_mr) {
+        error_setg(errp, TYPE_DW_MMC " 'dma-memory' link not set");
+        return;
+    }
+
+    address_space_init(&s->dma_as, s->dma_mr, "dw-mmc-dma");
+}
+
+static int dw_mmc_pre_save(void *opaque)
+{
+    DWMMCState *s = opaque;
+
+    /* Block jobs are drained before device state is saved */
+    assert(!s->aiocb);
+    return 0;
+}
+
+static const VMStateDescription dw_mmc_vmstate = {
+    .name = "dw-mmc",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_save = dw_mmc_pre_save,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, DWMMCState, DW_MMC_NR_REGS),
+        VMSTATE_UINT32(data_left, DWMMCState),
+        VMSTATE_UINT32(dscaddr, DWMMCState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property dw_mmc_properties[] = {
+    DEFINE_PROP_LINK("dma-memory", DWMMCState, dma_mr,
+                     TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void dw_mmc_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = dw_mmc_realize;
+    dc->vmsd = &dw_mmc_vmstate;
+    device_class_set_legacy_reset(dc, dw_mmc_reset);
+    device_class_set_props(dc, dw_mmc_properties);
+}
+
+static void dw_mmc_bus_class_init(ObjectClass *klass, void *data)
+{
+    SDBusClass *sbc = SD_BUS_CLASS(klass);
+
+    sbc->set_inserted = dw_mmc_set_inserted;
+}
+
+static const TypeInfo dw_mmc_types[] = {
+    {
+        .name          = TYPE_DW_MMC,
+        .parent        = TYPE_SYS_BUS_DEVICE,
+        .instance_size = sizeof(DWMMCState),
+        .instance_init = dw_mmc_init,
+        .class_init    = dw_mmc_class_init,
+    }, {
+        .name          = TYPE_DW_MMC_BUS,
+        .parent        = TYPE_SD_BUS,
+        .instance_size = sizeof(SDBus),
+        .class_init    = dw_mmc_bus_class_init,
+    },
+};
+
+DEFINE_TYPES(dw_mmc_types)
@@ -2541,6 +2541,73 @@ uint8_t sd_read_byte(SDState *sd)
     return ret;
 }
 
+static BlockBackend *sd_blk_transfer_begin(SDState *sd, uint64_t *offset,
+                                           uint64_t *max_len)
+{
+    uint64_t len;
+
+    /* Callers move whole 512-byte blocks, whatever SET_BLOCKLEN said */
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->data_offset != 0 || sd_blk_len(sd) != 1 << HWBLOCK_SHIFT) {
+        return NULL;
+    }
+
+    switch (sd->current_cmd) {
+    case 18:  /* CMD18:  READ_MULTIPLE_BLOCK */
+        if (sd->state != sd_sendingdata_state) {
+            return NULL;
+        }
+        break;
+    case 25:  /* CMD25:  WRITE_MULTIPLE_BLOCK */
+        if (sd->state != sd_receivingdata_state ||
+            (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+            return NULL;
+        }
+        /* Group write protection is checked block by block */
+        if (sd->size <= SDSC_MAX_CAPACITY) {
+            return NULL;
+        }
+        break;
+    default:
+        return NULL;
+    }
+
+    /* Let the byte-wise path report out of range accesses */
+    if (sd->data_start >= sd->size) {
+        return NULL;
+    }
+
+    len = sd->size - sd->data_start;
+    if (sd->multi_blk_cnt != 0) {
+        len = MIN(len, (uint64_t)sd->multi_blk_cnt * sd_blk_len(sd));
+    }
+
+    *offset = sd->data_start + sd_bootpart_offset(sd);
+    *max_len = len;
+    return sd->blk;
+}
+
+static void sd_blk_transfer_end(SDState *sd, uint64_t len)
+{
+    uint32_t blocks = len / sd_blk_len(sd);
+
+    if (sd->current_cmd == 18) {
+        trace_sdcard_read_block(sd->data_start, len);
+    } else {
+        trace_sdcard_write_block(sd->data_start, len);
+        sd->blk_written += blocks;
+        sd->csd[14] |= 0x40;
+    }
+    sd->data_start += len;
+
+    if (sd->multi_blk_cnt != 0) {
+        sd->multi_blk_cnt -= MIN(blocks, sd->multi_blk_cnt);
+        if (sd->multi_blk_cnt == 0) {
+            sd->state = sd_transfer_state;
+        }
+    }
+}
+
 static bool sd_receive_ready(SDState *sd)
 {
     return sd->state == sd_receivingdata_state;
@@ -2827,6 +2894,8 @@ static void sdmmc_common_class_init(ObjectClass *klass, void *data)
     sc->enable = sd_enable;
     sc->get_inserted = sd_get_inserted;
     sc->get_readonly = sd_get_readonly;
+    sc->blk_transfer_begin = sd_blk_transfer_begin;
+    sc->blk_transfer_end = sd_blk_transfer_end;
 }
 
 static void sd_class_init(ObjectClass *klass, void *data)
@@ -236,6 +236,7 @@ FIELD(SDHC_CAPAB, RETUNING_MODE,      46, 2); /* since v3 */
 FIELD(SDHC_CAPAB, CLOCK_MULT,         48, 8); /* since v3 */
 FIELD(SDHC_CAPAB, ADMA3,              59, 1); /* since v4.20 */
 FIELD(SDHC_CAPAB, V18_VDD2,           60, 1); /* since v4.20 */
+FIELD(SDHC_CAPAB, HS400,              63, 1); /* Arasan 5.1, non-standard */
 
 /* HWInit Maximum Current Capabilities Register 0x0 */
 #define SDHC_MAXCURR                   0x48
@@ -278,6 +279,8 @@ FIELD(SDHC_MAXCURR, V18_VDD2,         32, 8); /* since v4.20 */
 #define SDHC_INSERTION_DELAY            (NANOSECONDS_PER_SECOND)
 #define SDHC_TRANSFER_DELAY             100
 #define SDHC_ADMA_DESCS_PER_DELAY       5
+/* Upper bound on descriptors merged into one coalesced ADMA2 request */
+#define SDHC_ADMA_COALESCE_MAX_DESCS    1024
 #define SDHC_CMD_RESPONSE               (3 << 0)
 
 enum {
@@ -316,7 +319,10 @@ extern const VMStateDescription sdhci_vmstate;
     /* Capabilities registers provide information on supported
      * features of this specific host controller implementation */ \
     DEFINE_PROP_UINT64("capareg", _state, capareg, SDHC_CAPAB_REG_DEFAULT), \
-    DEFINE_PROP_UINT64("maxcurr", _state, maxcurr, 0)
+    DEFINE_PROP_UINT64("maxcurr", _state, maxcurr, 0), \
+    \
+    /* Issue runs of ADMA2 descriptors as one block backend request */ \
+    DEFINE_PROP_BOOL("adma-coalesce", _state, adma_coalesce, false)
 
 void sdhci_initfn(SDHCIState *s);
 void sdhci_uninitfn(SDHCIState *s);
@@ -30,6 +30,7 @@
 #include "qapi/error.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
+#include "sysemu/block-backend.h"
 #include "sysemu/dma.h"
 #include "qemu/timer.h"
 #include "qemu/bitops.h"
@@ -136,6 +137,10 @@ static void sdhci_check_capareg(SDHCIState *s, Error **errp)
         trace_sdhci_capareg("clock multiplier", val);
         msk = FIELD_DP64(msk, SDHC_CAPAB, CLOCK_MULT, 0);
 
+        val = FIELD_EX64(s->capareg, SDHC_CAPAB, HS400);
+        trace_sdhci_capareg("HS400", val);
+        msk = FIELD_DP64(msk, SDHC_CAPAB, HS400, 0);
+
     /* fallthrough */
     case 2: /* default version */
         val = FIELD_EX64(s->capareg, SDHC_CAPAB, ADMA2);
@@ -283,12 +288,23 @@ static void sdhci_set_readonly(DeviceState *dev, bool level)
     }
 }
 
+/* Abort a coalesced ADMA2 transfer still waiting for the block layer */
+static void sdhci_adma_cancel(SDHCIState *s)
+{
+    if (s->adma_aiocb) {
+        blk_aio_cancel(s->adma_aiocb);
+        s->adma_aiocb = NULL;
+        timer_del(s->transfer_timer);
+    }
+}
+
 static void sdhci_reset(SDHCIState *s)
 {
     DeviceState *dev = DEVICE(s);
 
     timer_del(s->insert_timer);
     timer_del(s->transfer_timer);
+    sdhci_adma_cancel(s);
 
     /* Set all registers to 0. Capabilities/Version registers are not cleared
      * and assumed to always preserve their value, given to them during
@@ -693,11 +709,12 @@ typedef struct ADMADescr {
     uint8_t incr;
 } ADMADescr;
 
-static void get_adma_description(SDHCIState *s, ADMADescr *dscr)
+static void get_adma_description(SDHCIState *s, hwaddr entry_addr,
+                                 ADMADescr *dscr)
 {
     uint32_t adma1 = 0;
     uint64_t adma2 = 0;
-    hwaddr entry_addr = (hwaddr)s->admasysaddr;
+
     switch (SDHC_DMA_TYPE(s->hostctl1)) {
     case SDHC_CTRL_ADMA2_32:
         dma_memory_read(s->dma_as, entry_addr, &adma2, sizeof(adma2),
@@ -739,6 +756,183 @@ static void get_adma_description(SDHCIState *s, ADMADescr *dscr)
     }
 }
 
+/*
+ * Coalesced ADMA2 transfer
+ *
+ * A multi-block read or write is usually described by a table of
+ * descriptors of a few KiB each.  Rather than moving every block through
+ * the SD bus, gather a run of transfer descriptors into one scatter-gather
+ * list and issue it against the card's block backend as a single request.
+ * The run ends at the end of the transfer, or at a descriptor that asks
+ * for an interrupt or terminates the table, so that the guest visible
+ * state on completion is the same as after the block by block loop.
+ */
+
+static void sdhci_adma_complete(void *opaque, int ret)
+{
+    SDHCIState *s = opaque;
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+    uint64_t len = s->adma_sg.size;
+
+    trace_sdhci_adma_coalesce_complete(len, ret);
+
+    s->adma_aiocb = NULL;
+    if (ret < 0) {
+        block_acct_failed(blk_get_stats(s->adma_blk), &s->adma_acct);
+    } else {
+        block_acct_done(blk_get_stats(s->adma_blk), &s->adma_acct);
+        sdbus_blk_transfer_end(&s->sdbus, len);
+    }
+    s->adma_blk = NULL;
+    qemu_sglist_destroy(&s->adma_sg);
+
+    if (ret == -ECANCELED) {
+        return;
+    } else if (ret < 0) {
+        s->admaerr &= ~SDHC_ADMAERR_STATE_MASK;
+        s->admaerr |= SDHC_ADMAERR_STATE_ST_TFR;
+        if (s->errintstsen & SDHC_EISEN_ADMAERR) {
+            trace_sdhci_error("Set ADMA error flag");
+            s->errintsts |= SDHC_EIS_ADMAERR;
+            s->norintsts |= SDHC_NIS_ERR;
+        }
+        sdhci_update_irq(s);
+        return;
+    }
+
+    s->blkcnt -= len / block_size;
+    s->admasysaddr = s->adma_next;
+
+    if (s->adma_attr & SDHC_ADMA_ATTR_INT) {
+        trace_sdhci_adma("interrupt", s->admasysaddr);
+        if (s->norintstsen & SDHC_NISEN_DMA) {
+            s->norintsts |= SDHC_NIS_DMA;
+        }
+        sdhci_update_irq(s);
+    }
+
+    if (s->blkcnt == 0 || (s->adma_attr & SDHC_ADMA_ATTR_END)) {
+        trace_sdhci_adma_transfer_completed();
+        if (s->blkcnt != 0) {
+            trace_sdhci_error("SD/MMC host ADMA length mismatch");
+            s->admaerr |= SDHC_ADMAERR_LENGTH_MISMATCH |
+                    SDHC_ADMAERR_STATE_ST_TFR;
+            if (s->errintstsen & SDHC_EISEN_ADMAERR) {
+                trace_sdhci_error("Set ADMA error flag");
+                s->errintsts |= SDHC_EIS_ADMAERR;
+                s->norintsts |= SDHC_NIS_ERR;
+            }
+            sdhci_update_irq(s);
+        }
+        sdhci_end_transfer(s);
+        return;
+    }
+
+    timer_mod(s->transfer_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + SDHC_TRANSFER_DELAY);
+}
+
+/* Returns true if the transfer was handed to the block layer */
+static bool sdhci_adma_coalesce(SDHCIState *s)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+    const bool is_read = s->trnmod & SDHC_TRNS_READ;
+    hwaddr entry_addr = s->admasysaddr;
+    uint64_t offset, max_len, want;
+    BlockBackend *blk;
+    ADMADescr dscr = {};
+    uint8_t attr = 0;
+    int i;
+
+    if (!s->adma_coalesce || block_size != BDRV_SECTOR_SIZE ||
+        s->data_count != 0 || s->stopped_state != sdhc_not_stopped ||
+        !(s->trnmod & SDHC_TRNS_MULTI) ||
+        !(s->trnmod & SDHC_TRNS_BLK_CNT_EN)) {
+        return false;
+    }
+    switch (SDHC_DMA_TYPE(s->hostctl1)) {
+    case SDHC_CTRL_ADMA2_32:
+    case SDHC_CTRL_ADMA2_64:
+        break;
+    default:
+        return false;
+    }
+
+    blk = sdbus_blk_transfer_begin(&s->sdbus, &offset, &max_len);
+    if (!blk) {
+        return false;
+    }
+    want = QEMU_ALIGN_DOWN(MIN((uint64_t)s->blkcnt * block_size, max_len),
+                           block_size);
+    if (!want) {
+        return false;
+    }
+
+    qemu_sglist_init(&s->adma_sg, DEVICE(s), 16, s->dma_as);
+    for (i = 0; i < SDHC_ADMA_COALESCE_MAX_DESCS; i++) {
+        unsigned int length;
+
+        get_adma_description(s, entry_addr, &dscr);
+        trace_sdhci_adma_loop(dscr.addr, dscr.length, dscr.attr);
+
+        /* Leave error reporting to the block by block loop */
+        if (!(dscr.attr & SDHC_ADMA_ATTR_VALID)) {
+            break;
+        }
+
+        if ((dscr.attr & SDHC_ADMA_ATTR_ACT_MASK) == SDHC_ADMA_ATTR_ACT_TRAN) {
+            length = dscr.length ? dscr.length : 64 * KiB;
+            /*
+             * A descriptor longer than what is left of the transfer, or of
+             * the card, is a length mismatch, or runs into the end of the
+             * card: leave it to the block by block loop, which reports it.
+             */
+            if (length > want - s->adma_sg.size) {
+                break;
+            }
+            qemu_sglist_add(&s->adma_sg, dscr.addr, length);
+        }
+        if ((dscr.attr & SDHC_ADMA_ATTR_ACT_MASK) == SDHC_ADMA_ATTR_ACT_LINK) {
+            entry_addr = dscr.addr;
+        } else {
+            entry_addr += dscr.incr;
+        }
+        attr = dscr.attr;
+
+        if (s->adma_sg.size == want ||
+            (attr & (SDHC_ADMA_ATTR_INT | SDHC_ADMA_ATTR_END))) {
+            break;
+        }
+    }
+
+    /* Partial blocks are left to the block by block loop */
+    if (!s->adma_sg.size || s->adma_sg.size % block_size ||
+        !(dscr.attr & SDHC_ADMA_ATTR_VALID)) {
+        qemu_sglist_destroy(&s->adma_sg);
+        return false;
+    }
+
+    trace_sdhci_adma_coalesce(is_read, offset, s->adma_sg.nsg,
+                              s->adma_sg.size);
+
+    s->adma_next = entry_addr;
+    s->adma_attr = attr;
+    s->adma_blk = blk;
+    s->prnsts |= SDHC_DATA_INHIBIT | SDHC_DAT_LINE_ACTIVE |
+                 (is_read ? SDHC_DOING_READ : SDHC_DOING_WRITE);
+
+    dma_acct_start(blk, &s->adma_acct, &s->adma_sg,
+                   is_read ? BLOCK_ACCT_READ : BLOCK_ACCT_WRITE);
+    if (is_read) {
+        s->adma_aiocb = dma_blk_read(blk, &s->adma_sg, offset,
+                                     BDRV_SECTOR_SIZE, sdhci_adma_complete, s);
+    } else {
+        s->adma_aiocb = dma_blk_write(blk, &s->adma_sg, offset,
+                                      BDRV_SECTOR_SIZE, sdhci_adma_complete, s);
+    }
+    return true;
+}
+
 /* Advanced DMA data transfer */
 
 static void sdhci_do_adma(SDHCIState *s)
@@ -750,16 +944,24 @@ static void sdhci_do_adma(SDHCIState *s)
     MemTxResult res = MEMTX_ERROR;
     int i;
 
+    if (s->adma_aiocb) {
+        return;
+    }
+
     if (s->trnmod & SDHC_TRNS_BLK_CNT_EN && !s->blkcnt) {
         /* Stop Multiple Transfer */
         sdhci_end_transfer(s);
         return;
     }
 
+    if (sdhci_adma_coalesce(s)) {
+        return;
+    }
+
     for (i = 0; i < SDHC_ADMA_DESCS_PER_DELAY; ++i) {
         s->admaerr &= ~SDHC_ADMAERR_LENGTH_MISMATCH;
 
-        get_adma_description(s, &dscr);
+        get_adma_description(s, s->admasysaddr, &dscr);
         trace_sdhci_adma_loop(dscr.addr, dscr.length, dscr.attr);
 
         if ((dscr.attr & SDHC_ADMA_ATTR_VALID) == 0) {
@@ -1129,6 +1331,7 @@ static inline void sdhci_reset_write(SDHCIState *s, uint8_t value)
         s->norintsts &= ~SDHC_NIS_CMDCMP;
         break;
     case SDHC_RESET_DATA:
+        sdhci_adma_cancel(s);
         s->data_count = 0;
         s->prnsts &= ~(SDHC_SPACE_AVAILABLE | SDHC_DATA_AVAILABLE |
                 SDHC_DOING_READ | SDHC_DOING_WRITE |
@@ -1451,6 +1654,7 @@ void sdhci_common_unrealize(SDHCIState *s)
      * - PCI:       via PCIDeviceClass->exit().
      * However to avoid double-free and/or use-after-free we still nullify
      * this variable (better safe than sorry!). */
+    sdhci_adma_cancel(s);
     g_free(s->fifo_buffer);
     s->fifo_buffer = NULL;
 }
@@ -1473,10 +1677,20 @@ static const VMStateDescription sdhci_pending_insert_vmstate = {
     },
 };
 
+static int sdhci_pre_save(void *opaque)
+{
+    SDHCIState *s = opaque;
+
+    /* Block requests are drained before device state is saved */
+    assert(!s->adma_aiocb);
+    return 0;
+}
+
 const VMStateDescription sdhci_vmstate = {
     .name = "sdhci",
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = sdhci_pre_save,
     .fields = (const VMStateField[]) {
         VMSTATE_UINT32(sdmasysad, SDHCIState),
         VMSTATE_UINT16(blksize, SDHCIState),
@@ -0,0 +1,462 @@
+/*
+ * Rockchip RK3399 SPI controller emulation
+ *
+ * The six SPI masters share one design: a 32-entry TX and RX FIFO, 4, 8
+ * or 16-bit frames, two chip selects driven from SER and DMA request
+ * lines for the peripheral PL330.  Frames are shifted out on the bus as
+ * soon as they are written to TXDR, so the TX FIFO always reads as empty
+ * and only received frames are buffered.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/registerfields.h"
+#include "hw/ssi/rk3399-spi.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+REG32(CTRLR0, 0x00)
+    FIELD(CTRLR0, DFS, 0, 2)
+    FIELD(CTRLR0, FBM, 16, 1)
+    FIELD(CTRLR0, XFM, 18, 2)
+REG32(CTRLR1, 0x04)
+    FIELD(CTRLR1, NDM, 0, 16)
+REG32(SSIENR, 0x08)
+REG32(SER, 0x0c)
+REG32(BAUDR, 0x10)
+REG32(TXFTLR, 0x14)
+REG32(RXFTLR, 0x18)
+REG32(TXFLR, 0x1c)
+REG32(RXFLR, 0x20)
+REG32(SR, 0x24)
+    FIELD(SR, BSF, 0, 1)
+    FIELD(SR, TFF, 1, 1)
+    FIELD(SR, TFE, 2, 1)
+    FIELD(SR, RFE, 3, 1)
+    FIELD(SR, RFF, 4, 1)
+REG32(IPR, 0x28)
+REG32(IMR, 0x2c)
+REG32(ISR, 0x30)
+REG32(RISR, 0x34)
+    FIELD(RISR, TFE, 0, 1)
+    FIELD(RISR, TFO, 1, 1)
+    FIELD(RISR, RFU, 2, 1)
+    FIELD(RISR, RFO, 3, 1)
+    FIELD(RISR, RFF, 4, 1)
+REG32(ICR, 0x38)
+    FIELD(ICR, ALL, 0, 1)
+    FIELD(ICR, RFU, 1, 1)
+    FIELD(ICR, RFO, 2, 1)
+    FIELD(ICR, TFO, 3, 1)
+REG32(DMACR, 0x3c)
+    FIELD(DMACR, RDE, 0, 1)
+    FIELD(DMACR, TDE, 1, 1)
+REG32(DMATDLR, 0x40)
+REG32(DMARDLR, 0x44)
+REG32(VERSION, 0x48)
+
+/* The data windows, any word within which accesses the FIFO */
+#define RK3399_SPI_TXDR         0x400
+#define RK3399_SPI_RXDR         0x800
+#define RK3399_SPI_DATA_SIZE    0x400
+
+/* CTRLR0.DFS */
+#define DFS_4BIT                0
+#define DFS_8BIT                1
+#define DFS_16BIT               2
+
+/* CTRLR0.XFM */
+#define XFM_TR                  0
+#define XFM_TO                  1
+#define XFM_RO                  2
+
+/* FIFO threshold registers hold a FIFO index */
+#define FIFO_LEVEL_MASK         (RK3399_SPI_FIFO_LEN - 1)
+
+#define RISR_STICKY_MASK        (R_RISR_TFO_MASK | R_RISR_RFU_MASK | \
+                                 R_RISR_RFO_MASK)
+
+static bool rk3399_spi_enabled(RK3399SPIState *s)
+{
+    return s->regs[R_SSIENR] & 1;
+}
+
+static unsigned rk3399_spi_xfm(RK3399SPIState *s)
+{
+    return FIELD_EX32(s->regs[R_CTRLR0], CTRLR0, XFM);
+}
+
+static uint32_t rk3399_spi_risr(RK3399SPIState *s)
+{
+    uint32_t risr = s->regs[R_RISR] & RISR_STICKY_MASK;
+
+    if (rk3399_spi_enabled(s)) {
+        /* Nothing ever waits in the TX FIFO */
+        risr |= R_RISR_TFE_MASK;
+    }
+    if (fifo32_num_used(&s->rx_fifo) > s->regs[R_RXFTLR]) {
+        risr |= R_RISR_RFF_MASK;
+    }
+    return risr;
+}
+
+static void rk3399_spi_update(RK3399SPIState *s)
+{
+    uint32_t rx_level = fifo32_num_used(&s->rx_fifo);
+    bool enabled = rk3399_spi_enabled(s);
+    bool tx_busy, rx_busy;
+
+    qemu_set_irq(s->irq, !!(rk3399_spi_risr(s) & s->regs[R_IMR]));
+
+    /*
+     * The TX request stands while the TX FIFO is at or below DMATDLR.
+     * Frames leave the FIFO at once, but when receiving too they land in
+     * the RX FIFO; hold the request back while the RX FIFO has less room
+     * than the TX request would have asked to fill.
+     */
+    tx_busy = !enabled || !(s->regs[R_DMACR] & R_DMACR_TDE_MASK);
+    if (rk3399_spi_xfm(s) == XFM_TR &&
+        fifo32_num_free(&s->rx_fifo) <
+        RK3399_SPI_FIFO_LEN - s->regs[R_DMATDLR]) {
+        tx_busy = true;
+    }
+    rx_busy = !enabled || !(s->regs[R_DMACR] & R_DMACR_RDE_MASK) ||
+              rx_level <= s->regs[R_DMARDLR];
+
+    qemu_set_irq(s->dma_busy[RK3399_SPI_DMA_TX], tx_busy);
+    qemu_set_irq(s->dma_busy[RK3399_SPI_DMA_RX], rx_busy);
+}
+
+static void rk3399_spi_update_cs(RK3399SPIState *s)
+{
+    int i;
+
+    for (i = 0; i < RK3399_SPI_NUM_CS; i++) {
+        qemu_set_irq(s->cs_lines[i], !(s->regs[R_SER] & BIT(i)));
+    }
+}
+
+static uint8_t rk3399_spi_xfer_byte(RK3399SPIState *s, uint8_t tx)
+{
+    bool lsb_first = FIELD_EX32(s->regs[R_CTRLR0], CTRLR0, FBM);
+    uint8_t rx;
+
+    rx = ssi_transfer(s->ssi, lsb_first ? revbit8(tx) : tx);
+    return lsb_first ? revbit8(rx) : rx;
+}
+
+/* Shift one frame out and return the frame shifted in */
+static uint32_t rk3399_spi_xfer_frame(RK3399SPIState *s, uint32_t tx)
+{
+    uint32_t rx;
+
+    switch (FIELD_EX32(s->regs[R_CTRLR0], CTRLR0, DFS)) {
+    case DFS_4BIT:
+        rx = rk3399_spi_xfer_byte(s, tx & 0xf) & 0xf;
+        break;
+    case DFS_8BIT:
+        rx = rk3399_spi_xfer_byte(s, tx);
+        break;
+    case DFS_16BIT:
+        if (FIELD_EX32(s->regs[R_CTRLR0], CTRLR0, FBM)) {
+            rx = rk3399_spi_xfer_byte(s, tx);
+            rx |= rk3399_spi_xfer_byte(s, tx >> 8) << 8;
+        } else {
+            rx = rk3399_spi_xfer_byte(s, tx >> 8) << 8;
+            rx |= rk3399_spi_xfer_byte(s, tx);
+        }
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: reserved frame size\n", __func__);
+        rx = 0;
+        break;
+    }
+
+    trace_rk3399_spi_xfer(tx, rx);
+    return rx;
+}
+
+static void rk3399_spi_rx_push(RK3399SPIState *s, uint32_t frame)
+{
+    if (fifo32_is_full(&s->rx_fifo)) {
+        s->regs[R_RISR] |= R_RISR_RFO_MASK;
+        return;
+    }
+    fifo32_push(&s->rx_fifo, frame);
+}
+
+/* Clock in receive-only frames for as long as the RX FIFO has room */
+static void rk3399_spi_ro_fill(RK3399SPIState *s)
+{
+    while (s->ro_remaining && !fifo32_is_full(&s->rx_fifo)) {
+        fifo32_push(&s->rx_fifo, rk3399_spi_xfer_frame(s, 0));
+        s->ro_remaining--;
+    }
+}
+
+static void rk3399_spi_write_txdr(RK3399SPIState *s, uint32_t value)
+{
+    uint32_t rx;
+
+    if (!rk3399_spi_enabled(s)) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to TXDR while disabled\n", __func__);
+        return;
+    }
+    if (rk3399_spi_xfm(s) == XFM_RO) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to TXDR in receive-only mode\n", __func__);
+        return;
+    }
+
+    rx = rk3399_spi_xfer_frame(s, value);
+    if (rk3399_spi_xfm(s) == XFM_TR) {
+        rk3399_spi_rx_push(s, rx);
+    }
+}
+
+static uint32_t rk3399_spi_read_rxdr(RK3399SPIState *s)
+{
+    uint32_t value;
+
+    if (fifo32_is_empty(&s->rx_fifo)) {
+        s->regs[R_RISR] |= R_RISR_RFU_MASK;
+        return 0;
+    }
+
+    value = fifo32_pop(&s->rx_fifo);
+    rk3399_spi_ro_fill(s);
+    return value;
+}
+
+static void rk3399_spi_set_enable(RK3399SPIState *s, bool enable)
+{
+    if (enable == rk3399_spi_enabled(s)) {
+        return;
+    }
+
+    s->regs[R_SSIENR] = enable;
+    fifo32_reset(&s->rx_fifo);
+    s->ro_remaining = 0;
+
+    if (enable && rk3399_spi_xfm(s) == XFM_RO) {
+        s->ro_remaining = FIELD_EX32(s->regs[R_CTRLR1], CTRLR1, NDM) + 1;
+        rk3399_spi_ro_fill(s);
+    }
+}
+
+static uint64_t rk3399_spi_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399SPIState *s = RK3399_SPI(opaque);
+    uint32_t rx_level = fifo32_num_used(&s->rx_fifo);
+    uint32_t value;
+
+    if (offset >= RK3399_SPI_RXDR &&
+        offset < RK3399_SPI_RXDR + RK3399_SPI_DATA_SIZE) {
+        value = rk3399_spi_read_rxdr(s);
+        rk3399_spi_update(s);
+        trace_rk3399_spi_read(offset, value);
+        return value;
+    }
+
+    switch (offset) {
+    case A_TXFLR:
+        value = 0;
+        break;
+    case A_RXFLR:
+        value = rx_level;
+        break;
+    case A_SR:
+        value = R_SR_TFE_MASK;
+        if (rx_level == 0) {
+            value |= R_SR_RFE_MASK;
+        }
+        if (fifo32_is_full(&s->rx_fifo)) {
+            value |= R_SR_RFF_MASK;
+        }
+        break;
+    case A_ISR:
+        value = rk3399_spi_risr(s) & s->regs[R_IMR];
+        break;
+    case A_RISR:
+        value = rk3399_spi_risr(s);
+        break;
+    case A_ICR:
+        value = 0;
+        break;
+    case A_CTRLR0 ... A_BAUDR:
+    case A_TXFTLR:
+    case A_RXFTLR:
+    case A_IPR:
+    case A_IMR:
+    case A_DMACR ... A_VERSION:
+        value = s->regs[offset >> 2];
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: bad read offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        value = 0;
+        break;
+    }
+
+    trace_rk3399_spi_read(offset, value);
+    return value;
+}
+
+static void rk3399_spi_write(void *opaque, hwaddr offset, uint64_t value,
+                             unsigned size)
+{
+    RK3399SPIState *s = RK3399_SPI(opaque);
+
+    trace_rk3399_spi_write(offset, value);
+
+    if (offset >= RK3399_SPI_TXDR &&
+        offset < RK3399_SPI_TXDR + RK3399_SPI_DATA_SIZE) {
+        rk3399_spi_write_txdr(s, value);
+        rk3399_spi_update(s);
+        return;
+    }
+
+    switch (offset) {
+    case A_SSIENR:
+        rk3399_spi_set_enable(s, value & 1);
+        break;
+    case A_SER:
+        s->regs[R_SER] = value & MAKE_64BIT_MASK(0, RK3399_SPI_NUM_CS);
+        rk3399_spi_update_cs(s);
+        break;
+    case A_TXFTLR:
+    case A_RXFTLR:
+    case A_DMATDLR:
+    case A_DMARDLR:
+        s->regs[offset >> 2] = value & FIFO_LEVEL_MASK;
+        break;
+    case A_ICR:
+        if (value & R_ICR_ALL_MASK) {
+            s->regs[R_RISR] &= ~RISR_STICKY_MASK;
+        }
+        if (value & R_ICR_RFU_MASK) {
+            s->regs[R_RISR] &= ~R_RISR_RFU_MASK;
+        }
+        if (value & R_ICR_RFO_MASK) {
+            s->regs[R_RISR] &= ~R_RISR_RFO_MASK;
+        }
+        if (value & R_ICR_TFO_MASK) {
+            s->regs[R_RISR] &= ~R_RISR_TFO_MASK;
+        }
+        break;
+    case A_CTRLR0:
+    case A_CTRLR1:
+    case A_BAUDR:
+    case A_IPR:
+    case A_IMR:
+    case A_DMACR:
+        s->regs[offset >> 2] = value;
+        break;
+    case A_TXFLR:
+    case A_RXFLR:
+    case A_SR:
+    case A_ISR:
+    case A_RISR:
+    case A_VERSION:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only register 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: bad write offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+
+    rk3399_spi_update(s);
+}
+
+static const MemoryRegionOps rk3399_spi_ops = {
+    .read = rk3399_spi_read,
+    .write = rk3399_spi_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_spi_reset(DeviceState *dev)
+{
+    RK3399SPIState *s = RK3399_SPI(dev);
+
+    memset(s->regs, 0, sizeof(s->regs));
+    fifo32_reset(&s->rx_fifo);
+    s->ro_remaining = 0;
+    rk3399_spi_update_cs(s);
+    rk3399_spi_update(s);
+}
+
+static void rk3399_spi_init(Object *obj)
+{
+    RK3399SPIState *s = RK3399_SPI(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int i;
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_spi_ops, s,
+                          TYPE_RK3399_SPI, RK3399_SPI_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+    for (i = 0; i < RK3399_SPI_NUM_CS; i++) {
+        sysbus_init_irq(sbd, &s->cs_lines[i]);
+    }
+    qdev_init_gpio_out_named(DEVICE(obj), s->dma_busy, "dma-busy",
+                             ARRAY_SIZE(s->dma_busy));
+
+    s->ssi = ssi_create_bus(DEVICE(obj), "spi");
+    fifo32_create(&s->rx_fifo, RK3399_SPI_FIFO_LEN);
+}
+
+static void rk3399_spi_finalize(Object *obj)
+{
+    RK3399SPIState *s = RK3399_SPI(obj);
+
+    fifo32_destroy(&s->rx_fifo);
+}
+
+static const VMStateDescription rk3399_spi_vmstate = {
+    .name = "rk3399-spi",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, RK3399SPIState, RK3399_SPI_NR_REGS),
+        VMSTATE_FIFO32(rx_fifo, RK3399SPIState),
+        VMSTATE_UINT32(ro_remaining, RK3399SPIState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_spi_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->vmsd = &rk3399_spi_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_spi_reset);
+}
+
+static const TypeInfo rk3399_spi_info = {
+    .name = TYPE_RK3399_SPI,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399SPIState),
+    .instance_init = rk3399_spi_init,
+    .instance_finalize = rk3399_spi_finalize,
+    .class_init = rk3399_spi_class_init,
+};
+
+static void rk3399_spi_register_types(void)
+{
+    type_register_static(&rk3399_spi_info);
+}
+
+type_init(rk3399_spi_register_types);
@@ -0,0 +1,316 @@
+/*
+ * Rockchip RK3399 timer block emulation
+ *
+ * Each block has six independent 64-bit down counters clocked from
+ * xin24m.  A channel counts from its load count down to zero, raises
+ * its interrupt status and then either reloads (free-running mode) or
+ * stops (user-defined count mode, used by Linux for one-shot events).
+ *
+ * Channels are backed by ptimer, so a channel only owns a pending
+ * QEMUTimer deadline while it is enabled; idle channels cost nothing.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/registerfields.h"
+#include "hw/timer/rk3399-timer.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+#define CHANNEL_STRIDE  0x20
+
+REG32(LOAD_COUNT0, 0x00)
+REG32(LOAD_COUNT1, 0x04)
+REG32(CURRENT_VALUE0, 0x08)
+REG32(CURRENT_VALUE1, 0x0c)
+REG32(LOAD_COUNT2, 0x10)
+REG32(LOAD_COUNT3, 0x14)
+REG32(INT_STATUS, 0x18)
+REG32(CONTROL, 0x1c)
+    FIELD(CONTROL, EN, 0, 1)
+    FIELD(CONTROL, MODE, 1, 1)
+    FIELD(CONTROL, INT_EN, 2, 1)
+
+#define CONTROL_MASK (R_CONTROL_EN_MASK | R_CONTROL_MODE_MASK | \
+                      R_CONTROL_INT_EN_MASK)
+
+static void rk3399_timer_update_irq(RK3399TimerChannel *c)
+{
+    qemu_set_irq(c->irq, c->int_status &&
+                 FIELD_EX32(c->control, CONTROL, INT_EN));
+}
+
+static void rk3399_timer_tick(void *opaque)
+{
+    RK3399TimerChannel *c = opaque;
+
+    trace_rk3399_timer_expired(c->index);
+    c->int_status = 1;
+    rk3399_timer_update_irq(c);
+}
+
+/* Must be called inside a ptimer transaction */
+static void rk3399_timer_start(RK3399TimerChannel *c)
+{
+    if (!c->load_count) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: channel %d enabled with zero load count\n",
+                      __func__, c->index);
+        ptimer_stop(c->ptimer);
+        return;
+    }
+    ptimer_set_limit(c->ptimer, c->load_count, 1);
+    ptimer_run(c->ptimer, FIELD_EX32(c->control, CONTROL, MODE));
+}
+
+static void rk3399_timer_write_control(RK3399TimerChannel *c, uint32_t value)
+{
+    uint32_t old = c->control;
+
+    c->control = value & CONTROL_MASK;
+
+    ptimer_transaction_begin(c->ptimer);
+    if (!FIELD_EX32(c->control, CONTROL, EN)) {
+        ptimer_stop(c->ptimer);
+    } else if (!FIELD_EX32(old, CONTROL, EN) ||
+               FIELD_EX32(old ^ c->control, CONTROL, MODE)) {
+        rk3399_timer_start(c);
+    }
+    ptimer_transaction_commit(c->ptimer);
+
+    rk3399_timer_update_irq(c);
+}
+
+static void rk3399_timer_write_load(RK3399TimerChannel *c, uint64_t load)
+{
+    c->load_count = load;
+
+    /* A running counter picks up the new value on its next reload */
+    if (FIELD_EX32(c->control, CONTROL, EN) && load) {
+        ptimer_transaction_begin(c->ptimer);
+        ptimer_set_limit(c->ptimer, load, 0);
+        ptimer_transaction_commit(c->ptimer);
+    }
+}
+
+static uint64_t rk3399_timer_read(void *opaque, hwaddr offset, unsigned size)
+{
+    RK3399TimerState *s = RK3399_TIMER(opaque);
+    int ch = offset / CHANNEL_STRIDE;
+    RK3399TimerChannel *c;
+    uint64_t r = 0;
+
+    if (ch >= RK3399_TIMER_CHANNELS) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+    c = &s->chan[ch];
+
+    switch (offset % CHANNEL_STRIDE) {
+    case A_LOAD_COUNT0:
+        r = extract64(c->load_count, 0, 32);
+        break;
+    case A_LOAD_COUNT1:
+        r = extract64(c->load_count, 32, 32);
+        break;
+    case A_CURRENT_VALUE0:
+        r = extract64(ptimer_get_count(c->ptimer), 0, 32);
+        break;
+    case A_CURRENT_VALUE1:
+        r = extract64(ptimer_get_count(c->ptimer), 32, 32);
+        break;
+    case A_LOAD_COUNT2:
+        r = extract64(c->init_count, 0, 32);
+        break;
+    case A_LOAD_COUNT3:
+        r = extract64(c->init_count, 32, 32);
+        break;
+    case A_INT_STATUS:
+        r = c->int_status;
+        break;
+    case A_CONTROL:
+        r = c->control;
+        break;
+    }
+
+    trace_rk3399_timer_read(ch, offset % CHANNEL_STRIDE, r);
+    return r;
+}
+
+static void rk3399_timer_write(void *opaque, hwaddr offset, uint64_t value,
+                               unsigned size)
+{
+    RK3399TimerState *s = RK3399_TIMER(opaque);
+    int ch = offset / CHANNEL_STRIDE;
+    RK3399TimerChannel *c;
+
+    if (ch >= RK3399_TIMER_CHANNELS) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+    c = &s->chan[ch];
+
+    trace_rk3399_timer_write(ch, offset % CHANNEL_STRIDE, value);
+
+    switch (offset % CHANNEL_STRIDE) {
+    case A_LOAD_COUNT0:
+        rk3399_timer_write_load(c, deposit64(c->load_count, 0, 32, value));
+        break;
+    case A_LOAD_COUNT1:
+        rk3399_timer_write_load(c, deposit64(c->load_count, 32, 32, value));
+        break;
+    case A_LOAD_COUNT2:
+        c->init_count = deposit64(c->init_count, 0, 32, value);
+        break;
+    case A_LOAD_COUNT3:
+        c->init_count = deposit64(c->init_count, 32, 32, value);
+        break;
+    case A_INT_STATUS:
+        /* Write 1 to clear */
+        c->int_status &= ~value;
+        rk3399_timer_update_irq(c);
+        break;
+    case A_CONTROL:
+        rk3399_timer_write_control(c, value);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to read-only offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+}
+
+static const MemoryRegionOps rk3399_timer_ops = {
+    .read = rk3399_timer_read,
+    .write = rk3399_timer_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void rk3399_timer_reset(DeviceState *dev)
+{
+    RK3399TimerState *s = RK3399_TIMER(dev);
+    int i;
+
+    for (i = 0; i < RK3399_TIMER_CHANNELS; i++) {
+        RK3399TimerChannel *c = &s->chan[i];
+
+        ptimer_transaction_begin(c->ptimer);
+        ptimer_stop(c->ptimer);
+        ptimer_set_limit(c->ptimer, 0, 1);
+        ptimer_transaction_commit(c->ptimer);
+
+        c->load_count = 0;
+        c->init_count = 0;
+        c->int_status = 0;
+        c->control = 0;
+        rk3399_timer_update_irq(c);
+    }
+}
+
+static void rk3399_timer_init(Object *obj)
+{
+    RK3399TimerState *s = RK3399_TIMER(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int i;
+
+    memory_region_init_io(&s->iomem, obj, &rk3399_timer_ops, s,
+                          TYPE_RK3399_TIMER, RK3399_TIMER_IOSIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+
+    for (i = 0; i < RK3399_TIMER_CHANNELS; i++) {
+        sysbus_init_irq(sbd, &s->chan[i].irq);
+    }
+}
+
+static void rk3399_timer_realize(DeviceState *dev, Error **errp)
+{
+    RK3399TimerState *s = RK3399_TIMER(dev);
+    int i;
+
+    if (!s->freq) {
+        error_setg(errp, "rk3399-timer: clock-frequency must be non-zero");
+        return;
+    }
+
+    for (i = 0; i < RK3399_TIMER_CHANNELS; i++) {
+        RK3399TimerChannel *c = &s->chan[i];
+
+        c->timer = s;
+        c->index = i;
+        c->ptimer = ptimer_init(rk3399_timer_tick, c,
+                                PTIMER_POLICY_WRAP_AFTER_ONE_PERIOD |
+                                PTIMER_POLICY_TRIGGER_ONLY_ON_DECREMENT |
+                                PTIMER_POLICY_NO_IMMEDIATE_RELOAD |
+                                PTIMER_POLICY_NO_COUNTER_ROUND_DOWN);
+        ptimer_transaction_begin(c->ptimer);
+        ptimer_set_freq(c->ptimer, s->freq);
+        ptimer_transaction_commit(c->ptimer);
+    }
+}
+
+static Property rk3399_timer_properties[] = {
+    DEFINE_PROP_UINT32("clock-frequency", RK3399TimerState, freq, 24000000),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static const VMStateDescription rk3399_timer_chan_vmstate = {
+    .name = "rk3399-timer-channel",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_PTIMER(ptimer, RK3399TimerChannel),
+        VMSTATE_UINT64(load_count, RK3399TimerChannel),
+        VMSTATE_UINT64(init_count, RK3399TimerChannel),
+        VMSTATE_UINT32(int_status, RK3399TimerChannel),
+        VMSTATE_UINT32(control, RK3399TimerChannel),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription rk3399_timer_vmstate = {
+    .name = "rk3399-timer",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(chan, RK3399TimerState, RK3399_TIMER_CHANNELS,
+                             1, rk3399_timer_chan_vmstate,
+                             RK3399TimerChannel),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void rk3399_timer_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = rk3399_timer_realize;
+    dc->vmsd = &rk3399_timer_vmstate;
+    device_class_set_legacy_reset(dc, rk3399_timer_reset);
+    device_class_set_props(dc, rk3399_timer_properties);
+}
+
+static const TypeInfo rk3399_timer_info = {
+    .name = TYPE_RK3399_TIMER,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(RK3399TimerState),
+    .instance_init = rk3399_timer_init,
+    .class_init = rk3399_timer_class_init,
+};
+
+static void rk3399_timer_register_types(void)
+{
+    type_register_static(&rk3399_timer_info);
+}
+
+type_init(rk3399_timer_register_types);
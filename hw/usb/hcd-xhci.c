@@ -127,6 +127,9 @@
 
 #define ERDP_EHB        (1<<3)
 
+#define IMOD_IMODI_MASK 0xffff
+#define IMOD_IMODI_NS   250
+
 #define TRB_SIZE 16
 typedef struct XHCITRB {
     uint64_t parameter;
@@ -574,6 +577,56 @@ static void xhci_intr_update(XHCIState *xhci, int v)
     }
 }
 
+static void xhci_intr_signal(XHCIState *xhci, int v)
+{
+    XHCIInterrupter *intr = &xhci->intr[v];
+
+    if (intr->imod_timer) {
+        intr->imod_next = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                          (intr->imod & IMOD_IMODI_MASK) * IMOD_IMODI_NS;
+    }
+    if (xhci->intr_raise) {
+        if (xhci->intr_raise(xhci, v, true)) {
+            intr->iman &= ~IMAN_IP;
+        }
+    }
+}
+
+/*
+ * Hold back the interrupt until the moderation interval (IMODI) since
+ * the previous one has passed.  Events queued meanwhile find EHB set and
+ * are covered by the one interrupt signalled from the timer.
+ */
+static bool xhci_intr_moderate(XHCIState *xhci, int v)
+{
+    XHCIInterrupter *intr = &xhci->intr[v];
+    int64_t now;
+
+    if (!intr->imod_timer) {
+        return false;
+    }
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if (now >= intr->imod_next) {
+        return false;
+    }
+    trace_usb_xhci_irq_moderate(v, intr->imod_next - now);
+    timer_mod(intr->imod_timer, intr->imod_next);
+    return true;
+}
+
+static void xhci_imod_timer(void *opaque)
+{
+    XHCIInterrupter *intr = opaque;
+    XHCIState *xhci = intr->xhci;
+
+    /* The guest may have polled the event ring meanwhile */
+    if (intr->iman & IMAN_IP &&
+        intr->iman & IMAN_IE &&
+        xhci->usbcmd & USBCMD_INTE) {
+        xhci_intr_signal(xhci, intr - xhci->intr);
+    }
+}
+
 static void xhci_intr_raise(XHCIState *xhci, int v)
 {
     bool pending = (xhci->intr[v].erdp_low & ERDP_EHB);
@@ -592,11 +645,10 @@ static void xhci_intr_raise(XHCIState *xhci, int v)
     if (!(xhci->usbcmd & USBCMD_INTE)) {
         return;
     }
-    if (xhci->intr_raise) {
-        if (xhci->intr_raise(xhci, v, true)) {
-            xhci->intr[v].iman &= ~IMAN_IP;
-        }
+    if (xhci_intr_moderate(xhci, v)) {
+        return;
     }
+    xhci_intr_signal(xhci, v);
 }
 
 static inline int xhci_running(XHCIState *xhci)
@@ -2724,6 +2776,11 @@ static void xhci_reset(DeviceState *dev)
         xhci->intr[i].er_pcs = 1;
         xhci->intr[i].ev_buffer_put = 0;
         xhci->intr[i].ev_buffer_get = 0;
+
+        if (xhci->intr[i].imod_timer) {
+            timer_del(xhci->intr[i].imod_timer);
+        }
+        xhci->intr[i].imod_next = 0;
     }
 
     xhci->mfindex_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
@@ -3387,6 +3444,14 @@ static void usb_xhci_realize(DeviceState *dev, Error **errp)
 
     usb_xhci_init(xhci);
     xhci->mfwrap_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, xhci_mfwrap_timer, xhci);
+    for (i = 0; i < xhci->numintrs; i++) {
+        xhci->intr[i].xhci = xhci;
+        if (xhci_get_flag(xhci, XHCI_FLAG_IMOD)) {
+            xhci->intr[i].imod_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                                    xhci_imod_timer,
+                                                    &xhci->intr[i]);
+        }
+    }
 
     memory_region_init(&xhci->mem, OBJECT(dev), "xhci", XHCI_LEN_REGS);
     memory_region_init_io(&xhci->mem_cap, OBJECT(dev), &xhci_cap_ops, xhci,
@@ -3429,6 +3494,13 @@ static void usb_xhci_unrealize(DeviceState *dev)
         xhci->mfwrap_timer = NULL;
     }
 
+    for (i = 0; i < xhci->numintrs; i++) {
+        if (xhci->intr[i].imod_timer) {
+            timer_free(xhci->intr[i].imod_timer);
+            xhci->intr[i].imod_timer = NULL;
+        }
+    }
+
     memory_region_del_subregion(&xhci->mem, &xhci->mem_cap);
     memory_region_del_subregion(&xhci->mem, &xhci->mem_oper);
     memory_region_del_subregion(&xhci->mem, &xhci->mem_runtime);
@@ -3542,6 +3614,25 @@ static bool xhci_er_full(void *opaque, int version_id)
     return false;
 }
 
+static bool xhci_intr_imod_needed(void *opaque)
+{
+    XHCIInterrupter *intr = opaque;
+
+    return intr->imod_timer != NULL;
+}
+
+static const VMStateDescription vmstate_xhci_intr_imod = {
+    .name = "xhci-intr/imod",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = xhci_intr_imod_needed,
+    .fields = (const VMStateField[]) {
+        VMSTATE_INT64(imod_next,      XHCIInterrupter),
+        VMSTATE_TIMER_PTR(imod_timer, XHCIInterrupter),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_xhci_intr = {
     .name = "xhci-intr",
     .version_id = 1,
@@ -3571,6 +3662,10 @@ static const VMStateDescription vmstate_xhci_intr = {
                                   vmstate_xhci_event, XHCIEvent),
 
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * const []) {
+        &vmstate_xhci_intr_imod,
+        NULL
     }
 };
 
@@ -3608,6 +3703,7 @@ const VMStateDescription vmstate_xhci = {
 static Property xhci_properties[] = {
     DEFINE_PROP_BIT("streams", XHCIState, flags,
                     XHCI_FLAG_ENABLE_STREAMS, true),
+    DEFINE_PROP_BIT("imod", XHCIState, flags, XHCI_FLAG_IMOD, false),
     DEFINE_PROP_UINT32("p2",    XHCIState, numports_2, 4),
     DEFINE_PROP_UINT32("p3",    XHCIState, numports_3, 4),
     DEFINE_PROP_LINK("host",    XHCIState, hostOpaque, TYPE_DEVICE,
@@ -37,6 +37,7 @@ typedef struct XHCIEPContext XHCIEPContext;
 
 enum xhci_flags {
     XHCI_FLAG_ENABLE_STREAMS = 1,
+    XHCI_FLAG_IMOD,
 };
 
 typedef enum TRBType {
@@ -170,6 +171,11 @@ typedef struct XHCIInterrupter {
     unsigned int ev_buffer_put;
     unsigned int ev_buffer_get;
 
+    /* interrupt moderation, only with XHCI_FLAG_IMOD */
+    XHCIState *xhci;
+    QEMUTimer *imod_timer;
+    /* earliest time the next interrupt may be signalled */
+    int64_t imod_next;
 } XHCIInterrupter;
 
 typedef struct XHCIState {
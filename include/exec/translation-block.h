@@ -141,6 +141,17 @@ struct TranslationBlock {
     uintptr_t jmp_list_head;
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_dest[2];
+
+    /*
+     * Profile for the hot trace tier, see tb_trace_profile().  Until
+     * trace_count reaches tb_trace_threshold, the TB is not chained and
+     * each exit through goto_tb slot N is counted in trace_exits[N], with
+     * the TB it led to in trace_succ[N].  trace_count is TB_TRACE_HEAD for
+     * traces and for the blocks they replace.
+     */
+    uint32_t trace_count;
+    uint32_t trace_exits[2];
+    struct TranslationBlock *trace_succ[2];
 };
 
 /* The alignment given to TranslationBlock during allocation. */
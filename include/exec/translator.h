@@ -20,6 +20,7 @@
 
 #include "qemu/bswap.h"
 #include "exec/vaddr.h"
+#include "tcg/tcg.h"
 
 /**
  * gen_intermediate_code
@@ -76,6 +77,14 @@ typedef enum DisasJumpType {
  * @fake_insn: True if translator_fake_ldb used.
  * @insn_start: The last op emitted by the insn_start hook,
  *              which is expected to be INDEX_op_insn_start.
+ * @trace_tb: When translating a hot trace, the TB previously translated
+ *            for the block being translated; otherwise NULL.
+ * @goto_tb_dest: The first destinations accepted by translator_use_goto_tb,
+ *                which may be translated ahead of time.
+ * @nb_goto_tb_dest: Number of entries in @goto_tb_dest.
+ * @goto_tb_same_state: Set by the target while the code at @goto_tb_dest
+ *                      is known to run with this TB's flags and cs_base,
+ *                      which translating it ahead of time assumes.
  *
  * Architecture-agnostic disassembly context.
  */
@@ -91,6 +100,10 @@ struct DisasContextBase {
     bool fake_insn;
     struct TCGOp *insn_start;
     void *host_addr[2];
+    TranslationBlock *trace_tb;
+    vaddr goto_tb_dest[2];
+    int nb_goto_tb_dest;
+    bool goto_tb_same_state;
 
     /*
      * Record insn data that we cannot read directly from host memory.
@@ -174,6 +187,34 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_trace_follow
+ * @db: disassembly context
+ * @n: goto_tb slot through which the block would exit
+ * @dest: destination of the branch
+ *
+ * Called by the target for a direct branch which ends the instruction,
+ * before emitting anything for its exit through goto_tb slot @n.  If a
+ * hot trace is being translated and its profile shows this exit as the
+ * dominant one, sets db->pc_next to @dest and returns true: translation
+ * is to continue at @dest, without using goto_tb slot @n.  Otherwise,
+ * returns false.
+ */
+bool translator_trace_follow(DisasContextBase *db, int n, vaddr dest);
+
+/**
+ * translator_indirect_jump
+ * @db: disassembly context
+ * @dest: the new pc
+ *
+ * Like tcg_gen_lookup_and_goto_ptr(), for an indirect branch which ends
+ * the TB, has set the pc to @dest, and leaves cs_base and flags in the
+ * same state on each execution of the TB.  The TB found for @dest is
+ * cached for this branch in each CPU, and is jumped to directly while
+ * @dest stays the same.
+ */
+void translator_indirect_jump(DisasContextBase *db, TCGv_i64 dest);
+
 /**
  * translator_io_start
  * @db: Disassembly context
@@ -0,0 +1,41 @@
+/*
+ * Rockchip RK3399 successive approximation ADC (SARADC) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_ADC_RK3399_SARADC_H
+#define HW_ADC_RK3399_SARADC_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+#define TYPE_RK3399_SARADC "rk3399-saradc"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399SARADCState, RK3399_SARADC)
+
+#define RK3399_SARADC_IOSIZE    0x100
+#define RK3399_SARADC_NUM_CHANNELS 6
+/** Reference voltage, in microvolts; inputs at or above it read full scale */
+#define RK3399_SARADC_VREF_UV   1800000
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: registers
+ *  + sysbus IRQ 0: end of conversion interrupt
+ *  + QOM property "voltage[n]": input voltage of channel n, in microvolts
+ */
+struct RK3399SARADCState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+
+    uint32_t data;
+    uint32_t ctrl;
+    uint32_t dly_pu_soc;
+    uint32_t voltage[RK3399_SARADC_NUM_CHANNELS];
+};
+
+#endif /* HW_ADC_RK3399_SARADC_H */
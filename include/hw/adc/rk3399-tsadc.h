@@ -0,0 +1,43 @@
+/*
+ * Rockchip RK3399 temperature sensor ADC (TSADC) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_ADC_RK3399_TSADC_H
+#define HW_ADC_RK3399_TSADC_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+#define TYPE_RK3399_TSADC "rk3399-tsadc"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399TSADCState, RK3399_TSADC)
+
+#define RK3399_TSADC_IOSIZE     0x100
+/** Number of 32-bit registers, up to and including AUTO_PERIOD_HT */
+#define RK3399_TSADC_NR_REGS    (0x70 / sizeof(uint32_t))
+/** Sensors: channel 0 sits in the CPU, channel 1 in the GPU */
+#define RK3399_TSADC_NUM_CHANNELS 2
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: registers
+ *  + sysbus IRQ 0: high temperature interrupt
+ *  + named GPIO output "tshut": TSHUT pin, when routed to GPIO
+ *  + QOM property "temperature[n]": temperature of sensor n, in
+ *    millidegrees Celsius
+ */
+struct RK3399TSADCState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+    qemu_irq tshut;
+
+    uint32_t regs[RK3399_TSADC_NR_REGS];
+    int32_t temperature[RK3399_TSADC_NUM_CHANNELS];
+};
+
+#endif /* HW_ADC_RK3399_TSADC_H */
@@ -1,35 +1,68 @@
 #pragma once
 #include "hw/qdev-core.h"
 #include "qemu/typedefs.h"
+#include "qapi/qapi-builtin-types.h"
 
 #define TYPE_ROCKCHIP_RK3399 MACHINE_TYPE_NAME("rockchip-rk3399")
 
 OBJECT_DECLARE_SIMPLE_TYPE(RK3399State, ROCKCHIP_RK3399)
 
+/* 4x Cortex-A53 "little" cluster followed by 2x Cortex-A72 "big" cluster */
+enum {
+    RK3399_CLUSTER_LITTLE,
+    RK3399_CLUSTER_BIG,
+    RK3399_NUM_CLUSTERS,
+};
+
+#define RK3399_NUM_CPUS 6
+
+/* Core clock of a cluster, and the throttling of its vCPUs that follows it */
+typedef struct RK3399ClusterClock {
+    RK3399State *s;
+    int cluster;
+    Clock *clk;
+    /* Only created with cpu-freq-scaling=on under MTTCG */
+    QEMUTimer *throttle_timer;
+    /* Share of each time slice the cluster's vCPUs sleep */
+    int throttle_pct;
+} RK3399ClusterClock;
+
 struct RK3399State {
     MachineState parent_obj;
     DeviceState *pmucru;
     DeviceState *cru;
+    DeviceState *pmu;
+    DeviceState *grf;
+    DeviceState *pmugrf;
     DeviceState *gic;
+    DeviceState *rktimer[2];
+    DeviceState *sdmmc;
+    DeviceState *emmc;
+    DeviceState *emmc_phy;
+    DeviceState *gmac;
+    DeviceState *dmac[2];
+    DeviceState *usb[2];
+    DeviceState *vop[2];
+    DeviceState *crypto[2];
+    DeviceState *spi1;
+    DeviceState *pcie;
+    DeviceState *tsadc;
+    DeviceState *saradc;
     struct arm_boot_info bootinfo;
-};
-
-#define TYPE_RK3399_PMUCRU "rk3399-pmucru"
-
-OBJECT_DECLARE_SIMPLE_TYPE(RK3399PMUCRUState, RK3399_PMUCRU)
-
-struct RK3399PMUCRUState {
-    SysBusDevice parent_obj;
-    MemoryRegion iomem;
-    char *buffer;
-};
-
-#define TYPE_RK3399_CRU "rk3399-cru"
-
-OBJECT_DECLARE_SIMPLE_TYPE(RK3399CRUState, RK3399_CRU)
-
-struct RK3399CRUState {
-    SysBusDevice parent_obj;
-    MemoryRegion iomem;
-    char *buffer;
+    int fdt_size;
+    uint32_t clock_phandle;
+    uint32_t cru_phandle;
+    uint32_t dmac_phandle[2];
+    uint32_t grf_phandle;
+    uint32_t gic_phandle;
+    uint32_t msi_phandle;
+    uint32_t tsadc_phandle;
+    /* Host time the last machine init stage finished, for tracing */
+    int64_t init_stage_ns;
+    /* Host CPUs the MTTCG vCPU threads of each cluster are pinned to */
+    uint16List *cluster_host_cpus[RK3399_NUM_CLUSTERS];
+    RK3399ClusterClock cluster_clock[RK3399_NUM_CLUSTERS];
+    bool cpu_freq_scaling;
+    /* vCPUs with a throttling sleep queued, by cpu_index */
+    bool throttle_scheduled[RK3399_NUM_CPUS];
 };
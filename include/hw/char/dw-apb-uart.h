@@ -0,0 +1,39 @@
+/*
+ * Synopsys DesignWare APB UART emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_CHAR_DW_APB_UART_H
+#define HW_CHAR_DW_APB_UART_H
+
+#include "hw/char/serial.h"
+#include "hw/sysbus.h"
+#include "qom/object.h"
+
+#define TYPE_DW_APB_UART "dw-apb-uart"
+OBJECT_DECLARE_SIMPLE_TYPE(DWAPBUARTState, DW_APB_UART)
+
+#define DW_APB_UART_IOSIZE      0x100
+#define DW_APB_UART_FIFO_SIZE   64
+
+/*
+ * QEMU interface:
+ *  + QOM properties "chardev", "baudbase" and "fifo-size", aliased from
+ *    the embedded 16550 core
+ *  + sysbus MMIO region 0: the register file, with 32-bit register spacing
+ *  + sysbus IRQ 0: the UART interrupt
+ */
+struct DWAPBUARTState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    SerialState serial;
+    MemoryRegion iomem;
+};
+
+DWAPBUARTState *dw_apb_uart_create(hwaddr base, qemu_irq irq, int baudbase,
+                                   Chardev *chr);
+
+#endif /* HW_CHAR_DW_APB_UART_H */
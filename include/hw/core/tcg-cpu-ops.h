@@ -190,6 +190,15 @@ struct TCGCPUOps {
      * needs to be recorded for replay purposes.
      */
     bool (*need_replay_interrupt)(int interrupt_request);
+    /**
+     * @tb_cache_config: Describe what else translation depends on
+     *
+     * Append to @config whatever state of @cpu the code generated for it
+     * depends on, besides its QOM properties and the flags of each block:
+     * e.g. ID registers set up at realize time.  The persistent TB cache
+     * is only reused when this is the same.
+     */
+    void (*tb_cache_config)(CPUState *cpu, GString *config);
 #endif /* !CONFIG_USER_ONLY */
 };
 
@@ -0,0 +1,62 @@
+/*
+ * Rockchip RK3399 Video Output Processor (VOP) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_DISPLAY_RK3399_VOP_H
+#define HW_DISPLAY_RK3399_VOP_H
+
+#include "hw/sysbus.h"
+#include "ui/console.h"
+#include "qom/object.h"
+
+#define TYPE_RK3399_VOP "rk3399-vop"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399VOPState, RK3399_VOP)
+
+#define RK3399_VOP_IOSIZE   0x2000
+/** Number of 32-bit registers, up to and including the interrupt block */
+#define RK3399_VOP_NR_REGS  (0x400 / sizeof(uint32_t))
+
+/* Scanout geometry of window 0 as last set up on the console */
+typedef struct RK3399VOPMode {
+    bool enabled;
+    uint32_t base;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t format;
+    bool rb_swap;
+} RK3399VOPMode;
+
+/*
+ * QEMU interface:
+ *  + QOM link "dma-memory": memory the framebuffers are fetched from
+ *  + sysbus MMIO region 0: registers
+ *  + sysbus IRQ 0: VOP interrupt
+ */
+struct RK3399VOPState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion iomem;
+    qemu_irq irq;
+    QemuConsole *con;
+
+    MemoryRegion *dma_mr;
+    MemoryRegionSection fbsection;
+
+    uint32_t regs[RK3399_VOP_NR_REGS];
+    /* Shadowed registers as latched by the last REG_CFG_DONE write */
+    uint32_t active[RK3399_VOP_NR_REGS];
+    uint32_t int_raw;
+
+    /* Frame start / line flag interrupts at the refresh rate */
+    QEMUTimer *vsync_timer;
+
+    RK3399VOPMode mode;
+    bool invalidate;
+};
+
+#endif /* HW_DISPLAY_RK3399_VOP_H */
@@ -0,0 +1,80 @@
+/*
+ * Rockchip RK3399 Clock and Reset Unit (CRU / PMUCRU) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_MISC_RK3399_CRU_H
+#define HW_MISC_RK3399_CRU_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+/** Size of the register I/O address space of both CRU blocks */
+#define RK3399_CRU_IOSIZE       (0x1000)
+
+/** Number of 32-bit register slots in the I/O space */
+#define RK3399_CRU_NR_REGS      (RK3399_CRU_IOSIZE / sizeof(uint32_t))
+
+/** Each PLL owns six consecutive CON registers, 0x20 bytes apart */
+#define RK3399_CRU_PLL_STRIDE   (0x20)
+
+/* Register flags */
+#define RK3399_CRU_REG_HIWORD   (1 << 0) /* bits [31:16] are write enables */
+#define RK3399_CRU_REG_PLL_CON2 (1 << 1) /* fractional divider and lock */
+#define RK3399_CRU_REG_RO       (1 << 2)
+#define RK3399_CRU_REG_GLB_SRST (1 << 3) /* magic write triggers reset */
+
+/**
+ * RK3399CRURegInfo:
+ * @name: register name, used for tracing
+ * @offset: offset of the first register of the group
+ * @count: number of consecutive 32-bit registers described by this entry
+ * @reset: reset value of each register in the group
+ * @flags: RK3399_CRU_REG_* access semantics
+ */
+typedef struct RK3399CRURegInfo {
+    const char *name;
+    hwaddr offset;
+    unsigned count;
+    uint32_t reset;
+    uint32_t flags;
+} RK3399CRURegInfo;
+
+#define TYPE_RK3399_CRU     "rk3399-cru"
+#define TYPE_RK3399_PMUCRU  "rk3399-pmucru"
+OBJECT_DECLARE_TYPE(RK3399CRUState, RK3399CRUClass, RK3399_CRU)
+
+struct RK3399CRUClass {
+    /*< private >*/
+    SysBusDeviceClass parent_class;
+    /*< public >*/
+
+    /** Register table, terminated by an entry with a NULL name */
+    const RK3399CRURegInfo *regs;
+    /** Whether the unit drives the CPU cluster core clocks */
+    bool has_core_clocks;
+};
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: registers
+ *  + Clock output "armclkl": core clock of the Cortex-A53 cluster (CRU only)
+ *  + Clock output "armclkb": core clock of the Cortex-A72 cluster (CRU only)
+ */
+struct RK3399CRUState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+
+    /** Table entry describing each register slot, NULL if unassigned */
+    const RK3399CRURegInfo *info[RK3399_CRU_NR_REGS];
+
+    uint32_t regs[RK3399_CRU_NR_REGS];
+
+    Clock *armclk[2];
+};
+
+#endif /* HW_MISC_RK3399_CRU_H */
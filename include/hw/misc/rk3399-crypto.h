@@ -0,0 +1,52 @@
+/*
+ * Rockchip RK3399 crypto engine emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_MISC_RK3399_CRYPTO_H
+#define HW_MISC_RK3399_CRYPTO_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+#include "crypto/cipher.h"
+
+#define TYPE_RK3399_CRYPTO "rk3399-crypto"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399CryptoState, RK3399_CRYPTO)
+
+#define RK3399_CRYPTO_IOSIZE    0x4000
+/** Number of 32-bit registers, up to and including the TRNG block */
+#define RK3399_CRYPTO_NR_REGS   (0x280 / sizeof(uint32_t))
+
+/*
+ * QEMU interface:
+ *  + QOM link "dma-memory": memory the block and hash DMA engines access
+ *  + sysbus MMIO region 0: registers
+ *  + sysbus IRQ 0: crypto interrupt
+ */
+struct RK3399CryptoState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+
+    uint32_t regs[RK3399_CRYPTO_NR_REGS];
+
+    /* Message collected so far, hashed in one go once HASH_MSG_LEN is in */
+    uint8_t *hash_buf;
+    uint32_t hash_len;
+    uint32_t hash_size;
+
+    /* Cipher context, kept across operations until the key changes */
+    QCryptoCipher *cipher;
+    int cipher_alg;
+    int cipher_mode;
+    uint8_t cipher_key[32];
+};
+
+#endif /* HW_MISC_RK3399_CRYPTO_H */
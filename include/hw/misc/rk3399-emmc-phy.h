@@ -0,0 +1,36 @@
+/*
+ * Rockchip RK3399 eMMC PHY emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_MISC_RK3399_EMMC_PHY_H
+#define HW_MISC_RK3399_EMMC_PHY_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+/** Offset of the PHY registers within the GRF */
+#define RK3399_EMMC_PHY_GRF_OFFSET  (0xf780)
+/** Size of the register I/O address space: CON0-6 and STATUS */
+#define RK3399_EMMC_PHY_IOSIZE      (0x24)
+#define RK3399_EMMC_PHY_NR_CON      (7)
+
+#define TYPE_RK3399_EMMC_PHY "rk3399-emmc-phy"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399EMMCPhyState, RK3399_EMMC_PHY)
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: GRF_EMMCPHY_CON0..6 and GRF_EMMCPHY_STATUS,
+ *    to be mapped over the GRF at RK3399_EMMC_PHY_GRF_OFFSET
+ */
+struct RK3399EMMCPhyState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    uint32_t con[RK3399_EMMC_PHY_NR_CON];
+};
+
+#endif /* HW_MISC_RK3399_EMMC_PHY_H */
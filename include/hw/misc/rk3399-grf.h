@@ -0,0 +1,73 @@
+/*
+ * Rockchip RK3399 General Register Files (GRF / PMUGRF) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_MISC_RK3399_GRF_H
+#define HW_MISC_RK3399_GRF_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+#define RK3399_GRF_IOSIZE       (0x10000)
+#define RK3399_PMUGRF_IOSIZE    (0x1000)
+
+/** Most register banks that need write hooks in either block */
+#define RK3399_GRF_MAX_HOOKS    (8)
+
+/* Register bank flags */
+#define RK3399_GRF_HIWORD       (1 << 0) /* bits [31:16] are write enables */
+#define RK3399_GRF_RO           (1 << 1)
+
+/**
+ * RK3399GRFBank:
+ * @name: bank name, used for tracing and as the name of its region
+ * @offset: offset of the first register of the bank
+ * @size: size of the bank in bytes
+ * @flags: RK3399_GRF_* access semantics
+ */
+typedef struct RK3399GRFBank {
+    const char *name;
+    hwaddr offset;
+    hwaddr size;
+    uint32_t flags;
+} RK3399GRFBank;
+
+#define TYPE_RK3399_GRF     "rk3399-grf"
+#define TYPE_RK3399_PMUGRF  "rk3399-pmugrf"
+OBJECT_DECLARE_TYPE(RK3399GRFState, RK3399GRFClass, RK3399_GRF)
+
+struct RK3399GRFClass {
+    /*< private >*/
+    SysBusDeviceClass parent_class;
+    /*< public >*/
+
+    /** Size of the register I/O address space */
+    hwaddr size;
+    /** Banks with write hooks, terminated by an entry with a NULL name */
+    const RK3399GRFBank *banks;
+};
+
+typedef struct RK3399GRFHook {
+    RK3399GRFState *grf;
+    const RK3399GRFBank *bank;
+    MemoryRegion iomem;
+} RK3399GRFHook;
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: registers
+ */
+struct RK3399GRFState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    /** Backing store of every register, mapped directly where plain */
+    MemoryRegion regs;
+    RK3399GRFHook hooks[RK3399_GRF_MAX_HOOKS];
+};
+
+#endif /* HW_MISC_RK3399_GRF_H */
@@ -0,0 +1,36 @@
+/*
+ * Rockchip RK3399 Power Management Unit emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_MISC_RK3399_PMU_H
+#define HW_MISC_RK3399_PMU_H
+
+#include "qom/object.h"
+#include "hw/sysbus.h"
+
+#define TYPE_RK3399_PMU "rk3399-pmu"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399PMUState, RK3399_PMU)
+
+#define RK3399_PMU_IOSIZE       0x1000
+/** Number of 32-bit registers, up to and including PMU_SYS_REG3 */
+#define RK3399_PMU_NR_REGS      (0x100 / sizeof(uint32_t))
+/** Cores with a power domain of their own: four A53s, then two A72s */
+#define RK3399_PMU_NUM_CORES    6
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: registers
+ */
+struct RK3399PMUState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+
+    uint32_t regs[RK3399_PMU_NR_REGS];
+};
+
+#endif /* HW_MISC_RK3399_PMU_H */
@@ -0,0 +1,72 @@
+/*
+ * Synopsys DesignWare Ethernet MAC (GMAC 3.x) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_NET_DW_GMAC_H
+#define HW_NET_DW_GMAC_H
+
+#include "hw/sysbus.h"
+#include "net/net.h"
+#include "qom/object.h"
+
+#define TYPE_DW_GMAC "dw-gmac"
+OBJECT_DECLARE_SIMPLE_TYPE(DWGMACState, DW_GMAC)
+
+#define DW_GMAC_IOSIZE          0x10000
+/** Number of 32-bit MAC registers, up to and including the address filters */
+#define DW_GMAC_NR_MAC_REGS     (0xc0 / sizeof(uint32_t))
+/** Number of 32-bit DMA registers, starting at offset 0x1000 */
+#define DW_GMAC_NR_DMA_REGS     (0x5c / sizeof(uint32_t))
+/** Number of registers of the MDIO attached PHY */
+#define DW_GMAC_NR_PHY_REGS     32
+
+/*
+ * QEMU interface:
+ *  + QOM link "dma-memory": memory the descriptor DMA engine accesses
+ *  + QOM property "clock-frequency": rate of the CSR clock that times the
+ *    receive interrupt watchdog
+ *  + QOM property "phy-addr": MDIO address of the built-in PHY
+ *  + NIC properties (mac, netdev)
+ *  + sysbus MMIO region 0: MAC and DMA registers
+ *  + sysbus IRQ 0: combined interrupt (macirq)
+ */
+struct DWGMACState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion iomem;
+    qemu_irq irq;
+    NICState *nic;
+    NICConf conf;
+
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+
+    uint32_t freq;
+    uint8_t phy_addr;
+
+    uint32_t mac[DW_GMAC_NR_MAC_REGS];
+    uint32_t dma[DW_GMAC_NR_DMA_REGS];
+    uint16_t phy[DW_GMAC_NR_PHY_REGS];
+
+    /* The receive DMA ran out of descriptors and waits for a poll demand */
+    bool rx_suspended;
+    /* The peer queued our last frame; resume the TX ring once it drains */
+    bool tx_blocked;
+    /* Ethertype of the frame being gathered from the TX ring */
+    uint16_t tx_ethertype;
+    /* Delivering queued frames in one go; raise the interrupt at the end */
+    bool rx_burst;
+    /* Receive interrupt watchdog (RIWT) */
+    QEMUTimer *rx_watchdog;
+    /* Continues the TX ring after a full batch */
+    QEMUBH *tx_bh;
+
+    struct NetTxPkt *tx_pkt;
+    struct NetRxPkt *rx_pkt;
+};
+
+#endif /* HW_NET_DW_GMAC_H */
@@ -0,0 +1,61 @@
+/*
+ * Synopsys DesignWare Mobile Storage Host (dw_mmc) emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_SD_DW_MMC_H
+#define HW_SD_DW_MMC_H
+
+#include "hw/sysbus.h"
+#include "hw/sd/sd.h"
+#include "sysemu/dma.h"
+#include "qom/object.h"
+
+#define TYPE_DW_MMC "dw-mmc"
+OBJECT_DECLARE_SIMPLE_TYPE(DWMMCState, DW_MMC)
+
+#define TYPE_DW_MMC_BUS "dw-mmc-bus"
+
+#define DW_MMC_IOSIZE       0x4000
+/** Number of 32-bit registers below the data FIFO window */
+#define DW_MMC_NR_REGS      (0x114 / sizeof(uint32_t))
+/** FIFO depth in 32-bit words */
+#define DW_MMC_FIFO_DEPTH   256
+
+/*
+ * QEMU interface:
+ *  + QOM link "dma-memory": memory the internal DMA controller accesses
+ *  + sysbus MMIO region 0: registers and data FIFO
+ *  + sysbus IRQ 0: controller interrupt
+ *  + child bus "sd-bus": the card slot
+ */
+struct DWMMCState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    SDBus sdbus;
+    MemoryRegion iomem;
+    qemu_irq irq;
+
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+
+    uint32_t regs[DW_MMC_NR_REGS];
+
+    /* Bytes left in the current data transfer */
+    uint32_t data_left;
+    /* Descriptor the IDMAC continues with */
+    uint32_t dscaddr;
+
+    /* In-flight IDMAC transfer straight to the card's block backend */
+    BlockAIOCB *aiocb;
+    BlockAcctCookie acct;
+    BlockBackend *blk;
+    QEMUSGList sg;
+    /* Descriptors it has taken, handed back to the guest on completion */
+    GArray *descs;
+};
+
+#endif /* HW_SD_DW_MMC_H */
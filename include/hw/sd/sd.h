@@ -132,6 +132,23 @@ struct SDCardClass {
     bool (*get_readonly)(SDState *sd);
     void (*set_cid)(SDState *sd);
     void (*set_csd)(SDState *sd, uint64_t size);
+    /**
+     * Hand the rest of a multiple block transfer over to the controller.
+     * @sd: card
+     * @offset: set to the backend offset of the next block to transfer
+     * @max_len: set to the number of bytes left in the transfer
+     *
+     * Return: the card's block backend, or NULL if the transfer in
+     * progress has to go through read_byte/write_byte.
+     */
+    BlockBackend *(*blk_transfer_begin)(SDState *sd, uint64_t *offset,
+                                        uint64_t *max_len);
+    /**
+     * Complete a transfer started with blk_transfer_begin.
+     * @sd: card
+     * @len: number of bytes the controller transferred, in whole blocks
+     */
+    void (*blk_transfer_end)(SDState *sd, uint64_t len);
 
     const struct SDProto *proto;
 };
@@ -200,6 +217,28 @@ void sdbus_write_data(SDBus *sdbus, const void *buf, size_t length);
 void sdbus_read_data(SDBus *sdbus, void *buf, size_t length);
 bool sdbus_receive_ready(SDBus *sd);
 bool sdbus_data_ready(SDBus *sd);
+/**
+ * sdbus_blk_transfer_begin: Start a direct block transfer
+ * @sdbus: bus
+ * @offset: set to the block backend offset of the next block
+ * @max_len: set to the number of bytes left in the transfer
+ *
+ * Controllers with a DMA engine use this to move the data of a READ/WRITE
+ * MULTIPLE BLOCK command straight between guest memory and the card's
+ * block backend, e.g. with dma_blk_io(), instead of byte by byte.  The
+ * transfer must be completed with sdbus_blk_transfer_end().
+ *
+ * Return: the card's block backend, or NULL if the data has to go
+ * through sdbus_read_data() / sdbus_write_data().
+ */
+BlockBackend *sdbus_blk_transfer_begin(SDBus *sdbus, uint64_t *offset,
+                                       uint64_t *max_len);
+/**
+ * sdbus_blk_transfer_end: Complete a direct block transfer
+ * @sdbus: bus
+ * @len: number of bytes transferred, a multiple of the block length
+ */
+void sdbus_blk_transfer_end(SDBus *sdbus, uint64_t len);
 bool sdbus_get_inserted(SDBus *sd);
 bool sdbus_get_readonly(SDBus *sd);
 /**
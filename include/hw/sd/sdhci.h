@@ -28,6 +28,7 @@
 #include "hw/pci/pci_device.h"
 #include "hw/sysbus.h"
 #include "hw/sd/sd.h"
+#include "sysemu/dma.h"
 #include "qom/object.h"
 
 /* SD/MMC host controller state */
@@ -87,6 +88,14 @@ struct SDHCIState {
     uint16_t data_count;   /* current element in FIFO buffer */
     uint8_t  stopped_state;/* Current SDHC state */
     bool     pending_insert_state;
+
+    /* In-flight coalesced ADMA2 transfer to the card's block backend */
+    BlockAIOCB *adma_aiocb;
+    BlockAcctCookie adma_acct;
+    BlockBackend *adma_blk;
+    QEMUSGList adma_sg;
+    uint64_t adma_next;    /* descriptor following the coalesced run */
+    uint8_t  adma_attr;    /* attributes of the last coalesced descriptor */
     /* Buffer Data Port Register - virtual access point to R and W buffers */
     /* Software Reset Register - always reads as 0 */
     /* Force Event Auto CMD12 Error Interrupt Reg - write only */
@@ -100,6 +109,7 @@ struct SDHCIState {
     uint8_t sd_spec_version;
     uint8_t uhs_mode;
     uint8_t vendor;        /* For vendor specific functionality */
+    bool adma_coalesce;
 };
 typedef struct SDHCIState SDHCIState;
 
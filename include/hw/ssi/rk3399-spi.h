@@ -0,0 +1,55 @@
+/*
+ * Rockchip RK3399 SPI controller emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_SSI_RK3399_SPI_H
+#define HW_SSI_RK3399_SPI_H
+
+#include "qemu/fifo32.h"
+#include "qom/object.h"
+#include "hw/sysbus.h"
+#include "hw/ssi/ssi.h"
+
+#define TYPE_RK3399_SPI "rk3399-spi"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399SPIState, RK3399_SPI)
+
+#define RK3399_SPI_IOSIZE       0x1000
+/** Number of 32-bit control registers, CTRLR0 to VERSION */
+#define RK3399_SPI_NR_REGS      (0x4c / sizeof(uint32_t))
+#define RK3399_SPI_FIFO_LEN     32
+#define RK3399_SPI_NUM_CS       2
+
+/* Indexes of the "dma-busy" outputs */
+#define RK3399_SPI_DMA_TX       0
+#define RK3399_SPI_DMA_RX       1
+
+/*
+ * QEMU interface:
+ *  + sysbus MMIO region 0: registers and the TXDR/RXDR FIFO windows
+ *  + sysbus IRQ 0: SPI interrupt
+ *  + sysbus IRQs 1..RK3399_SPI_NUM_CS: chip selects, active low
+ *  + named GPIO outputs "dma-busy": raised while the TX or RX DMA request
+ *    is not asserted, for the peripheral inputs of a PL330
+ *  + SSI bus "spi"
+ */
+struct RK3399SPIState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+    qemu_irq cs_lines[RK3399_SPI_NUM_CS];
+    qemu_irq dma_busy[2];
+    SSIBus *ssi;
+
+    uint32_t regs[RK3399_SPI_NR_REGS];
+    /* Frames are shifted as soon as they are written: only RX buffers */
+    Fifo32 rx_fifo;
+    /* Frames still to be clocked in by a receive-only transfer */
+    uint32_t ro_remaining;
+};
+
+#endif /* HW_SSI_RK3399_SPI_H */
@@ -0,0 +1,48 @@
+/*
+ * Rockchip RK3399 timer block emulation
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef HW_TIMER_RK3399_TIMER_H
+#define HW_TIMER_RK3399_TIMER_H
+
+#include "hw/sysbus.h"
+#include "hw/ptimer.h"
+#include "qom/object.h"
+
+#define TYPE_RK3399_TIMER "rk3399-timer"
+OBJECT_DECLARE_SIMPLE_TYPE(RK3399TimerState, RK3399_TIMER)
+
+#define RK3399_TIMER_CHANNELS   6
+#define RK3399_TIMER_IOSIZE     0x1000
+
+typedef struct RK3399TimerChannel {
+    RK3399TimerState *timer;
+    struct ptimer_state *ptimer;
+    qemu_irq irq;
+    int index;
+
+    uint64_t load_count;
+    uint64_t init_count;
+    uint32_t int_status;
+    uint32_t control;
+} RK3399TimerChannel;
+
+/*
+ * QEMU interface:
+ *  + QOM property "clock-frequency": rate of the timer clock (xin24m)
+ *  + sysbus MMIO region 0: the register banks of all channels
+ *  + sysbus IRQ 0..5: one interrupt per channel
+ */
+struct RK3399TimerState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion iomem;
+    uint32_t freq;
+    RK3399TimerChannel chan[RK3399_TIMER_CHANNELS];
+};
+
+#endif /* HW_TIMER_RK3399_TIMER_H */
@@ -74,6 +74,15 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_goto_ptr() - output goto_ptr TCG operation
+ * @ptr: Host code of a TB, or the epilogue
+ *
+ * For the ends of TB which look up the next TB themselves, as
+ * tcg_gen_lookup_and_goto_ptr() does.  Not to be used with CF_NO_GOTO_PTR.
+ */
+void tcg_gen_goto_ptr(TCGv_ptr ptr);
+
 void tcg_gen_plugin_cb(unsigned from);
 void tcg_gen_plugin_mem_cb(TCGv_i64 addr, unsigned meminfo);
 
@@ -496,6 +496,7 @@ struct TCGContext {
     TCGTemp *frame_temp;
 
     TranslationBlock *gen_tb;     /* tb for which code is being generated */
+    TranslationBlock *gen_trace_head; /* tb it replaces, for a hot trace */
     tcg_insn_unit *code_buf;      /* pointer for start of tb */
     tcg_insn_unit *code_ptr;      /* pointer for running end of tb */
 
@@ -760,6 +761,13 @@ TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
 
+/* Region access for the persistent TB cache */
+void tcg_region_set_address_hint(void *addr);
+size_t tcg_region_count(void);
+void tcg_region_get_bounds(size_t curr_region, void **pstart, void **pend);
+size_t tcg_region_used(size_t curr_region);
+void tcg_region_prefill(size_t curr_region, size_t size);
+
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
 
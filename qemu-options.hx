@@ -187,6 +187,9 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
+    "                tb-cache=file (keep TCG translated code in file across runs)\n"
+    "                trace-threshold=n (translate hot TCG loops as traces after n exits)\n"
+    "                translate-threads=n (TCG threads translating ahead of the vCPUs)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
@@ -230,6 +233,35 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``trace-threshold=n``
+        Profiles each translation block for its first n exits, without
+        chaining it to the next block, and translates hot loops again as
+        single blocks following their most frequent path, so that they
+        are optimized as a whole.  This trades slower warm-up for faster
+        tight loops, and is only implemented for AArch64 guests.  It has
+        no effect with ``-icount``.  The default, 0, disables it.
+
+    ``tb-cache=file``
+        Writes the code TCG has translated to file when QEMU exits, and
+        reuses it, for code the guest has not changed, the next time the
+        same QEMU binary starts on the same host with the same machine
+        type, accelerator options, semihosting setting, and number and
+        configuration of CPUs (``-cpu`` model and properties).  Anything
+        else is checked when the code runs.  The generated code is not
+        relocatable, so QEMU refuses to start with this option unless
+        address space randomization is disabled for it (e.g. under
+        ``setarch -R``).  Only supported for system emulation on Linux
+        hosts.
+
+    ``translate-threads=n``
+        Starts n threads, in addition to the vCPU threads, which translate
+        code before the guest runs it: the targets of the direct branches
+        of each block just translated (AArch64 guests only), and the hot
+        loops found with ``trace-threshold``.  This uses more host cores, and a bit more of
+        the translation block cache for code that may never run, to stall
+        the vCPUs less often.  Only used with ``thread=multi``, for system
+        emulation.  The default, 0, disables it.
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -2652,6 +2652,28 @@ static const struct SysemuCPUOps arm_sysemu_ops = {
 };
 #endif
 
+#if defined(CONFIG_TCG) && !defined(CONFIG_USER_ONLY)
+/* The ID registers and features the translators test, for the TB cache */
+static void arm_cpu_tb_cache_config(CPUState *cs, GString *config)
+{
+    ARMCPU *cpu = ARM_CPU(cs);
+    const uint8_t *isar = (const uint8_t *)&cpu->isar;
+    size_t i;
+
+    g_string_append_printf(config,
+                           ",features=%" PRIx64 ",revidr=%x,ctr=%" PRIx64
+                           ",sctlr=%x,pmceid=%" PRIx64 ":%" PRIx64
+                           ",dcz=%u,gm=%u,sve=%x,sme=%x,isar=",
+                           cpu->env.features, cpu->revidr, cpu->ctr,
+                           cpu->reset_sctlr, cpu->pmceid0, cpu->pmceid1,
+                           cpu->dcz_blocksize, cpu->gm_blocksize,
+                           cpu->sve_vq.map, cpu->sme_vq.map);
+    for (i = 0; i < sizeof(cpu->isar); i++) {
+        g_string_append_printf(config, "%02x", isar[i]);
+    }
+}
+#endif
+
 #ifdef CONFIG_TCG
 static const TCGCPUOps arm_tcg_ops = {
     .initialize = arm_translate_init,
@@ -2672,6 +2694,7 @@ static const TCGCPUOps arm_tcg_ops = {
     .adjust_watchpoint_address = arm_adjust_watchpoint_address,
     .debug_check_watchpoint = arm_debug_check_watchpoint,
     .debug_check_breakpoint = arm_debug_check_breakpoint,
+    .tb_cache_config = arm_cpu_tb_cache_config,
 #endif /* !CONFIG_USER_ONLY */
 };
 #endif /* CONFIG_TCG */
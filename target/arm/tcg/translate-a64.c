@@ -443,6 +443,8 @@ static void a64_test_cc(DisasCompare64 *c64, int cc)
 static void gen_rebuild_hflags(DisasContext *s)
 {
     gen_helper_rebuild_hflags_a64(tcg_env, tcg_constant_i32(s->current_el));
+    /* The next TB may have other flags */
+    s->base.goto_tb_same_state = false;
 }
 
 static void gen_exception_internal(int excp)
@@ -520,6 +522,60 @@ static void gen_goto_tb(DisasContext *s, int n, int64_t diff)
     }
 }
 
+/*
+ * Exit for a direct branch: as gen_goto_tb() with slot 0, except that
+ * when translating a hot trace, translation may continue at the
+ * destination instead.
+ */
+static void gen_goto_tb_or_follow(DisasContext *s, int64_t diff)
+{
+    if (s->ss_active ||
+        !translator_trace_follow(&s->base, 0, s->pc_curr + diff)) {
+        gen_goto_tb(s, 0, diff);
+    }
+}
+
+/*
+ * For a conditional branch to pc_curr + @diff, return which way to
+ * follow when translating a hot trace: 1 if taken, 0 if not taken,
+ * or -1 for neither.  For 0, the caller must invert the condition of
+ * the branch it emits to the label it passes to gen_cond_goto_tb().
+ */
+static int trace_follow_cond(DisasContext *s, int64_t diff)
+{
+    if (s->ss_active) {
+        return -1;
+    }
+    if (translator_trace_follow(&s->base, 1, s->pc_curr + diff)) {
+        return 1;
+    }
+    if (translator_trace_follow(&s->base, 0, s->pc_curr + 4)) {
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * Exits for a conditional branch to pc_curr + @diff, once the branch to
+ * @match, which is taken with the branch, has been emitted.  When
+ * @follow, from trace_follow_cond(), says that translation continues on
+ * one of the paths, the other one is rarely taken and exits without using
+ * a goto_tb slot, to leave those to the end of the trace.
+ */
+static void gen_cond_goto_tb(DisasContext *s, DisasLabel match, int follow,
+                             int64_t diff)
+{
+    if (follow >= 0) {
+        gen_a64_update_pc(s, follow ? 4 : diff);
+        tcg_gen_lookup_and_goto_ptr();
+        set_disas_label(s, match);
+    } else {
+        gen_goto_tb(s, 0, 4);
+        set_disas_label(s, match);
+        gen_goto_tb(s, 1, diff);
+    }
+}
+
 /*
  * Register access functions
  *
@@ -1449,7 +1505,7 @@ static inline AArch64DecodeFn *lookup_disas_fn(const AArch64DecodeTable *table,
 static bool trans_B(DisasContext *s, arg_i *a)
 {
     reset_btype(s);
-    gen_goto_tb(s, 0, a->imm);
+    gen_goto_tb_or_follow(s, a->imm);
     return true;
 }
 
@@ -1457,7 +1513,7 @@ static bool trans_BL(DisasContext *s, arg_i *a)
 {
     gen_pc_plus_diff(s, cpu_reg(s, 30), curr_insn_len(s));
     reset_btype(s);
-    gen_goto_tb(s, 0, a->imm);
+    gen_goto_tb_or_follow(s, a->imm);
     return true;
 }
 
@@ -1466,16 +1522,16 @@ static bool trans_CBZ(DisasContext *s, arg_cbz *a)
 {
     DisasLabel match;
     TCGv_i64 tcg_cmp;
+    int follow;
 
     tcg_cmp = read_cpu_reg(s, a->rt, a->sf);
     reset_btype(s);
 
+    follow = trace_follow_cond(s, a->imm);
     match = gen_disas_label(s);
-    tcg_gen_brcondi_i64(a->nz ? TCG_COND_NE : TCG_COND_EQ,
+    tcg_gen_brcondi_i64(a->nz ^ (follow == 0) ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, match.label);
-    gen_goto_tb(s, 0, 4);
-    set_disas_label(s, match);
-    gen_goto_tb(s, 1, a->imm);
+    gen_cond_goto_tb(s, match, follow, a->imm);
     return true;
 }
 
@@ -1483,18 +1539,18 @@ static bool trans_TBZ(DisasContext *s, arg_tbz *a)
 {
     DisasLabel match;
     TCGv_i64 tcg_cmp;
+    int follow;
 
     tcg_cmp = tcg_temp_new_i64();
     tcg_gen_andi_i64(tcg_cmp, cpu_reg(s, a->rt), 1ULL << a->bitpos);
 
     reset_btype(s);
 
+    follow = trace_follow_cond(s, a->imm);
     match = gen_disas_label(s);
-    tcg_gen_brcondi_i64(a->nz ? TCG_COND_NE : TCG_COND_EQ,
+    tcg_gen_brcondi_i64(a->nz ^ (follow == 0) ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, match.label);
-    gen_goto_tb(s, 0, 4);
-    set_disas_label(s, match);
-    gen_goto_tb(s, 1, a->imm);
+    gen_cond_goto_tb(s, match, follow, a->imm);
     return true;
 }
 
@@ -1507,14 +1563,13 @@ static bool trans_B_cond(DisasContext *s, arg_B_cond *a)
     reset_btype(s);
     if (a->cond < 0x0e) {
         /* genuinely conditional branches */
+        int follow = trace_follow_cond(s, a->imm);
         DisasLabel match = gen_disas_label(s);
-        arm_gen_test_cc(a->cond, match.label);
-        gen_goto_tb(s, 0, 4);
-        set_disas_label(s, match);
-        gen_goto_tb(s, 1, a->imm);
+        arm_gen_test_cc(a->cond ^ (follow == 0), match.label);
+        gen_cond_goto_tb(s, match, follow, a->imm);
     } else {
         /* 0xe and 0xf are both "always" conditions */
-        gen_goto_tb(s, 0, a->imm);
+        gen_goto_tb_or_follow(s, a->imm);
     }
     return true;
 }
@@ -2187,6 +2242,7 @@ static bool trans_MSR_i_SVCR(DisasContext *s, arg_MSR_i_SVCR *a)
             /* At least one bit changes. */
             gen_helper_set_svcr(tcg_env, tcg_constant_i32(new),
                                 tcg_constant_i32(a->mask));
+            s->base.goto_tb_same_state = false;
             s->base.is_jmp = DISAS_TOO_MANY;
         }
     }
@@ -11707,6 +11763,11 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
     dc->pauth_active = EX_TBFLAG_A64(tb_flags, PAUTH_ACTIVE);
     dc->bt = EX_TBFLAG_A64(tb_flags, BT);
     dc->btype = EX_TBFLAG_A64(tb_flags, BTYPE);
+    /*
+     * The first insn clears a non-zero BTYPE, so the next TB only has
+     * the flags of this one if it is zero already.
+     */
+    dc->base.goto_tb_same_state = dc->btype == 0;
     dc->unpriv = EX_TBFLAG_A64(tb_flags, UNPRIV);
     dc->ata[0] = EX_TBFLAG_A64(tb_flags, ATA);
     dc->ata[1] = EX_TBFLAG_A64(tb_flags, ATA0);
@@ -11917,10 +11978,12 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             break;
         case DISAS_UPDATE_NOCHAIN:
             gen_a64_update_pc(dc, 4);
-            /* fall through */
-        case DISAS_JUMP:
             tcg_gen_lookup_and_goto_ptr();
             break;
+        case DISAS_JUMP:
+            /* BR, BLR, RET and their pauth forms only change the pc */
+            translator_indirect_jump(&dc->base, cpu_pc);
+            break;
         case DISAS_NORETURN:
         case DISAS_SWI:
             break;
@@ -72,10 +72,20 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+
+    /*
+     * Bytes at the start of each region that hold code restored by the
+     * persistent TB cache, allocated past when the region is handed out.
+     * NULL unless the cache restored some code.
+     */
+    size_t *prefill;
 };
 
 static struct tcg_region_state region;
 
+/* Where to ask for the code_gen_buffer; see tcg_region_set_address_hint */
+static void *region_address_hint;
+
 /*
  * This is an array of struct tcg_region_tree's, with padding.
  * We use void * to simplify the computation of region_trees[i]; each
@@ -353,6 +363,9 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
     s->code_gen_buffer = start;
     s->code_gen_ptr = start;
+    if (region.prefill) {
+        s->code_gen_ptr += region.prefill[curr_region];
+    }
     s->code_gen_buffer_size = end - start;
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
@@ -412,6 +425,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    g_clear_pointer(&region.prefill, g_free);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -556,7 +570,7 @@ static int alloc_code_gen_buffer_anon(size_t size, int prot,
 {
     void *buf;
 
-    buf = mmap(NULL, size, prot, flags, -1, 0);
+    buf = mmap(region_address_hint, size, prot, flags, -1, 0);
     if (buf == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "allocate %zu bytes for jit buffer", size);
@@ -875,6 +889,80 @@ void tcg_region_prologue_set(TCGContext *s)
                      region.after_prologue);
 }
 
+/*
+ * Ask for the code_gen_buffer to be mapped at @addr, which the host may or
+ * may not honour.  Must be called before tcg_init().
+ */
+void tcg_region_set_address_hint(void *addr)
+{
+    region_address_hint = addr;
+}
+
+size_t tcg_region_count(void)
+{
+    return region.n;
+}
+
+void tcg_region_get_bounds(size_t curr_region, void **pstart, void **pend)
+{
+    tcg_region_bounds(curr_region, pstart, pend);
+}
+
+/*
+ * Returns the number of bytes at the start of region @curr_region that
+ * hold code, which is the whole region if it has filled up, and only the
+ * restored code if it has not been handed out yet.  Call from a safe-work
+ * context.
+ */
+size_t tcg_region_used(size_t curr_region)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    void *start, *end;
+    unsigned int i;
+
+    if (curr_region >= region.current) {
+        return region.prefill ? region.prefill[curr_region] : 0;
+    }
+
+    tcg_region_bounds(curr_region, &start, &end);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        if (s->code_gen_buffer == start) {
+            return s->code_gen_ptr - start;
+        }
+    }
+    /* Before any thread registers, the initial context owns region 0 */
+    if (tcg_init_ctx.code_gen_buffer == start) {
+        return tcg_init_ctx.code_gen_ptr - start;
+    }
+    return end - start;
+}
+
+/*
+ * Record that the first @size bytes of region @curr_region hold code
+ * restored by the persistent TB cache, so that they are not allocated
+ * again until the next tcg_region_reset_all().  Must be called before
+ * any TCG thread has registered.
+ */
+void tcg_region_prefill(size_t curr_region, size_t size)
+{
+    g_assert(qatomic_read(&tcg_cur_ctxs) == 0);
+    g_assert(curr_region < region.n);
+
+    qemu_mutex_lock(&region.lock);
+    if (!region.prefill) {
+        region.prefill = g_new0(size_t, region.n);
+    }
+    region.prefill[curr_region] = size;
+
+    /* The initial context already owns the first region */
+    if (curr_region == 0) {
+        tcg_region_assign(&tcg_init_ctx, 0);
+    }
+    qemu_mutex_unlock(&region.lock);
+}
+
 /*
  * Returns the size (in bytes) of all translated code (i.e. from all regions)
  * currently in the cache.
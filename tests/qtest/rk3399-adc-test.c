@@ -0,0 +1,142 @@
+/*
+ * QTest testcase for the Rockchip RK3399 TSADC and SARADC
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+#include "qapi/qmp/qdict.h"
+
+#define RK3399_TSADC_BASE       0xff260000
+#define RK3399_SARADC_BASE      0xff100000
+
+/* TSADC register offsets */
+#define TSADC_AUTO_CON          0x04
+#define TSADC_INT_EN            0x08
+#define TSADC_INT_PD            0x0c
+#define TSADC_DATA(chn)         (0x20 + (chn) * 4)
+#define TSADC_COMP_INT(chn)     (0x30 + (chn) * 4)
+#define TSADC_COMP_SHUT(chn)    (0x40 + (chn) * 4)
+
+#define TSADC_AUTO_EN           (1 << 0)
+#define TSADC_SRC_EN(chn)       (1 << (4 + (chn)))
+#define TSADC_HT_INTEN(chn)     (1 << (chn))
+#define TSADC_SHUT_2CRU(chn)    (1 << (8 + (chn)))
+#define TSADC_INT_PD_HT(chn)    (1 << (chn))
+
+/* Codes of the Linux rk3399 table */
+#define TSADC_CODE_40C          538
+#define TSADC_CODE_80C          607
+#define TSADC_CODE_85C          616
+#define TSADC_CODE_95C          633
+
+/* SARADC register offsets */
+#define SARADC_DATA             0x00
+#define SARADC_CTRL             0x08
+
+#define SARADC_CTRL_POWER       (1 << 3)
+#define SARADC_CTRL_IRQ_ENABLE  (1 << 5)
+#define SARADC_CTRL_IRQ_STATUS  (1 << 6)
+
+static void qom_set_int(const char *path, const char *property, int value)
+{
+    QDict *response;
+
+    response = qmp("{ 'execute': 'qom-set', 'arguments': { 'path': %s, "
+                   "'property': %s, 'value': %d } }", path, property, value);
+    g_assert(qdict_haskey(response, "return"));
+    qobject_unref(response);
+}
+
+static void tsadc_writel(uint32_t offset, uint32_t value)
+{
+    writel(RK3399_TSADC_BASE + offset, value);
+}
+
+static uint32_t tsadc_readl(uint32_t offset)
+{
+    return readl(RK3399_TSADC_BASE + offset);
+}
+
+static void rk3399_tsadc_test_data(void)
+{
+    g_assert_cmpuint(tsadc_readl(TSADC_DATA(0)), ==, TSADC_CODE_40C);
+    g_assert_cmpuint(tsadc_readl(TSADC_DATA(1)), ==, TSADC_CODE_40C);
+
+    qom_set_int("/machine/tsadc", "temperature[1]", 85000);
+    g_assert_cmpuint(tsadc_readl(TSADC_DATA(0)), ==, TSADC_CODE_40C);
+    g_assert_cmpuint(tsadc_readl(TSADC_DATA(1)), ==, TSADC_CODE_85C);
+    qom_set_int("/machine/tsadc", "temperature[1]", 40000);
+}
+
+static void rk3399_tsadc_test_alarm(void)
+{
+    tsadc_writel(TSADC_COMP_INT(0), TSADC_CODE_80C);
+    tsadc_writel(TSADC_INT_EN, TSADC_HT_INTEN(0));
+    tsadc_writel(TSADC_AUTO_CON, TSADC_AUTO_EN | TSADC_SRC_EN(0));
+    g_assert_cmphex(tsadc_readl(TSADC_INT_PD), ==, 0);
+
+    /* Crossing the threshold raises the alarm, until it is acknowledged */
+    qom_set_int("/machine/tsadc", "temperature[0]", 85000);
+    g_assert_cmphex(tsadc_readl(TSADC_INT_PD), ==, TSADC_INT_PD_HT(0));
+    tsadc_writel(TSADC_INT_PD, TSADC_INT_PD_HT(0));
+    g_assert_cmphex(tsadc_readl(TSADC_INT_PD), ==, 0);
+
+    qom_set_int("/machine/tsadc", "temperature[0]", 40000);
+    tsadc_writel(TSADC_AUTO_CON, 0);
+    tsadc_writel(TSADC_INT_EN, 0);
+}
+
+static void rk3399_tsadc_test_tshut(void)
+{
+    tsadc_writel(TSADC_COMP_SHUT(0), TSADC_CODE_95C);
+    tsadc_writel(TSADC_INT_EN, TSADC_SHUT_2CRU(0));
+    tsadc_writel(TSADC_AUTO_CON, TSADC_AUTO_EN | TSADC_SRC_EN(0));
+
+    /* Overheating resets the SoC, but not the temperature */
+    qom_set_int("/machine/tsadc", "temperature[0]", 100000);
+    qmp_eventwait("RESET");
+    g_assert_cmphex(tsadc_readl(TSADC_AUTO_CON), ==, 0);
+    g_assert_cmpuint(tsadc_readl(TSADC_DATA(0)), >, TSADC_CODE_95C);
+}
+
+static void rk3399_saradc_test_convert(void)
+{
+    uint32_t ctrl = SARADC_CTRL_POWER | SARADC_CTRL_IRQ_ENABLE | 1;
+
+    /* Half of the 1.8V reference */
+    qom_set_int("/machine/saradc", "voltage[1]", 900000);
+
+    writel(RK3399_SARADC_BASE + SARADC_CTRL, ctrl);
+    g_assert_cmphex(readl(RK3399_SARADC_BASE + SARADC_CTRL), ==,
+                    ctrl | SARADC_CTRL_IRQ_STATUS);
+    g_assert_cmpuint(readl(RK3399_SARADC_BASE + SARADC_DATA), ==, 511);
+
+    /* Powering down acknowledges the interrupt */
+    writel(RK3399_SARADC_BASE + SARADC_CTRL, 0);
+    g_assert_cmphex(readl(RK3399_SARADC_BASE + SARADC_CTRL), ==, 0);
+
+    /* Inputs above the reference read full scale */
+    qom_set_int("/machine/saradc", "voltage[1]", 3300000);
+    writel(RK3399_SARADC_BASE + SARADC_CTRL, ctrl);
+    g_assert_cmpuint(readl(RK3399_SARADC_BASE + SARADC_DATA), ==, 0x3ff);
+    writel(RK3399_SARADC_BASE + SARADC_CTRL, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/tsadc/data", rk3399_tsadc_test_data);
+    qtest_add_func("/rk3399/tsadc/alarm", rk3399_tsadc_test_alarm);
+    qtest_add_func("/rk3399/tsadc/tshut", rk3399_tsadc_test_tshut);
+    qtest_add_func("/rk3399/saradc/convert", rk3399_saradc_test_convert);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
@@ -0,0 +1,159 @@
+/*
+ * QTest testcase for the Rockchip RK3399 CRU and PMUCRU
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_PMUCRU_BASE  0xff750000
+#define RK3399_CRU_BASE     0xff760000
+/* An unimplemented device (CPU debug), whose accesses do nothing */
+#define RK3399_UNIMP_BASE   0xfe430000
+#define RK3399_MMIO_SIZE    0x1000
+
+/* Register offsets */
+#define PLL_CON2(pll)       ((pll) * 0x20 + 0x08)
+#define PLL_CON3(pll)       ((pll) * 0x20 + 0x0c)
+#define PLL_CON4(pll)       ((pll) * 0x20 + 0x10)
+#define CRU_CLKSEL_CON(n)   (0x100 + (n) * 4)
+#define PMUCRU_CLKSEL_CON(n) (0x080 + (n) * 4)
+#define CRU_GLB_RST_ST      0x514
+
+#define PLL_CON2_LOCK       (1u << 31)
+#define PLL_CON3_PWRDOWN    (1 << 0)
+
+#define HIWORD_UPDATE(val, mask)    (((mask) << 16) | (val))
+
+#define CRU_GPLL            4
+
+/*
+ * MMIO read rate: each qtest memread of a whole region is split into one
+ * access per register, so that the cost of the device model counts for
+ * more than the qtest round trip.  Best of a few runs, to not be thrown
+ * off by the host being busy.
+ */
+#define RATE_ROUNDS         64
+#define RATE_RUNS           5
+
+/*
+ * Reading the CRU must take at most this many times as long as reading a
+ * device that does nothing, which has half as many (64-bit) registers.
+ * The model it replaced printed a line per access, which costs much more
+ * than the dispatch and the round trip and would be well over.
+ */
+#define RATE_FLOOR          4
+
+static void rk3399_cru_test_reset(void)
+{
+    /* Values the board has always preset, on top of the PLL lock bit */
+    g_assert_cmphex(readl(RK3399_CRU_BASE + PLL_CON2(0)), ==,
+                    PLL_CON2_LOCK | 0x31f);
+    g_assert_cmphex(readl(RK3399_CRU_BASE + PLL_CON4(CRU_GPLL)), ==, 0x2dc);
+    g_assert_cmphex(readl(RK3399_PMUCRU_BASE + PLL_CON2(0)), ==,
+                    PLL_CON2_LOCK | 0x31f);
+    g_assert_cmphex(readl(RK3399_PMUCRU_BASE + PMUCRU_CLKSEL_CON(4)), ==,
+                    0x2dc);
+}
+
+static void rk3399_cru_test_hiword(void)
+{
+    uint32_t reg = RK3399_CRU_BASE + CRU_CLKSEL_CON(0);
+
+    g_assert_cmphex(readl(reg), ==, 0);
+
+    writel(reg, HIWORD_UPDATE(0x1234, 0xffff));
+    g_assert_cmphex(readl(reg), ==, 0x1234);
+
+    /* Only the bits with their write enable set change */
+    writel(reg, HIWORD_UPDATE(0x00ab, 0x00ff));
+    g_assert_cmphex(readl(reg), ==, 0x12ab);
+
+    writel(reg, 0xffff);
+    g_assert_cmphex(readl(reg), ==, 0x12ab);
+}
+
+static void rk3399_cru_test_read_only(void)
+{
+    writel(RK3399_CRU_BASE + CRU_GLB_RST_ST, 0xffffffff);
+    g_assert_cmphex(readl(RK3399_CRU_BASE + CRU_GLB_RST_ST), ==, 0);
+}
+
+static void rk3399_cru_test_pll_lock(gconstpointer data)
+{
+    uint32_t base = GPOINTER_TO_UINT(data);
+    int pll = 0;
+
+    /* Powered-up PLLs report lock without any prior write */
+    g_assert_cmphex(readl(base + PLL_CON2(pll)) & PLL_CON2_LOCK, ==,
+                    PLL_CON2_LOCK);
+
+    writel(base + PLL_CON3(pll),
+           HIWORD_UPDATE(PLL_CON3_PWRDOWN, PLL_CON3_PWRDOWN));
+    g_assert_cmphex(readl(base + PLL_CON2(pll)) & PLL_CON2_LOCK, ==, 0);
+
+    /* The lock bit is not writable */
+    writel(base + PLL_CON2(pll), PLL_CON2_LOCK | 0x123);
+    g_assert_cmphex(readl(base + PLL_CON2(pll)), ==, 0x123);
+
+    writel(base + PLL_CON3(pll), HIWORD_UPDATE(0, PLL_CON3_PWRDOWN));
+    g_assert_cmphex(readl(base + PLL_CON2(pll)), ==, PLL_CON2_LOCK | 0x123);
+}
+
+/* Reads per second of the whole region at @base */
+static double mmio_read_rate(uint32_t base)
+{
+    uint8_t buf[RK3399_MMIO_SIZE];
+    double elapsed, best = 0;
+    int run, i;
+
+    for (run = 0; run < RATE_RUNS; run++) {
+        g_test_timer_start();
+        for (i = 0; i < RATE_ROUNDS; i++) {
+            memread(base, buf, sizeof(buf));
+        }
+        elapsed = g_test_timer_elapsed();
+        best = MAX(best, RATE_ROUNDS / elapsed);
+    }
+    return best;
+}
+
+static void rk3399_cru_test_read_rate(void)
+{
+    double cru = mmio_read_rate(RK3399_CRU_BASE);
+    double unimp = mmio_read_rate(RK3399_UNIMP_BASE);
+    double regs = cru * RK3399_MMIO_SIZE / sizeof(uint32_t);
+
+    g_test_message("Region reads per second: CRU %.0f, no-op device %.0f",
+                   cru, unimp);
+    g_assert_cmpfloat(cru * RATE_FLOOR, >=, unimp);
+
+    if (g_test_perf()) {
+        g_test_maximized_result(regs, "CRU MMIO reads per second: %.0f",
+                                regs);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/cru/reset", rk3399_cru_test_reset);
+    qtest_add_func("/rk3399/cru/hiword", rk3399_cru_test_hiword);
+    qtest_add_func("/rk3399/cru/read_only", rk3399_cru_test_read_only);
+    qtest_add_data_func("/rk3399/cru/pll_lock",
+                        GUINT_TO_POINTER(RK3399_CRU_BASE),
+                        rk3399_cru_test_pll_lock);
+    qtest_add_data_func("/rk3399/pmucru/pll_lock",
+                        GUINT_TO_POINTER(RK3399_PMUCRU_BASE),
+                        rk3399_cru_test_pll_lock);
+    qtest_add_func("/rk3399/cru/read_rate", rk3399_cru_test_read_rate);
+
+    qtest_start("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
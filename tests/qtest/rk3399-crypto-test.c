@@ -0,0 +1,141 @@
+/*
+ * QTest testcase for the Rockchip RK3399 crypto engines
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "libqtest-single.h"
+
+#define RK3399_CRYPTO0_BASE     0xff8b0000
+#define RK3399_CRYPTO1_BASE     0xff8b8000
+
+/* Register offsets */
+#define CRYPTO_INTSTS           0x000
+#define CRYPTO_INTENA           0x004
+#define CRYPTO_CTRL             0x008
+#define CRYPTO_CONF             0x00c
+#define CRYPTO_BRDMAS           0x010
+#define CRYPTO_BTDMAS           0x014
+#define CRYPTO_BRDMAL           0x018
+#define CRYPTO_HRDMAS           0x01c
+#define CRYPTO_HRDMAL           0x020
+#define CRYPTO_AES_CTRL         0x080
+#define CRYPTO_AES_STS          0x084
+#define CRYPTO_AES_KEY_0        0x0b8
+#define CRYPTO_HASH_CTRL        0x180
+#define CRYPTO_HASH_STS         0x184
+#define CRYPTO_HASH_MSG_LEN     0x188
+#define CRYPTO_HASH_DOUT_0      0x18c
+
+#define INT_BCDMA_DONE          (1 << 0)
+#define INT_HRDMA_DONE          (1 << 2)
+#define INT_HASH_DONE           (1 << 4)
+#define CTRL_BLOCK_START        (1 << 2)
+#define CTRL_HASH_START         (1 << 3)
+#define CONF_BYTESWAP_FIFOS     ((1 << 3) | (1 << 4) | (1 << 5))
+#define AES_CTRL_FIFO_MODE      (1 << 1)
+#define AES_CTRL_BYTESWAP_KEY   (1 << 10)
+#define HASH_CTRL_SHA256        2
+
+#define SRC_ADDR                0x100000
+#define DST_ADDR                0x101000
+
+static void crypto_start(uint32_t base, uint32_t bit)
+{
+    writel(base + CRYPTO_CTRL, (bit << 16) | bit);
+}
+
+/* FIPS-197 appendix C.1 */
+static void rk3399_crypto_test_aes(void)
+{
+    static const uint8_t key[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    static const uint8_t plain[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    };
+    static const uint8_t cipher[16] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+    };
+    uint32_t bases[] = { RK3399_CRYPTO0_BASE, RK3399_CRYPTO1_BASE };
+    uint8_t out[16];
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(bases); i++) {
+        uint32_t base = bases[i];
+
+        for (j = 0; j < 4; j++) {
+            writel(base + CRYPTO_AES_KEY_0 + j * 4, ldl_le_p(key + j * 4));
+        }
+        /* AES-128 ECB encryption through the DMA FIFOs */
+        writel(base + CRYPTO_AES_CTRL, AES_CTRL_BYTESWAP_KEY | AES_CTRL_FIFO_MODE);
+        writel(base + CRYPTO_CONF, CONF_BYTESWAP_FIFOS);
+        writel(base + CRYPTO_INTENA, INT_BCDMA_DONE);
+        memwrite(SRC_ADDR, plain, sizeof(plain));
+        writel(base + CRYPTO_BRDMAS, SRC_ADDR);
+        writel(base + CRYPTO_BTDMAS, DST_ADDR);
+        writel(base + CRYPTO_BRDMAL, sizeof(plain) / 4);
+        crypto_start(base, CTRL_BLOCK_START);
+
+        g_assert_cmphex(readl(base + CRYPTO_INTSTS), ==, INT_BCDMA_DONE);
+        g_assert_cmphex(readl(base + CRYPTO_AES_STS), ==, 1);
+        g_assert_cmphex(readl(base + CRYPTO_CTRL) & CTRL_BLOCK_START, ==, 0);
+        memread(DST_ADDR, out, sizeof(out));
+        g_assert_cmpmem(out, sizeof(out), cipher, sizeof(cipher));
+
+        writel(base + CRYPTO_INTSTS, INT_BCDMA_DONE);
+        g_assert_cmphex(readl(base + CRYPTO_INTSTS), ==, 0);
+    }
+}
+
+/* SHA-256("abc"), which ends part way through the only word read */
+static void rk3399_crypto_test_sha256(void)
+{
+    static const uint32_t digest[8] = {
+        0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223,
+        0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad,
+    };
+    uint32_t base = RK3399_CRYPTO0_BASE;
+    int i;
+
+    memwrite(SRC_ADDR, "abc", 3);
+    writel(base + CRYPTO_CONF, CONF_BYTESWAP_FIFOS);
+    writel(base + CRYPTO_HASH_CTRL, HASH_CTRL_SHA256);
+    writel(base + CRYPTO_HASH_MSG_LEN, 3);
+    writel(base + CRYPTO_HRDMAS, SRC_ADDR);
+    writel(base + CRYPTO_HRDMAL, 1);
+    crypto_start(base, CTRL_HASH_START);
+
+    g_assert_cmphex(readl(base + CRYPTO_INTSTS), ==,
+                    INT_HRDMA_DONE | INT_HASH_DONE);
+    g_assert_cmphex(readl(base + CRYPTO_HASH_STS), ==, 1);
+    for (i = 0; i < ARRAY_SIZE(digest); i++) {
+        g_assert_cmphex(readl(base + CRYPTO_HASH_DOUT_0 + i * 4), ==,
+                        digest[i]);
+    }
+    writel(base + CRYPTO_INTSTS, INT_HRDMA_DONE | INT_HASH_DONE);
+
+    /* A new message length starts over */
+    writel(base + CRYPTO_HASH_MSG_LEN, 3);
+    g_assert_cmphex(readl(base + CRYPTO_HASH_STS), ==, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/crypto/aes", rk3399_crypto_test_aes);
+    qtest_add_func("/rk3399/crypto/sha256", rk3399_crypto_test_sha256);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
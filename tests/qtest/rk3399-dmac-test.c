@@ -0,0 +1,183 @@
+/*
+ * QTest testcase for the Rockchip RK3399 PL330 DMA controllers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_DMAC0_BASE   0xff6d0000
+#define RK3399_DMAC1_BASE   0xff6e0000
+
+/* Register offsets */
+#define PL330_INTEN         0x020
+#define PL330_INTMIS        0x028
+#define PL330_INTCLR        0x02c
+#define PL330_CSR(n)        (0x100 + (n) * 8)
+#define PL330_SAR(n)        (0x400 + (n) * 0x20)
+#define PL330_DAR(n)        (0x404 + (n) * 0x20)
+#define PL330_DBGSTATUS     0xd00
+#define PL330_DBGCMD        0xd04
+#define PL330_DBGINST0      0xd08
+#define PL330_DBGINST1      0xd0c
+#define PL330_CR0           0xe00
+#define PL330_PERIPH_ID     0xfe0
+
+/* Channel control: incrementing 8-byte beats, 16 beat bursts */
+#define CCR_SRC_INC         (1 << 0)
+#define CCR_SRC_SIZE(s)     ((s) << 1)
+#define CCR_SRC_LEN(l)      (((l) - 1) << 4)
+#define CCR_DST_INC         (1 << 14)
+#define CCR_DST_SIZE(s)     ((s) << 15)
+#define CCR_DST_LEN(l)      (((l) - 1) << 18)
+#define CCR_COPY            (CCR_SRC_INC | CCR_SRC_SIZE(3) | CCR_SRC_LEN(16) | \
+                             CCR_DST_INC | CCR_DST_SIZE(3) | CCR_DST_LEN(16))
+#define BURST_BYTES         (8 * 16)
+
+/* Instruction encodings */
+#define DMAEND              0x00
+#define DMALD               0x04
+#define DMAST               0x08
+#define DMANOP              0x18
+#define DMALP(lc)           (0x20 | ((lc) << 1))
+#define DMASEV              0x34
+#define DMALPEND(lc)        (0x38 | ((lc) << 2))
+#define DMAGO               0xa0
+#define DMAMOV              0xbc
+#define DMAMOV_SAR          0
+#define DMAMOV_CCR          1
+#define DMAMOV_DAR          2
+
+#define PROG_ADDR           0x100000
+#define SRC_ADDR            0x200000
+#define DST_ADDR            0x300000
+#define LOOP_COUNT          32
+#define COPY_LEN            (LOOP_COUNT * BURST_BYTES)
+
+typedef struct {
+    uint8_t code[64];
+    int len;
+} Program;
+
+static void emit(Program *p, uint8_t byte)
+{
+    g_assert_cmpint(p->len, <, sizeof(p->code));
+    p->code[p->len++] = byte;
+}
+
+static void emit_mov(Program *p, int reg, uint32_t value)
+{
+    emit(p, DMAMOV);
+    emit(p, reg);
+    emit(p, value);
+    emit(p, value >> 8);
+    emit(p, value >> 16);
+    emit(p, value >> 24);
+}
+
+/*
+ * Copy COPY_LEN bytes from SRC_ADDR to DST_ADDR, LOOP_COUNT bursts at a
+ * time, then signal event 0.  With @nop the loop body no longer matches
+ * a plain copy loop.
+ */
+static void build_copy(Program *p, bool nop)
+{
+    int loop;
+
+    p->len = 0;
+    emit_mov(p, DMAMOV_CCR, CCR_COPY);
+    emit_mov(p, DMAMOV_SAR, SRC_ADDR);
+    emit_mov(p, DMAMOV_DAR, DST_ADDR);
+    emit(p, DMALP(0));
+    emit(p, LOOP_COUNT - 1);
+    loop = p->len;
+    emit(p, DMALD);
+    if (nop) {
+        emit(p, DMANOP);
+    }
+    emit(p, DMAST);
+    emit(p, DMALPEND(0));
+    emit(p, p->len - 1 - loop);
+    emit(p, DMASEV);
+    emit(p, 0 << 3);
+    emit(p, DMAEND);
+}
+
+static void dmac_start(uint32_t base, int chan, uint32_t pc)
+{
+    g_assert_cmphex(readl(base + PL330_DBGSTATUS), ==, 0);
+    /* DMAGO issued to the manager thread */
+    writel(base + PL330_DBGINST0, (chan << 24) | (DMAGO << 16));
+    writel(base + PL330_DBGINST1, pc);
+    writel(base + PL330_DBGCMD, 0);
+}
+
+static void run_copy(uint32_t base, int chan, bool nop)
+{
+    uint8_t *src = g_malloc(COPY_LEN);
+    uint8_t *dst = g_malloc(COPY_LEN);
+    Program p;
+    int i;
+
+    for (i = 0; i < COPY_LEN; i++) {
+        src[i] = i * 13 + chan + nop;
+    }
+    memwrite(SRC_ADDR, src, COPY_LEN);
+    qtest_memset(global_qtest, DST_ADDR, 0, COPY_LEN);
+    build_copy(&p, nop);
+    memwrite(PROG_ADDR, p.code, p.len);
+
+    writel(base + PL330_INTEN, 1);
+    dmac_start(base, chan, PROG_ADDR);
+
+    /* Channel stopped, both addresses past the buffers, event raised */
+    g_assert_cmphex(readl(base + PL330_CSR(chan)) & 0xf, ==, 0);
+    g_assert_cmphex(readl(base + PL330_SAR(chan)), ==, SRC_ADDR + COPY_LEN);
+    g_assert_cmphex(readl(base + PL330_DAR(chan)), ==, DST_ADDR + COPY_LEN);
+    g_assert_cmphex(readl(base + PL330_INTMIS), ==, 1);
+    memread(DST_ADDR, dst, COPY_LEN);
+    g_assert_cmpmem(dst, COPY_LEN, src, COPY_LEN);
+
+    writel(base + PL330_INTCLR, 1);
+    g_assert_cmphex(readl(base + PL330_INTMIS), ==, 0);
+    g_free(src);
+    g_free(dst);
+}
+
+static void rk3399_dmac_test_config(void)
+{
+    /* CR0 num_chnls - 1 in bits 6:4, num_periph_req - 1 in 16:12 */
+    g_assert_cmphex(readl(RK3399_DMAC0_BASE + PL330_PERIPH_ID), ==, 0x30);
+    g_assert_cmphex((readl(RK3399_DMAC0_BASE + PL330_CR0) >> 4) & 7, ==, 5);
+    g_assert_cmphex((readl(RK3399_DMAC0_BASE + PL330_CR0) >> 12) & 0x1f, ==, 11);
+    g_assert_cmphex((readl(RK3399_DMAC1_BASE + PL330_CR0) >> 4) & 7, ==, 7);
+    g_assert_cmphex((readl(RK3399_DMAC1_BASE + PL330_CR0) >> 12) & 0x1f, ==, 19);
+}
+
+static void rk3399_dmac_test_bulk_copy(void)
+{
+    run_copy(RK3399_DMAC0_BASE, 0, false);
+    run_copy(RK3399_DMAC1_BASE, 7, false);
+}
+
+static void rk3399_dmac_test_burst_copy(void)
+{
+    run_copy(RK3399_DMAC1_BASE, 3, true);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/dmac/config", rk3399_dmac_test_config);
+    qtest_add_func("/rk3399/dmac/bulk_copy", rk3399_dmac_test_bulk_copy);
+    qtest_add_func("/rk3399/dmac/burst_copy", rk3399_dmac_test_burst_copy);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
@@ -0,0 +1,288 @@
+/*
+ * QTest testcase for the Rockchip RK3399 eMMC (Arasan SDHCI 5.1) controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest-single.h"
+
+#define RK3399_EMMC_BASE    0xfe330000
+#define RK3399_EMMC_PHY     0xff77f780
+
+/* Register offsets */
+#define SDHC_BLKSIZE        0x04
+#define SDHC_ARGUMENT       0x08
+#define SDHC_TRNMOD         0x0c
+#define SDHC_RSPREG0        0x10
+#define SDHC_HOSTCTL        0x28
+#define SDHC_CLKCON         0x2c
+#define SDHC_NORINTSTS      0x30
+#define SDHC_NORINTSTSEN    0x34
+#define SDHC_ERRINTSTS      0x32
+#define SDHC_CAPAB          0x40
+#define SDHC_ADMAERR        0x54
+#define SDHC_ADMASYSADDR    0x58
+
+#define EMMCPHY_CON6        0x18
+#define EMMCPHY_STATUS      0x20
+
+#define TRNS_DMA            (1 << 0)
+#define TRNS_BLK_CNT_EN     (1 << 1)
+#define TRNS_ACMD12         (1 << 2)
+#define TRNS_READ           (1 << 4)
+#define TRNS_MULTI          (1 << 5)
+
+#define CMD_RSP_136         (1 << 0)
+#define CMD_RSP_48          (2 << 0)
+#define CMD_DATA_PRESENT    (1 << 5)
+
+#define CTRL_ADMA2_32       0x10
+#define CLOCK_INT_EN        (1 << 0)
+#define CLOCK_SDCLK_EN      (1 << 2)
+
+#define NIS_CMDCMP          (1 << 0)
+#define NIS_TRSCMP          (1 << 1)
+#define NIS_DMA             (1 << 3)
+#define NIS_ERR             (1 << 15)
+#define EIS_ADMAERR         (1 << 9)
+#define ADMAERR_LENGTH_MISMATCH (1 << 2)
+
+#define CAPAB_ADMA2         (1ull << 19)
+#define CAPAB_8BIT          (1ull << 18)
+#define CAPAB_HS400         (1ull << 63)
+
+#define ADMA_VALID          (1 << 0)
+#define ADMA_END            (1 << 1)
+#define ADMA_INT            (1 << 2)
+#define ADMA_TRAN           (2 << 4)
+#define ADMA_LINK           (3 << 4)
+
+#define DESC_ADDR           0x200000
+#define BUF_ADDR            0x300000
+#define XFER_OFFSET         (16 * 512)
+#define XFER_BLOCKS         8
+#define IMG_SIZE            (1 * MiB)
+#define TRANSFER_TIMEOUT_S  10
+
+#define HIWORD_UPDATE(val, mask)    (((mask) << 16) | (val))
+
+static char *img_path;
+
+static uint32_t emmc_command(uint8_t cmd, uint32_t arg, uint16_t flags,
+                             uint16_t trnmod)
+{
+    uint32_t base = RK3399_EMMC_BASE;
+    uint16_t sts;
+
+    writel(base + SDHC_NORINTSTS, 0xffffffff);
+    writel(base + SDHC_ARGUMENT, arg);
+    writel(base + SDHC_TRNMOD, ((cmd << 8 | flags) << 16) | trnmod);
+    sts = readw(base + SDHC_NORINTSTS);
+    g_assert_cmphex(sts & (NIS_CMDCMP | NIS_ERR), ==, NIS_CMDCMP);
+
+    return readl(base + SDHC_RSPREG0);
+}
+
+static void write_adma2_desc(uint64_t addr, uint16_t attr, uint16_t len,
+                             uint32_t buf)
+{
+    writel(addr, (len << 16) | attr);
+    writel(addr + 4, buf);
+}
+
+static void rk3399_emmc_test_caps(void)
+{
+    uint64_t caps = readq(RK3399_EMMC_BASE + SDHC_CAPAB);
+
+    g_assert_cmphex(caps & (CAPAB_ADMA2 | CAPAB_8BIT | CAPAB_HS400), ==,
+                    CAPAB_ADMA2 | CAPAB_8BIT | CAPAB_HS400);
+}
+
+static void rk3399_emmc_test_phy(void)
+{
+    uint32_t phy = RK3399_EMMC_PHY;
+
+    g_assert_cmphex(readl(phy + EMMCPHY_STATUS), ==, 0);
+
+    /* Calibration completes on power up, the DLL locks once enabled */
+    writel(phy + EMMCPHY_CON6, HIWORD_UPDATE(0x1, 0x1));
+    g_assert_cmphex(readl(phy + EMMCPHY_STATUS), ==, 1 << 6);
+    writel(phy + EMMCPHY_CON6, HIWORD_UPDATE(0x2, 0x2));
+    g_assert_cmphex(readl(phy + EMMCPHY_STATUS), ==, (1 << 6) | (1 << 5));
+    writel(phy + EMMCPHY_CON6, HIWORD_UPDATE(0, 0x3));
+    g_assert_cmphex(readl(phy + EMMCPHY_STATUS), ==, 0);
+}
+
+/* Bring the card to the transfer state, once for all tests */
+static void emmc_select_card(void)
+{
+    static bool selected;
+    uint32_t base = RK3399_EMMC_BASE;
+    uint32_t rca = 0x1234 << 16;
+
+    if (selected) {
+        return;
+    }
+    writew(base + SDHC_CLKCON, CLOCK_INT_EN | CLOCK_SDCLK_EN);
+    writel(base + SDHC_NORINTSTSEN, 0xffffffff);
+
+    emmc_command(0, 0, 0, 0);
+    emmc_command(1, 0x40ff8080, CMD_RSP_48, 0);
+    emmc_command(2, 0, CMD_RSP_136, 0);
+    emmc_command(3, rca, CMD_RSP_48, 0);
+    emmc_command(7, rca, CMD_RSP_48, 0);
+    selected = true;
+}
+
+/*
+ * Read @blocks blocks from @offset with the descriptor table at DESC_ADDR,
+ * and return the normal interrupt status once the transfer is complete.
+ */
+static uint16_t emmc_adma2_read(uint32_t offset, uint16_t blocks)
+{
+    uint32_t base = RK3399_EMMC_BASE;
+    g_autoptr(GTimer) timer = NULL;
+    uint16_t sts = 0;
+
+    emmc_select_card();
+    writeb(base + SDHC_HOSTCTL, CTRL_ADMA2_32);
+    writel(base + SDHC_ADMAERR, 0);
+    writel(base + SDHC_ADMASYSADDR, DESC_ADDR);
+    writel(base + SDHC_BLKSIZE, (blocks << 16) | 512);
+
+    /* READ_MULTIPLE_BLOCK, byte addressed on this small device */
+    emmc_command(18, offset, CMD_RSP_48 | CMD_DATA_PRESENT,
+                 TRNS_DMA | TRNS_BLK_CNT_EN | TRNS_ACMD12 | TRNS_READ |
+                 TRNS_MULTI);
+
+    /*
+     * The transfer completes asynchronously, in the block layer or from
+     * the transfer timer if the controller fell back to its byte-wise loop
+     */
+    timer = g_timer_new();
+    while (!(sts & NIS_TRSCMP) &&
+           g_timer_elapsed(timer, NULL) < TRANSFER_TIMEOUT_S) {
+        clock_step(1000);
+        sts = readw(base + SDHC_NORINTSTS);
+    }
+    g_assert_cmphex(sts & NIS_TRSCMP, ==, NIS_TRSCMP);
+    return sts;
+}
+
+static void check_data(uint32_t offset, size_t len)
+{
+    g_autofree uint8_t *buf = g_malloc(len);
+    size_t i;
+
+    memread(BUF_ADDR, buf, len);
+    for (i = 0; i < len; i++) {
+        g_assert_cmphex(buf[i], ==, (uint8_t)((offset + i) * 7));
+    }
+}
+
+static void rk3399_emmc_test_adma2_read(void)
+{
+    uint16_t sts;
+
+    /* Split over three transfer descriptors and a link */
+    write_adma2_desc(DESC_ADDR, ADMA_TRAN | ADMA_VALID, 1024, BUF_ADDR);
+    write_adma2_desc(DESC_ADDR + 8, ADMA_LINK | ADMA_VALID, 0,
+                     DESC_ADDR + 0x100);
+    write_adma2_desc(DESC_ADDR + 0x100, ADMA_TRAN | ADMA_VALID, 2048,
+                     BUF_ADDR + 1024);
+    write_adma2_desc(DESC_ADDR + 0x108, ADMA_TRAN | ADMA_END | ADMA_VALID,
+                     1024, BUF_ADDR + 3072);
+
+    sts = emmc_adma2_read(XFER_OFFSET, XFER_BLOCKS);
+    g_assert_cmphex(sts & NIS_ERR, ==, 0);
+    g_assert_cmphex(readl(RK3399_EMMC_BASE + SDHC_ADMASYSADDR), ==,
+                    DESC_ADDR + 0x110);
+    check_data(XFER_OFFSET, XFER_BLOCKS * 512);
+}
+
+/* A descriptor asking for an interrupt in the middle of the table */
+static void rk3399_emmc_test_adma2_interrupt(void)
+{
+    uint16_t sts;
+
+    write_adma2_desc(DESC_ADDR, ADMA_TRAN | ADMA_INT | ADMA_VALID, 1024,
+                     BUF_ADDR);
+    write_adma2_desc(DESC_ADDR + 8, ADMA_TRAN | ADMA_VALID, 1024,
+                     BUF_ADDR + 1024);
+    write_adma2_desc(DESC_ADDR + 16, ADMA_TRAN | ADMA_END | ADMA_VALID, 2048,
+                     BUF_ADDR + 2048);
+
+    sts = emmc_adma2_read(2 * XFER_OFFSET, XFER_BLOCKS);
+    g_assert_cmphex(sts & (NIS_DMA | NIS_ERR), ==, NIS_DMA);
+    g_assert_cmphex(readl(RK3399_EMMC_BASE + SDHC_ADMASYSADDR), ==,
+                    DESC_ADDR + 24);
+    check_data(2 * XFER_OFFSET, XFER_BLOCKS * 512);
+}
+
+/*
+ * The last descriptor is longer than the transfer: the data is read, and
+ * the mismatch is reported as an ADMA error, as without coalescing.
+ */
+static void rk3399_emmc_test_adma2_length_mismatch(void)
+{
+    uint32_t base = RK3399_EMMC_BASE;
+    uint16_t sts;
+
+    write_adma2_desc(DESC_ADDR, ADMA_TRAN | ADMA_VALID, 1024, BUF_ADDR);
+    write_adma2_desc(DESC_ADDR + 8, ADMA_TRAN | ADMA_END | ADMA_VALID, 4096,
+                     BUF_ADDR + 1024);
+
+    sts = emmc_adma2_read(3 * XFER_OFFSET, 4);
+    g_assert_cmphex(sts & NIS_ERR, ==, NIS_ERR);
+    g_assert_cmphex(readw(base + SDHC_ERRINTSTS) & EIS_ADMAERR, ==,
+                    EIS_ADMAERR);
+    g_assert_cmphex(readl(base + SDHC_ADMAERR) & ADMAERR_LENGTH_MISMATCH, ==,
+                    ADMAERR_LENGTH_MISMATCH);
+    check_data(3 * XFER_OFFSET, 4 * 512);
+}
+
+static char *create_image(void)
+{
+    g_autofree uint8_t *data = g_malloc(IMG_SIZE);
+    char *path = NULL;
+    int fd, i;
+
+    for (i = 0; i < IMG_SIZE; i++) {
+        data[i] = i * 7;
+    }
+
+    fd = g_file_open_tmp("qtest-rk3399-emmc.XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    g_assert(write(fd, data, IMG_SIZE) == IMG_SIZE);
+    close(fd);
+
+    return path;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/emmc/caps", rk3399_emmc_test_caps);
+    qtest_add_func("/rk3399/emmc/phy", rk3399_emmc_test_phy);
+    qtest_add_func("/rk3399/emmc/adma2_read", rk3399_emmc_test_adma2_read);
+    qtest_add_func("/rk3399/emmc/adma2_interrupt",
+                   rk3399_emmc_test_adma2_interrupt);
+    qtest_add_func("/rk3399/emmc/adma2_length_mismatch",
+                   rk3399_emmc_test_adma2_length_mismatch);
+
+    img_path = create_image();
+    global_qtest = qtest_initf("-machine rockchip-rk3399 "
+                               "-drive if=sd,index=1,format=raw,file=%s",
+                               img_path);
+    ret = g_test_run();
+    qtest_end();
+
+    unlink(img_path);
+    g_free(img_path);
+
+    return ret;
+}
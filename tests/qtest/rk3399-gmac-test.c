@@ -0,0 +1,252 @@
+/*
+ * QTest testcase for the Rockchip RK3399 GMAC (DesignWare Ethernet MAC)
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "libqtest-single.h"
+
+#define RK3399_GMAC_BASE    0xfe300000
+
+/* Register offsets */
+#define GMAC_MAC_CONFIG     0x0000
+#define GMAC_MII_ADDR       0x0010
+#define GMAC_MII_DATA       0x0014
+#define GMAC_VERSION        0x0020
+#define DMA_TX_POLL         0x1004
+#define DMA_RX_POLL         0x1008
+#define DMA_RX_BASE         0x100c
+#define DMA_TX_BASE         0x1010
+#define DMA_STATUS          0x1014
+#define DMA_OP_MODE         0x1018
+#define DMA_CUR_TX_DESC     0x1048
+#define DMA_HW_FEATURE      0x1058
+
+#define MAC_CONFIG_RE       (1 << 2)
+#define MAC_CONFIG_TE       (1 << 3)
+
+#define MII_ADDR_GB         (1 << 0)
+#define MII_ADDR_GR(r)      ((r) << 6)
+
+#define STATUS_TI           (1 << 0)
+#define STATUS_TU           (1 << 2)
+#define STATUS_RI           (1 << 6)
+#define STATUS_RU           (1 << 7)
+
+#define OP_MODE_SR          (1 << 1)
+#define OP_MODE_ST          (1 << 13)
+
+#define HW_FEATURE_ENHDESSEL    (1 << 24)
+
+#define TDES0_OWN           (1u << 31)
+#define TDES0_IC            (1 << 30)
+#define TDES0_LS            (1 << 29)
+#define TDES0_FS            (1 << 28)
+#define TDES0_TER           (1 << 21)
+
+#define RDES0_OWN           (1u << 31)
+#define RDES0_FL(x)         (((x) >> 16) & 0x3fff)
+#define RDES0_FS            (1 << 9)
+#define RDES0_LS            (1 << 8)
+#define RDES0_FT            (1 << 5)
+#define RDES1_RER           (1 << 15)
+
+#define DESC_ADDR           0x200000
+#define BUF_ADDR            0x300000
+#define BUF_STRIDE          0x800
+#define FRAME_LEN           64
+#define FCS_LEN             4
+#define NR_TX_FRAMES        3
+#define RX_WAIT_STEPS       1000
+
+static int test_sockets[2];
+
+static uint32_t gmac_readl(uint32_t offset)
+{
+    return readl(RK3399_GMAC_BASE + offset);
+}
+
+static void gmac_writel(uint32_t offset, uint32_t value)
+{
+    writel(RK3399_GMAC_BASE + offset, value);
+}
+
+static void write_desc(uint32_t addr, uint32_t des0, uint32_t des1,
+                       uint32_t des2, uint32_t des3)
+{
+    writel(addr, des0);
+    writel(addr + 4, des1);
+    writel(addr + 8, des2);
+    writel(addr + 12, des3);
+}
+
+static void fill_frame(uint8_t *frame, int seed)
+{
+    int i;
+
+    /* Broadcast, local experimental ethertype */
+    memset(frame, 0xff, 6);
+    memset(frame + 6, 0x02, 6);
+    frame[12] = 0x88;
+    frame[13] = 0xb5;
+    for (i = 14; i < FRAME_LEN; i++) {
+        frame[i] = i * 7 + seed;
+    }
+}
+
+static uint16_t mdio_read(int reg)
+{
+    gmac_writel(GMAC_MII_ADDR, MII_ADDR_GR(reg) | MII_ADDR_GB);
+    g_assert_cmphex(gmac_readl(GMAC_MII_ADDR) & MII_ADDR_GB, ==, 0);
+    return gmac_readl(GMAC_MII_DATA);
+}
+
+static void rk3399_gmac_test_id(void)
+{
+    g_assert_cmphex(gmac_readl(GMAC_VERSION), ==, 0x1035);
+    g_assert_cmphex(gmac_readl(DMA_HW_FEATURE) & HW_FEATURE_ENHDESSEL, ==,
+                    HW_FEATURE_ENHDESSEL);
+
+    /* RTL8211E with the link up */
+    g_assert_cmphex(mdio_read(2), ==, 0x001c);
+    g_assert_cmphex(mdio_read(3), ==, 0xc915);
+    g_assert_cmphex(mdio_read(1) & 0x4, ==, 0x4);
+}
+
+static void rk3399_gmac_test_tx_batch(void)
+{
+    uint8_t frame[FRAME_LEN], buf[FRAME_LEN];
+    uint32_t len;
+    int i;
+
+    for (i = 0; i < NR_TX_FRAMES; i++) {
+        uint32_t des0 = TDES0_OWN | TDES0_FS | TDES0_LS;
+
+        fill_frame(frame, i);
+        memwrite(BUF_ADDR + i * BUF_STRIDE, frame, FRAME_LEN);
+        if (i == NR_TX_FRAMES - 1) {
+            /* Only the last frame asks for an interrupt */
+            des0 |= TDES0_IC | TDES0_TER;
+        }
+        write_desc(DESC_ADDR + i * 16, des0, FRAME_LEN,
+                   BUF_ADDR + i * BUF_STRIDE, 0);
+    }
+
+    gmac_writel(DMA_TX_BASE, DESC_ADDR);
+    gmac_writel(GMAC_MAC_CONFIG, MAC_CONFIG_TE);
+    /* Starting the DMA drains the whole ring at once */
+    gmac_writel(DMA_OP_MODE, OP_MODE_ST);
+
+    for (i = 0; i < NR_TX_FRAMES; i++) {
+        g_assert_cmphex(readl(DESC_ADDR + i * 16) & TDES0_OWN, ==, 0);
+
+        g_assert_cmpint(recv(test_sockets[0], &len, sizeof(len), MSG_DONTWAIT),
+                        ==, sizeof(len));
+        g_assert_cmpint(ntohl(len), ==, FRAME_LEN);
+        g_assert_cmpint(recv(test_sockets[0], buf, FRAME_LEN, MSG_DONTWAIT),
+                        ==, FRAME_LEN);
+        fill_frame(frame, i);
+        g_assert_cmpmem(buf, FRAME_LEN, frame, FRAME_LEN);
+    }
+
+    g_assert_cmphex(gmac_readl(DMA_STATUS) & (STATUS_TI | STATUS_TU), ==,
+                    STATUS_TI | STATUS_TU);
+    g_assert_cmphex(gmac_readl(DMA_CUR_TX_DESC), ==, DESC_ADDR);
+
+    gmac_writel(DMA_OP_MODE, 0);
+    gmac_writel(DMA_STATUS, STATUS_TI | STATUS_TU);
+}
+
+static void send_frame(const uint8_t *frame)
+{
+    uint32_t len = htonl(FRAME_LEN);
+    struct iovec iov[] = {
+        { .iov_base = &len, .iov_len = sizeof(len) },
+        { .iov_base = (void *)frame, .iov_len = FRAME_LEN },
+    };
+
+    g_assert_cmpint(iov_send(test_sockets[0], iov, 2, 0,
+                             sizeof(len) + FRAME_LEN),
+                    ==, sizeof(len) + FRAME_LEN);
+}
+
+static bool wait_status(uint32_t bits)
+{
+    int i;
+
+    for (i = 0; i < RX_WAIT_STEPS; i++) {
+        if ((gmac_readl(DMA_STATUS) & bits) == bits) {
+            return true;
+        }
+        clock_step(1000);
+        g_usleep(1000);
+    }
+    return false;
+}
+
+static void check_rx_desc(int n, int seed)
+{
+    uint8_t frame[FRAME_LEN], buf[FRAME_LEN];
+    uint32_t des0 = readl(DESC_ADDR + n * 16);
+
+    g_assert_cmphex(des0 & RDES0_OWN, ==, 0);
+    g_assert_cmphex(des0 & (RDES0_FS | RDES0_LS | RDES0_FT), ==,
+                    RDES0_FS | RDES0_LS | RDES0_FT);
+    g_assert_cmpint(RDES0_FL(des0), ==, FRAME_LEN + FCS_LEN);
+
+    fill_frame(frame, seed);
+    memread(BUF_ADDR + n * BUF_STRIDE, buf, FRAME_LEN);
+    g_assert_cmpmem(buf, FRAME_LEN, frame, FRAME_LEN);
+}
+
+static void rk3399_gmac_test_rx_burst(void)
+{
+    uint8_t frame[FRAME_LEN];
+
+    /* Two descriptors, but only the first belongs to the DMA for now */
+    write_desc(DESC_ADDR, RDES0_OWN, BUF_STRIDE, BUF_ADDR, 0);
+    write_desc(DESC_ADDR + 16, 0, RDES1_RER | BUF_STRIDE,
+               BUF_ADDR + BUF_STRIDE, 0);
+    gmac_writel(DMA_RX_BASE, DESC_ADDR);
+    gmac_writel(GMAC_MAC_CONFIG, MAC_CONFIG_RE);
+    gmac_writel(DMA_OP_MODE, OP_MODE_SR);
+
+    fill_frame(frame, 10);
+    send_frame(frame);
+    fill_frame(frame, 11);
+    send_frame(frame);
+
+    /* The first frame lands, the second waits for a descriptor */
+    g_assert_true(wait_status(STATUS_RI | STATUS_RU));
+    check_rx_desc(0, 10);
+    g_assert_cmphex(readl(DESC_ADDR + 16) & RDES0_OWN, ==, 0);
+
+    gmac_writel(DMA_STATUS, STATUS_RI | STATUS_RU);
+    writel(DESC_ADDR + 16, RDES0_OWN);
+    gmac_writel(DMA_RX_POLL, 0);
+
+    g_assert_true(wait_status(STATUS_RI));
+    check_rx_desc(1, 11);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/gmac/id", rk3399_gmac_test_id);
+    qtest_add_func("/rk3399/gmac/tx_batch", rk3399_gmac_test_tx_batch);
+    qtest_add_func("/rk3399/gmac/rx_burst", rk3399_gmac_test_rx_burst);
+
+    g_assert_cmpint(socketpair(PF_UNIX, SOCK_STREAM, 0, test_sockets), !=, -1);
+    global_qtest = qtest_initf("-machine rockchip-rk3399 "
+                               "-nic socket,fd=%d", test_sockets[1]);
+    ret = g_test_run();
+    qtest_end();
+
+    close(test_sockets[0]);
+
+    return ret;
+}
@@ -0,0 +1,86 @@
+/*
+ * QTest testcase for the Rockchip RK3399 GRF and PMUGRF
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_GRF_BASE         0xff770000
+#define RK3399_PMUGRF_BASE      0xff320000
+#define RK3399_EMMC_PHY         0xff77f780
+
+/* GRF register offsets */
+#define GRF_GPIO2A_IOMUX        0xe000
+#define GRF_SOC_STATUS0         0xe2a0
+#define GRF_DDRC0_CON0          0xe380
+
+/* PMUGRF register offsets */
+#define PMUGRF_GPIO0A_IOMUX     0x000
+#define PMUGRF_OS_REG0          0x300
+
+#define EMMCPHY_CON6            0x18
+#define EMMCPHY_STATUS          0x20
+
+#define HIWORD_UPDATE(v, m)     (((m) << 16) | (v))
+
+static void rk3399_grf_test_hiword(void)
+{
+    uint32_t reg = RK3399_GRF_BASE + GRF_GPIO2A_IOMUX;
+
+    writel(reg, HIWORD_UPDATE(0x00ff, 0x00ff));
+    g_assert_cmphex(readl(reg), ==, 0x00ff);
+
+    /* Only the bits with their write enable set change */
+    writel(reg, HIWORD_UPDATE(0x0f00, 0x0ff0));
+    g_assert_cmphex(readl(reg), ==, 0x0f0f);
+    writel(reg, 0xffff);
+    g_assert_cmphex(readl(reg), ==, 0x0f0f);
+
+    reg = RK3399_PMUGRF_BASE + PMUGRF_GPIO0A_IOMUX;
+    writel(reg, HIWORD_UPDATE(0x1234, 0xffff));
+    g_assert_cmphex(readl(reg), ==, 0x1234);
+}
+
+static void rk3399_grf_test_plain(void)
+{
+    /* Registers outside the hooked banks hold any value */
+    writel(RK3399_GRF_BASE + GRF_DDRC0_CON0, 0xdeadbeef);
+    g_assert_cmphex(readl(RK3399_GRF_BASE + GRF_DDRC0_CON0), ==, 0xdeadbeef);
+    writel(RK3399_PMUGRF_BASE + PMUGRF_OS_REG0, 0x12345678);
+    g_assert_cmphex(readl(RK3399_PMUGRF_BASE + PMUGRF_OS_REG0), ==,
+                    0x12345678);
+}
+
+static void rk3399_grf_test_status(void)
+{
+    writel(RK3399_GRF_BASE + GRF_SOC_STATUS0, 0xffffffff);
+    g_assert_cmphex(readl(RK3399_GRF_BASE + GRF_SOC_STATUS0), ==, 0);
+}
+
+static void rk3399_grf_test_emmc_phy(void)
+{
+    /* The eMMC PHY sits on top of the GRF: powering it up calibrates it */
+    g_assert_cmphex(readl(RK3399_EMMC_PHY + EMMCPHY_STATUS), ==, 0);
+    writel(RK3399_EMMC_PHY + EMMCPHY_CON6, HIWORD_UPDATE(1, 1));
+    g_assert_cmphex(readl(RK3399_EMMC_PHY + EMMCPHY_STATUS), !=, 0);
+    writel(RK3399_EMMC_PHY + EMMCPHY_CON6, HIWORD_UPDATE(0, 1));
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/grf/hiword", rk3399_grf_test_hiword);
+    qtest_add_func("/rk3399/grf/plain", rk3399_grf_test_plain);
+    qtest_add_func("/rk3399/grf/status", rk3399_grf_test_status);
+    qtest_add_func("/rk3399/grf/emmc-phy", rk3399_grf_test_emmc_phy);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
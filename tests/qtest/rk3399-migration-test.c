@@ -0,0 +1,125 @@
+/*
+ * QTest testcase for migrating the state of the Rockchip RK3399 devices
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "migration-helpers.h"
+
+#define RK3399_CRU_BASE         0xff760000
+#define RK3399_PMU_BASE         0xff310000
+#define RK3399_SPI1_BASE        0xff1d0000
+#define RK3399_TIMER0_BASE      0xff850000
+#define RK3399_VOPB_BASE        0xff900000
+#define RK3399_CRYPTO0_BASE     0xff8b0000
+#define RK3399_GRF_BASE         0xff770000
+#define RK3399_PMUGRF_BASE      0xff320000
+
+#define CRU_CLKSEL_CON5         (RK3399_CRU_BASE + 0x114)
+#define PMU_SYS_REG0            (RK3399_PMU_BASE + 0xf0)
+#define TIMER_LOAD_COUNT0       (RK3399_TIMER0_BASE + 0x00)
+#define VOP_INTR_EN0            (RK3399_VOPB_BASE + 0x280)
+#define CRYPTO_AES_KEY_0        (RK3399_CRYPTO0_BASE + 0xb8)
+#define GRF_GPIO2A_IOMUX        (RK3399_GRF_BASE + 0xe000)
+#define PMUGRF_OS_REG0          (RK3399_PMUGRF_BASE + 0x300)
+
+#define SPI_CTRLR0              (RK3399_SPI1_BASE + 0x00)
+#define SPI_SSIENR              (RK3399_SPI1_BASE + 0x08)
+#define SPI_SER                 (RK3399_SPI1_BASE + 0x0c)
+#define SPI_RXFLR               (RK3399_SPI1_BASE + 0x20)
+#define SPI_TXDR                (RK3399_SPI1_BASE + 0x400)
+#define SPI_RXDR                (RK3399_SPI1_BASE + 0x800)
+
+#define HIWORD_UPDATE(v, m)     (((m) << 16) | (v))
+
+/* Registers the test programs on the source and checks on the destination */
+static const uint64_t rk3399_migration_regs[] = {
+    CRU_CLKSEL_CON5,
+    PMU_SYS_REG0,
+    TIMER_LOAD_COUNT0,
+    VOP_INTR_EN0,
+    CRYPTO_AES_KEY_0,
+    GRF_GPIO2A_IOMUX,
+    PMUGRF_OS_REG0,
+    SPI_CTRLR0,
+    SPI_RXFLR,
+};
+
+static void rk3399_migration_setup(QTestState *qts)
+{
+    int i;
+
+    qtest_writel(qts, CRU_CLKSEL_CON5, HIWORD_UPDATE(0x1234, 0xffff));
+    qtest_writel(qts, PMU_SYS_REG0, 0x12345678);
+    qtest_writel(qts, TIMER_LOAD_COUNT0, 0x1000);
+    qtest_writel(qts, VOP_INTR_EN0, HIWORD_UPDATE(1, 1));
+    qtest_writel(qts, CRYPTO_AES_KEY_0, 0x01020304);
+    qtest_writel(qts, GRF_GPIO2A_IOMUX, HIWORD_UPDATE(0x5555, 0xffff));
+    qtest_writel(qts, PMUGRF_OS_REG0, 0x87654321);
+
+    /* Leave the flash's READ ID response in the RX FIFO */
+    qtest_writel(qts, SPI_CTRLR0, 1);
+    qtest_writel(qts, SPI_SSIENR, 1);
+    qtest_writel(qts, SPI_SER, 1);
+    qtest_writel(qts, SPI_TXDR, 0x9f);
+    for (i = 0; i < 3; i++) {
+        qtest_writel(qts, SPI_TXDR, 0);
+    }
+    qtest_writel(qts, SPI_SER, 0);
+}
+
+static void rk3399_migration_test_devices(void)
+{
+    g_autofree char *tmpdir = g_dir_make_tmp("rk3399-migration-XXXXXX",
+                                             NULL);
+    g_autofree char *path = NULL;
+    g_autofree char *uri = NULL;
+    uint32_t expected[ARRAY_SIZE(rk3399_migration_regs)];
+    QTestState *from, *to;
+    int i;
+
+    g_assert(tmpdir);
+    path = g_build_filename(tmpdir, "migsocket", NULL);
+    uri = g_strdup_printf("unix:%s", path);
+
+    from = qtest_initf("-machine rockchip-rk3399");
+    to = qtest_initf("-machine rockchip-rk3399 -incoming defer");
+
+    rk3399_migration_setup(from);
+    for (i = 0; i < ARRAY_SIZE(rk3399_migration_regs); i++) {
+        expected[i] = qtest_readl(from, rk3399_migration_regs[i]);
+        g_assert_cmphex(expected[i], !=, 0);
+    }
+
+    migrate_incoming_qmp(to, uri, "{}");
+    migrate_qmp(from, to, uri, NULL, "{}");
+    wait_for_migration_complete(from);
+    wait_for_migration_complete(to);
+
+    for (i = 0; i < ARRAY_SIZE(rk3399_migration_regs); i++) {
+        g_assert_cmphex(qtest_readl(to, rk3399_migration_regs[i]), ==,
+                        expected[i]);
+    }
+
+    /* The RX FIFO contents came along, not just its level */
+    qtest_readl(to, SPI_RXDR);
+    g_assert_cmphex(qtest_readl(to, SPI_RXDR), ==, 0x20);
+    g_assert_cmphex(qtest_readl(to, SPI_RXDR), ==, 0xba);
+    g_assert_cmphex(qtest_readl(to, SPI_RXDR), ==, 0x18);
+
+    qtest_quit(to);
+    qtest_quit(from);
+    unlink(path);
+    rmdir(tmpdir);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/migration/devices",
+                   rk3399_migration_test_devices);
+
+    return g_test_run();
+}
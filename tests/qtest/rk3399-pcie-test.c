@@ -0,0 +1,51 @@
+/*
+ * QTest testcase for the PCIe root complex of the rockchip-rk3399 machine
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_PCIE_ECAM_BASE   0xf8000000
+
+#define ECAM(bus, dev, fn, reg) \
+    (RK3399_PCIE_ECAM_BASE + ((bus) << 20) + ((dev) << 15) + ((fn) << 12) + \
+     (reg))
+
+/* Config space offsets */
+#define PCI_VENDOR_ID           0x00
+#define PCI_DEVICE_ID           0x02
+#define PCI_CLASS_DEVICE        0x0a
+
+#define PCI_VENDOR_ID_REDHAT    0x1b36
+#define PCI_DEVICE_ID_GPEX      0x0008
+#define PCI_CLASS_BRIDGE_HOST   0x0600
+
+static void rk3399_pcie_test_host_bridge(void)
+{
+    g_assert_cmphex(readw(ECAM(0, 0, 0, PCI_VENDOR_ID)), ==,
+                    PCI_VENDOR_ID_REDHAT);
+    g_assert_cmphex(readw(ECAM(0, 0, 0, PCI_DEVICE_ID)), ==,
+                    PCI_DEVICE_ID_GPEX);
+    g_assert_cmphex(readw(ECAM(0, 0, 0, PCI_CLASS_DEVICE)), ==,
+                    PCI_CLASS_BRIDGE_HOST);
+
+    /* Empty slots and the last bus in the window read as all ones */
+    g_assert_cmphex(readw(ECAM(0, 1, 0, PCI_VENDOR_ID)), ==, 0xffff);
+    g_assert_cmphex(readw(ECAM(31, 0, 0, PCI_VENDOR_ID)), ==, 0xffff);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/pcie/host_bridge", rk3399_pcie_test_host_bridge);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
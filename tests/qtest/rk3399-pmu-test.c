@@ -0,0 +1,106 @@
+/*
+ * QTest testcase for the Rockchip RK3399 PMU
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_PMU_BASE         0xff310000
+
+/* Register offsets */
+#define PMU_PWRDN_CON           0x14
+#define PMU_PWRDN_ST            0x18
+#define PMU_BUS_IDLE_REQ        0x60
+#define PMU_BUS_IDLE_ST         0x64
+#define PMU_BUS_IDLE_ACK        0x68
+#define PMU_SYS_REG0            0xf0
+
+#define PWRDN_CORES             0xff
+#define PWRDN_CORE(n)           (1 << (n))
+#define PWRDN_SCU_B             (1 << 7)
+#define PD_GPU                  (1 << 15)
+#define IDLE_GPU                (1 << 0)
+
+static void rk3399_pmu_test_domains(void)
+{
+    uint32_t base = RK3399_PMU_BASE;
+
+    g_assert_cmphex(readl(base + PMU_PWRDN_ST) & ~PWRDN_CORES, ==, 0);
+
+    /* Idle requests are acknowledged at once */
+    writel(base + PMU_BUS_IDLE_REQ, IDLE_GPU);
+    g_assert_cmphex(readl(base + PMU_BUS_IDLE_ST), ==, IDLE_GPU);
+    g_assert_cmphex(readl(base + PMU_BUS_IDLE_ACK), ==, IDLE_GPU);
+
+    /* As are domain power switches */
+    writel(base + PMU_PWRDN_CON, PD_GPU);
+    g_assert_cmphex(readl(base + PMU_PWRDN_ST) & ~PWRDN_CORES, ==, PD_GPU);
+    writel(base + PMU_PWRDN_CON, 0);
+    g_assert_cmphex(readl(base + PMU_PWRDN_ST) & ~PWRDN_CORES, ==, 0);
+
+    writel(base + PMU_BUS_IDLE_REQ, 0);
+    g_assert_cmphex(readl(base + PMU_BUS_IDLE_ACK), ==, 0);
+
+    /* Status registers ignore writes */
+    writel(base + PMU_BUS_IDLE_ST, IDLE_GPU);
+    g_assert_cmphex(readl(base + PMU_BUS_IDLE_ST), ==, 0);
+
+    writel(base + PMU_SYS_REG0, 0x12345678);
+    g_assert_cmphex(readl(base + PMU_SYS_REG0), ==, 0x12345678);
+}
+
+/* The cores are switched from their own threads: wait for it */
+static void wait_cores_off(uint32_t cores, uint32_t expected)
+{
+    uint32_t base = RK3399_PMU_BASE;
+    g_autoptr(GTimer) timer = g_timer_new();
+    uint32_t st;
+
+    do {
+        st = readl(base + PMU_PWRDN_ST) & cores;
+    } while (st != expected && g_timer_elapsed(timer, NULL) < 10);
+    g_assert_cmphex(st, ==, expected);
+}
+
+static void rk3399_pmu_test_cores(void)
+{
+    uint32_t base = RK3399_PMU_BASE;
+    uint32_t big = PWRDN_CORE(4) | PWRDN_CORE(5);
+
+    /* All six cores start powered */
+    g_assert_cmphex(readl(base + PMU_PWRDN_ST) & PWRDN_CORES, ==, 0);
+
+    /*
+     * PWRDN_ST reports the power state of the vCPU itself, so this checks
+     * that the second A72 was really turned off, and the rest left alone
+     */
+    writel(base + PMU_PWRDN_CON, PWRDN_CORE(5));
+    wait_cores_off(PWRDN_CORES, PWRDN_CORE(5));
+
+    /* The cluster goes down with its last core */
+    writel(base + PMU_PWRDN_CON, big);
+    wait_cores_off(PWRDN_CORES, big | PWRDN_SCU_B);
+
+    /* And both come back once their bits are cleared */
+    writel(base + PMU_PWRDN_CON, PWRDN_CORE(5));
+    wait_cores_off(PWRDN_CORES, PWRDN_CORE(5));
+    writel(base + PMU_PWRDN_CON, 0);
+    wait_cores_off(PWRDN_CORES, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/pmu/domains", rk3399_pmu_test_domains);
+    qtest_add_func("/rk3399/pmu/cores", rk3399_pmu_test_cores);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
@@ -0,0 +1,208 @@
+/*
+ * QTest testcase for the Rockchip RK3399 SD/MMC (dw_mmc) controller
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest-single.h"
+
+#define RK3399_SDMMC_BASE   0xfe320000
+
+/* Register offsets */
+#define SDMMC_CTRL          0x00
+#define SDMMC_BLKSIZ        0x1c
+#define SDMMC_BYTCNT        0x20
+#define SDMMC_CMDARG        0x28
+#define SDMMC_CMD           0x2c
+#define SDMMC_RESP0         0x30
+#define SDMMC_RINTSTS       0x44
+#define SDMMC_CDETECT       0x50
+#define SDMMC_VERID         0x6c
+#define SDMMC_BMOD          0x80
+#define SDMMC_DBADDR        0x88
+#define SDMMC_IDSTS         0x8c
+
+#define CTRL_INT_ENABLE     (1 << 4)
+#define CTRL_USE_IDMAC      (1 << 25)
+
+#define CMD_RESP_EXP        (1 << 6)
+#define CMD_RESP_LONG       (1 << 7)
+#define CMD_DATA_EXP        (1 << 9)
+#define CMD_SEND_STOP       (1 << 12)
+#define CMD_START           (1u << 31)
+
+#define INT_CMD_DONE        (1 << 2)
+#define INT_DATA_OVER       (1 << 3)
+#define INT_DCRC            (1 << 7)
+#define INT_RTO             (1 << 8)
+#define INT_ACD             (1 << 14)
+
+#define BMOD_DE             (1 << 7)
+#define IDSTS_RI            (1 << 1)
+#define IDSTS_DU            (1 << 4)
+
+#define DES0_LD             (1 << 2)
+#define DES0_FD             (1 << 3)
+#define DES0_CH             (1 << 4)
+#define DES0_CES            (1 << 30)
+#define DES0_OWN            (1u << 31)
+
+#define DESC_ADDR           0x200000
+#define BUF_ADDR            0x300000
+#define XFER_OFFSET         (8 * 512)
+#define XFER_LEN            (4 * 512)
+#define IMG_SIZE            (1 * MiB)
+
+static char *img_path;
+
+static uint32_t sdmmc_command(uint8_t cmd, uint32_t arg, uint32_t flags)
+{
+    uint32_t base = RK3399_SDMMC_BASE;
+    uint32_t rintsts;
+
+    writel(base + SDMMC_RINTSTS, 0xffffffff);
+    writel(base + SDMMC_CMDARG, arg);
+    writel(base + SDMMC_CMD, CMD_START | flags | cmd);
+    rintsts = readl(base + SDMMC_RINTSTS);
+    g_assert_cmphex(rintsts & INT_CMD_DONE, ==, INT_CMD_DONE);
+    g_assert_cmphex(rintsts & INT_RTO, ==, 0);
+
+    return readl(base + SDMMC_RESP0);
+}
+
+static void rk3399_sdmmc_test_id(void)
+{
+    g_assert_cmphex(readl(RK3399_SDMMC_BASE + SDMMC_VERID), ==, 0x5342270a);
+    /* Card present */
+    g_assert_cmphex(readl(RK3399_SDMMC_BASE + SDMMC_CDETECT) & 1, ==, 0);
+}
+
+/* Bring the card to the transfer state */
+static void sdmmc_select_card(void)
+{
+    uint32_t rca;
+
+    sdmmc_command(0, 0, 0);
+    sdmmc_command(8, 0x1aa, CMD_RESP_EXP);
+    sdmmc_command(55, 0, CMD_RESP_EXP);
+    sdmmc_command(41, 0x00300000, CMD_RESP_EXP);
+    sdmmc_command(2, 0, CMD_RESP_EXP | CMD_RESP_LONG);
+    rca = sdmmc_command(3, 0, CMD_RESP_EXP) & 0xffff0000;
+    sdmmc_command(7, rca, CMD_RESP_EXP);
+}
+
+static void sdmmc_idmac_setup(void)
+{
+    uint32_t base = RK3399_SDMMC_BASE;
+
+    writel(base + SDMMC_CTRL, CTRL_USE_IDMAC | CTRL_INT_ENABLE);
+    writel(base + SDMMC_DBADDR, DESC_ADDR);
+    writel(base + SDMMC_BMOD, BMOD_DE);
+    writel(base + SDMMC_BLKSIZ, 512);
+    writel(base + SDMMC_BYTCNT, XFER_LEN);
+}
+
+static void rk3399_sdmmc_test_idmac_read(void)
+{
+    uint32_t base = RK3399_SDMMC_BASE;
+    g_autofree uint8_t *buf = g_malloc(XFER_LEN);
+    uint32_t rintsts = 0;
+    int i;
+
+    sdmmc_select_card();
+
+    /* One chained descriptor covering the whole transfer */
+    writel(DESC_ADDR + 0x0, DES0_OWN | DES0_CH | DES0_FD | DES0_LD);
+    writel(DESC_ADDR + 0x4, XFER_LEN);
+    writel(DESC_ADDR + 0x8, BUF_ADDR);
+    writel(DESC_ADDR + 0xc, 0);
+    sdmmc_idmac_setup();
+
+    /* READ_MULTIPLE_BLOCK, byte addressed on this standard capacity card */
+    sdmmc_command(18, XFER_OFFSET,
+                  CMD_RESP_EXP | CMD_DATA_EXP | CMD_SEND_STOP);
+
+    /* The transfer completes asynchronously */
+    for (i = 0; i < 1000 && !(rintsts & INT_DATA_OVER); i++) {
+        rintsts = readl(base + SDMMC_RINTSTS);
+    }
+    g_assert_cmphex(rintsts & (INT_DATA_OVER | INT_ACD), ==,
+                    INT_DATA_OVER | INT_ACD);
+    g_assert_cmphex(readl(base + SDMMC_IDSTS) & IDSTS_RI, ==, IDSTS_RI);
+    g_assert_cmphex(readl(DESC_ADDR) & DES0_OWN, ==, 0);
+
+    memread(BUF_ADDR, buf, XFER_LEN);
+    for (i = 0; i < XFER_LEN; i++) {
+        g_assert_cmphex(buf[i], ==, (uint8_t)((XFER_OFFSET + i) * 7));
+    }
+}
+
+static void rk3399_sdmmc_test_idmac_unavailable(void)
+{
+    uint32_t base = RK3399_SDMMC_BASE;
+
+    sdmmc_select_card();
+
+    /* The first descriptor chains to one the guest has not handed over */
+    writel(DESC_ADDR + 0x00, DES0_OWN | DES0_CH | DES0_FD);
+    writel(DESC_ADDR + 0x04, 512);
+    writel(DESC_ADDR + 0x08, BUF_ADDR);
+    writel(DESC_ADDR + 0x0c, DESC_ADDR + 0x10);
+    writel(DESC_ADDR + 0x10, DES0_CH | DES0_LD);
+    writel(DESC_ADDR + 0x14, XFER_LEN - 512);
+    writel(DESC_ADDR + 0x18, BUF_ADDR + 512);
+    writel(DESC_ADDR + 0x1c, 0);
+    sdmmc_idmac_setup();
+
+    sdmmc_command(18, XFER_OFFSET,
+                  CMD_RESP_EXP | CMD_DATA_EXP | CMD_SEND_STOP);
+
+    g_assert_cmphex(readl(base + SDMMC_IDSTS) & IDSTS_DU, ==, IDSTS_DU);
+    g_assert_cmphex(readl(base + SDMMC_RINTSTS) & INT_DCRC, ==, INT_DCRC);
+    /* The descriptor taken is handed back, marked as failed */
+    g_assert_cmphex(readl(DESC_ADDR) & (DES0_OWN | DES0_CES), ==, DES0_CES);
+    g_assert_cmphex(readl(DESC_ADDR + 0x10), ==, DES0_CH | DES0_LD);
+}
+
+static char *create_image(void)
+{
+    g_autofree uint8_t *data = g_malloc(IMG_SIZE);
+    char *path = NULL;
+    int fd, i;
+
+    for (i = 0; i < IMG_SIZE; i++) {
+        data[i] = i * 7;
+    }
+
+    fd = g_file_open_tmp("qtest-rk3399-sdmmc.XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    g_assert(write(fd, data, IMG_SIZE) == IMG_SIZE);
+    close(fd);
+
+    return path;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/sdmmc/id", rk3399_sdmmc_test_id);
+    qtest_add_func("/rk3399/sdmmc/idmac_read", rk3399_sdmmc_test_idmac_read);
+    qtest_add_func("/rk3399/sdmmc/idmac_unavailable",
+                   rk3399_sdmmc_test_idmac_unavailable);
+
+    img_path = create_image();
+    global_qtest = qtest_initf("-machine rockchip-rk3399 "
+                               "-drive if=sd,index=0,format=raw,file=%s",
+                               img_path);
+    ret = g_test_run();
+    qtest_end();
+
+    unlink(img_path);
+    g_free(img_path);
+
+    return ret;
+}
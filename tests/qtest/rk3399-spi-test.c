@@ -0,0 +1,131 @@
+/*
+ * QTest testcase for the Rockchip RK3399 SPI controller and its SPI NOR
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_SPI1_BASE        0xff1d0000
+
+/* Register offsets */
+#define SPI_CTRLR0              0x00
+#define SPI_CTRLR1              0x04
+#define SPI_SSIENR              0x08
+#define SPI_SER                 0x0c
+#define SPI_TXFTLR              0x14
+#define SPI_RXFLR               0x20
+#define SPI_SR                  0x24
+#define SPI_RISR                0x34
+#define SPI_ICR                 0x38
+#define SPI_TXDR                0x400
+#define SPI_RXDR                0x800
+
+#define CTRLR0_DFS_8BIT         (1 << 0)
+#define CTRLR0_XFM_TO           (1 << 18)
+#define CTRLR0_XFM_RO           (2 << 18)
+#define SR_TFE                  (1 << 2)
+#define SR_RFE                  (1 << 3)
+#define RISR_RFU                (1 << 2)
+
+/* JEDEC ID of the n25q128a13 on chip select 0 */
+#define FLASH_JEDEC_ID          0x20ba18
+
+static uint32_t spi_readl(uint32_t offset)
+{
+    return readl(RK3399_SPI1_BASE + offset);
+}
+
+static void spi_writel(uint32_t offset, uint32_t value)
+{
+    writel(RK3399_SPI1_BASE + offset, value);
+}
+
+static void rk3399_spi_test_fifo_len(void)
+{
+    /* Drivers size the FIFO from the first threshold that does not stick */
+    spi_writel(SPI_TXFTLR, 31);
+    g_assert_cmpuint(spi_readl(SPI_TXFTLR), ==, 31);
+    spi_writel(SPI_TXFTLR, 32);
+    g_assert_cmpuint(spi_readl(SPI_TXFTLR), ==, 0);
+}
+
+static void rk3399_spi_test_read_id(void)
+{
+    uint32_t id = 0;
+    int i;
+
+    spi_writel(SPI_CTRLR0, CTRLR0_DFS_8BIT);
+    spi_writel(SPI_SSIENR, 1);
+    g_assert_cmphex(spi_readl(SPI_SR), ==, SR_TFE | SR_RFE);
+
+    spi_writel(SPI_SER, 1);
+    spi_writel(SPI_TXDR, 0x9f);
+    for (i = 0; i < 3; i++) {
+        spi_writel(SPI_TXDR, 0);
+    }
+    spi_writel(SPI_SER, 0);
+
+    g_assert_cmpuint(spi_readl(SPI_RXFLR), ==, 4);
+    spi_readl(SPI_RXDR);
+    for (i = 0; i < 3; i++) {
+        id = (id << 8) | spi_readl(SPI_RXDR);
+    }
+    g_assert_cmphex(id, ==, FLASH_JEDEC_ID);
+    g_assert_cmphex(spi_readl(SPI_SR), ==, SR_TFE | SR_RFE);
+
+    /* Reading an empty FIFO flags an underflow */
+    g_assert_cmphex(spi_readl(SPI_RISR) & RISR_RFU, ==, 0);
+    spi_readl(SPI_RXDR);
+    g_assert_cmphex(spi_readl(SPI_RISR) & RISR_RFU, ==, RISR_RFU);
+    spi_writel(SPI_ICR, 1);
+    g_assert_cmphex(spi_readl(SPI_RISR) & RISR_RFU, ==, 0);
+
+    spi_writel(SPI_SSIENR, 0);
+}
+
+static void rk3399_spi_test_read_data(void)
+{
+    const int len = 40;
+    int i;
+
+    /* Send READ from address 0 without capturing anything */
+    spi_writel(SPI_CTRLR0, CTRLR0_DFS_8BIT | CTRLR0_XFM_TO);
+    spi_writel(SPI_SSIENR, 1);
+    spi_writel(SPI_SER, 1);
+    spi_writel(SPI_TXDR, 0x03);
+    for (i = 0; i < 3; i++) {
+        spi_writel(SPI_TXDR, 0);
+    }
+    g_assert_cmpuint(spi_readl(SPI_RXFLR), ==, 0);
+    spi_writel(SPI_SSIENR, 0);
+
+    /* Then clock in more frames than the FIFO holds; a blank flash reads 1s */
+    spi_writel(SPI_CTRLR0, CTRLR0_DFS_8BIT | CTRLR0_XFM_RO);
+    spi_writel(SPI_CTRLR1, len - 1);
+    spi_writel(SPI_SSIENR, 1);
+    g_assert_cmpuint(spi_readl(SPI_RXFLR), ==, 32);
+    for (i = 0; i < len; i++) {
+        g_assert_cmphex(spi_readl(SPI_RXDR), ==, 0xff);
+    }
+    g_assert_cmpuint(spi_readl(SPI_RXFLR), ==, 0);
+    spi_writel(SPI_SER, 0);
+    spi_writel(SPI_SSIENR, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/spi/fifo_len", rk3399_spi_test_fifo_len);
+    qtest_add_func("/rk3399/spi/read_id", rk3399_spi_test_read_id);
+    qtest_add_func("/rk3399/spi/read_data", rk3399_spi_test_read_data);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
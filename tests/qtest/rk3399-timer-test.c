@@ -0,0 +1,102 @@
+/*
+ * QTest testcase for the Rockchip RK3399 timer blocks
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_TIMER0_BASE  0xff850000
+#define RK3399_TIMER1_BASE  0xff858000
+
+/* 24 MHz timer clock */
+#define NANOSECONDS_PER_TICK    (1000000000 / 24000000.0)
+
+/* Per-channel register offsets */
+#define CHANNEL(n)          ((n) * 0x20)
+#define LOAD_COUNT0         0x00
+#define LOAD_COUNT1         0x04
+#define CURRENT_VALUE0      0x08
+#define CURRENT_VALUE1      0x0c
+#define INT_STATUS          0x18
+#define CONTROL             0x1c
+
+#define CONTROL_EN          (1 << 0)
+#define CONTROL_ONESHOT     (1 << 1)
+#define CONTROL_INT_EN      (1 << 2)
+
+static void timer_step_ticks(uint64_t ticks)
+{
+    clock_step(ticks * NANOSECONDS_PER_TICK + 1);
+}
+
+static void rk3399_timer_test_oneshot(gconstpointer data)
+{
+    uint32_t base = GPOINTER_TO_UINT(data) + CHANNEL(3);
+
+    writel(base + LOAD_COUNT0, 24000);
+    writel(base + LOAD_COUNT1, 0);
+    writel(base + CONTROL, CONTROL_EN | CONTROL_ONESHOT | CONTROL_INT_EN);
+
+    timer_step_ticks(12000);
+    g_assert_cmpuint(readl(base + CURRENT_VALUE0), <=, 12000);
+    g_assert_cmpuint(readl(base + INT_STATUS), ==, 0);
+
+    timer_step_ticks(12000);
+    g_assert_cmpuint(readl(base + INT_STATUS), ==, 1);
+    g_assert_cmpuint(readl(base + CURRENT_VALUE0), ==, 0);
+
+    /* A one-shot channel does not reload */
+    timer_step_ticks(24000);
+    g_assert_cmpuint(readl(base + CURRENT_VALUE0), ==, 0);
+
+    /* Interrupt status is write-1-to-clear */
+    writel(base + INT_STATUS, 1);
+    g_assert_cmpuint(readl(base + INT_STATUS), ==, 0);
+
+    writel(base + CONTROL, 0);
+}
+
+static void rk3399_timer_test_periodic(void)
+{
+    uint32_t base = RK3399_TIMER0_BASE + CHANNEL(0);
+
+    /* Load counts wider than 32 bits span LOAD_COUNT0/1 */
+    writel(base + LOAD_COUNT0, 0);
+    writel(base + LOAD_COUNT1, 1);
+    writel(base + CONTROL, CONTROL_EN);
+    g_assert_cmpuint(readl(base + CURRENT_VALUE1), ==, 1);
+
+    timer_step_ticks(1ULL << 32);
+    g_assert_cmpuint(readl(base + INT_STATUS), ==, 1);
+    writel(base + INT_STATUS, 1);
+
+    /* A periodic channel reloads and keeps counting */
+    timer_step_ticks(1ULL << 31);
+    g_assert_cmpuint(readl(base + CURRENT_VALUE1), ==, 0);
+    g_assert_cmpuint(readl(base + CURRENT_VALUE0), !=, 0);
+    g_assert_cmpuint(readl(base + INT_STATUS), ==, 0);
+
+    writel(base + CONTROL, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_data_func("/rk3399/timer/0/oneshot",
+                        GUINT_TO_POINTER(RK3399_TIMER0_BASE),
+                        rk3399_timer_test_oneshot);
+    qtest_add_data_func("/rk3399/timer/1/oneshot",
+                        GUINT_TO_POINTER(RK3399_TIMER1_BASE),
+                        rk3399_timer_test_oneshot);
+    qtest_add_func("/rk3399/timer/0/periodic", rk3399_timer_test_periodic);
+
+    qtest_start("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
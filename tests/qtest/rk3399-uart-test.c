@@ -0,0 +1,146 @@
+/*
+ * QTest testcase for the Rockchip RK3399 (DesignWare APB) UARTs
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_UART0_BASE   0xff180000
+#define RK3399_UART2_BASE   0xff1a0000
+#define RK3399_UART3_BASE   0xff1b0000
+
+/* Register offsets */
+#define UART_THR            0x00
+#define UART_FCR            0x08
+#define UART_LSR            0x14
+#define UART_USR            0x7c
+#define UART_TFL            0x80
+#define UART_CPR            0xf4
+#define UART_UCV            0xf8
+
+#define UART_FCR_FE         0x01
+#define UART_LSR_THRE       0x20
+#define UART_LSR_TEMT       0x40
+#define UART_USR_TFNF       (1 << 1)
+#define UART_USR_TFE        (1 << 2)
+
+static void rk3399_uart_test_id(gconstpointer data)
+{
+    uint32_t base = GPOINTER_TO_UINT(data);
+
+    /* 64-byte FIFOs, reported in units of 16 bytes */
+    g_assert_cmphex((readl(base + UART_CPR) >> 16) & 0xff, ==, 4);
+    g_assert_cmphex(readl(base + UART_UCV), ==, 0x3430312a);
+}
+
+/* Output of UART2, the first serial port */
+static char *serial_path;
+
+static gsize serial_output(gchar **contents)
+{
+    g_autoptr(GError) err = NULL;
+    gsize len;
+
+    g_file_get_contents(serial_path, contents, &len, &err);
+    g_assert_no_error(err);
+    return len;
+}
+
+static void rk3399_uart_test_fifo(void)
+{
+    uint32_t base = RK3399_UART2_BASE;
+    g_autofree gchar *out = NULL;
+    uint32_t usr, tfl;
+    int i;
+
+    writel(base + UART_FCR, UART_FCR_FE);
+    for (i = 0; i < 32; i++) {
+        writel(base + UART_THR, 'a' + i % 26);
+    }
+    usr = readl(base + UART_USR);
+    g_assert_cmphex(usr & UART_USR_TFNF, ==, UART_USR_TFNF);
+
+    /*
+     * Whatever has not reached the chardev yet is still in the FIFO.  The
+     * transmit bottom half scheduled by the last THR write has run by the
+     * time a second command is handled, so this snapshot is stable.
+     */
+    tfl = readl(base + UART_TFL);
+    g_assert_cmpuint(tfl, ==, 32 - serial_output(&out));
+
+    /* Polling LSR drains whatever is still queued */
+    g_assert_cmphex(readl(base + UART_LSR) & (UART_LSR_THRE | UART_LSR_TEMT),
+                    ==, UART_LSR_THRE | UART_LSR_TEMT);
+    g_assert_cmpuint(readl(base + UART_TFL), ==, 0);
+    g_assert_cmphex(readl(base + UART_USR) & UART_USR_TFE, ==, UART_USR_TFE);
+
+    g_free(out);
+    g_assert_cmpuint(serial_output(&out), ==, 32);
+    for (i = 0; i < 32; i++) {
+        g_assert_cmpint(out[i], ==, 'a' + i % 26);
+    }
+}
+
+static void rk3399_uart_test_fifo_disable(void)
+{
+    uint32_t base = RK3399_UART2_BASE;
+    g_autofree gchar *out = NULL;
+    gsize before, sent;
+    int i;
+
+    before = serial_output(&out);
+
+    writel(base + UART_FCR, UART_FCR_FE);
+    for (i = 0; i < 8; i++) {
+        writel(base + UART_THR, '0' + i);
+    }
+
+    /* Turning the FIFO off flushes what the transmitter has not sent */
+    writel(base + UART_FCR, 0);
+    g_assert_cmpuint(readl(base + UART_TFL), ==, 0);
+    g_assert_cmphex(readl(base + UART_LSR) & (UART_LSR_THRE | UART_LSR_TEMT),
+                    ==, UART_LSR_THRE | UART_LSR_TEMT);
+
+    g_free(out);
+    sent = serial_output(&out) - before;
+    g_assert_cmpuint(sent, <=, 8);
+
+    /* Only the new byte goes out next, nothing left over from the FIFO */
+    writel(base + UART_THR, 'x');
+    g_assert_cmphex(readl(base + UART_LSR) & (UART_LSR_THRE | UART_LSR_TEMT),
+                    ==, UART_LSR_THRE | UART_LSR_TEMT);
+    g_free(out);
+    g_assert_cmpuint(serial_output(&out), ==, before + sent + 1);
+    g_assert_cmpint(out[before + sent], ==, 'x');
+}
+
+int main(int argc, char **argv)
+{
+    g_autofree char *args = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_data_func("/rk3399/uart/0/id",
+                        GUINT_TO_POINTER(RK3399_UART0_BASE),
+                        rk3399_uart_test_id);
+    qtest_add_data_func("/rk3399/uart/3/id",
+                        GUINT_TO_POINTER(RK3399_UART3_BASE),
+                        rk3399_uart_test_id);
+    qtest_add_func("/rk3399/uart/2/fifo", rk3399_uart_test_fifo);
+    qtest_add_func("/rk3399/uart/2/fifo_disable",
+                   rk3399_uart_test_fifo_disable);
+
+    close(g_file_open_tmp("qtest-rk3399-uart-XXXXXX", &serial_path, NULL));
+    args = g_strdup_printf("-machine rockchip-rk3399 -serial file:%s",
+                           serial_path);
+    qtest_start(args);
+    ret = g_test_run();
+    qtest_end();
+
+    unlink(serial_path);
+    g_free(serial_path);
+
+    return ret;
+}
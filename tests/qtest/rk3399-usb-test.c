@@ -0,0 +1,171 @@
+/*
+ * QTest testcase for the Rockchip RK3399 USB 3.0 (DWC3 xHCI) controllers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_USB3_0_BASE  0xfe800000
+#define RK3399_USB3_1_BASE  0xfe900000
+
+/* xHCI register blocks */
+#define XHCI_HCSPARAMS1     0x0004
+#define XHCI_OPER           0x0040
+#define XHCI_RUNTIME        0x1000
+#define XHCI_DOORBELL       0x2000
+
+#define USBCMD              (XHCI_OPER + 0x00)
+#define CRCR_LO             (XHCI_OPER + 0x18)
+#define CRCR_HI             (XHCI_OPER + 0x1c)
+#define IMAN                (XHCI_RUNTIME + 0x20)
+#define IMOD                (XHCI_RUNTIME + 0x24)
+#define ERSTSZ              (XHCI_RUNTIME + 0x28)
+#define ERSTBA_LO           (XHCI_RUNTIME + 0x30)
+#define ERSTBA_HI           (XHCI_RUNTIME + 0x34)
+#define ERDP_LO             (XHCI_RUNTIME + 0x38)
+#define ERDP_HI             (XHCI_RUNTIME + 0x3c)
+
+/* DWC3 global registers */
+#define DWC3_GSNPSID        0xc120
+
+#define USBCMD_RS           (1 << 0)
+#define USBCMD_INTE         (1 << 2)
+#define CRCR_RCS            (1 << 0)
+#define IMAN_IP             (1 << 0)
+#define IMAN_IE             (1 << 1)
+#define ERDP_EHB            (1 << 3)
+
+#define TRB_C               (1 << 0)
+#define TRB_TYPE(t)         ((t) << 10)
+#define TRB_TYPE_OF(c)      (((c) >> 10) & 0x3f)
+#define CR_NOOP             23
+#define ER_COMMAND_COMPLETE 33
+
+#define ERST_ADDR           0x400000
+#define EVENT_RING_ADDR     0x401000
+#define EVENT_RING_SIZE     16
+#define CMD_RING_ADDR       0x402000
+#define TRB_SIZE            16
+
+/* IMODI in 250ns units: 1ms */
+#define IMOD_INTERVAL       4000
+#define IMOD_INTERVAL_NS    (IMOD_INTERVAL * 250)
+
+static uint32_t usb_readl(uint32_t offset)
+{
+    return readl(RK3399_USB3_0_BASE + offset);
+}
+
+static void usb_writel(uint32_t offset, uint32_t value)
+{
+    writel(RK3399_USB3_0_BASE + offset, value);
+}
+
+static void rk3399_usb_test_id(void)
+{
+    uint32_t base[] = { RK3399_USB3_0_BASE, RK3399_USB3_1_BASE };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(base); i++) {
+        uint32_t hcsparams1 = readl(base[i] + XHCI_HCSPARAMS1);
+
+        g_assert_cmphex(readl(base[i] + DWC3_GSNPSID), ==, 0x5533330a);
+        /* CAPLENGTH */
+        g_assert_cmphex(readl(base[i]) & 0xff, ==, XHCI_OPER);
+        /* One USB 2.0 and one USB 3.0 port, a single interrupter */
+        g_assert_cmpint(hcsparams1 >> 24, ==, 2);
+        g_assert_cmpint((hcsparams1 >> 8) & 0x7ff, ==, 1);
+    }
+}
+
+static int cmd_idx;
+static int event_idx;
+
+static void issue_noop(void)
+{
+    uint32_t addr = CMD_RING_ADDR + cmd_idx++ * TRB_SIZE;
+
+    writeq(addr, 0);
+    writel(addr + 8, 0);
+    writel(addr + 12, TRB_TYPE(CR_NOOP) | TRB_C);
+    usb_writel(XHCI_DOORBELL, 0);
+}
+
+static void check_event(void)
+{
+    uint32_t addr = EVENT_RING_ADDR + event_idx++ * TRB_SIZE;
+    uint32_t control = readl(addr + 12);
+
+    g_assert_cmphex(control & TRB_C, ==, TRB_C);
+    g_assert_cmpint(TRB_TYPE_OF(control), ==, ER_COMMAND_COMPLETE);
+    g_assert_cmphex(usb_readl(IMAN) & IMAN_IP, ==, IMAN_IP);
+}
+
+static void ack_events(void)
+{
+    usb_writel(IMAN, IMAN_IP | IMAN_IE);
+    usb_writel(ERDP_LO, (EVENT_RING_ADDR + event_idx * TRB_SIZE) | ERDP_EHB);
+    usb_writel(ERDP_HI, 0);
+    g_assert_false(get_irq(0));
+}
+
+static void rk3399_usb_test_imod(void)
+{
+    qtest_memset(global_qtest, ERST_ADDR, 0, 0x3000);
+    writel(ERST_ADDR, EVENT_RING_ADDR);
+    writel(ERST_ADDR + 4, 0);
+    writel(ERST_ADDR + 8, EVENT_RING_SIZE);
+
+    usb_writel(ERSTSZ, 1);
+    usb_writel(ERDP_LO, EVENT_RING_ADDR);
+    usb_writel(ERDP_HI, 0);
+    usb_writel(ERSTBA_LO, ERST_ADDR);
+    usb_writel(ERSTBA_HI, 0);
+    usb_writel(IMOD, IMOD_INTERVAL);
+    usb_writel(IMAN, IMAN_IE);
+    usb_writel(CRCR_LO, CMD_RING_ADDR | CRCR_RCS);
+    usb_writel(CRCR_HI, 0);
+    usb_writel(USBCMD, USBCMD_RS | USBCMD_INTE);
+
+    qtest_irq_intercept_out(global_qtest, "/machine/usb[0]/dwc3-xhci");
+
+    /* Nothing signalled recently: the interrupt fires straight away */
+    issue_noop();
+    check_event();
+    g_assert_true(get_irq(0));
+    ack_events();
+
+    /* Within the interval the event is queued, the interrupt held back */
+    issue_noop();
+    check_event();
+    issue_noop();
+    check_event();
+    g_assert_false(get_irq(0));
+    clock_step(IMOD_INTERVAL_NS);
+    g_assert_true(get_irq(0));
+    ack_events();
+
+    /* Once the interval has passed without events, no delay again */
+    clock_step(IMOD_INTERVAL_NS);
+    issue_noop();
+    check_event();
+    g_assert_true(get_irq(0));
+    ack_events();
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/usb/id", rk3399_usb_test_id);
+    qtest_add_func("/rk3399/usb/imod", rk3399_usb_test_imod);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
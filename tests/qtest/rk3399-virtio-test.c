@@ -0,0 +1,58 @@
+/*
+ * QTest testcase for the virtio-mmio transports of the rockchip-rk3399 machine
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_VIRTIO_BASE      0xfc000000
+#define RK3399_VIRTIO_SIZE      0x200
+#define RK3399_VIRTIO_COUNT     8
+
+/* Register offsets */
+#define VIRTIO_MMIO_MAGIC       0x000
+#define VIRTIO_MMIO_VERSION     0x004
+#define VIRTIO_MMIO_DEVICE_ID   0x008
+#define VIRTIO_MMIO_VENDOR_ID   0x00c
+
+#define VIRTIO_MMIO_MAGIC_VALUE 0x74726976  /* "virt" */
+#define VIRTIO_VENDOR_QEMU      0x554d4551  /* "QEMU" */
+
+static void rk3399_virtio_test_transports(void)
+{
+    int i;
+
+    for (i = 0; i < RK3399_VIRTIO_COUNT; i++) {
+        uint32_t base = RK3399_VIRTIO_BASE + i * RK3399_VIRTIO_SIZE;
+
+        g_assert_cmphex(readl(base + VIRTIO_MMIO_MAGIC), ==,
+                        VIRTIO_MMIO_MAGIC_VALUE);
+        /* Modern (virtio 1.0) transports */
+        g_assert_cmpint(readl(base + VIRTIO_MMIO_VERSION), ==, 2);
+        g_assert_cmphex(readl(base + VIRTIO_MMIO_VENDOR_ID), ==,
+                        VIRTIO_VENDOR_QEMU);
+        /* Nothing plugged in */
+        g_assert_cmpint(readl(base + VIRTIO_MMIO_DEVICE_ID), ==, 0);
+    }
+
+    /* The bank ends where the last transport does */
+    g_assert_cmphex(readl(RK3399_VIRTIO_BASE +
+                          RK3399_VIRTIO_COUNT * RK3399_VIRTIO_SIZE), !=,
+                    VIRTIO_MMIO_MAGIC_VALUE);
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/virtio/transports", rk3399_virtio_test_transports);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
@@ -0,0 +1,183 @@
+/*
+ * QTest testcase for the Rockchip RK3399 VOP display controllers
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+
+#define RK3399_VOPB_BASE        0xff900000
+#define RK3399_VOPL_BASE        0xff8f0000
+
+/* Register offsets */
+#define VOP_REG_CFG_DONE        0x0000
+#define VOP_SYS_CTRL            0x0008
+#define VOP_WIN0_CTRL0          0x0030
+#define VOP_WIN0_VIR            0x003c
+#define VOP_WIN0_YRGB_MST       0x0040
+#define VOP_WIN0_ACT_INFO       0x0048
+#define VOP_INTR_EN0            0x0280
+#define VOP_INTR_CLEAR0         0x0284
+#define VOP_INTR_STATUS0        0x0288
+#define VOP_INTR_RAW_STATUS0    0x028c
+
+#define SYS_CTRL_STANDBY        (1 << 22)
+#define INTR_FS                 (1 << 0)
+#define INTR_DSP_HOLD_VALID     (1 << 13)
+#define HIWORD_UPDATE(v, m)     (((m) << 16) | (v))
+
+#define WIN0_CTRL0_EN           (1 << 0)
+#define WIN0_ACT_INFO(w, h)     ((((h) - 1) << 16) | ((w) - 1))
+
+#define FRAME_NS                (1000000000 / 60)
+
+/* Size of the surface shown while no window is scanned out */
+#define PLACEHOLDER_WIDTH       640
+#define PLACEHOLDER_HEIGHT      480
+
+#define FB_ADDR                 0x1000000
+#define FB_WIDTH                320
+#define FB_HEIGHT               240
+
+static void rk3399_vop_test_standby(void)
+{
+    uint32_t base[] = { RK3399_VOPB_BASE, RK3399_VOPL_BASE };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(base); i++) {
+        /* Out of reset the output is in standby */
+        g_assert_cmphex(readl(base[i] + VOP_SYS_CTRL) & SYS_CTRL_STANDBY, ==,
+                        SYS_CTRL_STANDBY);
+
+        writel(base[i] + VOP_SYS_CTRL, 0);
+        g_assert_cmphex(readl(base[i] + VOP_INTR_RAW_STATUS0), ==, 0);
+
+        /* Entering standby flags the held frame */
+        writel(base[i] + VOP_SYS_CTRL, SYS_CTRL_STANDBY);
+        g_assert_cmphex(readl(base[i] + VOP_INTR_RAW_STATUS0), ==,
+                        INTR_DSP_HOLD_VALID);
+        g_assert_cmphex(readl(base[i] + VOP_INTR_STATUS0), ==, 0);
+
+        writel(base[i] + VOP_INTR_CLEAR0,
+               HIWORD_UPDATE(INTR_DSP_HOLD_VALID, INTR_DSP_HOLD_VALID));
+        g_assert_cmphex(readl(base[i] + VOP_INTR_RAW_STATUS0), ==, 0);
+    }
+}
+
+static void rk3399_vop_test_vsync(void)
+{
+    uint32_t base = RK3399_VOPB_BASE;
+
+    writel(base + VOP_SYS_CTRL, 0);
+    writel(base + VOP_INTR_EN0, HIWORD_UPDATE(INTR_FS, INTR_FS));
+    /* Bits outside the write mask are left alone */
+    writel(base + VOP_INTR_EN0, 0);
+    g_assert_cmphex(readl(base + VOP_INTR_EN0), ==, INTR_FS);
+
+    clock_step(FRAME_NS);
+    g_assert_cmphex(readl(base + VOP_INTR_STATUS0), ==, INTR_FS);
+
+    writel(base + VOP_INTR_CLEAR0, HIWORD_UPDATE(INTR_FS, INTR_FS));
+    g_assert_cmphex(readl(base + VOP_INTR_STATUS0), ==, 0);
+
+    /* No frames while in standby */
+    writel(base + VOP_SYS_CTRL, SYS_CTRL_STANDBY);
+    writel(base + VOP_INTR_CLEAR0,
+           HIWORD_UPDATE(INTR_DSP_HOLD_VALID, INTR_DSP_HOLD_VALID));
+    clock_step(FRAME_NS * 2);
+    g_assert_cmphex(readl(base + VOP_INTR_STATUS0), ==, 0);
+}
+
+/*
+ * Dump the first console, VOP big's, and return its size and the colour
+ * of its top left pixel
+ */
+static void screendump(int *width, int *height, uint8_t rgb[3])
+{
+    g_autofree char *path = NULL;
+    g_autofree char *data = NULL;
+    g_autoptr(GError) err = NULL;
+    gsize len;
+    int maxval, offset = 0;
+
+    close(g_file_open_tmp("qtest-rk3399-vop-XXXXXX.ppm", &path, NULL));
+    qtest_qmp_assert_success(global_qtest,
+                             "{ 'execute': 'screendump', "
+                             "  'arguments': { 'filename': %s } }", path);
+    g_file_get_contents(path, &data, &len, &err);
+    g_assert_no_error(err);
+    unlink(path);
+
+    g_assert_cmpint(sscanf(data, "P6 %d %d %d%n", width, height, &maxval,
+                           &offset), ==, 3);
+    g_assert_cmpint(maxval, ==, 255);
+    /* A single whitespace character ends the header */
+    g_assert_cmpuint(len, >=, offset + 1 + 3);
+    memcpy(rgb, data + offset + 1, 3);
+}
+
+static void rk3399_vop_test_scanout(void)
+{
+    uint32_t base = RK3399_VOPB_BASE;
+    uint8_t rgb[3];
+    int width, height;
+
+    writel(base + VOP_SYS_CTRL, 0);
+
+    /* One red ARGB8888 pixel in the top left corner */
+    writel(FB_ADDR, 0x00ff0000);
+    writel(base + VOP_WIN0_YRGB_MST, FB_ADDR);
+    writel(base + VOP_WIN0_VIR, FB_WIDTH);
+    writel(base + VOP_WIN0_ACT_INFO, WIN0_ACT_INFO(FB_WIDTH, FB_HEIGHT));
+    writel(base + VOP_WIN0_CTRL0, WIN0_CTRL0_EN);
+
+    /* The window registers are shadowed until REG_CFG_DONE */
+    screendump(&width, &height, rgb);
+    g_assert_cmpint(width, ==, PLACEHOLDER_WIDTH);
+    g_assert_cmpint(height, ==, PLACEHOLDER_HEIGHT);
+
+    writel(base + VOP_REG_CFG_DONE, 1);
+    screendump(&width, &height, rgb);
+    g_assert_cmpint(width, ==, FB_WIDTH);
+    g_assert_cmpint(height, ==, FB_HEIGHT);
+    g_assert_cmphex(rgb[0], ==, 0xff);
+    g_assert_cmphex(rgb[1], ==, 0);
+    g_assert_cmphex(rgb[2], ==, 0);
+
+    writel(base + VOP_WIN0_ACT_INFO, WIN0_ACT_INFO(FB_WIDTH / 2, FB_HEIGHT));
+    screendump(&width, &height, rgb);
+    g_assert_cmpint(width, ==, FB_WIDTH);
+
+    /*
+     * Disabling the window blanks the output: the console switches to a
+     * placeholder of the same size, black but for a centered message
+     */
+    writel(base + VOP_WIN0_CTRL0, 0);
+    writel(base + VOP_REG_CFG_DONE, 1);
+    screendump(&width, &height, rgb);
+    g_assert_cmpint(width, ==, FB_WIDTH);
+    g_assert_cmphex(rgb[0], ==, 0);
+    g_assert_cmphex(rgb[1], ==, 0);
+    g_assert_cmphex(rgb[2], ==, 0);
+
+    writel(base + VOP_SYS_CTRL, SYS_CTRL_STANDBY);
+    writel(base + VOP_INTR_CLEAR0,
+           HIWORD_UPDATE(INTR_DSP_HOLD_VALID, INTR_DSP_HOLD_VALID));
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_func("/rk3399/vop/standby", rk3399_vop_test_standby);
+    qtest_add_func("/rk3399/vop/vsync", rk3399_vop_test_vsync);
+    qtest_add_func("/rk3399/vop/scanout", rk3399_vop_test_scanout);
+
+    global_qtest = qtest_initf("-machine rockchip-rk3399");
+    ret = g_test_run();
+    qtest_end();
+
+    return ret;
+}
@@ -0,0 +1,177 @@
+/*
+ * Indirect branches, taken many times from the same sites.
+ *
+ * Each BR, BLR and RET site keeps the last block it went to in an inline
+ * cache.  This checks that what the guest sees does not depend on whether
+ * the cache hits: the results of a dispatch loop, and the branch target
+ * exceptions taken for the BTYPE each kind of site sets.
+ */
+
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifndef PROT_BTI
+#define PROT_BTI  0x10
+#endif
+
+#define PSR_BTYPE_MASK  (3 << 10)
+
+/* Skip the landing pad and the "mov x1, #0" after it */
+static void skip2_sigill(int sig, siginfo_t *info, void *vuc)
+{
+    ucontext_t *uc = vuc;
+    uc->uc_mcontext.pc += 8;
+    uc->uc_mcontext.pstate &= ~PSR_BTYPE_MASK;
+}
+
+#define BTI_N     "hint #32"
+#define BTI_C     "hint #34"
+#define BTI_J     "hint #36"
+#define BTI_JC    "hint #38"
+
+/* Returns to x4 with x1 cleared, unless the landing pad faulted */
+#define TARGET(PAD)               \
+    PAD "\n\t"                    \
+    "mov x1, #0\n\t"              \
+    "ret x4\n\t"                  \
+    "nop\n\t"
+
+/*
+ * Each kind of site goes to the four targets in turn, eight times in a
+ * row, so that the inline caches both hit and miss.  Per round of four:
+ *   br x16 (BTYPE 1) faults on bti n;
+ *   blr x16 (BTYPE 2) faults on bti j and bti n;
+ *   br x15 (BTYPE 3) faults on bti c and bti n.
+ */
+#define ITERS           256
+#define EXPECTED_FAULTS (ITERS / 4 * 5)
+
+#define stringify_1(x)  #x
+#define stringify(x)    stringify_1(x)
+
+asm("\n"
+"test_begin:\n\t"
+    BTI_C "\n\t"
+    "mov x2, x30\n\t"
+    "mov x0, #0\n\t"
+    "mov x3, #" stringify(ITERS) "\n"
+"0:\n\t"
+    "ubfx x6, x3, #3, #2\n\t"
+    "adr x7, targets\n\t"
+    "add x16, x7, x6, lsl #4\n\t"
+    "mov x15, x16\n\t"
+
+    "mov x1, #1\n\t"
+    "adr x4, 1f\n\t"
+    "br x16\n"
+"1:  add x0, x0, x1\n\t"
+
+    "mov x1, #1\n\t"
+    "adr x4, 2f\n\t"
+    "blr x16\n"
+"2:  add x0, x0, x1\n\t"
+
+    "mov x1, #1\n\t"
+    "adr x4, 3f\n\t"
+    "br x15\n"
+"3:  add x0, x0, x1\n\t"
+
+    "subs x3, x3, #1\n\t"
+    "b.ne 0b\n\t"
+    "ret x2\n\t"
+
+    ".balign 16\n"
+"targets:\n\t"
+    TARGET(BTI_C)
+    TARGET(BTI_J)
+    TARGET(BTI_JC)
+    TARGET(BTI_N)
+"test_end:"
+);
+
+typedef unsigned (*op_fn)(unsigned);
+
+static unsigned op0(unsigned x) { return x + 3; }
+static unsigned op1(unsigned x) { return x * 5; }
+static unsigned op2(unsigned x) { return x ^ 0x5a5a; }
+static unsigned op3(unsigned x) { return x - 7; }
+static unsigned op4(unsigned x) { return (x << 3) | (x >> 29); }
+static unsigned op5(unsigned x) { return ~x; }
+static unsigned op6(unsigned x) { return x + (x >> 4); }
+static unsigned op7(unsigned x) { return x * 3 + 1; }
+
+static op_fn ops[] = { op0, op1, op2, op3, op4, op5, op6, op7 };
+
+/* Calls through pointers, and returns from a varying depth */
+static unsigned __attribute__((noinline)) dispatch(unsigned x, unsigned depth)
+{
+    if (depth) {
+        x = dispatch(x, depth - 1);
+    }
+    return ops[(x ^ depth) & 7](x);
+}
+
+static unsigned direct(unsigned x, unsigned depth)
+{
+    if (depth) {
+        x = direct(x, depth - 1);
+    }
+    switch ((x ^ depth) & 7) {
+    case 0: return op0(x);
+    case 1: return op1(x);
+    case 2: return op2(x);
+    case 3: return op3(x);
+    case 4: return op4(x);
+    case 5: return op5(x);
+    case 6: return op6(x);
+    default: return op7(x);
+    }
+}
+
+int main()
+{
+    struct sigaction sa;
+    void *tb, *te, *p;
+    unsigned i, x = 1, y = 1;
+    long faults;
+
+    for (i = 0; i < 100000; i++) {
+        x = dispatch(x, i & 15);
+        y = direct(y, i & 15);
+        if (x != y) {
+            printf("FAIL: dispatch %u gave 0x%x instead of 0x%x\n", i, x, y);
+            return 1;
+        }
+    }
+
+    p = mmap(0, getpagesize(), PROT_EXEC | PROT_READ | PROT_WRITE | PROT_BTI,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = skip2_sigill;
+    sa.sa_flags = SA_SIGINFO;
+    if (sigaction(SIGILL, &sa, NULL) < 0) {
+        perror("sigaction");
+        return 1;
+    }
+
+    /* As in bti-2, avoid :got references to the asm labels */
+    asm("adr %0, test_begin; adr %1, test_end" : "=r"(tb), "=r"(te));
+
+    memcpy(p, tb, te - tb);
+
+    faults = ((long (*)(void))p)();
+    if (faults != EXPECTED_FAULTS) {
+        printf("FAIL: %ld branch target exceptions instead of %d\n",
+               faults, EXPECTED_FAULTS);
+        return 1;
+    }
+    return 0;
+}
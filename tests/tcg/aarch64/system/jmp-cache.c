@@ -0,0 +1,152 @@
+/*
+ * Many indirect branch targets on several CPUs at once
+ *
+ * Most CPUs call a lot more stubs through pointers than the jump cache
+ * has entries at first, so that it misses and grows, while one CPU keeps
+ * rewriting a stub of its own.  As the code is position independent,
+ * each rewrite invalidates the jump caches of all CPUs, during their
+ * resizing too.  Every call must still land on the right stub.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+#include "smp.h"
+
+#define NR_STUBS        16384
+#define STUB_INSNS      4
+#define ROUNDS          64
+#define WRITER_CPU      1
+
+/* movz w1, #value; add x0, x0, x1; ret; nop */
+#define INSN_MOVZ_W1    0x52800001
+#define INSN_ADD_X0_X1  0x8b010000
+#define INSN_RET        0xd65f03c0
+#define INSN_NOP        0xd503201f
+
+asm("\t.pushsection .text\n"
+    "\t.balign 4096\n"
+    "stubs:\n"
+    "\t.space " __stringify(NR_STUBS * STUB_INSNS * 4) "\n"
+    "stubs_end:\n"
+    "\t.balign 4096\n"
+    "hot_stub:\n"
+    "\t.space " __stringify(STUB_INSNS * 4) "\n"
+    "hot_stub_end:\n"
+    "\t.balign 4096\n"
+    "\t.popsection\n");
+
+extern uint32_t stubs[], stubs_end[], hot_stub[], hot_stub_end[];
+
+typedef uint64_t stub_fn(uint64_t);
+
+static uint32_t callers_done;
+static int nr_cpus;
+static uint64_t expected;
+
+static struct {
+    uint32_t errors;
+    uint32_t round;
+    uint64_t got;
+} result[SMP_MAX_CPUS];
+
+static void write_stub(uint32_t *insn, uint16_t value)
+{
+    insn[0] = INSN_MOVZ_W1 | (uint32_t)value << 5;
+    insn[1] = INSN_ADD_X0_X1;
+    insn[2] = INSN_RET;
+    insn[3] = INSN_NOP;
+}
+
+static void error(int cpu, uint32_t round, uint64_t got)
+{
+    if (!result[cpu].errors++) {
+        result[cpu].round = round;
+        result[cpu].got = got;
+    }
+}
+
+/* Call all stubs in turn, in an order of our own, a number of times */
+static void caller(int cpu)
+{
+    uint32_t round;
+    int i, n;
+
+    for (round = 0; round < ROUNDS; round++) {
+        uint64_t x = 0;
+
+        for (n = 0; n < NR_STUBS; n++) {
+            i = (n * (2 * cpu + 1) + round) % NR_STUBS;
+            x = ((stub_fn *)&stubs[i * STUB_INSNS])(x);
+        }
+        if (x != expected) {
+            error(cpu, round, x);
+        }
+    }
+    smp_inc(&callers_done);
+}
+
+/* Rewrite our stub until the other CPUs are done */
+static void writer(int cpu)
+{
+    uint32_t round;
+
+    for (round = 0; smp_load_acquire(&callers_done) < nr_cpus - 1; round++) {
+        uint64_t got;
+
+        write_stub(hot_stub, round);
+        smp_sync_icache(hot_stub, hot_stub_end);
+        got = ((stub_fn *)hot_stub)(0);
+        if (got != (uint16_t)round) {
+            error(cpu, round, got);
+        }
+    }
+}
+
+static void secondary(int cpu)
+{
+    if (cpu == WRITER_CPU) {
+        writer(cpu);
+    } else {
+        caller(cpu);
+    }
+}
+
+int main(void)
+{
+    int i, cpu, err = 0;
+
+    ml_printf("Jump Cache Test\n");
+
+    for (i = 0; i < NR_STUBS; i++) {
+        write_stub(&stubs[i * STUB_INSNS], i);
+        expected += i;
+    }
+    smp_sync_icache(stubs, stubs_end);
+    write_stub(hot_stub, 0);
+    smp_sync_icache(hot_stub, hot_stub_end);
+
+    nr_cpus = smp_start_all(SMP_MAX_CPUS, secondary);
+    if (nr_cpus < 3) {
+        ml_printf("FAIL: %d CPUs, -smp 3 at least\n", nr_cpus);
+        return 1;
+    }
+    ml_printf("%d CPUs\n", nr_cpus);
+
+    /* The writer stops once all others are done, including us */
+    caller(0);
+    smp_wait(&callers_done, nr_cpus - 1);
+
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        if (result[cpu].errors) {
+            ml_printf("FAIL: CPU %d: %d wrong results, first in round %d: "
+                      "%ld\n", cpu, result[cpu].errors, result[cpu].round,
+                      result[cpu].got);
+            err = 1;
+        }
+    }
+
+    ml_printf("%s\n", err ? "FAIL" : "PASS");
+    return err;
+}
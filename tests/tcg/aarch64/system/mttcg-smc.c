@@ -0,0 +1,134 @@
+/*
+ * Code modified while other CPUs run, with a small code buffer
+ *
+ * The first CPU rewrites a page of stubs for each generation, while the
+ * other CPUs wait, and then all of them call every stub and check that
+ * it returns the value of the current generation.  Each stub branches
+ * to its second half, which the translation threads can translate ahead
+ * (-accel tcg,translate-threads=N), and the code buffer is kept small
+ * enough (tb-size) to be flushed over and over meanwhile.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+#include "smp.h"
+
+#define NR_STUBS        4096
+#define STUB_INSNS      4
+#define GENERATIONS     16
+
+/* movz w1, #value; b 1f; 1: add x0, x0, x1; ret */
+#define INSN_MOVZ_W1    0x52800001
+#define INSN_B_NEXT     0x14000001
+#define INSN_ADD_X0_X1  0x8b010000
+#define INSN_RET        0xd65f03c0
+
+asm("\t.pushsection .text\n"
+    "\t.balign 4096\n"
+    "stubs:\n"
+    "\t.space " __stringify(NR_STUBS * STUB_INSNS * 4) "\n"
+    "stubs_end:\n"
+    "\t.balign 4096\n"
+    "\t.popsection\n");
+
+extern uint32_t stubs[], stubs_end[];
+
+typedef uint64_t stub_fn(uint64_t);
+
+static uint32_t generation;
+static uint32_t done;
+static int nr_cpus;
+
+static struct {
+    uint32_t errors;
+    uint32_t stub;
+    uint64_t got;
+} result[SMP_MAX_CPUS];
+
+static uint16_t stub_value(int i, uint32_t gen)
+{
+    return i * 7 + gen * 13;
+}
+
+static void write_stubs(uint32_t gen)
+{
+    int i;
+
+    for (i = 0; i < NR_STUBS; i++) {
+        uint32_t *insn = &stubs[i * STUB_INSNS];
+
+        insn[0] = INSN_MOVZ_W1 | (uint32_t)stub_value(i, gen) << 5;
+        insn[1] = INSN_B_NEXT;
+        insn[2] = INSN_ADD_X0_X1;
+        insn[3] = INSN_RET;
+    }
+    smp_sync_icache(stubs, stubs_end);
+}
+
+/* Call all stubs, in an order of our own */
+static void run_stubs(int cpu, uint32_t gen)
+{
+    int i, n;
+
+    asm volatile("isb");
+    for (n = 0; n < NR_STUBS; n++) {
+        stub_fn *fn;
+        uint64_t got;
+
+        i = (n * (2 * cpu + 1)) % NR_STUBS;
+        fn = (stub_fn *)&stubs[i * STUB_INSNS];
+        got = fn(1000);
+        if (got != 1000 + stub_value(i, gen) && !result[cpu].errors++) {
+            result[cpu].stub = i;
+            result[cpu].got = got;
+        }
+    }
+}
+
+static void secondary(int cpu)
+{
+    uint32_t gen;
+
+    for (gen = 1; gen <= GENERATIONS; gen++) {
+        smp_wait(&generation, gen);
+        run_stubs(cpu, gen);
+        smp_inc(&done);
+    }
+}
+
+int main(void)
+{
+    uint32_t gen;
+    int cpu, err = 0;
+
+    ml_printf("MTTCG SMC Test\n");
+
+    nr_cpus = smp_start_all(SMP_MAX_CPUS, secondary);
+    if (nr_cpus < 2) {
+        ml_printf("FAIL: no secondary CPU started, -smp 2 at least\n");
+        return 1;
+    }
+    ml_printf("%d CPUs\n", nr_cpus);
+
+    for (gen = 1; gen <= GENERATIONS; gen++) {
+        /* Nobody runs the stubs while they are rewritten */
+        write_stubs(gen);
+        smp_store_release(&generation, gen);
+        run_stubs(0, gen);
+        smp_wait(&done, gen * (nr_cpus - 1));
+    }
+
+    for (cpu = 0; cpu < nr_cpus; cpu++) {
+        if (result[cpu].errors) {
+            ml_printf("FAIL: CPU %d: %d wrong results, first stub %d "
+                      "returned %ld\n", cpu, result[cpu].errors,
+                      result[cpu].stub, result[cpu].got);
+            err = 1;
+        }
+    }
+
+    ml_printf("%s\n", err ? "FAIL" : "PASS");
+    return err;
+}
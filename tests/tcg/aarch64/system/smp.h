@@ -0,0 +1,154 @@
+/*
+ * Secondary CPUs for the AArch64 system tests
+ *
+ * boot.S only runs the first CPU.  smp_start() powers another one on
+ * through PSCI, which enters it with its MMU off, and gives it the
+ * vectors, page tables and system register setup of the first one
+ * before calling the function it is to run, on a stack of its own.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef AARCH64_SYSTEM_SMP_H
+#define AARCH64_SYSTEM_SMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define __stringify_1(x...) #x
+#define __stringify(x...)   __stringify_1(x)
+
+#define read_sysreg(r) ({                                           \
+            uint64_t __val;                                         \
+            asm volatile("mrs %0, " __stringify(r) : "=r" (__val)); \
+            __val;                                                  \
+})
+
+#define PSCI_CPU_ON_64      0xc4000003
+
+#define SMP_MAX_CPUS        8
+#define SMP_STACK_SIZE      16384
+
+/* Read by smp_secondary_entry, mind the offsets there */
+typedef struct SMPBoot {
+    uint64_t vbar, ttbr0;
+    uint64_t tcr, mair;
+    uint64_t cpacr, sctlr;
+    uint64_t sp;
+    void (*fn)(int cpu);
+    uint64_t cpu;
+} SMPBoot;
+
+static SMPBoot smp_boot[SMP_MAX_CPUS];
+static uint8_t smp_stack[SMP_MAX_CPUS][SMP_STACK_SIZE]
+    __attribute__((aligned(16)));
+
+asm("\t.pushsection .text\n"
+    "\t.balign 4\n"
+    "smp_secondary_entry:\n"
+    "\tldp x1, x2, [x0]\n"
+    "\tmsr vbar_el1, x1\n"
+    "\tmsr ttbr0_el1, x2\n"
+    "\tldp x1, x2, [x0, #16]\n"
+    "\tmsr tcr_el1, x1\n"
+    "\tmsr mair_el1, x2\n"
+    "\tldp x1, x2, [x0, #32]\n"
+    "\tmsr cpacr_el1, x1\n"
+    "\tisb\n"
+    "\tdsb sy\n"
+    "\tmsr sctlr_el1, x2\n"
+    "\tisb\n"
+    "\tldp x1, x2, [x0, #48]\n"
+    "\tmov sp, x1\n"
+    "\tldr x0, [x0, #64]\n"
+    "\tblr x2\n"
+    "1:\twfi\n"
+    "\tb 1b\n"
+    "\t.popsection\n");
+
+extern char smp_secondary_entry[];
+
+/* Start @cpu, whose MPIDR is @cpu on the virt machine, running @fn */
+static bool smp_start(int cpu, void (*fn)(int cpu))
+{
+    SMPBoot *b = &smp_boot[cpu];
+    register uint64_t x0 asm("x0") = PSCI_CPU_ON_64;
+    register uint64_t x1 asm("x1") = cpu;
+    register uint64_t x2 asm("x2") = (uintptr_t)smp_secondary_entry;
+    register uint64_t x3 asm("x3") = (uintptr_t)b;
+
+    b->vbar = read_sysreg(vbar_el1);
+    b->ttbr0 = read_sysreg(ttbr0_el1);
+    b->tcr = read_sysreg(tcr_el1);
+    b->mair = read_sysreg(mair_el1);
+    b->cpacr = read_sysreg(cpacr_el1);
+    b->sctlr = read_sysreg(sctlr_el1);
+    b->sp = (uintptr_t)&smp_stack[cpu][SMP_STACK_SIZE];
+    b->fn = fn;
+    b->cpu = cpu;
+
+    /* The new CPU reads @b with its MMU off */
+    asm volatile("dsb sy" : : : "memory");
+    asm volatile("hvc #0" : "+r" (x0) : "r" (x1), "r" (x2), "r" (x3)
+                 : "memory");
+    return x0 == 0;
+}
+
+/* Start as many CPUs as there are, up to @max; returns how many run */
+static int smp_start_all(int max, void (*fn)(int cpu))
+{
+    int n = 1;
+
+    while (n < max && n < SMP_MAX_CPUS && smp_start(n, fn)) {
+        n++;
+    }
+    return n;
+}
+
+static inline uint32_t smp_load_acquire(const uint32_t *p)
+{
+    uint32_t val;
+
+    asm volatile("ldar %w0, %1" : "=r" (val) : "Q" (*p) : "memory");
+    return val;
+}
+
+static inline void smp_store_release(uint32_t *p, uint32_t val)
+{
+    asm volatile("stlr %w1, %0" : "=Q" (*p) : "r" (val) : "memory");
+}
+
+static inline void smp_inc(uint32_t *p)
+{
+    uint32_t val, fail;
+
+    asm volatile("1: ldaxr %w0, %2\n\t"
+                 "add %w0, %w0, #1\n\t"
+                 "stlxr %w1, %w0, %2\n\t"
+                 "cbnz %w1, 1b"
+                 : "=&r" (val), "=&r" (fail), "+Q" (*p) : : "memory");
+}
+
+/* Wait for *@p to reach @val */
+static inline void smp_wait(const uint32_t *p, uint32_t val)
+{
+    while (smp_load_acquire(p) != val) {
+        asm volatile("yield");
+    }
+}
+
+/* Make the instructions written at [@start, @end) visible to all CPUs */
+static inline void smp_sync_icache(void *start, void *end)
+{
+    uintptr_t p;
+
+    for (p = (uintptr_t)start & ~63; p < (uintptr_t)end; p += 64) {
+        asm volatile("dc cvau, %0" : : "r" (p) : "memory");
+    }
+    asm volatile("dsb ish\n\t"
+                 "ic ialluis\n\t"
+                 "dsb ish\n\t"
+                 "isb" : : : "memory");
+}
+
+#endif
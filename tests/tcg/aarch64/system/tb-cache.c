@@ -0,0 +1,92 @@
+/*
+ * TB cache test guest
+ *
+ * Computes the same results along different code paths, direct and
+ * indirect calls, loops and recursion, so that plenty of blocks are
+ * translated, and then powers the machine off through PSCI.  Unlike a
+ * semihosting exit, which leaves the vCPUs running, this lets QEMU write
+ * its tb-cache file back.  See tb-cache.sh for the runs.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <minilib.h>
+
+#define PSCI_SYSTEM_OFF     0x84000008
+
+static uint64_t fib_rec(unsigned n)
+{
+    return n < 2 ? n : fib_rec(n - 1) + fib_rec(n - 2);
+}
+
+static uint64_t fib_iter(unsigned n)
+{
+    uint64_t a = 0, b = 1;
+
+    while (n--) {
+        uint64_t t = a + b;
+
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static uint64_t sum_squares(unsigned n)
+{
+    uint64_t sum = 0;
+    unsigned i;
+
+    for (i = 1; i <= n; i++) {
+        sum += (uint64_t)i * i;
+    }
+    return sum;
+}
+
+static uint64_t sum_squares_closed(unsigned n)
+{
+    return (uint64_t)n * (n + 1) * (2 * n + 1) / 6;
+}
+
+static const struct {
+    const char *name;
+    uint64_t (*f)(unsigned);
+    uint64_t (*g)(unsigned);
+    unsigned n;
+} checks[] = {
+    { "fib", fib_rec, fib_iter, 20 },
+    { "sum of squares", sum_squares, sum_squares_closed, 1000 },
+};
+
+static void __attribute__((noreturn)) system_off(void)
+{
+    register uint64_t x0 asm("x0") = PSCI_SYSTEM_OFF;
+
+    asm volatile("hvc #0" : : "r" (x0) : "memory");
+    for (;;) {
+        asm volatile("wfi");
+    }
+}
+
+int main(void)
+{
+    int err = 0;
+    int i;
+
+    ml_printf("TB Cache Test\n");
+
+    for (i = 0; i < sizeof(checks) / sizeof(checks[0]); i++) {
+        uint64_t f = checks[i].f(checks[i].n);
+        uint64_t g = checks[i].g(checks[i].n);
+
+        if (f != g) {
+            ml_printf("FAIL: %s(%d) is %ld or %ld\n",
+                      checks[i].name, checks[i].n, f, g);
+            err = 1;
+        }
+    }
+
+    ml_printf("%s\n", err ? "FAIL" : "PASS");
+    system_off();
+}
@@ -0,0 +1,119 @@
+/*
+ * Hot trace test
+ *
+ * Runs a loop of two blocks long enough for the trace tier to replace
+ * its head with a trace, with a side exit out of the trace taken every
+ * fourth iteration.  The results must not change.  trace.sh checks from
+ * the trace events that a trace did replace the head and ran.
+ *
+ * When the PMU can count retired instructions (-icount shift=0), their
+ * count must be exact too.  No trace is formed then, as icount charges
+ * whole blocks: this checks that trace-threshold leaves icount alone.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <minilib.h>
+
+#define __stringify_1(x...) #x
+#define __stringify(x...)   __stringify_1(x)
+
+#define read_sysreg(r) ({                                           \
+            uint64_t __val;                                         \
+            asm volatile("mrs %0, " __stringify(r) : "=r" (__val)); \
+            __val;                                                  \
+})
+
+#define write_sysreg(r, v) do {                     \
+        uint64_t __val = (uint64_t)(v);             \
+        asm volatile("msr " __stringify(r) ", %x0"  \
+                 : : "rZ" (__val));                 \
+} while (0)
+
+#define PMU_INST_RETIRED    0x08
+
+/* Iterations, a multiple of 4: far more than any sensible trace-threshold */
+#define N                   1000
+
+/*
+ * Three instructions in each of the two blocks of the loop, and two more
+ * in the side block on every fourth iteration.
+ */
+#define LOOP_INSNS(n)       (6 * (n) + 2 * ((n) / 4))
+
+static uint64_t loop(uint64_t n, uint64_t *side)
+{
+    uint64_t i = 0, sum = 0, taken = 0, tmp;
+
+    asm volatile("1:  add   %[sum], %[sum], %[i]\n\t"
+                 "    and   %[tmp], %[i], #3\n\t"
+                 "    cbz   %[tmp], 3f\n\t"
+                 "2:  add   %[i], %[i], #1\n\t"
+                 "    cmp   %[i], %[n]\n\t"
+                 "    b.lo  1b\n\t"
+                 "    b     4f\n\t"
+                 "3:  add   %[taken], %[taken], #1\n\t"
+                 "    b     2b\n\t"
+                 "4:"
+                 : [i] "+r" (i), [sum] "+r" (sum), [taken] "+r" (taken),
+                   [tmp] "=&r" (tmp)
+                 : [n] "r" (n)
+                 : "cc");
+
+    *side = taken;
+    return sum;
+}
+
+static uint32_t counted_loop(uint64_t n, uint64_t *sum, uint64_t *side)
+{
+    uint32_t start = read_sysreg(pmevcntr0_el0);
+
+    *sum = loop(n, side);
+    return read_sysreg(pmevcntr0_el0) - start;
+}
+
+int main(void)
+{
+    bool counting = read_sysreg(pmceid0_el0) & (1 << PMU_INST_RETIRED);
+    uint64_t sum, side;
+    uint32_t once, twice;
+    int err = 0;
+
+    ml_printf("Trace Test\n");
+
+    if (counting) {
+        write_sysreg(pmevtyper0_el0, PMU_INST_RETIRED);
+        write_sysreg(pmcntenset_el0, 1);
+        write_sysreg(pmcr_el0, 1);
+        asm volatile("isb");
+    } else {
+        ml_printf("Not counting instructions, -icount shift=0 to do so\n");
+    }
+
+    /* The first run crosses the threshold, the second one runs the trace */
+    once = counted_loop(N, &sum, &side);
+    if (sum != (uint64_t)N * (N - 1) / 2 || side != N / 4) {
+        ml_printf("FAIL: sum=%ld side=%ld for %d iterations\n", sum, side, N);
+        err = 1;
+    }
+
+    twice = counted_loop(2 * N, &sum, &side);
+    if (sum != (uint64_t)2 * N * (2 * N - 1) / 2 || side != 2 * N / 4) {
+        ml_printf("FAIL: sum=%ld side=%ld for %d iterations\n",
+                  sum, side, 2 * N);
+        err = 1;
+    }
+
+    /* The code around the loop is the same both times */
+    if (counting && twice - once != LOOP_INSNS(2 * N) - LOOP_INSNS(N)) {
+        ml_printf("FAIL: %d instructions retired for %d iterations, "
+                  "expected %d\n", twice - once, N,
+                  LOOP_INSNS(2 * N) - LOOP_INSNS(N));
+        err = 1;
+    }
+
+    ml_printf("%s\n", err ? "FAIL" : "PASS");
+    return err;
+}
@@ -0,0 +1,133 @@
+#!/bin/sh
+#
+# Round trip through a tb-cache file, and what QEMU does with one which
+# does not match the guest, the machine, the CPU or its own contents.
+#
+# usage: tb-cache.sh QEMU GUEST OTHER-GUEST QEMU-OPTIONS... -kernel
+#
+# GUEST powers the machine off, so that the cache is written back, and
+# prints PASS.  OTHER-GUEST exits with a non-zero status on failure.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+qemu=$1
+guest=$2
+other=$3
+shift 3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+cache=$dir/cache
+
+fail() {
+    echo "tb-cache: $*" >&2
+    exit 1
+}
+
+# The cached code is only used by a QEMU loaded at the same address
+if ! setarch "$(uname -m)" -R true 2>/dev/null; then
+    echo "  SKIPPED tb-cache because setarch -R is not available"
+    exit 0
+fi
+
+# run NAME CACHE-FILE KERNEL [QEMU-OPTIONS...]
+run() {
+    name=$1
+    file=$2
+    kernel=$3
+    shift 3
+    setarch "$(uname -m)" -R \
+        "$qemu" -monitor none -display none \
+        -chardev file,path="$dir/$name.out",id=output \
+        -accel tcg,tb-cache="$file" \
+        -d trace:tb_cache_save,trace:tb_cache_adopt -D "$dir/$name.log" \
+        "$@" $opts "$kernel" 2>"$dir/$name.err"
+}
+
+opts="$*"
+
+check_pass() {
+    grep -q PASS "$dir/$1.out" || fail "$1: the guest did not pass"
+}
+
+check_warning() {
+    grep -q "tb-cache: .*$2" "$dir/$1.err" ||
+        fail "$1: no warning about the cache file $2"
+}
+
+# Cold run: nothing to adopt, the cache is written on exit
+run cold "$cache" "$guest" || fail "cold: QEMU failed"
+check_pass cold
+test -s "$cache" || fail "cold: $cache was not written"
+if grep -q "tb-cache" "$dir/cold.err"; then
+    fail "cold: $(cat "$dir/cold.err")"
+fi
+
+# Without the log trace backend, whether blocks are adopted is not seen
+traced=false
+grep -q tb_cache_save "$dir/cold.log" && traced=true
+
+# Warm run: the blocks of the cold run are adopted
+cp "$cache" "$dir/stale-guest"
+cp "$cache" "$dir/stale-machine"
+cp "$cache" "$dir/stale-cpu"
+cp "$cache" "$dir/corrupted"
+cp "$cache" "$dir/truncated"
+run warm "$cache" "$guest" || fail "warm: QEMU failed"
+check_pass warm
+if grep -q "tb-cache" "$dir/warm.err"; then
+    fail "warm: $(cat "$dir/warm.err")"
+fi
+if $traced && ! grep -q tb_cache_adopt "$dir/warm.log"; then
+    fail "warm: no block was adopted"
+fi
+
+# Other guest code at the same addresses: only identical blocks are used
+run stale-guest "$dir/stale-guest" "$other" ||
+    fail "stale-guest: the guest failed"
+
+# Another machine configuration: the whole file is ignored
+run stale-machine "$dir/stale-machine" "$guest" -smp 2 ||
+    fail "stale-machine: QEMU failed"
+check_pass stale-machine
+check_warning stale-machine "another machine configuration"
+
+# The same CPU model with other features: the code would differ too
+run stale-cpu "$dir/stale-cpu" "$guest" -global max-arm-cpu.sve=off ||
+    fail "stale-cpu: QEMU failed"
+check_pass stale-cpu
+check_warning stale-cpu "another machine configuration"
+
+# Damaged files are ignored too, rather than run: flip the last byte
+size=$(stat -c %s "$cache")
+byte=$(od -An -tu1 -j $((size - 1)) -N1 "$cache")
+printf "\\$(printf %03o $((255 - byte)))" |
+    dd of="$dir/corrupted" bs=1 seek=$((size - 1)) conv=notrunc 2>/dev/null
+run corrupted "$dir/corrupted" "$guest" || fail "corrupted: QEMU failed"
+check_pass corrupted
+check_warning corrupted "corrupted"
+
+truncate -s $((size / 2)) "$dir/truncated"
+run truncated "$dir/truncated" "$guest" || fail "truncated: QEMU failed"
+check_pass truncated
+check_warning truncated "truncated"
+
+for name in stale-machine stale-cpu corrupted truncated; do
+    if $traced && grep -q tb_cache_adopt "$dir/$name.log"; then
+        fail "$name: blocks were adopted from the cache"
+    fi
+done
+
+# With address space randomization, QEMU refuses the option altogether
+persona=$(cat /proc/$$/personality 2>/dev/null || echo 0)
+if [ "$(cat /proc/sys/kernel/randomize_va_space 2>/dev/null)" != 0 ] &&
+   [ $((0x$persona & 0x40000)) = 0 ]; then
+    if "$qemu" -monitor none -display none \
+        -chardev file,path="$dir/aslr.out",id=output \
+        -accel tcg,tb-cache="$cache" $opts "$guest" 2>"$dir/aslr.err"; then
+        fail "aslr: QEMU started with randomization enabled"
+    fi
+    grep -q "address space randomization" "$dir/aslr.err" ||
+        fail "aslr: $(cat "$dir/aslr.err")"
+fi
+exit 0
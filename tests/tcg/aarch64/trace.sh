@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Run the trace test and check, from the trace events QEMU logs, that
+# the trace tier did what the guest cannot see: a trace was formed for
+# the loop, its head was retired, and the trace ran in its place.  With
+# "none", check that no trace was formed at all.
+#
+# usage: trace.sh QEMU GUEST formed|none QEMU-OPTIONS... -kernel
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+qemu=$1
+guest=$2
+expect=$3
+shift 3
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+log=$dir/trace.log
+
+fail() {
+    echo "trace: $*" >&2
+    exit 1
+}
+
+"$qemu" -monitor none -display none \
+    -chardev file,path="$dir/trace.out",id=output \
+    -d trace:tb_gen_trace,trace:tb_retire,trace:exec_tb -D "$log" \
+    "$@" "$guest" || fail "the guest failed"
+grep -q PASS "$dir/trace.out" || fail "the guest did not pass"
+
+# Without the log trace backend, nothing more can be checked
+if ! grep -q "exec_tb " "$log"; then
+    echo "  SKIPPED trace checks because trace events are not logged"
+    exit 0
+fi
+
+if [ "$expect" = none ]; then
+    if grep -q "tb_gen_trace " "$log"; then
+        fail "traces were formed: $(grep "tb_gen_trace " "$log")"
+    fi
+    exit 0
+fi
+
+# tb_gen_trace head:0x..., trace:0x..., insns:N
+grep -q "tb_gen_trace " "$log" || fail "no trace was formed"
+grep "tb_gen_trace " "$log" |
+    sed -n 's/.*head:\([^,]*\), trace:\([^,]*\),.*/\1 \2/p' > "$dir/traces"
+while read -r head trace; do
+    if grep -q "tb_retire head:$head," "$log" &&
+       grep -q "exec_tb tb:$trace " "$log"; then
+        exit 0
+    fi
+done < "$dir/traces"
+fail "no trace both replaced its head and ran"